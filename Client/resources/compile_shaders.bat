@@ -0,0 +1,21 @@
+@echo off
+rem Compiles every shader in this directory into the SPIR-V binaries the renderer loads. Needs glslc
+rem from the Vulkan SDK on the path. Run it after changing any GLSL source, the running client picks
+rem the new binaries up through hot reload.
+
+cd /d "%~dp0"
+
+glslc shader.vert -o vert.spv || exit /b 1
+glslc shader.frag -o frag.spv || exit /b 1
+glslc overdraw.frag -o overdraw.spv || exit /b 1
+glslc shadow.vert -o shadow.spv || exit /b 1
+glslc cluster_lights.comp -o cluster_lights.spv || exit /b 1
+
+rem Vertex pulling and face expansion
+glslc face.vert -o face.spv || exit /b 1
+glslc shadow_face.vert -o shadow_face.spv || exit /b 1
+glslc expand_faces.comp -o expand_faces.spv || exit /b 1
+
+rem Mesh shaders need SPIR-V 1.4, the device enables VK_KHR_spirv_1_4 for them
+glslc --target-env=vulkan1.1 --target-spv=spv1.4 -fshader-stage=task face.task -o face_task.spv || exit /b 1
+glslc --target-env=vulkan1.1 --target-spv=spv1.4 -fshader-stage=mesh face.mesh -o face_mesh.spv || exit /b 1
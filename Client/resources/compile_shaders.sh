@@ -0,0 +1,21 @@
+#!/bin/sh
+# Compiles every shader in this directory into the SPIR-V binaries the renderer loads. Needs glslc
+# from the Vulkan SDK on the path. Run it after changing any GLSL source, the running client picks
+# the new binaries up through hot reload.
+set -e
+cd "$(dirname "$0")"
+
+glslc shader.vert -o vert.spv
+glslc shader.frag -o frag.spv
+glslc overdraw.frag -o overdraw.spv
+glslc shadow.vert -o shadow.spv
+glslc cluster_lights.comp -o cluster_lights.spv
+
+# Vertex pulling and face expansion
+glslc face.vert -o face.spv
+glslc shadow_face.vert -o shadow_face.spv
+glslc expand_faces.comp -o expand_faces.spv
+
+# Mesh shaders need SPIR-V 1.4, the device enables VK_KHR_spirv_1_4 for them
+glslc --target-env=vulkan1.1 --target-spv=spv1.4 -fshader-stage=task face.task -o face_task.spv
+glslc --target-env=vulkan1.1 --target-spv=spv1.4 -fshader-stage=mesh face.mesh -o face_mesh.spv
@@ -0,0 +1,84 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Vertex pulling variant of shader.vert for chunks: every PackedFace record in the face buffer expands
+// into the four vertices ChunkMesher would have emitted, gl_VertexIndex / 4 selects the face
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    mat4 invProj;
+    uvec4 clusterGrid;
+    vec4 screenParams;
+} ubo;
+
+// Renderer::PackedFace
+struct PackedFace {
+    uint position;   // Bits 0-14 block xyz, 15-16 axis, 17 positive side, 18-19 first corner, 20-21 atlas row, 22-29 ambient occlusion per corner
+    uint tint;       // RGBA8
+    uint skyLight;   // 8 bits per corner
+    uint blockLight; // 8 bits per corner
+};
+
+layout(std430, binding = 6) readonly buffer Faces {
+    PackedFace faces[];
+};
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+} pc;
+
+layout (location = 0) out vec3 fragColor;
+layout (location = 1) out vec2 texCoord;
+layout (location = 2) out vec3 viewPosition;
+layout (location = 3) out vec3 worldPosition;
+layout (location = 4) out vec4 shading;
+
+// Depth pre-pass and colour pass must produce bit-identical depth
+invariant gl_Position;
+
+// Texture atlas layout of Grass_Block.png, see ChunkMesher.cpp
+const float ATLAS_CELL_WIDTH = 1.0f / 3.0f;
+const float ATLAS_CELL_HEIGHT = 1.0f / 4.0f;
+
+const ivec2 CORNERS[4] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+
+void main() {
+    PackedFace face = faces[gl_VertexIndex >> 2];
+    
+    ivec3 block = ivec3(face.position & 31u, (face.position >> 5) & 31u, (face.position >> 10) & 31u);
+    int axis = int((face.position >> 15) & 3u);
+    bool positive = ((face.position >> 17) & 1u) != 0u;
+    uint first_corner = (face.position >> 18) & 3u;
+    float atlas_row = float((face.position >> 20) & 3u);
+    
+    // Same corner walk as ChunkMesher::EmitFace, negative facing quads are wound the other way round
+    uint vertex = (uint(gl_VertexIndex) + first_corner) & 3u;
+    ivec2 corner = CORNERS[positive ? vertex : (4u - vertex) & 3u];
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
+    
+    vec3 offset = vec3(0.0f);
+    offset[axis] = positive ? 1.0f : 0.0f;
+    offset[u] = float(corner.x);
+    offset[v] = float(corner.y);
+    
+    // Side faces keep the texture upright, top and bottom map the horizontal plane
+    float s = axis == 1 ? offset.x : (axis == 0 ? offset.z : offset.x);
+    float t = axis == 1 ? offset.z : 1.0f - offset.y;
+    
+    vec4 tint = unpackUnorm4x8(face.tint);
+    uint occlusion = (face.position >> (22u + 2u * vertex)) & 3u;
+    
+    vec4 world_position = pc.model * vec4(vec3(block) + offset, 1.0f);
+    vec4 view_position = ubo.view * world_position;
+    gl_Position = ubo.proj * view_position;
+    fragColor = tint.rgb;
+    texCoord = vec2((1.0f + s) * ATLAS_CELL_WIDTH, (atlas_row + t) * ATLAS_CELL_HEIGHT);
+    viewPosition = view_position.xyz;
+    worldPosition = world_position.xyz;
+    shading = vec4(float(occlusion) / 3.0f,
+                   float((face.skyLight >> (8u * vertex)) & 255u) / 255.0f,
+                   float((face.blockLight >> (8u * vertex)) & 255u) / 255.0f,
+                   tint.a);
+}
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (location = 0) in vec3 fragColor;
+layout (location = 1) in vec2 texCoord;
+layout (location = 2) in vec3 viewPosition;
+layout (location = 3) in vec3 worldPosition;
+
+layout (location = 0) out vec4 outColor;
+
+// Additively blended, so brightness is proportional to the number of shaded fragments per pixel
+void main() {
+    outColor = vec4(0.1f, 0.05f, 0.025f, 1.0f);
+}
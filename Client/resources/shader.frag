@@ -1,13 +1,136 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// Must match SHADOW_CASCADE_COUNT in Renderer.h
+#define SHADOW_CASCADE_COUNT 4
+
+// Pipeline variant features, see PipelineKey in Renderer.h
+layout (constant_id = 0) const bool FOG = false;
+layout (constant_id = 1) const bool AMBIENT_OCCLUSION = true;
+layout (constant_id = 2) const bool ALPHA_TEST = false;
+layout (constant_id = 4) const float FOG_COLOR_R = 0.55f;
+layout (constant_id = 5) const float FOG_COLOR_G = 0.7f;
+layout (constant_id = 6) const float FOG_COLOR_B = 0.9f;
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    mat4 invProj;
+    uvec4 clusterGrid;
+    vec4 screenParams;
+    mat4 cascadeViewProjection[SHADOW_CASCADE_COUNT];
+    vec4 cascadeSplits;
+    vec4 sunDirection;
+} ubo;
+
+struct PointLight {
+    vec4 positionRadius;
+    vec4 colorIntensity;
+};
+
+struct LightCluster {
+    uint offset;
+    uint count;
+};
+
+layout (binding = 1) uniform sampler2D texSampler;
+
+layout(std430, binding = 2) readonly buffer Lights {
+    PointLight lights[];
+};
+
+layout(std430, binding = 3) readonly buffer Clusters {
+    LightCluster clusters[];
+};
+
+layout(std430, binding = 4) readonly buffer LightIndices {
+    uint lightIndexCount;
+    uint lightIndices[];
+};
+
+layout (binding = 5) uniform sampler2DArrayShadow shadowMap;
+
 layout (location = 0) in vec3 fragColor;
 layout (location = 1) in vec2 texCoord;
+layout (location = 2) in vec3 viewPosition;
+layout (location = 3) in vec3 worldPosition;
+layout (location = 4) in vec4 shading; // Baked ambient occlusion, sky light, block light and opacity
 
 layout (location = 0) out vec4 outColor;
 
-layout (binding = 1) uniform sampler2D texSampler;
+const vec3 ambient = vec3(0.25f);
+const vec3 sunColor = vec3(1.0f, 0.95f, 0.85f);
+const vec3 torchColor = vec3(1.0f, 0.7f, 0.4f);
+const float minimumSkyLight = 0.15f;
+const float alphaCutoff = 0.5f;
+const float fogStart = 0.6f; // Fraction of the view distance where fog begins
+
+uint ClusterIndex() {
+    float near = ubo.screenParams.z;
+    float far = ubo.screenParams.w;
+    
+    uvec2 tile = uvec2(gl_FragCoord.xy / ubo.screenParams.xy * vec2(ubo.clusterGrid.xy));
+    uint slice = uint(log(-viewPosition.z / near) / log(far / near) * float(ubo.clusterGrid.z));
+    tile = min(tile, ubo.clusterGrid.xy - 1);
+    slice = min(slice, ubo.clusterGrid.z - 1);
+    
+    return tile.x + ubo.clusterGrid.x * (tile.y + ubo.clusterGrid.y * slice);
+}
+
+float SunVisibility(float depth) {
+    uint cascade = 0;
+    while (cascade < SHADOW_CASCADE_COUNT && depth > ubo.cascadeSplits[cascade]) {
+        cascade++;
+    }
+    
+    if (cascade == SHADOW_CASCADE_COUNT) {
+        return 1.0f;
+    }
+    
+    vec4 shadow_position = ubo.cascadeViewProjection[cascade] * vec4(worldPosition, 1.0f);
+    return texture(shadowMap, vec4(shadow_position.xy * 0.5f + 0.5f, float(cascade), shadow_position.z));
+}
 
 void main() {
-    outColor = texture(texSampler, texCoord);
+    vec4 albedo = texture(texSampler, texCoord) * vec4(fragColor, shading.w);
+    if (ALPHA_TEST && albedo.a < alphaCutoff) {
+        discard;
+    }
+    
+    float occlusion = AMBIENT_OCCLUSION ? shading.x : 1.0f;
+    float sky_light = shading.y;
+    float block_light = shading.z;
+    
+    // Voxel faces are flat, so the geometric normal from screen space derivatives is exact
+    vec3 normal = normalize(cross(dFdy(viewPosition), dFdx(viewPosition)));
+    
+    vec3 sun_direction = normalize((ubo.view * vec4(ubo.sunDirection.xyz, 0.0f)).xyz);
+    float sun = max(dot(normal, -sun_direction), 0.0f);
+    
+    // Sky light keeps the sun and sky out of caves that the shadow map does not cover
+    vec3 lighting = ambient * occlusion * max(sky_light, minimumSkyLight);
+    if (sun > 0.0f && sky_light > 0.0f) {
+        lighting += sunColor * ubo.sunDirection.w * sun * sky_light * SunVisibility(-viewPosition.z);
+    }
+    lighting += torchColor * block_light * block_light * occlusion;
+    
+    LightCluster cluster = clusters[ClusterIndex()];
+    for (uint i = 0; i < cluster.count; i++) {
+        PointLight light = lights[lightIndices[cluster.offset + i]];
+        
+        vec3 to_light = (ubo.view * vec4(light.positionRadius.xyz, 1.0f)).xyz - viewPosition;
+        float distance = length(to_light);
+        float attenuation = clamp(1.0f - distance / light.positionRadius.w, 0.0f, 1.0f);
+        
+        lighting += light.colorIntensity.rgb * light.colorIntensity.w * attenuation * attenuation * max(dot(normal, to_light / distance), 0.0f);
+    }
+    
+    vec3 color = albedo.rgb * lighting;
+    if (FOG) {
+        float view_distance = ubo.screenParams.w;
+        float fog = smoothstep(fogStart * view_distance, view_distance, length(viewPosition));
+        color = mix(color, vec3(FOG_COLOR_R, FOG_COLOR_G, FOG_COLOR_B), fog);
+    }
+    
+    outColor = vec4(color, albedo.a);
 }
@@ -2,20 +2,41 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
+    mat4 invProj;
+    uvec4 clusterGrid;
+    vec4 screenParams;
 } ubo;
 
+// Vertex format of the pipeline variant, models carry no baked lighting
+layout (constant_id = 3) const bool BAKED_SHADING = true;
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+} pc;
+
 layout (location = 0) in vec3 inPosition;
 layout (location = 1) in vec3 inColor;
 layout (location = 2) in vec2 inTextureCoordinate;
+layout (location = 3) in vec4 inShading;
 
 layout (location = 0) out vec3 fragColor;
 layout (location = 1) out vec2 texCoord;
+layout (location = 2) out vec3 viewPosition;
+layout (location = 3) out vec3 worldPosition;
+layout (location = 4) out vec4 shading;
+
+// Depth pre-pass and colour pass must produce bit-identical depth
+invariant gl_Position;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0f);
+    vec4 world_position = pc.model * vec4(inPosition, 1.0f);
+    vec4 view_position = ubo.view * world_position;
+    gl_Position = ubo.proj * view_position;
     fragColor = inColor;
     texCoord = inTextureCoordinate;
+    viewPosition = view_position.xyz;
+    worldPosition = world_position.xyz;
+    shading = BAKED_SHADING ? inShading : vec4(1.0f, 1.0f, 0.0f, 1.0f);
 }
@@ -0,0 +1,13 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    mat4 viewProjection;
+} pc;
+
+layout (location = 0) in vec3 inPosition;
+
+void main() {
+    gl_Position = pc.viewProjection * pc.model * vec4(inPosition, 1.0f);
+}
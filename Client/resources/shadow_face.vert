@@ -0,0 +1,39 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Vertex pulling variant of shadow.vert, only the position of each PackedFace corner is rebuilt
+
+struct PackedFace {
+    uint position;
+    uint tint;
+    uint skyLight;
+    uint blockLight;
+};
+
+layout(std430, binding = 6) readonly buffer Faces {
+    PackedFace faces[];
+};
+
+layout(push_constant) uniform PushConstants {
+    mat4 model;
+    mat4 viewProjection;
+} pc;
+
+const ivec2 CORNERS[4] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+
+void main() {
+    uint position = faces[gl_VertexIndex >> 2].position;
+    
+    ivec3 block = ivec3(position & 31u, (position >> 5) & 31u, (position >> 10) & 31u);
+    int axis = int((position >> 15) & 3u);
+    bool positive = ((position >> 17) & 1u) != 0u;
+    uint vertex = (uint(gl_VertexIndex) + ((position >> 18) & 3u)) & 3u;
+    ivec2 corner = CORNERS[positive ? vertex : (4u - vertex) & 3u];
+    
+    vec3 offset = vec3(0.0f);
+    offset[axis] = positive ? 1.0f : 0.0f;
+    offset[(axis + 1) % 3] = float(corner.x);
+    offset[(axis + 2) % 3] = float(corner.y);
+    
+    gl_Position = pc.viewProjection * pc.model * vec4(vec3(block) + offset, 1.0f);
+}
@@ -0,0 +1,73 @@
+#include "Chunk.h"
+
+#include <cstddef>
+#include <vector>
+
+void Chunk::ComputeLighting() {
+    Light.fill(0);
+    
+    std::vector<int> queue;
+    queue.reserve(CHUNK_VOLUME);
+    
+    // Sky light falls straight down without loss until it hits something that is not air
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            for (int y = CHUNK_SIZE - 1; y >= 0 && GetBlock(x, y, z) == Block::Air; y--) {
+                Light[Index(x, y, z)] = MAX_LIGHT_LEVEL << 4;
+                queue.push_back(Index(x, y, z));
+            }
+        }
+    }
+    
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        if (uint8_t emission = LightEmission(Blocks[i])) {
+            Light[i] = (Light[i] & 0xF0) | emission;
+            queue.push_back(i);
+        }
+    }
+    
+    // Breadth first spread of both channels, losing one level per block travelled
+    for (size_t head = 0; head < queue.size(); head++) {
+        int index = queue[head];
+        int x = index % CHUNK_SIZE;
+        int z = (index / CHUNK_SIZE) % CHUNK_SIZE;
+        int y = index / (CHUNK_SIZE * CHUNK_SIZE);
+        
+        uint8_t sky = Light[index] >> 4;
+        uint8_t block = Light[index] & 0x0F;
+        
+        const int offsets[6][3] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+        for (const auto& offset : offsets) {
+            int nx = x + offset[0];
+            int ny = y + offset[1];
+            int nz = z + offset[2];
+            if (nx < 0 || ny < 0 || nz < 0 || nx >= CHUNK_SIZE || ny >= CHUNK_SIZE || nz >= CHUNK_SIZE) {
+                continue;
+            }
+            
+            int neighbour = Index(nx, ny, nz);
+            if (IsOpaque(Blocks[neighbour])) {
+                continue;
+            }
+            
+            uint8_t neighbour_sky = Light[neighbour] >> 4;
+            uint8_t neighbour_block = Light[neighbour] & 0x0F;
+            bool changed = false;
+            
+            if (sky > 1 && neighbour_sky < sky - 1) {
+                neighbour_sky = sky - 1;
+                changed = true;
+            }
+            
+            if (block > 1 && neighbour_block < block - 1) {
+                neighbour_block = block - 1;
+                changed = true;
+            }
+            
+            if (changed) {
+                Light[neighbour] = static_cast<uint8_t>((neighbour_sky << 4) | neighbour_block);
+                queue.push_back(neighbour);
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef Chunk_h
+#define Chunk_h
+
+#include <array>
+#include <cstdint>
+
+constexpr int CHUNK_SIZE = 16;
+constexpr int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+constexpr uint8_t MAX_LIGHT_LEVEL = 15;
+
+enum class Block : uint8_t {
+    Air,
+    Grass,
+    Dirt,
+    Stone,
+    Water,
+    Glass,
+    Torch,
+    Log,
+    Leaves
+};
+
+inline bool IsOpaque(Block block) {
+    return block != Block::Air && block != Block::Water && block != Block::Glass && block != Block::Torch;
+}
+
+inline bool IsTransparent(Block block) {
+    return block == Block::Water || block == Block::Glass;
+}
+
+inline uint8_t LightEmission(Block block) {
+    return block == Block::Torch ? 14 : 0;
+}
+
+// Cubic section of the world with y pointing up. Light is stored per block,
+// sky light in the high nibble and block light in the low nibble.
+struct Chunk {
+    std::array<Block, CHUNK_VOLUME> Blocks{};
+    std::array<uint8_t, CHUNK_VOLUME> Light{};
+    
+    static int Index(int x, int y, int z) {
+        return x + CHUNK_SIZE * (z + CHUNK_SIZE * y);
+    }
+    
+    Block GetBlock(int x, int y, int z) const { return Blocks[Index(x, y, z)]; }
+    void SetBlock(int x, int y, int z, Block block) { Blocks[Index(x, y, z)] = block; }
+    
+    uint8_t GetSkyLight(int x, int y, int z) const { return Light[Index(x, y, z)] >> 4; }
+    uint8_t GetBlockLight(int x, int y, int z) const { return Light[Index(x, y, z)] & 0x0F; }
+    
+    // Flood fills sky light from the top of the chunk and block light from emitters, ignoring neighbours
+    void ComputeLighting();
+};
+
+#endif
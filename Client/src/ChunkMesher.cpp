@@ -0,0 +1,197 @@
+#include "ChunkMesher.h"
+
+namespace {
+
+// Texture atlas layout of Grass_Block.png: three columns and four rows, faces use the middle column
+constexpr float ATLAS_CELL_WIDTH = 1.0f / 3.0f;
+constexpr float ATLAS_CELL_HEIGHT = 1.0f / 4.0f;
+constexpr float ATLAS_TOP_ROW = 1.0f;
+constexpr float ATLAS_SIDE_ROW = 2.0f;
+constexpr float ATLAS_BOTTOM_ROW = 3.0f;
+
+glm::vec4 BlockTint(Block block) {
+    switch (block) {
+        case Block::Dirt: return glm::vec4(0.6f, 0.45f, 0.3f, 1.0f);
+        case Block::Stone: return glm::vec4(0.55f, 0.55f, 0.55f, 1.0f);
+        case Block::Water: return glm::vec4(0.25f, 0.4f, 0.9f, 0.6f);
+        case Block::Glass: return glm::vec4(0.9f, 0.95f, 1.0f, 0.3f);
+        case Block::Torch: return glm::vec4(1.0f, 0.8f, 0.4f, 1.0f);
+        case Block::Log: return glm::vec4(0.45f, 0.32f, 0.18f, 1.0f);
+        case Block::Leaves: return glm::vec4(0.35f, 0.65f, 0.25f, 1.0f);
+        default: return glm::vec4(1.0f);
+    }
+}
+
+}
+
+ChunkMesher::ChunkMesher()
+    : m_Options() {
+}
+
+ChunkMesher::ChunkMesher(Options options)
+    : m_Options(options) {
+}
+
+void ChunkMesher::Mesh(const Neighbourhood& neighbourhood, ChunkMesh& mesh) {
+    mesh.Opaque.Vertices.clear();
+    mesh.Opaque.Faces.clear();
+    mesh.Transparent.Vertices.clear();
+    mesh.Transparent.Faces.clear();
+    
+    CopyNeighbourhood(neighbourhood);
+    
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                Block block = m_Blocks[PaddedIndex(x, y, z)];
+                if (block == Block::Air) {
+                    continue;
+                }
+                
+                for (int axis = 0; axis < 3; axis++) {
+                    for (int sign = -1; sign <= 1; sign += 2) {
+                        int position[3] = { x, y, z };
+                        position[axis] += sign;
+                        Block neighbour = m_Blocks[PaddedIndex(position[0], position[1], position[2])];
+                        
+                        // Hidden behind an opaque block, or an inner face between two blocks of the same fluid or glass
+                        if (IsOpaque(neighbour) || (!IsOpaque(block) && neighbour == block)) {
+                            continue;
+                        }
+                        
+                        EmitFace(x, y, z, axis, sign, block, IsTransparent(block) ? mesh.Transparent : mesh.Opaque);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void ChunkMesher::CopyNeighbourhood(const Neighbourhood& neighbourhood) {
+    for (int y = -1; y <= CHUNK_SIZE; y++) {
+        for (int z = -1; z <= CHUNK_SIZE; z++) {
+            for (int x = -1; x <= CHUNK_SIZE; x++) {
+                // Which of the 27 chunks the position falls into and where inside it
+                int cx = x < 0 ? 0 : (x < CHUNK_SIZE ? 1 : 2);
+                int cy = y < 0 ? 0 : (y < CHUNK_SIZE ? 1 : 2);
+                int cz = z < 0 ? 0 : (z < CHUNK_SIZE ? 1 : 2);
+                const Chunk* chunk = neighbourhood[cx + 3 * (cy + 3 * cz)];
+                
+                int padded = PaddedIndex(x, y, z);
+                if (chunk == nullptr) {
+                    m_Blocks[padded] = Block::Air;
+                    m_Light[padded] = MAX_LIGHT_LEVEL << 4;
+                    continue;
+                }
+                
+                int local = Chunk::Index((x + CHUNK_SIZE) % CHUNK_SIZE, (y + CHUNK_SIZE) % CHUNK_SIZE, (z + CHUNK_SIZE) % CHUNK_SIZE);
+                m_Blocks[padded] = chunk->Blocks[local];
+                m_Light[padded] = chunk->Light[local];
+            }
+        }
+    }
+}
+
+void ChunkMesher::EmitFace(int x, int y, int z, int axis, int sign, Block block, QuadMesh& mesh) const {
+    // Tangent axes chosen so (u, v, normal) is right handed, corners below are then counter-clockwise from outside
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
+    const int corners[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+    
+    int outer[3] = { x, y, z };
+    outer[axis] += sign;
+    
+    glm::vec4 tint = BlockTint(block);
+    float atlas_row = axis != 1 ? ATLAS_SIDE_ROW : (sign > 0 ? ATLAS_TOP_ROW : ATLAS_BOTTOM_ROW);
+    
+    std::array<Renderer::Vertex, 4> vertices;
+    std::array<int, 4> occlusion;
+    for (int i = 0; i < 4; i++) {
+        // Negative facing quads are wound the other way round
+        int corner = sign > 0 ? i : (4 - i) % 4;
+        int du = corners[corner][0];
+        int dv = corners[corner][1];
+        
+        float position[3] = { static_cast<float>(x), static_cast<float>(y), static_cast<float>(z) };
+        position[axis] += sign > 0 ? 1.0f : 0.0f;
+        position[u] += static_cast<float>(du);
+        position[v] += static_cast<float>(dv);
+        
+        // The three blocks touching this corner in the layer in front of the face
+        int side1[3] = { outer[0], outer[1], outer[2] };
+        int side2[3] = { outer[0], outer[1], outer[2] };
+        side1[u] += du ? 1 : -1;
+        side2[v] += dv ? 1 : -1;
+        int diagonal[3] = { side1[0], side1[1], side1[2] };
+        diagonal[v] += dv ? 1 : -1;
+        
+        int front_index = PaddedIndex(outer[0], outer[1], outer[2]);
+        int side1_index = PaddedIndex(side1[0], side1[1], side1[2]);
+        int side2_index = PaddedIndex(side2[0], side2[1], side2[2]);
+        int diagonal_index = PaddedIndex(diagonal[0], diagonal[1], diagonal[2]);
+        
+        bool side1_solid = IsOpaque(m_Blocks[side1_index]);
+        bool side2_solid = IsOpaque(m_Blocks[side2_index]);
+        bool diagonal_solid = IsOpaque(m_Blocks[diagonal_index]);
+        
+        occlusion[i] = 3;
+        if (m_Options.AmbientOcclusion) {
+            occlusion[i] = side1_solid && side2_solid ? 0 : 3 - (side1_solid + side2_solid + diagonal_solid);
+        }
+        
+        // Average over the non opaque blocks around the corner; the diagonal only counts when light can reach it
+        uint32_t sky = m_Light[front_index] >> 4;
+        uint32_t emitted = m_Light[front_index] & 0x0F;
+        uint32_t samples = 1;
+        if (m_Options.SmoothLighting) {
+            bool diagonal_visible = !diagonal_solid && !(side1_solid && side2_solid);
+            for (auto [index, visible] : { std::pair{side1_index, !side1_solid}, std::pair{side2_index, !side2_solid}, std::pair{diagonal_index, diagonal_visible} }) {
+                if (visible) {
+                    sky += m_Light[index] >> 4;
+                    emitted += m_Light[index] & 0x0F;
+                    samples++;
+                }
+            }
+        }
+        
+        // Side faces keep the texture upright, top and bottom map the horizontal plane
+        float s = axis == 1 ? position[0] - x : (axis == 0 ? position[2] - z : position[0] - x);
+        float t = axis == 1 ? position[2] - z : 1.0f - (position[1] - y);
+        
+        auto& vertex = vertices[i];
+        vertex.Position = glm::vec3(position[0], position[1], position[2]);
+        vertex.Color = glm::vec3(tint);
+        vertex.Shading = glm::u8vec4(occlusion[i] * 85,
+                                     sky * 17 / samples,
+                                     emitted * 17 / samples,
+                                     static_cast<uint8_t>(tint.w * 255.0f));
+        vertex.TextureCoordinate = glm::vec2((1.0f + s) * ATLAS_CELL_WIDTH, (atlas_row + t) * ATLAS_CELL_HEIGHT);
+    }
+    
+    // Split the quad along the diagonal with less occlusion difference to avoid anisotropic interpolation.
+    // Rotating the vertices keeps the shared index pattern valid for every quad.
+    uint32_t start = occlusion[0] + occlusion[2] < occlusion[1] + occlusion[3] ? 1 : 0;
+    if (!m_Options.PackedFaces) {
+        for (uint32_t i = 0; i < 4; i++) {
+            mesh.Vertices.push_back(vertices[(start + i) % 4]);
+        }
+        return;
+    }
+    
+    // face.vert rebuilds the same four vertices; per corner values stay in the unrotated corner order
+    Renderer::PackedFace face{};
+    face.Position = static_cast<uint32_t>(x)
+        | static_cast<uint32_t>(y) << 5
+        | static_cast<uint32_t>(z) << 10
+        | static_cast<uint32_t>(axis) << 15
+        | static_cast<uint32_t>(sign > 0) << 17
+        | start << 18
+        | static_cast<uint32_t>(atlas_row) << 20;
+    for (uint32_t i = 0; i < 4; i++) {
+        face.Position |= static_cast<uint32_t>(occlusion[i]) << (22 + 2 * i);
+        face.Tint |= static_cast<uint32_t>(tint[i] * 255.0f) << (8 * i);
+        face.SkyLight |= static_cast<uint32_t>(vertices[i].Shading.y) << (8 * i);
+        face.BlockLight |= static_cast<uint32_t>(vertices[i].Shading.z) << (8 * i);
+    }
+    mesh.Faces.push_back(face);
+}
@@ -0,0 +1,62 @@
+#ifndef ChunkMesher_h
+#define ChunkMesher_h
+
+#include "Renderer.h"
+#include "Chunk.h"
+
+// A block emits at most one quad per side, so no chunk mesh holds more than six quads per block
+constexpr uint32_t MAX_CHUNK_QUADS = 6 * CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+// Either four vertices or one packed face per quad, depending on ChunkMesher::Options::PackedFaces. Quads all
+// share the index pattern 0, 1, 2, 2, 3, 0, so chunks upload no indices and draw with the renderer's shared
+// quad index buffer.
+struct QuadMesh {
+    std::vector<Renderer::Vertex> Vertices;
+    std::vector<Renderer::PackedFace> Faces;
+    
+    uint32_t QuadCount() const {
+        return static_cast<uint32_t>(Vertices.size() / 4 + Faces.size());
+    }
+};
+
+// Opaque and transparent faces are kept apart so they can be drawn in separate passes
+struct ChunkMesh {
+    QuadMesh Opaque;
+    QuadMesh Transparent;
+};
+
+class ChunkMesher {
+public:
+    struct Options {
+        bool AmbientOcclusion = true;
+        bool SmoothLighting = true;
+        bool PackedFaces = false; // For renderers with vertex pulling enabled
+    };
+    
+    // Chunk and its 26 neighbours indexed by (x + 1) + 3 * ((y + 1) + 3 * (z + 1)), the chunk itself is
+    // at 13. Missing neighbours are treated as sky lit air.
+    using Neighbourhood = std::array<const Chunk*, 27>;
+    
+    ChunkMesher();
+    explicit ChunkMesher(Options options);
+    
+    void Mesh(const Neighbourhood& neighbourhood, ChunkMesh& mesh);
+    
+private:
+    static constexpr int PADDED_SIZE = CHUNK_SIZE + 2;
+    
+    Options m_Options;
+    
+    // Chunk with a one block border copied from the neighbours, so corner lookups never leave the array
+    std::array<Block, PADDED_SIZE * PADDED_SIZE * PADDED_SIZE> m_Blocks;
+    std::array<uint8_t, PADDED_SIZE * PADDED_SIZE * PADDED_SIZE> m_Light;
+    
+    static int PaddedIndex(int x, int y, int z) {
+        return (x + 1) + PADDED_SIZE * ((z + 1) + PADDED_SIZE * (y + 1));
+    }
+    
+    void CopyNeighbourhood(const Neighbourhood& neighbourhood);
+    void EmitFace(int x, int y, int z, int axis, int sign, Block block, QuadMesh& mesh) const;
+};
+
+#endif
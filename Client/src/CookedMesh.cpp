@@ -0,0 +1,114 @@
+#include "CookedMesh.h"
+#include "MeshData.h"
+
+#include <filesystem>
+
+namespace {
+
+constexpr char MAGIC[4] = {'M', 'C', 'C', 'M'};
+
+uint64_t Align(uint64_t offset) {
+    return (offset + CookedMesh::ALIGNMENT - 1) & ~(CookedMesh::ALIGNMENT - 1);
+}
+
+std::vector<CookedMesh::Attribute> VertexLayout() {
+    std::vector<CookedMesh::Attribute> layout;
+    for (const auto& description : Renderer::Vertex::AttributeDescriptions()) {
+        layout.push_back({description.location, static_cast<uint32_t>(description.format), description.offset, 0});
+    }
+    
+    return layout;
+}
+
+}
+
+bool CookedMesh::Open(const std::string& path) {
+    Close();
+    
+    if (!m_File.Open(path) || m_File.Size() < sizeof(Header)) {
+        Close();
+        return false;
+    }
+    
+    memcpy(&m_Header, m_File.Data(), sizeof(Header));
+    
+    // Anything cooked for another vertex layout has to be cooked again rather than reinterpreted
+    auto layout = VertexLayout();
+    bool valid = memcmp(m_Header.Magic, MAGIC, sizeof(MAGIC)) == 0
+        && m_Header.Version == VERSION
+        && m_Header.VertexStride == sizeof(Renderer::Vertex)
+        && (m_Header.IndexSize == sizeof(uint16_t) || m_Header.IndexSize == sizeof(uint32_t))
+        && m_Header.AttributeCount == layout.size()
+        && sizeof(Header) + sizeof(Attribute) * layout.size() <= m_File.Size()
+        && memcmp(m_File.Data() + sizeof(Header), layout.data(), sizeof(Attribute) * layout.size()) == 0
+        && m_Header.VertexOffset % ALIGNMENT == 0
+        && m_Header.IndexOffset % ALIGNMENT == 0
+        && m_Header.VertexOffset + VertexDataSize() <= m_Header.IndexOffset
+        && m_Header.IndexOffset + IndexDataSize() <= m_File.Size();
+    
+    if (!valid) {
+        Close();
+        return false;
+    }
+    
+    return true;
+}
+
+void CookedMesh::Close() {
+    m_File.Close();
+    m_Header = {};
+}
+
+bool CookedMesh::Write(const std::string& path, const MeshData& mesh, const SourceStamp& source) {
+    auto layout = VertexLayout();
+    
+    Header header{};
+    memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+    header.Version = VERSION;
+    header.AttributeCount = static_cast<uint32_t>(layout.size());
+    header.VertexStride = sizeof(Renderer::Vertex);
+    header.VertexCount = static_cast<uint32_t>(mesh.Vertices.size());
+    header.IndexCount = static_cast<uint32_t>(mesh.Indices.size());
+    header.IndexSize = mesh.FitsShortIndices() ? sizeof(uint16_t) : sizeof(uint32_t);
+    header.VertexOffset = Align(sizeof(Header) + sizeof(Attribute) * layout.size());
+    header.IndexOffset = Align(header.VertexOffset + sizeof(Renderer::Vertex) * mesh.Vertices.size());
+    header.Source = source;
+    
+    std::vector<uint16_t> short_indices;
+    const void* indices = mesh.Indices.data();
+    if (header.IndexSize == sizeof(uint16_t)) {
+        short_indices = mesh.ShortIndices();
+        indices = short_indices.data();
+    }
+    
+    const char padding[ALIGNMENT] = {};
+    auto pad = [&](std::ofstream& file, uint64_t offset) {
+        file.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+    };
+    
+    // Written aside and renamed so a crash never leaves a truncated mesh behind
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(layout.data()), sizeof(Attribute) * layout.size());
+        pad(file, header.VertexOffset);
+        file.write(reinterpret_cast<const char*>(mesh.Vertices.data()), sizeof(Renderer::Vertex) * mesh.Vertices.size());
+        pad(file, header.IndexOffset);
+        file.write(static_cast<const char*>(indices), static_cast<std::streamsize>(uint64_t(header.IndexSize) * header.IndexCount));
+        if (!file) {
+            std::cerr << "Failed to write cooked mesh " << path << "\n";
+            return false;
+        }
+    }
+    
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::cerr << "Failed to write cooked mesh " << path << "\n";
+        std::filesystem::remove(temporary_path, error);
+        return false;
+    }
+    
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef CookedMesh_h
+#define CookedMesh_h
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+
+struct MeshData;
+
+// Mesh stored in the layout its GPU buffers use: a header, the vertex layout it was cooked with, then
+// the vertex and index blobs, each aligned to CookedMesh::ALIGNMENT. Opening maps the file and the blobs
+// are read in place, so uploading is a single copy into staging memory.
+class CookedMesh {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t ALIGNMENT = 64;
+    
+    // File the mesh was cooked from, both zero when unknown
+    struct SourceStamp {
+        uint64_t Size = 0;
+        int64_t Time = 0;
+    };
+    
+    struct Header {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t AttributeCount;
+        uint32_t VertexStride;
+        uint32_t VertexCount;
+        uint32_t IndexCount;
+        uint32_t IndexSize;  // 2 when every vertex fits a 16-bit index, otherwise 4
+        uint32_t Reserved;
+        uint64_t VertexOffset;
+        uint64_t IndexOffset;
+        SourceStamp Source;
+    };
+    
+    // Mirrors VkVertexInputAttributeDescription, followed by AttributeCount of these after the header
+    struct Attribute {
+        uint32_t Location;
+        uint32_t Format;
+        uint32_t Offset;
+        uint32_t Reserved;
+    };
+    
+    // Fails on missing files and on files cooked for a different Renderer::Vertex layout
+    bool Open(const std::string& path);
+    void Close();
+    
+    bool IsOpen() const { return m_File.Data() != nullptr; }
+    const Header& GetHeader() const { return m_Header; }
+    
+    const std::byte* VertexData() const { return m_File.Data() + m_Header.VertexOffset; }
+    uint64_t VertexDataSize() const { return uint64_t(m_Header.VertexStride) * m_Header.VertexCount; }
+    const std::byte* IndexData() const { return m_File.Data() + m_Header.IndexOffset; }
+    uint64_t IndexDataSize() const { return uint64_t(m_Header.IndexSize) * m_Header.IndexCount; }
+    
+    static bool Write(const std::string& path, const MeshData& mesh, const SourceStamp& source);
+
+private:
+    MappedFile m_File;
+    Header m_Header{};
+};
+
+#endif
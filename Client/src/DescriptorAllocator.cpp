@@ -0,0 +1,168 @@
+#include "DescriptorAllocator.h"
+
+#include <iostream>
+
+bool DescriptorAllocator::Initialize(VkDevice device, uint32_t frame_count, const std::vector<VkDescriptorPoolSize>& set_sizes, VkDescriptorPoolCreateFlags flags) {
+    m_Device = device;
+    m_Flags = flags;
+    m_Frames.assign(frame_count, FramePools{});
+    m_Frame = 0;
+    
+    m_PoolSizes = set_sizes;
+    for (auto& size : m_PoolSizes) {
+        size.descriptorCount *= SETS_PER_POOL;
+    }
+    
+    // One pool per frame up front, enough for the usual frame
+    for (auto& frame : m_Frames) {
+        VkDescriptorPool pool = CreatePool();
+        if (pool == VK_NULL_HANDLE) {
+            return false;
+        }
+        frame.Pools.push_back(pool);
+    }
+    
+    return true;
+}
+
+void DescriptorAllocator::Destroy() {
+    for (auto& frame : m_Frames) {
+        for (auto pool : frame.Pools) {
+            vkDestroyDescriptorPool(m_Device, pool, nullptr);
+        }
+    }
+    m_Frames.clear();
+}
+
+void DescriptorAllocator::BeginFrame(uint32_t frame) {
+    m_Frame = frame;
+    
+    auto& pools = m_Frames[frame];
+    for (size_t i = 0; i <= pools.Current && i < pools.Pools.size(); i++) {
+        vkResetDescriptorPool(m_Device, pools.Pools[i], 0);
+    }
+    pools.Current = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout) {
+    auto& pools = m_Frames[m_Frame];
+    
+    VkDescriptorSetAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts = &layout;
+    
+    while (true) {
+        if (pools.Current == pools.Pools.size()) {
+            VkDescriptorPool pool = CreatePool();
+            if (pool == VK_NULL_HANDLE) {
+                return VK_NULL_HANDLE;
+            }
+            pools.Pools.push_back(pool);
+        }
+        
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        allocate_info.descriptorPool = pools.Pools[pools.Current];
+        VkResult result = vkAllocateDescriptorSets(m_Device, &allocate_info, &set);
+        if (result == VK_SUCCESS) {
+            return set;
+        }
+        
+        // A full pool moves on to the next one, anything else will not get better by retrying
+        if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+            std::cerr << "Failed to allocate descriptor set\n";
+            return VK_NULL_HANDLE;
+        }
+        pools.Current++;
+    }
+}
+
+VkDescriptorPool DescriptorAllocator::CreatePool() const {
+    VkDescriptorPoolCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    create_info.flags = m_Flags;
+    create_info.poolSizeCount = static_cast<uint32_t>(m_PoolSizes.size());
+    create_info.pPoolSizes = m_PoolSizes.data();
+    create_info.maxSets = SETS_PER_POOL;
+    
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    if (vkCreateDescriptorPool(m_Device, &create_info, nullptr, &pool) != VK_SUCCESS) {
+        std::cerr << "Failed to create descriptor pool\n";
+        return VK_NULL_HANDLE;
+    }
+    
+    return pool;
+}
+
+bool DescriptorTemplate::Create(VkDevice device, VkDescriptorSetLayout layout, const std::vector<VkDescriptorUpdateTemplateEntry>& entries, bool use_template) {
+    m_Device = device;
+    m_Entries = entries;
+    
+    if (!use_template) {
+        return true;
+    }
+    
+    VkDescriptorUpdateTemplateCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    create_info.descriptorUpdateEntryCount = static_cast<uint32_t>(m_Entries.size());
+    create_info.pDescriptorUpdateEntries = m_Entries.data();
+    create_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    create_info.descriptorSetLayout = layout;
+    
+    if (vkCreateDescriptorUpdateTemplate(m_Device, &create_info, nullptr, &m_Template) != VK_SUCCESS) {
+        std::cerr << "Failed to create descriptor update template\n";
+        m_Template = VK_NULL_HANDLE;
+        return false;
+    }
+    
+    return true;
+}
+
+void DescriptorTemplate::Destroy() {
+    if (m_Template != VK_NULL_HANDLE) {
+        vkDestroyDescriptorUpdateTemplate(m_Device, m_Template, nullptr);
+        m_Template = VK_NULL_HANDLE;
+    }
+    m_Entries.clear();
+}
+
+void DescriptorTemplate::Update(VkDescriptorSet set, const void* data) const {
+    if (m_Template != VK_NULL_HANDLE) {
+        vkUpdateDescriptorSetWithTemplate(m_Device, set, m_Template, data);
+        return;
+    }
+    
+    const auto* bytes = static_cast<const char*>(data);
+    std::vector<VkWriteDescriptorSet> writes(m_Entries.size());
+    for (size_t i = 0; i < m_Entries.size(); i++) {
+        const auto& entry = m_Entries[i];
+        auto& write = writes[i];
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = entry.dstBinding;
+        write.dstArrayElement = entry.dstArrayElement;
+        write.descriptorCount = entry.descriptorCount;
+        write.descriptorType = entry.descriptorType;
+        
+        const void* info = bytes + entry.offset;
+        switch (entry.descriptorType) {
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+                write.pBufferInfo = static_cast<const VkDescriptorBufferInfo*>(info);
+                break;
+            
+            case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                write.pTexelBufferView = static_cast<const VkBufferView*>(info);
+                break;
+            
+            default:
+                write.pImageInfo = static_cast<const VkDescriptorImageInfo*>(info);
+                break;
+        }
+    }
+    
+    vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
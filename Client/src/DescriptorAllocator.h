@@ -0,0 +1,63 @@
+#ifndef DescriptorAllocator_h
+#define DescriptorAllocator_h
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+// Hands out descriptor sets that live for one frame. Every frame in flight owns its pools, which are reset
+// in bulk when the frame slot comes around again instead of freeing sets one by one. A frame that needs
+// more sets than a pool holds gets another pool, kept for later frames.
+class DescriptorAllocator {
+public:
+    static constexpr uint32_t SETS_PER_POOL = 16;
+    
+    DescriptorAllocator() = default;
+    DescriptorAllocator(const DescriptorAllocator&) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+    
+    // Set sizes are the descriptors a single set needs of each type
+    bool Initialize(VkDevice device, uint32_t frame_count, const std::vector<VkDescriptorPoolSize>& set_sizes, VkDescriptorPoolCreateFlags flags = 0);
+    void Destroy();
+    
+    // The frame's previous submission must have completed, its sets are recycled
+    void BeginFrame(uint32_t frame);
+    VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+private:
+    struct FramePools {
+        std::vector<VkDescriptorPool> Pools;
+        size_t Current = 0;
+    };
+    
+    VkDevice m_Device = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPoolSize> m_PoolSizes;
+    VkDescriptorPoolCreateFlags m_Flags = 0;
+    std::vector<FramePools> m_Frames;
+    uint32_t m_Frame = 0;
+    
+    VkDescriptorPool CreatePool() const;
+};
+
+// Writes a fixed list of bindings from one struct whose layout the entries describe. Uses a
+// VkDescriptorUpdateTemplate where the device has Vulkan 1.1 and the matching vkUpdateDescriptorSets call elsewhere.
+class DescriptorTemplate {
+public:
+    DescriptorTemplate() = default;
+    DescriptorTemplate(const DescriptorTemplate&) = delete;
+    DescriptorTemplate& operator=(const DescriptorTemplate&) = delete;
+    
+    // Arrays must be tightly packed, the fallback passes them to VkWriteDescriptorSet as they are
+    bool Create(VkDevice device, VkDescriptorSetLayout layout, const std::vector<VkDescriptorUpdateTemplateEntry>& entries, bool use_template);
+    void Destroy();
+    
+    void Update(VkDescriptorSet set, const void* data) const;
+
+private:
+    VkDevice m_Device = VK_NULL_HANDLE;
+    VkDescriptorUpdateTemplate m_Template = VK_NULL_HANDLE;
+    std::vector<VkDescriptorUpdateTemplateEntry> m_Entries;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "MappedFile.h"
+
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+    
+#ifdef MAPPED_FILE_POSIX
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return false;
+    }
+    
+    struct stat status{};
+    if (fstat(descriptor, &status) != 0 || status.st_size <= 0) {
+        close(descriptor);
+        return false;
+    }
+    
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    
+    // The mapping keeps the file alive on its own
+    close(descriptor);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    
+    m_Data = static_cast<const std::byte*>(data);
+    m_Size = static_cast<size_t>(status.st_size);
+    m_Mapped = true;
+    return true;
+#else
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    m_Fallback.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(m_Fallback.data()), m_Fallback.size());
+    if (!file || m_Fallback.empty()) {
+        m_Fallback.clear();
+        return false;
+    }
+    
+    m_Data = m_Fallback.data();
+    m_Size = m_Fallback.size();
+    return true;
+#endif
+}
+
+void MappedFile::Close() {
+#ifdef MAPPED_FILE_POSIX
+    if (m_Mapped) {
+        munmap(const_cast<std::byte*>(m_Data), m_Size);
+    }
+#endif
+    m_Fallback.clear();
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Mapped = false;
+}
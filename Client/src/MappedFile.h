@@ -0,0 +1,29 @@
+#ifndef MappedFile_h
+#define MappedFile_h
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read only view of a whole file. Memory mapped on POSIX systems, read into memory elsewhere.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+    
+    bool Open(const std::string& path);
+    void Close();
+    
+    const std::byte* Data() const { return m_Data; }
+    size_t Size() const { return m_Size; }
+
+private:
+    const std::byte* m_Data = nullptr;
+    size_t m_Size = 0;
+    bool m_Mapped = false;
+    std::vector<std::byte> m_Fallback;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef MeshData_h
+#define MeshData_h
+
+#include "Renderer.h"
+
+// CPU side copy of an indexed triangle mesh
+struct MeshData {
+    std::vector<Renderer::Vertex> Vertices;
+    std::vector<uint32_t> Indices;
+    
+    // Index 0xFFFF is left out so the mesh stays valid if primitive restart is ever enabled
+    bool FitsShortIndices() const {
+        return Vertices.size() <= UINT16_MAX;
+    }
+    
+    // Only meaningful when FitsShortIndices, halves index memory and bandwidth
+    std::vector<uint16_t> ShortIndices() const {
+        std::vector<uint16_t> indices(Indices.size());
+        std::transform(Indices.begin(), Indices.end(), indices.begin(), [](uint32_t index) {
+            return static_cast<uint16_t>(index);
+        });
+        
+        return indices;
+    }
+};
+
+#endif
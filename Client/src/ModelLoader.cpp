@@ -0,0 +1,202 @@
+#include "ModelLoader.h"
+
+#include <filesystem>
+
+namespace {
+
+std::optional<CookedMesh::SourceStamp> StampSource(const std::string& path) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    
+    auto time = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    
+    return CookedMesh::SourceStamp{size, static_cast<int64_t>(time.time_since_epoch().count())};
+}
+
+// Maps (position, texture coordinate) index pairs to output vertices. Linear probing over a
+// power of two table keeps lookups to one hash and usually one cache line.
+class IndexTable {
+public:
+    explicit IndexTable(size_t expected) {
+        size_t capacity = 16;
+        while (capacity < expected * 2) {
+            capacity *= 2;
+        }
+        m_Slots.resize(capacity);
+    }
+    
+    // Returns the value stored under key, storing value first when the key is new
+    uint32_t FindOrInsert(uint64_t key, uint32_t value) {
+        if ((m_Size + 1) * 2 > m_Slots.size()) {
+            Grow();
+        }
+        
+        size_t mask = m_Slots.size() - 1;
+        for (size_t i = Hash(key) & mask;; i = (i + 1) & mask) {
+            Slot& slot = m_Slots[i];
+            if (slot.Key == EMPTY) {
+                slot = {key, value};
+                m_Size++;
+                return value;
+            }
+            
+            if (slot.Key == key) {
+                return slot.Value;
+            }
+        }
+    }
+
+private:
+    // Position indices are never negative, so no real key has every bit set
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    
+    struct Slot {
+        uint64_t Key = EMPTY;
+        uint32_t Value = 0;
+    };
+    
+    std::vector<Slot> m_Slots;
+    size_t m_Size = 0;
+    
+    // MurmurHash3 finalizer, spreads neighbouring indices across the whole table
+    static uint64_t Hash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+    
+    void Grow() {
+        std::vector<Slot> slots(m_Slots.size() * 2);
+        std::swap(slots, m_Slots);
+        
+        size_t mask = m_Slots.size() - 1;
+        for (const Slot& slot : slots) {
+            if (slot.Key == EMPTY) {
+                continue;
+            }
+            
+            size_t i = Hash(slot.Key) & mask;
+            while (m_Slots[i].Key != EMPTY) {
+                i = (i + 1) & mask;
+            }
+            m_Slots[i] = slot;
+        }
+    }
+};
+
+}
+
+bool ModelLoader::Load(const std::string& path, CookedMesh& mesh) const {
+    std::string cooked_path = CookedPath(path);
+    auto stamp = StampSource(path);
+    if (mesh.Open(cooked_path)) {
+        const auto& source = mesh.GetHeader().Source;
+        if (!stamp || (source.Size == stamp->Size && source.Time == stamp->Time)) {
+            return true;
+        }
+    }
+    
+    if (!stamp) {
+        std::cerr << "Failed to find model " << path << "\n";
+        return false;
+    }
+    
+    if (!Cook(path, cooked_path)) {
+        return false;
+    }
+    
+    if (!mesh.Open(cooked_path)) {
+        std::cerr << "Failed to open cooked mesh " << cooked_path << "\n";
+        return false;
+    }
+    
+    return true;
+}
+
+bool ModelLoader::Import(const std::string& path, MeshData& mesh) const {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn;
+    std::string err;
+    
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) {
+        std::cerr << "Failed to load object " << path << "\n";
+        return false;
+    }
+    
+    size_t index_count = 0;
+    for (const auto& shape : shapes) {
+        index_count += shape.mesh.indices.size();
+    }
+    
+    // Most OBJ exports pair each position with one texture coordinate, so the position count is a
+    // close guess for the unique vertex count
+    size_t position_count = attrib.vertices.size() / 3;
+    mesh.Vertices.clear();
+    mesh.Indices.clear();
+    mesh.Vertices.reserve(position_count);
+    mesh.Indices.reserve(index_count);
+    
+    // Vertices are identical exactly when they reference the same position and texture coordinate,
+    // so the index pair stands in for the whole vertex
+    IndexTable unique_vertices(position_count);
+    for (const auto& shape : shapes) {
+        for (const auto& index : shape.mesh.indices) {
+            uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(index.vertex_index)) << 32
+                | static_cast<uint32_t>(index.texcoord_index);
+            
+            auto next = static_cast<uint32_t>(mesh.Vertices.size());
+            uint32_t vertex_index = unique_vertices.FindOrInsert(key, next);
+            if (vertex_index == next) {
+                Renderer::Vertex vertex{};
+                
+                vertex.Position = {
+                    attrib.vertices[3 * index.vertex_index + 0],
+                    attrib.vertices[3 * index.vertex_index + 1],
+                    attrib.vertices[3 * index.vertex_index + 2]
+                };
+                
+                // Faces without texture coordinates sample the corner of the texture
+                if (index.texcoord_index >= 0) {
+                    vertex.TextureCoordinate = {
+                        attrib.texcoords[2 * index.texcoord_index + 0],
+                        1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                    };
+                }
+                
+                // Models are untinted and not part of the voxel grid, the VertexFormat::Model variant ignores Shading
+                vertex.Color = glm::vec3(1.0f);
+                
+                mesh.Vertices.push_back(vertex);
+            }
+            
+            mesh.Indices.push_back(vertex_index);
+        }
+    }
+    
+    return true;
+}
+
+bool ModelLoader::Cook(const std::string& path, const std::string& cooked_path) const {
+    auto stamp = StampSource(path);
+    MeshData mesh;
+    if (!stamp || !Import(path, mesh)) {
+        return false;
+    }
+    
+    return CookedMesh::Write(cooked_path, mesh, *stamp);
+}
+
+std::string ModelLoader::CookedPath(const std::string& path) {
+    return std::filesystem::path(path).replace_extension(".cmesh").string();
+}
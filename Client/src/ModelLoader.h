@@ -0,0 +1,24 @@
+#ifndef ModelLoader_h
+#define ModelLoader_h
+
+#include "MeshData.h"
+#include "CookedMesh.h"
+
+#include <string>
+
+// Imports OBJ models into MeshData with vertices shared between faces, and cooks them into
+// CookedMesh files that later starts map instead of parsing the OBJ again.
+class ModelLoader {
+public:
+    // Opens the cooked mesh next to the model, cooking it first when it is missing or the OBJ changed.
+    // A cooked mesh without its OBJ is used as is.
+    bool Load(const std::string& path, CookedMesh& mesh) const;
+    
+    // Parses the OBJ without touching the cooked mesh
+    bool Import(const std::string& path, MeshData& mesh) const;
+    bool Cook(const std::string& path, const std::string& cooked_path) const;
+    
+    static std::string CookedPath(const std::string& path);
+};
+
+#endif
@@ -1,11 +1,6 @@
 #include "Renderer.h"
-
-bool operator==(const Renderer::Vertex left, const Renderer::Vertex& right) {
-    return
-        left.Position == right.Position
-        && left.Color == right.Color
-        && left.TextureCoordinate == right.TextureCoordinate;
-}
+#include "ChunkMesher.h"
+#include "ModelLoader.h"
 
 GLFWwindow* Renderer::Initialize() {
     CreateWindow();
@@ -18,8 +13,12 @@ GLFWwindow* Renderer::Initialize() {
     if (vulkan_available) vulkan_available = CreateImageViews();
     if (vulkan_available) vulkan_available = CreateRenderPass();
     if (vulkan_available) vulkan_available = CreateDescriptorSetLayout();
+    if (vulkan_available) vulkan_available = CreatePipelineCache();
     if (vulkan_available) vulkan_available = CreateGraphicPipeline();
+    if (vulkan_available) vulkan_available = CreateComputePipeline();
     if (vulkan_available) vulkan_available = CreateCommandPool();
+    if (vulkan_available) vulkan_available = CreateShadowResources();
+    if (vulkan_available) vulkan_available = CreateShadowPipeline();
     if (vulkan_available) vulkan_available = CreateColorResources();
     if (vulkan_available) vulkan_available = CreateDepthResources();
     if (vulkan_available) vulkan_available = CreateFramebuffers();
@@ -29,12 +28,21 @@ GLFWwindow* Renderer::Initialize() {
     if (vulkan_available) vulkan_available = LoadModel();
     if (vulkan_available) vulkan_available = CreateVertexBuffer();
     if (vulkan_available) vulkan_available = CreateIndexBuffer();
+    if (vulkan_available) vulkan_available = CreateQuadIndexBuffers();
+    if (vulkan_available) vulkan_available = CreateFaceBuffer();
+    if (vulkan_available) vulkan_available = CreateScene();
     if (vulkan_available) vulkan_available = CreateUniformBuffers();
-    if (vulkan_available) vulkan_available = CreateDescriptorPool();
-    if (vulkan_available) vulkan_available = CreateDescriptorSet();
+    if (vulkan_available) vulkan_available = CreateLightBuffers();
+    if (vulkan_available) vulkan_available = CreateFaceExpansionBuffers();
+    if (vulkan_available) vulkan_available = CreateDescriptorAllocator();
     if (vulkan_available) vulkan_available = CreateCommandBuffers();
     if (vulkan_available) vulkan_available = CreateSyncObjects();
     
+    // Hot reload is a development aid, shaders still work from the startup build without it
+    if (vulkan_available && EnableShaderHotReload) {
+        m_ShaderWatcher.Start(SHADER_DIRECTORY);
+    }
+    
     if (!vulkan_available) {
         glfwSetWindowTitle(m_Window, "Failed to initialize Vulkan");
     }
@@ -44,6 +52,9 @@ GLFWwindow* Renderer::Initialize() {
 
 void Renderer::DrawFrame() {
     vkWaitForFences(m_Device, 1, &m_InFlightFences[m_CurrentFrame], VK_TRUE, UINT64_MAX);
+    CollectShadowTimings(static_cast<uint32_t>(m_CurrentFrame));
+    DestroyRetiredMeshes(false);
+    UpdateShaderHotReload();
     
     uint32_t image_index = -1;
     VkResult swapchain_status = vkAcquireNextImageKHR(m_Device, m_Swapchain, UINT64_MAX, m_ImageAvailableSemaphores[m_CurrentFrame], VK_NULL_HANDLE, &image_index);
@@ -58,13 +69,35 @@ void Renderer::DrawFrame() {
     if (m_ImagesInFlight[image_index] != VK_NULL_HANDLE) {
         vkWaitForFences(m_Device, 1, &m_ImagesInFlight[image_index], VK_TRUE, UINT64_MAX);
     }
-    m_ImagesInFlight[image_index] = m_InFlightFences[m_CurrentFrame];
     
     VkSemaphore wait_semaphores[] = { m_ImageAvailableSemaphores[m_CurrentFrame] };
     VkSemaphore signal_semaphores[] = { m_RenderFinishedSemaphores[m_CurrentFrame] };
     VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
     
+    UpdateShadowCascades();
     UpdateUniformBuffer(image_index);
+    UpdateLightBuffer(image_index);
+    // The acquired image has to be presented either way, or the swapchain never gets it back. A
+    // frame that cannot be drawn only moves the image into the layout presentation expects.
+    bool recorded = UpdateFrameDescriptors(image_index) && RecordCommandBuffer(image_index);
+    if (!recorded && !RecordPresentOnly(image_index)) {
+        // The acquire signals its semaphore regardless, an empty submission waits on it so it is
+        // unsignaled again before the next acquire uses it, and signals the frame's fence.
+        // Recreating the swapchain releases the image.
+        VkSubmitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        wait_info.waitSemaphoreCount = 1;
+        wait_info.pWaitSemaphores = wait_semaphores;
+        wait_info.pWaitDstStageMask = wait_stages;
+        
+        vkResetFences(m_Device, 1, &m_InFlightFences[m_CurrentFrame]);
+        if (vkQueueSubmit(m_GraphicsQueue, 1, &wait_info, m_InFlightFences[m_CurrentFrame]) != VK_SUCCESS) {
+            std::cerr << "Failed to submit image acquire wait\n";
+        }
+        RecreateSwapchain();
+        return;
+    }
+    m_ImagesInFlight[image_index] = m_InFlightFences[m_CurrentFrame];
     
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -80,7 +113,13 @@ void Renderer::DrawFrame() {
     
     if (vkQueueSubmit(m_GraphicsQueue, 1, &submit_info, m_InFlightFences[m_CurrentFrame]) != VK_SUCCESS) {
         std::cerr << "Failed to submit draw command buffer\n";
+    } else if (recorded) {
+        // Cascades of a frame that never ran are drawn again by the next one
+        for (auto& cascade : m_ShadowCascades) {
+            cascade.Dirty &= !cascade.Recorded;
+        }
     }
+    m_FrameNumber++;
     
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -99,27 +138,61 @@ void Renderer::DrawFrame() {
     }
     
     m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    
+    if (m_ReportFrameTimes) {
+        ReportFrameTime();
+    }
 }
 
 void Renderer::Destroy() {
+    m_ShaderWatcher.Stop();
+    CancelPipelineBuild();
     vkDeviceWaitIdle(m_Device);
     
+    DestroyRetiredPipelines(true);
+    DestroyRetiredMeshes(true);
+    SavePipelineCache();
+    vkDestroyPipelineCache(m_Device, m_PipelineCache, nullptr);
     DestroySwapchain();
-    vkDestroyImageView(m_Device, m_ColorImageView, nullptr);
-    vkFreeMemory(m_Device, m_ColorImageMemory, nullptr);
-    vkDestroyImage(m_Device, m_ColorImage, nullptr);
     vkDestroySampler(m_Device, m_Sampler, nullptr);
+    vkDestroySampler(m_Device, m_ShadowSampler, nullptr);
+    vkDestroyPipeline(m_Device, m_ShadowPipeline, nullptr);
+    vkDestroyPipeline(m_Device, m_ShadowFacesPipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_ShadowPipelineLayout, nullptr);
+    for (size_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        vkDestroyFramebuffer(m_Device, m_ShadowFramebuffers[i], nullptr);
+        vkDestroyImageView(m_Device, m_ShadowLayerViews[i], nullptr);
+    }
+    vkDestroyRenderPass(m_Device, m_ShadowRenderPass, nullptr);
+    vkDestroyImageView(m_Device, m_ShadowImageView, nullptr);
+    vkDestroyImage(m_Device, m_ShadowImage, nullptr);
+    vkFreeMemory(m_Device, m_ShadowImageMemory, nullptr);
+    if (m_ShadowQueryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(m_Device, m_ShadowQueryPool, nullptr);
+    }
     vkDestroyImageView(m_Device, m_TextureImageView, nullptr);
     vkDestroyImage(m_Device, m_TextureImage, nullptr);
     vkFreeMemory(m_Device, m_TextureImageMemory, nullptr);
+    m_FrameDescriptorTemplate.Destroy();
+    m_DescriptorAllocator.Destroy();
     vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(m_Device, m_RenderFinishedSemaphores[i], nullptr);
         vkDestroySemaphore(m_Device, m_ImageAvailableSemaphores[i], nullptr);
         vkDestroyFence(m_Device, m_InFlightFences[i], nullptr);
     }
+    for (auto& [position, chunk] : m_Chunks) {
+        DestroyGpuMesh(chunk.Opaque);
+        DestroyGpuMesh(chunk.Transparent);
+    }
     vkDestroyBuffer(m_Device, m_IndexBuffer, nullptr);
     vkFreeMemory(m_Device, m_IndexBufferMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_ShortQuadIndexBuffer, nullptr);
+    vkFreeMemory(m_Device, m_ShortQuadIndexBufferMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_QuadIndexBuffer, nullptr);
+    vkFreeMemory(m_Device, m_QuadIndexBufferMemory, nullptr);
+    vkDestroyBuffer(m_Device, m_FaceBuffer, nullptr);
+    vkFreeMemory(m_Device, m_FaceBufferMemory, nullptr);
     vkDestroyBuffer(m_Device, m_VertexBuffer, nullptr);
     vkFreeMemory(m_Device, m_VertexBufferMemory, nullptr);
     vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
@@ -130,7 +203,194 @@ void Renderer::Destroy() {
     glfwTerminate();
 }
 
+void Renderer::AddLight(const PointLight& light) {
+    if (m_Lights.size() >= MAX_LIGHTS) {
+        std::cerr << "Light limit of " << MAX_LIGHTS << " reached\n";
+        return;
+    }
+    
+    m_Lights.push_back(light);
+}
+
+void Renderer::LoadLightBenchmark(uint32_t light_count) {
+    // Fixed seed so runs with the same light count are comparable
+    std::mt19937 generator(1337);
+    std::uniform_real_distribution<float> position(-8.0f, 8.0f);
+    std::uniform_real_distribution<float> height(0.0f, 4.0f);
+    std::uniform_real_distribution<float> radius(0.5f, 2.5f);
+    std::uniform_real_distribution<float> color(0.2f, 1.0f);
+    
+    m_Lights.clear();
+    for (uint32_t i = 0; i < std::min(light_count, MAX_LIGHTS); i++) {
+        PointLight light{};
+        light.PositionRadius = glm::vec4(position(generator), position(generator), height(generator), radius(generator));
+        light.ColorIntensity = glm::vec4(color(generator), color(generator) * 0.8f, color(generator) * 0.5f, 1.0f);
+        m_Lights.push_back(light);
+    }
+    
+    m_ReportFrameTimes = true;
+    m_LastFrameTime = std::chrono::steady_clock::now();
+}
+
+void Renderer::SetSunDirection(const glm::vec3& direction) {
+    m_SunDirection = glm::normalize(direction);
+}
+
+void Renderer::UploadChunk(const glm::ivec3& position, const ChunkMesh& mesh) {
+    ChunkRenderData chunk{};
+    if (!CreateGpuMesh(mesh.Opaque, chunk.Opaque) || !CreateGpuMesh(mesh.Transparent, chunk.Transparent)) {
+        std::cerr << "Failed to upload chunk mesh\n";
+        DestroyGpuMesh(chunk.Opaque);
+        DestroyGpuMesh(chunk.Transparent);
+        return;
+    }
+    
+    RemoveChunk(position);
+    
+    // Chunks are y up like the block model and share its rotation into the z up world
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::translate(model, glm::vec3(position * CHUNK_SIZE));
+    
+    for (const auto* gpu_mesh : { &chunk.Opaque, &chunk.Transparent }) {
+        if (gpu_mesh->QuadCount == 0) {
+            continue;
+        }
+        
+        bool short_indices = gpu_mesh->QuadCount <= MAX_SHORT_INDEX_QUADS;
+        
+        // Pulled faces are found through the vertex offset, gl_VertexIndex / 4 is the face index
+        DrawCall draw{};
+        draw.VertexBuffer = gpu_mesh->VertexBuffer;
+        draw.IndexBuffer = short_indices ? m_ShortQuadIndexBuffer : m_QuadIndexBuffer;
+        draw.IndexCount = gpu_mesh->QuadCount * 6;
+        draw.IndexType = short_indices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        draw.VertexOffset = static_cast<int32_t>(gpu_mesh->FirstFace * 4);
+        draw.Model = model;
+        draw.Center = glm::vec3(CHUNK_SIZE * 0.5f);
+        draw.Radius = CHUNK_SIZE * 0.5f * std::sqrt(3.0f);
+        draw.Transparent = gpu_mesh == &chunk.Transparent;
+        draw.AlphaTest = false;
+        draw.Format = gpu_mesh->VertexBuffer == VK_NULL_HANDLE ? VertexFormat::Face : VertexFormat::Chunk;
+        m_DrawCalls.push_back(draw);
+    }
+    
+    InvalidateShadowCascades(glm::vec3(model * glm::vec4(glm::vec3(CHUNK_SIZE * 0.5f), 1.0f)), CHUNK_SIZE * 0.5f * std::sqrt(3.0f));
+    m_Chunks[position] = chunk;
+}
+
+void Renderer::RemoveChunk(const glm::ivec3& position) {
+    auto chunk = m_Chunks.find(position);
+    if (chunk == m_Chunks.end()) {
+        return;
+    }
+    
+    auto& data = chunk->second;
+    auto draws_mesh = [](const DrawCall& draw, const GpuMesh& mesh) {
+        return mesh.QuadCount > 0 && draw.VertexBuffer == mesh.VertexBuffer && draw.VertexOffset == static_cast<int32_t>(mesh.FirstFace * 4);
+    };
+    m_DrawCalls.erase(std::remove_if(m_DrawCalls.begin(), m_DrawCalls.end(), [&](const DrawCall& draw) {
+        return draws_mesh(draw, data.Opaque) || draws_mesh(draw, data.Transparent);
+    }), m_DrawCalls.end());
+    
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(position * CHUNK_SIZE) + glm::vec3(CHUNK_SIZE * 0.5f), 1.0f));
+    InvalidateShadowCascades(center, CHUNK_SIZE * 0.5f * std::sqrt(3.0f));
+    
+    // Buffers and face ranges may still be read by frames in flight
+    m_RetiredMeshes.push_back({ data.Opaque, m_FrameNumber });
+    m_RetiredMeshes.push_back({ data.Transparent, m_FrameNumber });
+    m_Chunks.erase(chunk);
+}
+
+void Renderer::SetVertexPulling(bool enabled) {
+    m_VertexPullingEnabled = enabled;
+}
+
+void Renderer::SetFaceExpansion(FaceExpansion expansion) {
+    m_FaceExpansion = expansion;
+    if (expansion != FaceExpansion::VertexShader) {
+        m_VertexPullingEnabled = true;
+    }
+}
+
+void Renderer::SetFrameTimeReporting(bool enabled) {
+    m_ReportFrameTimes = enabled;
+    m_LastFrameTime = std::chrono::steady_clock::now();
+}
+
+void Renderer::ReportFrameTime() {
+    auto now = std::chrono::steady_clock::now();
+    m_FrameTimeAccumulator += std::chrono::duration<double, std::milli>(now - m_LastFrameTime).count();
+    m_FrameTimeSamples++;
+    m_LastFrameTime = now;
+    
+    if (m_FrameTimeSamples == 500) {
+        std::cout << "Frame time: " << m_FrameTimeAccumulator / m_FrameTimeSamples << " ms (" << m_Lights.size() << " lights)\n";
+        for (size_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+            double average = m_ShadowRenderCount[i] > 0 ? m_ShadowTimeAccumulator[i] / m_ShadowRenderCount[i] : 0.0;
+            std::cout << "  Shadow cascade " << i << ": " << average << " ms GPU, rendered in " << m_ShadowRenderCount[i] << "/" << m_FrameTimeSamples << " frames\n";
+        }
+        
+        m_FrameTimeAccumulator = 0.0;
+        m_FrameTimeSamples = 0;
+        m_ShadowTimeAccumulator.fill(0.0);
+        m_ShadowRenderCount.fill(0);
+    }
+}
+
+void Renderer::UpdateShaderHotReload() {
+    DestroyRetiredPipelines(false);
+    
+    if (m_PipelineBuild.valid() && m_PipelineBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        auto pipelines = m_PipelineBuild.get();
+        if (pipelines) {
+            // Nothing recorded so far this frame, the next command buffer picks up the new pipelines
+            m_RetiredPipelines.push_back({ SwapPipelines(std::move(*pipelines)), m_FrameNumber });
+            std::cout << "Reloaded shaders\n";
+        } else {
+            std::cerr << "Shader reload failed, keeping previous pipelines\n";
+        }
+    }
+    
+    // Changes arriving during a build are picked up by the next one
+    if (!m_PipelineBuild.valid() && m_ShaderWatcher.PollChanges()) {
+        std::vector<PipelineKey> keys;
+        for (const auto& [key, pipeline] : m_GraphicsPipelines) {
+            keys.push_back(key);
+        }
+        
+        m_PipelineBuild = std::async(std::launch::async, [this, keys]() { return BuildPipelines(keys); });
+    }
+}
+
+void Renderer::DestroyRetiredPipelines(bool all) {
+    // Frames are submitted in order, once the fence of frame N is waited on every frame
+    // before N + MAX_FRAMES_IN_FLIGHT has finished with the pipelines it was recorded with
+    auto retired = std::remove_if(m_RetiredPipelines.begin(), m_RetiredPipelines.end(), [&](const RetiredPipelines& entry) {
+        if (all || m_FrameNumber >= entry.RetiredFrame + MAX_FRAMES_IN_FLIGHT) {
+            DestroyPipelines(entry.Pipelines);
+            return true;
+        }
+        return false;
+    });
+    m_RetiredPipelines.erase(retired, m_RetiredPipelines.end());
+}
+
+void Renderer::CancelPipelineBuild() {
+    if (!m_PipelineBuild.valid()) {
+        return;
+    }
+    
+    auto pipelines = m_PipelineBuild.get();
+    if (pipelines) {
+        DestroyPipelines(*pipelines);
+    }
+}
+
 void Renderer::DestroySwapchain() {
+    vkDestroyImageView(m_Device, m_ColorImageView, nullptr);
+    vkDestroyImage(m_Device, m_ColorImage, nullptr);
+    vkFreeMemory(m_Device, m_ColorImageMemory, nullptr);
     vkDestroyImageView(m_Device, m_DepthImageView, nullptr);
     vkDestroyImage(m_Device, m_DepthImage, nullptr);
     vkFreeMemory(m_Device, m_DepthImageMemory, nullptr);
@@ -142,11 +402,30 @@ void Renderer::DestroySwapchain() {
     for (size_t i = 0; i < m_SwapchainImages.size(); i++) {
         vkDestroyBuffer(m_Device, m_UniformBuffers[i], nullptr);
         vkFreeMemory(m_Device, m_UniformBuffersMemory[i], nullptr);
+        vkDestroyBuffer(m_Device, m_LightBuffers[i], nullptr);
+        vkFreeMemory(m_Device, m_LightBuffersMemory[i], nullptr);
+        vkDestroyBuffer(m_Device, m_ClusterBuffers[i], nullptr);
+        vkFreeMemory(m_Device, m_ClusterBuffersMemory[i], nullptr);
+        vkDestroyBuffer(m_Device, m_LightIndexBuffers[i], nullptr);
+        vkFreeMemory(m_Device, m_LightIndexBuffersMemory[i], nullptr);
+    }
+    
+    for (size_t i = 0; i < m_ExpandedVertexBuffers.size(); i++) {
+        vkDestroyBuffer(m_Device, m_ExpandedVertexBuffers[i], nullptr);
+        vkFreeMemory(m_Device, m_ExpandedVertexBuffersMemory[i], nullptr);
+        vkDestroyBuffer(m_Device, m_FaceJobBuffers[i], nullptr);
+        vkFreeMemory(m_Device, m_FaceJobBuffersMemory[i], nullptr);
     }
     
-    vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
-    vkDestroyPipeline(m_Device, m_GraphicsPipeline, nullptr);
+    vkFreeCommandBuffers(m_Device, m_CommandPool, static_cast<uint32_t>(m_CommandBuffers.size()), m_CommandBuffers.data());
+    for (const auto& [key, pipeline] : m_GraphicsPipelines) {
+        vkDestroyPipeline(m_Device, pipeline, nullptr);
+    }
+    m_GraphicsPipelines.clear();
     vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+    vkDestroyPipeline(m_Device, m_ClusterPipeline, nullptr);
+    vkDestroyPipeline(m_Device, m_ExpandFacesPipeline, nullptr);
+    vkDestroyPipelineLayout(m_Device, m_ClusterPipelineLayout, nullptr);
     vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
     for (auto view : m_SwapchainImageViews) {
         vkDestroyImageView(m_Device, view, nullptr);
@@ -163,27 +442,47 @@ void Renderer::RecreateSwapchain() {
         glfwWaitEvents();
     }
     
+    // A build in flight was made against the old swapchain extent, the new pipelines read the shaders again
+    CancelPipelineBuild();
     vkDeviceWaitIdle(m_Device);
+    DestroyRetiredPipelines(true);
+    DestroySwapchain();
     
     CreateSwapchain();
     CreateImageViews();
     CreateRenderPass();
     CreateGraphicPipeline();
+    CreateComputePipeline();
     CreateColorResources();
     CreateDepthResources();
     CreateFramebuffers();
     CreateUniformBuffers();
-    CreateDescriptorPool();
-    CreateDescriptorSet();
+    CreateLightBuffers();
+    CreateFaceExpansionBuffers();
     CreateCommandBuffers();
 }
 
 void Renderer::UpdateUniformBuffer(uint32_t index) {
     UniformBufferObject ubo{};
-    ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)); // glm::rotate(glm::mat4(1.0f), delta * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.projection = glm::perspective(glm::radians(45.0f), m_SwapchainExtent.width / (float)m_SwapchainExtent.height, 0.1f, 10.0f);
+    ubo.view = glm::lookAt(m_CameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    // Reverse Z with an infinite far plane: depth is near / distance, 1 at the near plane falling towards 0,
+    // which matches the precision of a float depth buffer to the perspective divide
+    float focal_length = 1.0f / std::tan(m_FieldOfView * 0.5f);
+    ubo.projection = glm::mat4(0.0f);
+    ubo.projection[0][0] = focal_length / (m_SwapchainExtent.width / (float)m_SwapchainExtent.height);
+    ubo.projection[1][1] = focal_length;
+    ubo.projection[2][3] = -1.0f;
+    ubo.projection[3][2] = m_NearPlane;
     ubo.projection[1][1] *= -1;
+    ubo.inverseProjection = glm::inverse(ubo.projection);
+    m_ViewProjection = ubo.projection * ubo.view;
+    ubo.clusterGrid = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, static_cast<uint32_t>(m_Lights.size()));
+    ubo.screenParams = glm::vec4(m_SwapchainExtent.width, m_SwapchainExtent.height, m_NearPlane, m_ViewDistance);
+    for (size_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        ubo.cascadeViewProjection[i] = m_ShadowCascades[i].ViewProjection;
+        ubo.cascadeSplits[i] = m_ShadowCascades[i].SplitFar;
+    }
+    ubo.sunDirection = glm::vec4(m_SunDirection, 1.0f);
     
     void* data;
     vkMapMemory(m_Device, m_UniformBuffersMemory[index], 0, sizeof(ubo), 0, &data);
@@ -191,6 +490,97 @@ void Renderer::UpdateUniformBuffer(uint32_t index) {
     vkUnmapMemory(m_Device, m_UniformBuffersMemory[index]);
 }
 
+void Renderer::UpdateShadowCascades() {
+    static_assert(SHADOW_CASCADE_COUNT == 4, "Cascade splits are packed into a vec4");
+    
+    float aspect = m_SwapchainExtent.width / (float)m_SwapchainExtent.height;
+    glm::mat4 view = glm::lookAt(m_CameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    
+    glm::vec3 up = std::abs(m_SunDirection.z) > 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::mat4 light_rotation = glm::lookAt(glm::vec3(0.0f), m_SunDirection, up);
+    
+    float previous_split = m_NearPlane;
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        // Practical split scheme, a blend between logarithmic and uniform distribution
+        float p = (i + 1) / static_cast<float>(SHADOW_CASCADE_COUNT);
+        float log_split = m_NearPlane * std::pow(m_ShadowDistance / m_NearPlane, p);
+        float uniform_split = m_NearPlane + (m_ShadowDistance - m_NearPlane) * p;
+        float split = glm::mix(uniform_split, log_split, 0.75f);
+        
+        glm::vec3 center(0.0f);
+        float radius = 0.0f;
+        if (i < SHADOW_CACHED_CASCADE_START) {
+            // Bounding sphere of the frustum slice; rotation invariant so the projection size never changes
+            glm::mat4 inverse = glm::inverse(glm::perspective(m_FieldOfView, aspect, previous_split, split) * view);
+            std::array<glm::vec3, 8> corners;
+            for (uint32_t c = 0; c < 8; c++) {
+                glm::vec4 corner = inverse * glm::vec4(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : 0.0f, 1.0f);
+                corners[c] = glm::vec3(corner) / corner.w;
+                center += corners[c] / 8.0f;
+            }
+            for (const auto& corner : corners) {
+                radius = std::max(radius, glm::length(corner - center));
+            }
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+        } else {
+            // Centred on the camera and snapped to coarse steps, so only travelling a step invalidates the cascade.
+            // The radius reaches the frustum corners at the split depth in any view direction.
+            float tangent = std::tan(m_FieldOfView * 0.5f);
+            float corner_distance = split * std::sqrt(1.0f + tangent * tangent * (1.0f + aspect * aspect));
+            float step = split / 8.0f;
+            center = glm::floor(m_CameraPosition / step) * step;
+            radius = corner_distance + step * std::sqrt(3.0f);
+        }
+        
+        // Snap to whole shadow map texels in light space to stop edges shimmering as the camera moves
+        float texel = 2.0f * radius / SHADOW_MAP_SIZE;
+        glm::vec3 light_center = glm::vec3(light_rotation * glm::vec4(center, 1.0f));
+        light_center.x = std::floor(light_center.x / texel) * texel;
+        light_center.y = std::floor(light_center.y / texel) * texel;
+        
+        // Extend towards the sun so casters outside the cascade still land in the map
+        glm::mat4 projection = glm::ortho(light_center.x - radius, light_center.x + radius,
+                                          light_center.y - radius, light_center.y + radius,
+                                          -light_center.z - 2.0f * radius, -light_center.z + radius);
+        
+        auto& cascade = m_ShadowCascades[i];
+        bool moved = cascade.Center != center || cascade.Radius != radius || cascade.SunDirection != m_SunDirection;
+        if (i < SHADOW_CACHED_CASCADE_START || moved) {
+            cascade.Dirty = true;
+        }
+        
+        cascade.ViewProjection = projection * light_rotation;
+        cascade.Center = center;
+        cascade.Radius = radius;
+        cascade.SplitFar = split;
+        cascade.SunDirection = m_SunDirection;
+        
+        previous_split = split;
+    }
+}
+
+void Renderer::InvalidateShadowCascades(const glm::vec3& center, float radius) {
+    // Cascade volumes reach two radii towards the sun, test against a sphere that covers all of it
+    for (auto& cascade : m_ShadowCascades) {
+        if (glm::length(center - cascade.Center) <= 3.0f * cascade.Radius + radius) {
+            cascade.Dirty = true;
+        }
+    }
+}
+
+void Renderer::UpdateLightBuffer(uint32_t index) {
+    if (m_Lights.empty()) {
+        return;
+    }
+    
+    VkDeviceSize size = sizeof(PointLight) * m_Lights.size();
+    
+    void* data;
+    vkMapMemory(m_Device, m_LightBuffersMemory[index], 0, size, 0, &data);
+    memcpy(data, m_Lights.data(), size);
+    vkUnmapMemory(m_Device, m_LightBuffersMemory[index]);
+}
+
 void Renderer::CreateWindow() {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -198,6 +588,7 @@ void Renderer::CreateWindow() {
     m_Window = glfwCreateWindow(WIDTH, HEIGHT, "Minicraft", nullptr, nullptr);
     glfwSetWindowUserPointer(m_Window, this);
     glfwSetFramebufferSizeCallback(m_Window, Renderer::FramebufferResizeCallback);
+    glfwSetKeyCallback(m_Window, Renderer::KeyCallback);
 }
 
 bool Renderer::CreateInstance() {
@@ -206,13 +597,20 @@ bool Renderer::CreateInstance() {
         return false;
     }
     
+    // Update templates and mesh shaders need Vulkan 1.1, loaders without vkEnumerateInstanceVersion only know 1.0
+    auto enumerate_instance_version = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    uint32_t loader_version = VK_API_VERSION_1_0;
+    if (enumerate_instance_version != nullptr && enumerate_instance_version(&loader_version) == VK_SUCCESS && loader_version >= VK_API_VERSION_1_1) {
+        m_InstanceVersion = VK_API_VERSION_1_1;
+    }
+    
     VkApplicationInfo app_info{};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     app_info.pApplicationName = "Minicraft";
     app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.pEngineName = "No Engine";
     app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    app_info.apiVersion = VK_API_VERSION_1_0;
+    app_info.apiVersion = m_InstanceVersion;
     
     VkInstanceCreateInfo instance{};
     instance.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -263,6 +661,11 @@ bool Renderer::PickPhysicalDevice() {
     if (suitable != physical_devices.end()) {
         m_PhysicalDevice = *suitable;
         m_MSAASamples = MaxUsableSampleCount();
+        
+        if (m_FaceExpansion == FaceExpansion::MeshShader && !SupportsMeshShaders(m_PhysicalDevice)) {
+            std::cerr << "Mesh shaders are not supported, expanding faces with compute instead\n";
+            m_FaceExpansion = FaceExpansion::Compute;
+        }
         return true;
     } else {
         std::cerr << "Failed to find a suitable GPU\n";
@@ -290,13 +693,48 @@ bool Renderer::CreateLogiaclDevice() {
     VkPhysicalDeviceFeatures device_features{};
     device_features.samplerAnisotropy = VK_TRUE;
     
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    m_UpdateTemplatesSupported = m_InstanceVersion >= VK_API_VERSION_1_1 && properties.apiVersion >= VK_API_VERSION_1_1;
+    m_PartiallyBoundSupported = SupportsPartiallyBoundDescriptors(m_PhysicalDevice);
+    
+    bool mesh_shaders = m_FaceExpansion == FaceExpansion::MeshShader;
+    std::vector<const char*> extensions = DeviceExtensions;
+    if (mesh_shaders) {
+        extensions.insert(extensions.end(), MeshShaderExtensions.begin(), MeshShaderExtensions.end());
+    }
+    if (m_PartiallyBoundSupported) {
+        extensions.insert(extensions.end(), DescriptorIndexingExtensions.begin(), DescriptorIndexingExtensions.end());
+    }
+    
+    // Optional features are chained in front of each other
+    void* features_chain = nullptr;
+    
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptor_indexing_features{};
+    descriptor_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    descriptor_indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+    if (m_PartiallyBoundSupported) {
+        descriptor_indexing_features.pNext = features_chain;
+        features_chain = &descriptor_indexing_features;
+    }
+    
+    VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features{};
+    mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    mesh_shader_features.taskShader = VK_TRUE;
+    mesh_shader_features.meshShader = VK_TRUE;
+    if (mesh_shaders) {
+        mesh_shader_features.pNext = features_chain;
+        features_chain = &mesh_shader_features;
+    }
+    
     VkDeviceCreateInfo device_create_info{};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_create_info.pNext = features_chain;
     device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     device_create_info.pQueueCreateInfos = queue_create_infos.data();
     device_create_info.pEnabledFeatures = &device_features;
-    device_create_info.enabledExtensionCount = static_cast<uint32_t>(DeviceExtensions.size());
-    device_create_info.ppEnabledExtensionNames = DeviceExtensions.data();
+    device_create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    device_create_info.ppEnabledExtensionNames = extensions.data();
     
     if (EnableValidationLayers) {
         device_create_info.enabledLayerCount = static_cast<uint32_t>(ValidationLayers.size());
@@ -313,6 +751,17 @@ bool Renderer::CreateLogiaclDevice() {
     vkGetDeviceQueue(m_Device, indices.GraphicsFamily.value(), 0, &m_GraphicsQueue);
     vkGetDeviceQueue(m_Device, indices.PresentFamily.value(), 0, &m_PresentQueue);
     
+    if (mesh_shaders) {
+        m_CmdDrawMeshTasks = reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(vkGetDeviceProcAddr(m_Device, "vkCmdDrawMeshTasksEXT"));
+        if (m_CmdDrawMeshTasks == nullptr) {
+            std::cerr << "Failed to load vkCmdDrawMeshTasksEXT, expanding faces with compute instead\n";
+            m_FaceExpansion = FaceExpansion::Compute;
+        }
+        m_PushConstantStages = m_FaceExpansion == FaceExpansion::MeshShader
+            ? VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT
+            : VK_SHADER_STAGE_VERTEX_BIT;
+    }
+    
     return true;
 }
 
@@ -389,8 +838,10 @@ bool Renderer::CreateRenderPass() {
     VkAttachmentDescription color_attachment{};
     color_attachment.format = m_SwapchainImageFormat;
     color_attachment.samples = m_MSAASamples;
+    // Multisampled colour only lives inside the pass: it is resolved into the swapchain image and never
+    // read back, so it is not stored and a tiler can keep it entirely in tile memory
     color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -399,6 +850,7 @@ bool Renderer::CreateRenderPass() {
     VkAttachmentDescription depth_attachment{};
     depth_attachment.format = FindDepthFormat();
     depth_attachment.samples = m_MSAASamples;
+    // Depth is cleared every frame and not needed after the pass, stencil is unused
     depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -409,6 +861,7 @@ bool Renderer::CreateRenderPass() {
     VkAttachmentDescription color_attachment_resolve{};
     color_attachment_resolve.format = m_SwapchainImageFormat;
     color_attachment_resolve.samples = VK_SAMPLE_COUNT_1_BIT;
+    // Every pixel is overwritten by the resolve, the previous contents never have to be loaded
     color_attachment_resolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     color_attachment_resolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -435,13 +888,14 @@ bool Renderer::CreateRenderPass() {
     subpass.pDepthStencilAttachment = &depth_attachment_ref;
     subpass.pResolveAttachments = &resolve_attachment_ref;
     
+    // The colour and depth images are shared by every frame in flight, the clear must wait for the previous frame's writes
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     
     std::array<VkAttachmentDescription, 3> attachments = { color_attachment, depth_attachment, color_attachment_resolve };
     VkRenderPassCreateInfo render_pass_create_info{};
@@ -462,11 +916,14 @@ bool Renderer::CreateRenderPass() {
 }
 
 bool Renderer::CreateDescriptorSetLayout() {
+    // Task and mesh stages only exist with VK_EXT_mesh_shader enabled
+    VkShaderStageFlags mesh_stages = m_FaceExpansion == FaceExpansion::MeshShader ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : 0;
+    
     VkDescriptorSetLayoutBinding ubo_binding{};
     ubo_binding.binding = 0;
     ubo_binding.descriptorCount = 1;
     ubo_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    ubo_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    ubo_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT | mesh_stages;
     
     VkDescriptorSetLayoutBinding sampler_binding{};
     sampler_binding.binding = 1;
@@ -475,9 +932,66 @@ bool Renderer::CreateDescriptorSetLayout() {
     sampler_binding.pImmutableSamplers = nullptr;
     sampler_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {ubo_binding, sampler_binding};
+    VkDescriptorSetLayoutBinding lights_binding{};
+    lights_binding.binding = 2;
+    lights_binding.descriptorCount = 1;
+    lights_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    lights_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    
+    VkDescriptorSetLayoutBinding clusters_binding{};
+    clusters_binding.binding = 3;
+    clusters_binding.descriptorCount = 1;
+    clusters_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    clusters_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    
+    VkDescriptorSetLayoutBinding light_indices_binding{};
+    light_indices_binding.binding = 4;
+    light_indices_binding.descriptorCount = 1;
+    light_indices_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    light_indices_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    
+    VkDescriptorSetLayoutBinding shadow_binding{};
+    shadow_binding.binding = 5;
+    shadow_binding.descriptorCount = 1;
+    shadow_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    shadow_binding.pImmutableSamplers = nullptr;
+    shadow_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    
+    VkDescriptorSetLayoutBinding faces_binding{};
+    faces_binding.binding = 6;
+    faces_binding.descriptorCount = 1;
+    faces_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    faces_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT | mesh_stages;
+    
+    VkDescriptorSetLayoutBinding face_jobs_binding{};
+    face_jobs_binding.binding = 7;
+    face_jobs_binding.descriptorCount = 1;
+    face_jobs_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    face_jobs_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    
+    VkDescriptorSetLayoutBinding expanded_vertices_binding{};
+    expanded_vertices_binding.binding = 8;
+    expanded_vertices_binding.descriptorCount = 1;
+    expanded_vertices_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    expanded_vertices_binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    
+    std::array<VkDescriptorSetLayoutBinding, 9> bindings = {ubo_binding, sampler_binding, lights_binding, clusters_binding, light_indices_binding, shadow_binding, faces_binding, face_jobs_binding, expanded_vertices_binding};
+    
+    // The face bindings only exist with vertex pulling or compute expansion; partially bound
+    // they can stay unwritten otherwise instead of relying on no pipeline touching them
+    std::array<VkDescriptorBindingFlagsEXT, 9> binding_flags{};
+    binding_flags[6] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+    binding_flags[7] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+    binding_flags[8] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+    
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_create_info{};
+    binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    binding_flags_create_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+    binding_flags_create_info.pBindingFlags = binding_flags.data();
+    
     VkDescriptorSetLayoutCreateInfo descriptor_set_layout{};
     descriptor_set_layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout.pNext = m_PartiallyBoundSupported ? &binding_flags_create_info : nullptr;
     descriptor_set_layout.bindingCount = static_cast<uint32_t>(bindings.size());
     descriptor_set_layout.pBindings = bindings.data();
     
@@ -489,26 +1003,129 @@ bool Renderer::CreateDescriptorSetLayout() {
     return true;
 }
 
+bool Renderer::CreatePipelineCache() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    
+    // Cache from a previous run, discarded when it was written by another device or driver
+    std::vector<char> cache_data;
+    std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        cache_data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(cache_data.data(), cache_data.size());
+        
+        VkPipelineCacheHeaderVersionOne header{};
+        if (cache_data.size() < sizeof(header)) {
+            cache_data.clear();
+        } else {
+            std::memcpy(&header, cache_data.data(), sizeof(header));
+            if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                || header.vendorID != properties.vendorID
+                || header.deviceID != properties.deviceID
+                || std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+                cache_data.clear();
+            }
+        }
+    }
+    
+    VkPipelineCacheCreateInfo cache_create_info{};
+    cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_create_info.initialDataSize = cache_data.size();
+    cache_create_info.pInitialData = cache_data.empty() ? nullptr : cache_data.data();
+    
+    if (vkCreatePipelineCache(m_Device, &cache_create_info, nullptr, &m_PipelineCache) != VK_SUCCESS) {
+        std::cerr << "Failed to create pipeline cache\n";
+        return false;
+    }
+    
+    return true;
+}
+
 bool Renderer::CreateGraphicPipeline() {
-    auto vert_shader_code = ReadFile("resources/vert.spv");
-    auto frag_shader_code = ReadFile("resources/frag.spv");
+    // Mesh pipelines read MeshPushConstants, which starts with the model matrix the vertex shaders read
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = m_PushConstantStages;
+    push_constant_range.offset = 0;
+    push_constant_range.size = m_FaceExpansion == FaceExpansion::MeshShader ? sizeof(MeshPushConstants) : sizeof(PushConstants);
     
-    VkShaderModule vert_shader_module = CreateShaderModule(vert_shader_code);
-    VkShaderModule frag_shader_module = CreateShaderModule(frag_shader_code);
+    VkPipelineLayoutCreateInfo layout_create_info{};
+    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount = 1;
+    layout_create_info.pSetLayouts = &m_DescriptorSetLayout;
+    layout_create_info.pushConstantRangeCount = 1;
+    layout_create_info.pPushConstantRanges = &push_constant_range;
+    
+    if (vkCreatePipelineLayout(m_Device, &layout_create_info, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create pipeline layout\n";
+        return false;
+    }
+    
+    // Compute expanded faces are drawn as classic chunk vertices
+    VertexFormat chunk_format = VertexFormat::Chunk;
+    if (m_FaceExpansion == FaceExpansion::MeshShader) {
+        chunk_format = VertexFormat::MeshFace;
+    } else if (m_VertexPullingEnabled && m_FaceExpansion == FaceExpansion::VertexShader) {
+        chunk_format = VertexFormat::Face;
+    }
+    
+    // Variants the first frames draw with, any other is built the first time it is used
+    std::vector<PipelineKey> keys;
+    for (auto format : { chunk_format, VertexFormat::Model }) {
+        for (auto pass : { PipelinePass::DepthPrepass, PipelinePass::Opaque, PipelinePass::Transparent, PipelinePass::Overdraw }) {
+            PipelineKey key{};
+            key.Pass = pass;
+            key.Format = format;
+            key.Fog = m_FogEnabled;
+            key.AmbientOcclusion = m_AmbientOcclusionEnabled;
+            key.AlphaTest = false;
+            keys.push_back(key.Canonical());
+        }
+    }
+    
+    PipelineSet pipelines{};
+    if (!BuildGraphicsPipelines(keys, pipelines)) {
+        return false;
+    }
     
-    VkPipelineShaderStageCreateInfo vert_create_info{};
-    vert_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vert_create_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vert_create_info.module = vert_shader_module;
-    vert_create_info.pName = "main";
+    m_GraphicsPipelines = std::move(pipelines.Graphics);
     
-    VkPipelineShaderStageCreateInfo frag_create_info{};
-    frag_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    frag_create_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    frag_create_info.module = frag_shader_module;
-    frag_create_info.pName = "main";
+    return true;
+}
+
+bool Renderer::BuildGraphicsPipelines(const std::vector<PipelineKey>& keys, PipelineSet& pipelines) const {
+    bool pulls_faces = std::any_of(keys.begin(), keys.end(), [](const PipelineKey& key) {
+        return key.Format == VertexFormat::Face;
+    });
+    bool meshes_faces = std::any_of(keys.begin(), keys.end(), [](const PipelineKey& key) {
+        return key.Format == VertexFormat::MeshFace;
+    });
+    
+    auto vert_shader_code = ReadFile(SHADER_DIRECTORY + "/vert.spv");
+    auto frag_shader_code = ReadFile(SHADER_DIRECTORY + "/frag.spv");
+    auto overdraw_shader_code = ReadFile(SHADER_DIRECTORY + "/overdraw.spv");
+    auto face_shader_code = pulls_faces ? ReadFile(SHADER_DIRECTORY + "/face.spv") : std::vector<char>();
+    auto task_shader_code = meshes_faces ? ReadFile(SHADER_DIRECTORY + "/face_task.spv") : std::vector<char>();
+    auto mesh_shader_code = meshes_faces ? ReadFile(SHADER_DIRECTORY + "/face_mesh.spv") : std::vector<char>();
     
-    VkPipelineShaderStageCreateInfo shader_stages[] = { vert_create_info, frag_create_info };
+    VkShaderModule vert_shader_module = CreateShaderModule(vert_shader_code);
+    VkShaderModule frag_shader_module = CreateShaderModule(frag_shader_code);
+    VkShaderModule overdraw_shader_module = CreateShaderModule(overdraw_shader_code);
+    VkShaderModule face_shader_module = pulls_faces ? CreateShaderModule(face_shader_code) : VK_NULL_HANDLE;
+    VkShaderModule task_shader_module = meshes_faces ? CreateShaderModule(task_shader_code) : VK_NULL_HANDLE;
+    VkShaderModule mesh_shader_module = meshes_faces ? CreateShaderModule(mesh_shader_code) : VK_NULL_HANDLE;
+    
+    if (vert_shader_module == VK_NULL_HANDLE || frag_shader_module == VK_NULL_HANDLE || overdraw_shader_module == VK_NULL_HANDLE
+        || (pulls_faces && face_shader_module == VK_NULL_HANDLE)
+        || (meshes_faces && (task_shader_module == VK_NULL_HANDLE || mesh_shader_module == VK_NULL_HANDLE))) {
+        vkDestroyShaderModule(m_Device, vert_shader_module, nullptr);
+        vkDestroyShaderModule(m_Device, frag_shader_module, nullptr);
+        vkDestroyShaderModule(m_Device, overdraw_shader_module, nullptr);
+        vkDestroyShaderModule(m_Device, face_shader_module, nullptr);
+        vkDestroyShaderModule(m_Device, task_shader_module, nullptr);
+        vkDestroyShaderModule(m_Device, mesh_shader_module, nullptr);
+        return false;
+    }
     
     auto binding_description = Vertex::BingindDescription();
     auto attribute_descriptions = Vertex::AttributeDescriptions();
@@ -520,6 +1137,10 @@ bool Renderer::CreateGraphicPipeline() {
     vertex_input_create_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
     vertex_input_create_info.pVertexAttributeDescriptions = attribute_descriptions.data();
     
+    // Pulled faces are read from the face buffer, there is no vertex input at all
+    VkPipelineVertexInputStateCreateInfo face_input_create_info{};
+    face_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    
     VkPipelineInputAssemblyStateCreateInfo input_assembly_create_info{};
     input_assembly_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -563,7 +1184,7 @@ bool Renderer::CreateGraphicPipeline() {
     depth_stencil_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depth_stencil_create_info.depthTestEnable = VK_TRUE;
     depth_stencil_create_info.depthWriteEnable = VK_TRUE;
-    depth_stencil_create_info.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil_create_info.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL; // Reverse Z; equal depths must pass after the depth pre-pass
     depth_stencil_create_info.depthBoundsTestEnable = VK_FALSE;
     depth_stencil_create_info.stencilTestEnable = VK_FALSE;
     
@@ -577,40 +1198,229 @@ bool Renderer::CreateGraphicPipeline() {
     color_blend_create_info.attachmentCount = 1;
     color_blend_create_info.pAttachments = &color_blend_attachment;
     
-    VkPipelineLayoutCreateInfo layout_create_info{};
-    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layout_create_info.setLayoutCount = 1;
-    layout_create_info.pSetLayouts = &m_DescriptorSetLayout;
-    layout_create_info.pushConstantRangeCount = 0;
-    layout_create_info.pPushConstantRanges = nullptr;
-    
-    if (vkCreatePipelineLayout(m_Device, &layout_create_info, nullptr, &m_PipelineLayout) != VK_SUCCESS) {
-        std::cerr << "Failed to create pipeline layout\n";
-        return false;
-    }
-    
     VkGraphicsPipelineCreateInfo pipeline_create_info{};
     pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipeline_create_info.stageCount = 2;
-    pipeline_create_info.pStages = shader_stages;
     pipeline_create_info.pVertexInputState = &vertex_input_create_info;
     pipeline_create_info.pInputAssemblyState = &input_assembly_create_info;
     pipeline_create_info.pViewportState = &viewport_state_create_info;
-    pipeline_create_info.pRasterizationState = &rasterization_create_info;
     pipeline_create_info.pMultisampleState = &multisampling_create_info;
-    pipeline_create_info.pColorBlendState = &color_blend_create_info;
     pipeline_create_info.layout = m_PipelineLayout;
     pipeline_create_info.renderPass = m_RenderPass;
     pipeline_create_info.subpass = 0;
-    pipeline_create_info.pDepthStencilState = &depth_stencil_create_info;
     
-    if (vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &m_GraphicsPipeline) != VK_SUCCESS) {
-        std::cerr << "Failed to create graphics pipeline\n";
-        return false;
+    // Constant ids are shared by both stages, a stage ignores the ones it does not declare
+    std::array<VkSpecializationMapEntry, 7> specialization_entries = {{
+        { 0, offsetof(SpecializationConstants, fog), sizeof(VkBool32) },
+        { 1, offsetof(SpecializationConstants, ambientOcclusion), sizeof(VkBool32) },
+        { 2, offsetof(SpecializationConstants, alphaTest), sizeof(VkBool32) },
+        { 3, offsetof(SpecializationConstants, bakedShading), sizeof(VkBool32) },
+        { 4, offsetof(SpecializationConstants, fogColor) + 0 * sizeof(float), sizeof(float) },
+        { 5, offsetof(SpecializationConstants, fogColor) + 1 * sizeof(float), sizeof(float) },
+        { 6, offsetof(SpecializationConstants, fogColor) + 2 * sizeof(float), sizeof(float) }
+    }};
+    
+    // Per variant state, sized up front so the pointers in the create infos stay valid
+    struct VariantState {
+        SpecializationConstants Constants;
+        VkSpecializationInfo Specialization;
+        std::array<VkPipelineShaderStageCreateInfo, 3> Stages;
+        VkPipelineRasterizationStateCreateInfo Rasterization;
+        VkPipelineDepthStencilStateCreateInfo DepthStencil;
+        VkPipelineColorBlendAttachmentState BlendAttachment;
+        VkPipelineColorBlendStateCreateInfo Blend;
+    };
+    
+    std::vector<VariantState> variants(keys.size());
+    std::vector<VkGraphicsPipelineCreateInfo> create_infos(keys.size(), pipeline_create_info);
+    
+    for (size_t i = 0; i < keys.size(); i++) {
+        const auto& key = keys[i];
+        auto& variant = variants[i];
+        
+        variant.Constants.fog = key.Fog ? VK_TRUE : VK_FALSE;
+        variant.Constants.ambientOcclusion = key.AmbientOcclusion ? VK_TRUE : VK_FALSE;
+        variant.Constants.alphaTest = key.AlphaTest ? VK_TRUE : VK_FALSE;
+        variant.Constants.bakedShading = key.Format != VertexFormat::Model ? VK_TRUE : VK_FALSE;
+        variant.Constants.fogColor[0] = SKY_COLOR.r;
+        variant.Constants.fogColor[1] = SKY_COLOR.g;
+        variant.Constants.fogColor[2] = SKY_COLOR.b;
+        
+        variant.Specialization.mapEntryCount = static_cast<uint32_t>(specialization_entries.size());
+        variant.Specialization.pMapEntries = specialization_entries.data();
+        variant.Specialization.dataSize = sizeof(SpecializationConstants);
+        variant.Specialization.pData = &variant.Constants;
+        
+        for (auto& stage : variant.Stages) {
+            stage = {};
+            stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stage.pName = "main";
+            stage.pSpecializationInfo = &variant.Specialization;
+        }
+        // Geometry stages come first so the depth pre-pass can drop the fragment stage off the end
+        uint32_t geometry_stages = 1;
+        if (key.Format == VertexFormat::MeshFace) {
+            variant.Stages[0].stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+            variant.Stages[0].module = task_shader_module;
+            variant.Stages[1].stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+            variant.Stages[1].module = mesh_shader_module;
+            geometry_stages = 2;
+        } else {
+            variant.Stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+            variant.Stages[0].module = key.Format == VertexFormat::Face ? face_shader_module : vert_shader_module;
+        }
+        variant.Stages[geometry_stages].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        variant.Stages[geometry_stages].module = key.Pass == PipelinePass::Overdraw ? overdraw_shader_module : frag_shader_module;
+        
+        variant.Rasterization = rasterization_create_info;
+        variant.DepthStencil = depth_stencil_create_info;
+        variant.BlendAttachment = color_blend_attachment;
+        variant.Blend = color_blend_create_info;
+        variant.Blend.pAttachments = &variant.BlendAttachment;
+        
+        auto& create_info = create_infos[i];
+        create_info.pVertexInputState = key.Format == VertexFormat::Face ? &face_input_create_info : &vertex_input_create_info;
+        create_info.stageCount = geometry_stages + 1;
+        create_info.pStages = variant.Stages.data();
+        create_info.pRasterizationState = &variant.Rasterization;
+        create_info.pDepthStencilState = &variant.DepthStencil;
+        create_info.pColorBlendState = &variant.Blend;
+        
+        // Mesh shaders assemble their own primitives
+        if (key.Format == VertexFormat::MeshFace) {
+            create_info.pVertexInputState = nullptr;
+            create_info.pInputAssemblyState = nullptr;
+        }
+        
+        switch (key.Pass) {
+            case PipelinePass::Opaque:
+                break;
+            
+            case PipelinePass::DepthPrepass:
+                // Lays down depth so the opaque pass shades each pixel once; alpha tested
+                // geometry needs the fragment stage to discard the same texels as the colour pass
+                create_info.stageCount = key.AlphaTest ? geometry_stages + 1 : geometry_stages;
+                variant.DepthStencil.depthCompareOp = VK_COMPARE_OP_GREATER;
+                variant.BlendAttachment.colorWriteMask = 0;
+                break;
+            
+            case PipelinePass::Transparent:
+                // Alpha blended back-to-front and does not occlude what is drawn after it
+                variant.Rasterization.cullMode = VK_CULL_MODE_NONE;
+                variant.DepthStencil.depthWriteEnable = VK_FALSE;
+                variant.BlendAttachment.blendEnable = VK_TRUE;
+                variant.BlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                variant.BlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                variant.BlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+                variant.BlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                variant.BlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                variant.BlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+                break;
+            
+            case PipelinePass::Overdraw:
+                // Every fragment that survives the depth test adds a constant to the pixel
+                variant.BlendAttachment.blendEnable = VK_TRUE;
+                variant.BlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+                variant.BlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+                variant.BlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+                variant.BlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                variant.BlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                variant.BlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+                break;
+        }
     }
     
+    // Created in one call so the driver can compile the variants in parallel and share the cache
+    std::vector<VkPipeline> created(keys.size(), VK_NULL_HANDLE);
+    VkResult result = vkCreateGraphicsPipelines(m_Device, m_PipelineCache, static_cast<uint32_t>(create_infos.size()), create_infos.data(), nullptr, created.data());
+    
     vkDestroyShaderModule(m_Device, vert_shader_module, nullptr);
     vkDestroyShaderModule(m_Device, frag_shader_module, nullptr);
+    vkDestroyShaderModule(m_Device, overdraw_shader_module, nullptr);
+    vkDestroyShaderModule(m_Device, face_shader_module, nullptr);
+    vkDestroyShaderModule(m_Device, task_shader_module, nullptr);
+    vkDestroyShaderModule(m_Device, mesh_shader_module, nullptr);
+    
+    if (result != VK_SUCCESS) {
+        for (auto pipeline : created) {
+            vkDestroyPipeline(m_Device, pipeline, nullptr);
+        }
+        std::cerr << "Failed to create graphics pipelines\n";
+        return false;
+    }
+    
+    for (size_t i = 0; i < keys.size(); i++) {
+        pipelines.Graphics[keys[i]] = created[i];
+    }
+    
+    return true;
+}
+
+bool Renderer::CreateComputePipeline() {
+    VkPipelineLayoutCreateInfo layout_create_info{};
+    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount = 1;
+    layout_create_info.pSetLayouts = &m_DescriptorSetLayout;
+    
+    if (vkCreatePipelineLayout(m_Device, &layout_create_info, nullptr, &m_ClusterPipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create light clustering pipeline layout\n";
+        return false;
+    }
+    
+    PipelineSet pipelines{};
+    if (!BuildComputePipeline(pipelines)) {
+        return false;
+    }
+    
+    m_ClusterPipeline = pipelines.Cluster;
+    m_ExpandFacesPipeline = pipelines.ExpandFaces;
+    
+    return true;
+}
+
+bool Renderer::BuildComputePipeline(PipelineSet& pipelines) const {
+    bool expands_faces = m_FaceExpansion == FaceExpansion::Compute;
+    
+    auto cluster_shader_code = ReadFile(SHADER_DIRECTORY + "/cluster_lights.spv");
+    auto expand_shader_code = expands_faces ? ReadFile(SHADER_DIRECTORY + "/expand_faces.spv") : std::vector<char>();
+    VkShaderModule cluster_shader_module = CreateShaderModule(cluster_shader_code);
+    VkShaderModule expand_shader_module = expands_faces ? CreateShaderModule(expand_shader_code) : VK_NULL_HANDLE;
+    if (cluster_shader_module == VK_NULL_HANDLE || (expands_faces && expand_shader_module == VK_NULL_HANDLE)) {
+        vkDestroyShaderModule(m_Device, cluster_shader_module, nullptr);
+        vkDestroyShaderModule(m_Device, expand_shader_module, nullptr);
+        return false;
+    }
+    
+    VkComputePipelineCreateInfo pipeline_create_info{};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_create_info.stage.module = cluster_shader_module;
+    pipeline_create_info.stage.pName = "main";
+    pipeline_create_info.layout = m_ClusterPipelineLayout;
+    
+    // Face expansion only reads the descriptor set as well, so it shares the light clustering layout
+    VkComputePipelineCreateInfo expand_pipeline_create_info = pipeline_create_info;
+    expand_pipeline_create_info.stage.module = expand_shader_module;
+    
+    std::array<VkComputePipelineCreateInfo, 2> create_infos = {pipeline_create_info, expand_pipeline_create_info};
+    std::array<VkPipeline, 2> created = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    uint32_t count = expands_faces ? 2 : 1;
+    
+    VkResult result = vkCreateComputePipelines(m_Device, m_PipelineCache, count, create_infos.data(), nullptr, created.data());
+    vkDestroyShaderModule(m_Device, cluster_shader_module, nullptr);
+    vkDestroyShaderModule(m_Device, expand_shader_module, nullptr);
+    
+    if (result != VK_SUCCESS) {
+        for (auto pipeline : created) {
+            vkDestroyPipeline(m_Device, pipeline, nullptr);
+        }
+        std::cerr << "Failed to create compute pipelines\n";
+        return false;
+    }
+    
+    pipelines.Cluster = created[0];
+    pipelines.ExpandFaces = created[1];
     
     return true;
 }
@@ -645,6 +1455,7 @@ bool Renderer::CreateCommandPool() {
     VkCommandPoolCreateInfo command_pool_create_info{};
     command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     command_pool_create_info.queueFamilyIndex = indices.GraphicsFamily.value();
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // Command buffers are re-recorded every frame
     
     if (vkCreateCommandPool(m_Device, &command_pool_create_info, nullptr, &m_CommandPool) != VK_SUCCESS) {
         std::cerr << "Failed to create command pool\n";
@@ -654,23 +1465,310 @@ bool Renderer::CreateCommandPool() {
     return true;
 }
 
-bool Renderer::CreateColorResources() {
-    VkFormat color_format = m_SwapchainImageFormat;
+bool Renderer::CreateShadowResources() {
+    m_ShadowFormat = FindSupportedFormat(
+        { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM },
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+    );
     
-    CreateImage(m_SwapchainExtent.width, m_SwapchainExtent.height, 1, m_MSAASamples, color_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_ColorImage, &m_ColorImageMemory);
-    m_ColorImageView = CreateImageView(m_ColorImage, color_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    CreateImage(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1, VK_SAMPLE_COUNT_1_BIT, m_ShadowFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_ShadowImage, &m_ShadowImageMemory, SHADOW_CASCADE_COUNT);
+    m_ShadowImageView = CreateImageView(m_ShadowImage, m_ShadowFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, SHADOW_CASCADE_COUNT);
+    if (m_ShadowImageView == VK_NULL_HANDLE) {
+        return false;
+    }
     
-    return true;
-}
-
-bool Renderer::CreateDepthResources() {
-    auto format = FindDepthFormat();
+    // Cascades are rendered in separate passes, the contents of cached ones must survive
+    VkAttachmentDescription depth_attachment{};
+    depth_attachment.format = m_ShadowFormat;
+    depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
     
-    CreateImage(m_SwapchainExtent.width, m_SwapchainExtent.height, 1, m_MSAASamples, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_DepthImage, &m_DepthImageMemory);
-    m_DepthImageView = CreateImageView(m_DepthImage, format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    VkAttachmentReference depth_attachment_ref{};
+    depth_attachment_ref.attachment = 0;
+    depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     
-    return true;
-}
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 0;
+    subpass.pDepthStencilAttachment = &depth_attachment_ref;
+    
+    // Wait for previous frames to stop sampling the cascade, then make the new depth visible to the main pass
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    
+    VkRenderPassCreateInfo render_pass_create_info{};
+    render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.attachmentCount = 1;
+    render_pass_create_info.pAttachments = &depth_attachment;
+    render_pass_create_info.subpassCount = 1;
+    render_pass_create_info.pSubpasses = &subpass;
+    render_pass_create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    render_pass_create_info.pDependencies = dependencies.data();
+    
+    if (vkCreateRenderPass(m_Device, &render_pass_create_info, nullptr, &m_ShadowRenderPass) != VK_SUCCESS) {
+        std::cerr << "Failed to create shadow render pass\n";
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        m_ShadowLayerViews[i] = CreateImageView(m_ShadowImage, m_ShadowFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, VK_IMAGE_VIEW_TYPE_2D, i, 1);
+        if (m_ShadowLayerViews[i] == VK_NULL_HANDLE) {
+            return false;
+        }
+        
+        VkFramebufferCreateInfo framebuffer_create_info{};
+        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_create_info.renderPass = m_ShadowRenderPass;
+        framebuffer_create_info.attachmentCount = 1;
+        framebuffer_create_info.pAttachments = &m_ShadowLayerViews[i];
+        framebuffer_create_info.width = SHADOW_MAP_SIZE;
+        framebuffer_create_info.height = SHADOW_MAP_SIZE;
+        framebuffer_create_info.layers = 1;
+        
+        if (vkCreateFramebuffer(m_Device, &framebuffer_create_info, nullptr, &m_ShadowFramebuffers[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create shadow framebuffer\n";
+            return false;
+        }
+    }
+    
+    VkSamplerCreateInfo sampler{};
+    sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler.magFilter = VK_FILTER_LINEAR;
+    sampler.minFilter = VK_FILTER_LINEAR;
+    sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+    sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    sampler.compareEnable = VK_TRUE;
+    sampler.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler.maxLod = 1.0f;
+    
+    if (vkCreateSampler(m_Device, &sampler, nullptr, &m_ShadowSampler) != VK_SUCCESS) {
+        std::cerr << "Failed to create shadow sampler\n";
+        return false;
+    }
+    
+    // Timestamps are optional, shadows still work when the queue cannot time them
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    if (properties.limits.timestampComputeAndGraphics) {
+        m_TimestampPeriod = properties.limits.timestampPeriod;
+        // A set of queries per frame in flight, read back once the frame's fence has signalled, so
+        // recreating the swapchain never changes how many there are
+        m_ShadowQuerySlots = MAX_FRAMES_IN_FLIGHT;
+        m_ShadowQueriesWritten.resize(m_ShadowQuerySlots);
+        
+        VkQueryPoolCreateInfo query_pool_create_info{};
+        query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_create_info.queryCount = m_ShadowQuerySlots * SHADOW_CASCADE_COUNT * 2;
+        
+        if (vkCreateQueryPool(m_Device, &query_pool_create_info, nullptr, &m_ShadowQueryPool) != VK_SUCCESS) {
+            std::cerr << "Failed to create shadow timestamp query pool\n";
+            m_ShadowQueryPool = VK_NULL_HANDLE;
+            m_ShadowQuerySlots = 0;
+        }
+    }
+    
+    return true;
+}
+
+bool Renderer::CreateShadowPipeline() {
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(ShadowPushConstants);
+    
+    // Only pulled faces read the descriptor set, for the face buffer
+    VkPipelineLayoutCreateInfo layout_create_info{};
+    layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_create_info.setLayoutCount = 1;
+    layout_create_info.pSetLayouts = &m_DescriptorSetLayout;
+    layout_create_info.pushConstantRangeCount = 1;
+    layout_create_info.pPushConstantRanges = &push_constant_range;
+    
+    if (vkCreatePipelineLayout(m_Device, &layout_create_info, nullptr, &m_ShadowPipelineLayout) != VK_SUCCESS) {
+        std::cerr << "Failed to create shadow pipeline layout\n";
+        return false;
+    }
+    
+    PipelineSet pipelines{};
+    if (!BuildShadowPipeline(pipelines)) {
+        return false;
+    }
+    
+    m_ShadowPipeline = pipelines.Shadow;
+    m_ShadowFacesPipeline = pipelines.ShadowFaces;
+    
+    return true;
+}
+
+bool Renderer::BuildShadowPipeline(PipelineSet& pipelines) const {
+    auto shadow_shader_code = ReadFile(SHADER_DIRECTORY + "/shadow.spv");
+    auto shadow_face_shader_code = m_VertexPullingEnabled ? ReadFile(SHADER_DIRECTORY + "/shadow_face.spv") : std::vector<char>();
+    VkShaderModule shadow_shader_module = CreateShaderModule(shadow_shader_code);
+    VkShaderModule shadow_face_shader_module = m_VertexPullingEnabled ? CreateShaderModule(shadow_face_shader_code) : VK_NULL_HANDLE;
+    if (shadow_shader_module == VK_NULL_HANDLE || (m_VertexPullingEnabled && shadow_face_shader_module == VK_NULL_HANDLE)) {
+        vkDestroyShaderModule(m_Device, shadow_shader_module, nullptr);
+        vkDestroyShaderModule(m_Device, shadow_face_shader_module, nullptr);
+        return false;
+    }
+    
+    VkPipelineShaderStageCreateInfo shadow_create_info{};
+    shadow_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shadow_create_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shadow_create_info.module = shadow_shader_module;
+    shadow_create_info.pName = "main";
+    
+    VkPipelineShaderStageCreateInfo shadow_face_create_info = shadow_create_info;
+    shadow_face_create_info.module = shadow_face_shader_module;
+    
+    // Only the position is consumed
+    auto binding_description = Vertex::BingindDescription();
+    auto attribute_descriptions = Vertex::AttributeDescriptions();
+    
+    VkPipelineVertexInputStateCreateInfo vertex_input_create_info{};
+    vertex_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_create_info.vertexBindingDescriptionCount = 1;
+    vertex_input_create_info.pVertexBindingDescriptions = &binding_description;
+    vertex_input_create_info.vertexAttributeDescriptionCount = 1;
+    vertex_input_create_info.pVertexAttributeDescriptions = &attribute_descriptions[0];
+    
+    VkPipelineVertexInputStateCreateInfo face_input_create_info{};
+    face_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_create_info{};
+    input_assembly_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly_create_info.primitiveRestartEnable = VK_FALSE;
+    
+    VkViewport viewport{};
+    viewport.x = 0;
+    viewport.y = 0;
+    viewport.width = static_cast<float>(SHADOW_MAP_SIZE);
+    viewport.height = static_cast<float>(SHADOW_MAP_SIZE);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    
+    VkRect2D scissors{};
+    scissors.offset = {0, 0};
+    scissors.extent = {SHADOW_MAP_SIZE, SHADOW_MAP_SIZE};
+    
+    VkPipelineViewportStateCreateInfo viewport_state_create_info{};
+    viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state_create_info.viewportCount = 1;
+    viewport_state_create_info.pViewports = &viewport;
+    viewport_state_create_info.scissorCount = 1;
+    viewport_state_create_info.pScissors = &scissors;
+    
+    // Blocks are closed, rendering both faces avoids light leaking through single sided geometry
+    VkPipelineRasterizationStateCreateInfo rasterization_create_info{};
+    rasterization_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization_create_info.depthClampEnable = VK_FALSE;
+    rasterization_create_info.rasterizerDiscardEnable = VK_FALSE;
+    rasterization_create_info.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization_create_info.lineWidth = 1.0f;
+    rasterization_create_info.cullMode = VK_CULL_MODE_NONE;
+    rasterization_create_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterization_create_info.depthBiasEnable = VK_TRUE;
+    rasterization_create_info.depthBiasConstantFactor = 1.25f;
+    rasterization_create_info.depthBiasSlopeFactor = 1.75f;
+    
+    VkPipelineMultisampleStateCreateInfo multisampling_create_info{};
+    multisampling_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling_create_info.sampleShadingEnable = VK_FALSE;
+    multisampling_create_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_create_info{};
+    depth_stencil_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_create_info.depthTestEnable = VK_TRUE;
+    depth_stencil_create_info.depthWriteEnable = VK_TRUE;
+    depth_stencil_create_info.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil_create_info.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil_create_info.stencilTestEnable = VK_FALSE;
+    
+    VkPipelineColorBlendStateCreateInfo color_blend_create_info{};
+    color_blend_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend_create_info.logicOpEnable = VK_FALSE;
+    color_blend_create_info.attachmentCount = 0;
+    
+    VkGraphicsPipelineCreateInfo pipeline_create_info{};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stageCount = 1;
+    pipeline_create_info.pStages = &shadow_create_info;
+    pipeline_create_info.pVertexInputState = &vertex_input_create_info;
+    pipeline_create_info.pInputAssemblyState = &input_assembly_create_info;
+    pipeline_create_info.pViewportState = &viewport_state_create_info;
+    pipeline_create_info.pRasterizationState = &rasterization_create_info;
+    pipeline_create_info.pMultisampleState = &multisampling_create_info;
+    pipeline_create_info.pColorBlendState = &color_blend_create_info;
+    pipeline_create_info.pDepthStencilState = &depth_stencil_create_info;
+    pipeline_create_info.layout = m_ShadowPipelineLayout;
+    pipeline_create_info.renderPass = m_ShadowRenderPass;
+    pipeline_create_info.subpass = 0;
+    
+    VkGraphicsPipelineCreateInfo face_pipeline_create_info = pipeline_create_info;
+    face_pipeline_create_info.pStages = &shadow_face_create_info;
+    face_pipeline_create_info.pVertexInputState = &face_input_create_info;
+    
+    std::array<VkGraphicsPipelineCreateInfo, 2> create_infos = {pipeline_create_info, face_pipeline_create_info};
+    std::array<VkPipeline, 2> created = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    uint32_t count = m_VertexPullingEnabled ? 2 : 1;
+    
+    VkResult result = vkCreateGraphicsPipelines(m_Device, m_PipelineCache, count, create_infos.data(), nullptr, created.data());
+    vkDestroyShaderModule(m_Device, shadow_shader_module, nullptr);
+    vkDestroyShaderModule(m_Device, shadow_face_shader_module, nullptr);
+    
+    if (result != VK_SUCCESS) {
+        for (auto pipeline : created) {
+            vkDestroyPipeline(m_Device, pipeline, nullptr);
+        }
+        std::cerr << "Failed to create shadow pipeline\n";
+        return false;
+    }
+    
+    pipelines.Shadow = created[0];
+    pipelines.ShadowFaces = created[1];
+    return true;
+}
+
+bool Renderer::CreateColorResources() {
+    VkFormat color_format = m_SwapchainImageFormat;
+    
+    CreateImage(m_SwapchainExtent.width, m_SwapchainExtent.height, 1, m_MSAASamples, color_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_ColorImage, &m_ColorImageMemory);
+    m_ColorImageView = CreateImageView(m_ColorImage, color_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    
+    return true;
+}
+
+bool Renderer::CreateDepthResources() {
+    auto format = FindDepthFormat();
+    
+    // Never stored or sampled, like the multisampled colour image
+    CreateImage(m_SwapchainExtent.width, m_SwapchainExtent.height, 1, m_MSAASamples, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &m_DepthImage, &m_DepthImageMemory);
+    m_DepthImageView = CreateImageView(m_DepthImage, format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+    
+    return true;
+}
 
 bool Renderer::CreateTextureImage() {
     int width, height, channels;
@@ -743,47 +1841,16 @@ bool Renderer::CreateTextureSampler() {
 }
 
 bool Renderer::LoadModel() {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn;
-    std::string err;
-    
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-        std::cerr << "Failed to load object\n";
+    if (!ModelLoader().Load(MODEL_PATH, m_Model)) {
+        std::cerr << "Failed to load model\n";
         return false;
     }
     
-    std::unordered_map<Vertex, uint32_t> unique_vertices;
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            Vertex vertex{};
-            
-            vertex.Position = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
-            
-            vertex.TextureCoordinate = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
-            
-            if (unique_vertices.count(vertex) == 0) {
-                unique_vertices[vertex] = static_cast<uint32_t>(m_Vertices.size());
-                m_Vertices.push_back(vertex);
-            }
-            
-            m_Indices.push_back(unique_vertices[vertex]);
-        }
-    }
-    
     return true;
 }
 
 bool Renderer::CreateVertexBuffer() {
-    VkDeviceSize size = sizeof(m_Vertices[0]) * m_Vertices.size();
+    VkDeviceSize size = m_Model.VertexDataSize();
     
     VkBuffer staging_buffer;
     VkDeviceMemory staging_buffer_memory;
@@ -798,7 +1865,7 @@ bool Renderer::CreateVertexBuffer() {
     
     void* data;
     vkMapMemory(m_Device, staging_buffer_memory, 0, size, 0, &data);
-    memcpy(data, m_Vertices.data(), size);
+    memcpy(data, m_Model.VertexData(), size);
     vkUnmapMemory(m_Device, staging_buffer_memory);
     
     if (!CreateBuffer(size,
@@ -819,7 +1886,7 @@ bool Renderer::CreateVertexBuffer() {
 }
 
 bool Renderer::CreateIndexBuffer() {
-    VkDeviceSize size = sizeof(m_Indices[0]) * m_Indices.size();
+    VkDeviceSize size = m_Model.IndexDataSize();
     
     VkBuffer staging_buffer;
     VkDeviceMemory staging_buffer_memory;
@@ -834,7 +1901,7 @@ bool Renderer::CreateIndexBuffer() {
     
     void* data;
     vkMapMemory(m_Device, staging_buffer_memory, 0, size, 0, &data);
-    memcpy(data, m_Indices.data(), size);
+    memcpy(data, m_Model.IndexData(), size);
     vkUnmapMemory(m_Device, staging_buffer_memory);
     
     if (!CreateBuffer(size,
@@ -854,6 +1921,65 @@ bool Renderer::CreateIndexBuffer() {
     return true;
 }
 
+bool Renderer::CreateQuadIndexBuffers() {
+    std::vector<uint32_t> indices;
+    indices.reserve(6 * MAX_CHUNK_QUADS);
+    for (uint32_t quad = 0; quad < MAX_CHUNK_QUADS; quad++) {
+        for (uint32_t index : { 0u, 1u, 2u, 2u, 3u, 0u }) {
+            indices.push_back(4 * quad + index);
+        }
+    }
+    
+    std::vector<uint16_t> short_indices(indices.begin(), indices.begin() + 6 * std::min(MAX_SHORT_INDEX_QUADS, MAX_CHUNK_QUADS));
+    
+    if (!CreateDeviceLocalBuffer(short_indices.data(), sizeof(short_indices[0]) * short_indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &m_ShortQuadIndexBuffer, &m_ShortQuadIndexBufferMemory)
+        || !CreateDeviceLocalBuffer(indices.data(), sizeof(indices[0]) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &m_QuadIndexBuffer, &m_QuadIndexBufferMemory)) {
+        std::cerr << "Failed to create quad index buffers\n";
+        return false;
+    }
+    
+    return true;
+}
+
+bool Renderer::CreateFaceBuffer() {
+    if (!m_VertexPullingEnabled) {
+        return true;
+    }
+    
+    if (!CreateBuffer(sizeof(PackedFace) * FACE_BUFFER_CAPACITY,
+                      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                      &m_FaceBuffer,
+                      &m_FaceBufferMemory)) {
+        std::cerr << "Failed to create face buffer\n";
+        return false;
+    }
+    
+    m_FreeFaces[0] = FACE_BUFFER_CAPACITY;
+    return true;
+}
+
+bool Renderer::CreateScene() {
+    DrawCall block{};
+    block.VertexBuffer = m_VertexBuffer;
+    block.IndexBuffer = m_IndexBuffer;
+    block.IndexCount = m_Model.GetHeader().IndexCount;
+    block.IndexType = m_Model.GetHeader().IndexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    block.Model = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    block.Center = glm::vec3(0.0f, 1.0f, 0.0f);
+    block.Radius = std::sqrt(3.0f);
+    block.Transparent = false;
+    block.AlphaTest = false;
+    block.Format = VertexFormat::Model;
+    
+    m_DrawCalls.push_back(block);
+    
+    // Everything the scene needs from the model now lives in device memory
+    m_Model.Close();
+    
+    return true;
+}
+
 bool Renderer::CreateUniformBuffers() {
     VkDeviceSize size = sizeof(UniformBufferObject);
     
@@ -867,73 +1993,145 @@ bool Renderer::CreateUniformBuffers() {
     return true;
 }
 
-bool Renderer::CreateDescriptorPool() {
-    std::array<VkDescriptorPoolSize, 2> sizes;
-    sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    sizes[0].descriptorCount = static_cast<uint32_t>(m_SwapchainImages.size());
-    sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    sizes[1].descriptorCount = static_cast<uint32_t>(m_SwapchainImages.size());
-    
-    VkDescriptorPoolCreateInfo descriptor_pool{};
-    descriptor_pool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptor_pool.poolSizeCount = static_cast<uint32_t>(sizes.size());
-    descriptor_pool.pPoolSizes = sizes.data();
-    descriptor_pool.maxSets = static_cast<uint32_t>(m_SwapchainImages.size());
+bool Renderer::CreateLightBuffers() {
+    m_LightBuffers.resize(m_SwapchainImages.size());
+    m_LightBuffersMemory.resize(m_SwapchainImages.size());
+    m_ClusterBuffers.resize(m_SwapchainImages.size());
+    m_ClusterBuffersMemory.resize(m_SwapchainImages.size());
+    m_LightIndexBuffers.resize(m_SwapchainImages.size());
+    m_LightIndexBuffersMemory.resize(m_SwapchainImages.size());
+    
+    // Light index list is prefixed with the atomic counter used to allocate ranges
+    VkDeviceSize lights_size = sizeof(PointLight) * MAX_LIGHTS;
+    VkDeviceSize clusters_size = sizeof(LightCluster) * CLUSTER_COUNT;
+    VkDeviceSize light_indices_size = sizeof(uint32_t) * (1 + CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
     
-    if (vkCreateDescriptorPool(m_Device, &descriptor_pool, nullptr, &m_DescriptorPool) != VK_SUCCESS) {
-        std::cerr << "Failed to create descriptor pool\n";
-        return false;
+    for (size_t i = 0; i < m_SwapchainImages.size(); i++) {
+        if (!CreateBuffer(lights_size,
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                          &m_LightBuffers[i],
+                          &m_LightBuffersMemory[i])
+            || !CreateBuffer(clusters_size,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             &m_ClusterBuffers[i],
+                             &m_ClusterBuffersMemory[i])
+            || !CreateBuffer(light_indices_size,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             &m_LightIndexBuffers[i],
+                             &m_LightIndexBuffersMemory[i])) {
+            std::cerr << "Failed to create light buffers\n";
+            return false;
+        }
     }
     
     return true;
 }
 
-bool Renderer::CreateDescriptorSet() {
-    std::vector<VkDescriptorSetLayout> layouts(m_SwapchainImages.size(), m_DescriptorSetLayout);
+bool Renderer::CreateFaceExpansionBuffers() {
+    m_ExpandedVertexBuffers.clear();
+    m_ExpandedVertexBuffersMemory.clear();
+    m_FaceJobBuffers.clear();
+    m_FaceJobBuffersMemory.clear();
+    if (m_FaceExpansion != FaceExpansion::Compute) {
+        return true;
+    }
+    
+    m_ExpandedVertexBuffers.resize(m_SwapchainImages.size());
+    m_ExpandedVertexBuffersMemory.resize(m_SwapchainImages.size());
+    m_FaceJobBuffers.resize(m_SwapchainImages.size());
+    m_FaceJobBuffersMemory.resize(m_SwapchainImages.size());
     
-    VkDescriptorSetAllocateInfo descriptor_set{};
-    descriptor_set.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    descriptor_set.descriptorPool = m_DescriptorPool;
-    descriptor_set.descriptorSetCount = static_cast<uint32_t>(m_SwapchainImages.size());
-    descriptor_set.pSetLayouts = layouts.data();
+    VkDeviceSize vertices_size = sizeof(Vertex) * 4 * FACE_EXPANSION_QUAD_CAPACITY;
+    VkDeviceSize jobs_size = sizeof(FaceExpansionJob) * MAX_FACE_EXPANSION_JOBS;
+    
+    for (size_t i = 0; i < m_SwapchainImages.size(); i++) {
+        if (!CreateBuffer(vertices_size,
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                          &m_ExpandedVertexBuffers[i],
+                          &m_ExpandedVertexBuffersMemory[i])
+            || !CreateBuffer(jobs_size,
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             &m_FaceJobBuffers[i],
+                             &m_FaceJobBuffersMemory[i])) {
+            std::cerr << "Failed to create face expansion buffers\n";
+            return false;
+        }
+    }
     
-    m_DescriptorSets.resize(m_SwapchainImages.size());
-    if (vkAllocateDescriptorSets(m_Device, &descriptor_set, m_DescriptorSets.data()) != VK_SUCCESS) {
-        std::cerr << "Failed to allocate descriptor sets\n";
+    return true;
+}
+
+bool Renderer::CreateDescriptorAllocator() {
+    // Created once, unlike the buffers the sets point at, which come and go with the swapchain
+    std::vector<VkDescriptorPoolSize> set_sizes = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 }
+    };
+    
+    if (!m_DescriptorAllocator.Initialize(m_Device, MAX_FRAMES_IN_FLIGHT, set_sizes)) {
         return false;
     }
     
-    for (size_t i = 0; i < m_SwapchainImages.size(); i++) {
-        VkDescriptorBufferInfo descriptor_buffer{};
-        descriptor_buffer.buffer = m_UniformBuffers[i];
-        descriptor_buffer.offset = 0;
-        descriptor_buffer.range = sizeof(UniformBufferObject);
-        
-        VkDescriptorImageInfo descriptor_image{};
-        descriptor_image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        descriptor_image.imageView = m_TextureImageView;
-        descriptor_image.sampler = m_Sampler;
-        
-        std::array<VkWriteDescriptorSet, 2> write_descriptors{};
-        write_descriptors[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_descriptors[0].dstSet = m_DescriptorSets[i];
-        write_descriptors[0].dstBinding = 0;
-        write_descriptors[0].dstArrayElement = 0;
-        write_descriptors[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        write_descriptors[0].descriptorCount = 1;
-        write_descriptors[0].pBufferInfo = &descriptor_buffer;
-        
-        write_descriptors[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write_descriptors[1].dstSet = m_DescriptorSets[i];
-        write_descriptors[1].dstBinding = 1;
-        write_descriptors[1].dstArrayElement = 0;
-        write_descriptors[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        write_descriptors[1].descriptorCount = 1;
-        write_descriptors[1].pImageInfo = &descriptor_image;
-        
-        vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(write_descriptors.size()), write_descriptors.data(), 0, nullptr);
+    auto entry = [](uint32_t binding, VkDescriptorType type, size_t offset) {
+        VkDescriptorUpdateTemplateEntry template_entry{};
+        template_entry.dstBinding = binding;
+        template_entry.dstArrayElement = 0;
+        template_entry.descriptorCount = 1;
+        template_entry.descriptorType = type;
+        template_entry.offset = offset;
+        template_entry.stride = type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ? sizeof(VkDescriptorImageInfo) : sizeof(VkDescriptorBufferInfo);
+        return template_entry;
+    };
+    
+    std::vector<VkDescriptorUpdateTemplateEntry> entries = {
+        entry(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(FrameDescriptors, Uniforms)),
+        entry(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(FrameDescriptors, Texture)),
+        entry(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(FrameDescriptors, Lights)),
+        entry(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(FrameDescriptors, Clusters)),
+        entry(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(FrameDescriptors, LightIndices)),
+        entry(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(FrameDescriptors, Shadow))
+    };
+    
+    // No pipeline reads the face bindings without their buffers
+    if (m_FaceBuffer != VK_NULL_HANDLE) {
+        entries.push_back(entry(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(FrameDescriptors, Faces)));
+    }
+    if (m_FaceExpansion == FaceExpansion::Compute) {
+        entries.push_back(entry(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(FrameDescriptors, FaceJobs)));
+        entries.push_back(entry(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(FrameDescriptors, ExpandedVertices)));
     }
     
+    return m_FrameDescriptorTemplate.Create(m_Device, m_DescriptorSetLayout, entries, m_UpdateTemplatesSupported);
+}
+
+bool Renderer::UpdateFrameDescriptors(uint32_t index) {
+    // The frame's fence has been waited on, nothing still reads the sets it allocated last time round
+    m_DescriptorAllocator.BeginFrame(static_cast<uint32_t>(m_CurrentFrame));
+    m_FrameDescriptorSet = m_DescriptorAllocator.Allocate(m_DescriptorSetLayout);
+    if (m_FrameDescriptorSet == VK_NULL_HANDLE) {
+        return false;
+    }
+    
+    bool expands_faces = !m_FaceJobBuffers.empty();
+    
+    FrameDescriptors descriptors{};
+    descriptors.Uniforms = { m_UniformBuffers[index], 0, sizeof(UniformBufferObject) };
+    descriptors.Texture = { m_Sampler, m_TextureImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    descriptors.Lights = { m_LightBuffers[index], 0, VK_WHOLE_SIZE };
+    descriptors.Clusters = { m_ClusterBuffers[index], 0, VK_WHOLE_SIZE };
+    descriptors.LightIndices = { m_LightIndexBuffers[index], 0, VK_WHOLE_SIZE };
+    descriptors.Shadow = { m_ShadowSampler, m_ShadowImageView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+    descriptors.Faces = { m_FaceBuffer, 0, VK_WHOLE_SIZE };
+    descriptors.FaceJobs = { expands_faces ? m_FaceJobBuffers[index] : VK_NULL_HANDLE, 0, VK_WHOLE_SIZE };
+    descriptors.ExpandedVertices = { expands_faces ? m_ExpandedVertexBuffers[index] : VK_NULL_HANDLE, 0, VK_WHOLE_SIZE };
+    
+    m_FrameDescriptorTemplate.Update(m_FrameDescriptorSet, &descriptors);
     return true;
 }
 
@@ -951,42 +2149,302 @@ bool Renderer::CreateCommandBuffers() {
         return false;
     }
     
-    for (size_t i = 0; i < m_CommandBuffers.size(); i++) {
-        VkCommandBufferBeginInfo command_buffer_begin_info{};
-        command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    return true;
+}
+
+void Renderer::SortDrawCalls() {
+    m_OpaqueOrder.clear();
+    m_TransparentOrder.clear();
+    
+    std::vector<float> distances(m_DrawCalls.size());
+    for (uint32_t i = 0; i < m_DrawCalls.size(); i++) {
+        const auto& draw = m_DrawCalls[i];
+        glm::vec3 center = glm::vec3(draw.Model * glm::vec4(draw.Center, 1.0f));
+        glm::vec3 offset = center - m_CameraPosition;
+        distances[i] = glm::dot(offset, offset);
         
-        if (vkBeginCommandBuffer(m_CommandBuffers[i], &command_buffer_begin_info) != VK_SUCCESS) {
-            std::cerr << "Failed to begin command buffer\n";
-            return false;
+        (draw.Transparent ? m_TransparentOrder : m_OpaqueOrder).push_back(i);
+    }
+    
+    // Opaque front-to-back so early depth testing rejects hidden fragments, transparent back-to-front for correct blending
+    std::sort(m_OpaqueOrder.begin(), m_OpaqueOrder.end(), [&](uint32_t a, uint32_t b) { return distances[a] < distances[b]; });
+    std::sort(m_TransparentOrder.begin(), m_TransparentOrder.end(), [&](uint32_t a, uint32_t b) { return distances[a] > distances[b]; });
+}
+
+bool Renderer::RecordCommandBuffer(uint32_t index) {
+    VkCommandBuffer command_buffer = m_CommandBuffers[index];
+    
+    VkCommandBufferBeginInfo command_buffer_begin_info{};
+    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    
+    if (vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+        std::cerr << "Failed to begin command buffer\n";
+        return false;
+    }
+    
+    std::array<VkClearValue, 2> clear_values{};
+    clear_values[0] = {SKY_COLOR.r, SKY_COLOR.g, SKY_COLOR.b, 1.0f};
+    clear_values[1] = {0.0f, 0}; // Reverse Z, infinitely far
+    
+    VkRenderPassBeginInfo render_pass_begin_info{};
+    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_begin_info.renderPass = m_RenderPass;
+    render_pass_begin_info.framebuffer = m_SwapchainFramebuffers[index];
+    render_pass_begin_info.renderArea.offset = {0, 0};
+    render_pass_begin_info.renderArea.extent = m_SwapchainExtent;
+    render_pass_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+    render_pass_begin_info.pClearValues = clear_values.data();
+    
+    SortDrawCalls();
+    RecordShadowPasses(command_buffer, static_cast<uint32_t>(m_CurrentFrame));
+    RecordLightCulling(command_buffer, index);
+    RecordFaceExpansion(command_buffer, index);
+    
+    vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_FrameDescriptorSet, 0, nullptr);
+    
+    if (m_DepthPrepassEnabled) {
+        RecordDrawCalls(command_buffer, index, m_OpaqueOrder, PipelinePass::DepthPrepass);
+    }
+    RecordDrawCalls(command_buffer, index, m_OpaqueOrder, m_OverdrawVisualisation ? PipelinePass::Overdraw : PipelinePass::Opaque);
+    RecordDrawCalls(command_buffer, index, m_TransparentOrder, m_OverdrawVisualisation ? PipelinePass::Overdraw : PipelinePass::Transparent);
+    
+    vkCmdEndRenderPass(command_buffer);
+    
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        std::cerr << "Failed to record command buffer\n";
+        return false;
+    }
+    
+    return true;
+}
+
+bool Renderer::RecordPresentOnly(uint32_t index) {
+    VkCommandBuffer command_buffer = m_CommandBuffers[index];
+    
+    // A failed recording can leave the buffer in the recording state, which begin does not accept
+    VkCommandBufferBeginInfo command_buffer_begin_info{};
+    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    
+    if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS || vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info) != VK_SUCCESS) {
+        std::cerr << "Failed to begin command buffer\n";
+        return false;
+    }
+    
+    // Coming from undefined may discard the contents, the frame can show garbage
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = m_SwapchainImages[index];
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        std::cerr << "Failed to record command buffer\n";
+        return false;
+    }
+    
+    // Shadow timestamps the failed recording meant to write never run
+    if (m_CurrentFrame < m_ShadowQuerySlots) {
+        m_ShadowQueriesWritten[m_CurrentFrame].fill(false);
+    }
+    return true;
+}
+
+void Renderer::RecordShadowPasses(VkCommandBuffer command_buffer, uint32_t frame) {
+    bool timed = m_ShadowQueryPool != VK_NULL_HANDLE && frame < m_ShadowQuerySlots;
+    uint32_t first_query = frame * SHADOW_CASCADE_COUNT * 2;
+    if (timed) {
+        vkCmdResetQueryPool(command_buffer, m_ShadowQueryPool, first_query, SHADOW_CASCADE_COUNT * 2);
+    }
+    
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        auto& cascade = m_ShadowCascades[i];
+        cascade.Recorded = cascade.Dirty;
+        if (timed) {
+            m_ShadowQueriesWritten[frame][i] = cascade.Dirty;
         }
         
-        std::array<VkClearValue, 2> clear_values{};
-        clear_values[0] = {0.0f, 0.0f, 0.0f, 1.0f};
-        clear_values[1] = {1.0f, 0};
+        if (!cascade.Dirty) {
+            continue;
+        }
+        
+        if (timed) {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_ShadowQueryPool, first_query + i * 2);
+        }
+        
+        VkClearValue clear_value{};
+        clear_value.depthStencil = {1.0f, 0};
         
         VkRenderPassBeginInfo render_pass_begin_info{};
         render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        render_pass_begin_info.renderPass = m_RenderPass;
-        render_pass_begin_info.framebuffer = m_SwapchainFramebuffers[i];
+        render_pass_begin_info.renderPass = m_ShadowRenderPass;
+        render_pass_begin_info.framebuffer = m_ShadowFramebuffers[i];
         render_pass_begin_info.renderArea.offset = {0, 0};
-        render_pass_begin_info.renderArea.extent = m_SwapchainExtent;
-        render_pass_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
-        render_pass_begin_info.pClearValues = clear_values.data();
+        render_pass_begin_info.renderArea.extent = {SHADOW_MAP_SIZE, SHADOW_MAP_SIZE};
+        render_pass_begin_info.clearValueCount = 1;
+        render_pass_begin_info.pClearValues = &clear_value;
+        
+        vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_ShadowPipelineLayout, 0, 1, &m_FrameDescriptorSet, 0, nullptr);
+        VkPipeline bound_pipeline = VK_NULL_HANDLE;
+        
+        for (auto draw_index : m_OpaqueOrder) {
+            const auto& draw = m_DrawCalls[draw_index];
+            glm::vec3 center = glm::vec3(draw.Model * glm::vec4(draw.Center, 1.0f));
+            if (glm::length(center - cascade.Center) > 3.0f * cascade.Radius + draw.Radius) {
+                continue;
+            }
+            
+            VkPipeline pipeline = draw.Format == VertexFormat::Face ? m_ShadowFacesPipeline : m_ShadowPipeline;
+            if (pipeline != bound_pipeline) {
+                vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                bound_pipeline = pipeline;
+            }
+            
+            if (draw.VertexBuffer != VK_NULL_HANDLE) {
+                VkDeviceSize offset = 0;
+                vkCmdBindVertexBuffers(command_buffer, 0, 1, &draw.VertexBuffer, &offset);
+            }
+            vkCmdBindIndexBuffer(command_buffer, draw.IndexBuffer, 0, draw.IndexType);
+            
+            ShadowPushConstants constants{};
+            constants.model = draw.Model;
+            constants.viewProjection = cascade.ViewProjection;
+            vkCmdPushConstants(command_buffer, m_ShadowPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+            vkCmdDrawIndexed(command_buffer, draw.IndexCount, 1, 0, draw.VertexOffset, 0);
+        }
+        
+        vkCmdEndRenderPass(command_buffer);
+        
+        if (timed) {
+            vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_ShadowQueryPool, first_query + i * 2 + 1);
+        }
+    }
+}
+
+void Renderer::CollectShadowTimings(uint32_t frame) {
+    if (m_ShadowQueryPool == VK_NULL_HANDLE || frame >= m_ShadowQuerySlots) {
+        return;
+    }
+    
+    // Called once the frame's previous submission has finished, so results are available without waiting
+    for (uint32_t i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+        if (!m_ShadowQueriesWritten[frame][i]) {
+            continue;
+        }
         
-        vkCmdBeginRenderPass(m_CommandBuffers[i], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(m_CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
+        std::array<uint64_t, 2> timestamps{};
+        uint32_t first_query = frame * SHADOW_CASCADE_COUNT * 2 + i * 2;
+        if (vkGetQueryPoolResults(m_Device, m_ShadowQueryPool, first_query, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            m_ShadowTimeAccumulator[i] += (timestamps[1] - timestamps[0]) * m_TimestampPeriod / 1e6;
+            m_ShadowRenderCount[i]++;
+        }
         
-        VkBuffer vertex_buffers[] = { m_VertexBuffer };
-        VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(m_CommandBuffers[i], 0, 1, vertex_buffers, offsets);
-        vkCmdBindIndexBuffer(m_CommandBuffers[i], m_IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        m_ShadowQueriesWritten[frame][i] = false;
+    }
+}
+
+void Renderer::RecordLightCulling(VkCommandBuffer command_buffer, uint32_t index) const {
+    // Reset the light index allocator before binning
+    vkCmdFillBuffer(command_buffer, m_LightIndexBuffers[index], 0, sizeof(uint32_t), 0);
+    
+    VkMemoryBarrier reset_barrier{};
+    reset_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    reset_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &reset_barrier, 0, nullptr, 0, nullptr);
+    
+    // One invocation per cluster, see local_size_x in cluster_lights.comp
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ClusterPipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ClusterPipelineLayout, 0, 1, &m_FrameDescriptorSet, 0, nullptr);
+    vkCmdDispatch(command_buffer, (CLUSTER_COUNT + 63) / 64, 1, 1);
+    
+    VkMemoryBarrier cluster_barrier{};
+    cluster_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cluster_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cluster_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &cluster_barrier, 0, nullptr, 0, nullptr);
+}
+
+void Renderer::RecordFaceExpansion(VkCommandBuffer command_buffer, uint32_t index) {
+    m_ExpandedDraws.assign(m_DrawCalls.size(), ExpandedDraw{});
+    if (m_FaceExpansion == FaceExpansion::VertexShader) {
+        return;
+    }
+    
+    // Only chunks in view are expanded; shadow passes keep pulling positions with shadow_face.vert
+    // since cached cascades cover chunks outside the view
+    std::vector<FaceExpansionJob> jobs;
+    uint32_t quad_count = 0;
+    for (uint32_t i = 0; i < m_DrawCalls.size(); i++) {
+        const auto& draw = m_DrawCalls[i];
+        if (draw.Format != VertexFormat::Face) {
+            continue;
+        }
+        
+        auto& expanded = m_ExpandedDraws[i];
+        expanded.Visible = IsSphereVisible(glm::vec3(draw.Model * glm::vec4(draw.Center, 1.0f)), draw.Radius);
+        if (!expanded.Visible || m_FaceExpansion != FaceExpansion::Compute) {
+            continue;
+        }
+        
+        // Faces that do not fit this frame are pulled by face.vert instead
+        uint32_t face_count = draw.IndexCount / 6;
+        if (jobs.size() == MAX_FACE_EXPANSION_JOBS || quad_count + face_count > FACE_EXPANSION_QUAD_CAPACITY) {
+            continue;
+        }
         
-        vkCmdBindDescriptorSets(m_CommandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_DescriptorSets[i], 0, nullptr);
-        vkCmdDrawIndexed(m_CommandBuffers[i], static_cast<uint32_t>(m_Indices.size()), 1, 0, 0, 0);
-        vkCmdEndRenderPass(m_CommandBuffers[i]);
+        FaceExpansionJob job{};
+        job.FirstFace = static_cast<uint32_t>(draw.VertexOffset / 4);
+        job.FaceCount = face_count;
+        job.FirstQuad = quad_count;
+        jobs.push_back(job);
         
-        if (vkEndCommandBuffer(m_CommandBuffers[i]) != VK_SUCCESS) {
-            std::cerr << "Failed to record command buffer\n";
+        expanded.FirstQuad = quad_count;
+        quad_count += face_count;
+    }
+    
+    if (jobs.empty()) {
+        return;
+    }
+    
+    VkDeviceSize size = sizeof(FaceExpansionJob) * jobs.size();
+    
+    void* data;
+    vkMapMemory(m_Device, m_FaceJobBuffersMemory[index], 0, size, 0, &data);
+    memcpy(data, jobs.data(), size);
+    vkUnmapMemory(m_Device, m_FaceJobBuffersMemory[index]);
+    
+    // One work group per job, see expand_faces.comp
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ExpandFacesPipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ClusterPipelineLayout, 0, 1, &m_FrameDescriptorSet, 0, nullptr);
+    vkCmdDispatch(command_buffer, static_cast<uint32_t>(jobs.size()), 1, 1);
+    
+    VkMemoryBarrier vertex_barrier{};
+    vertex_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    vertex_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vertex_barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &vertex_barrier, 0, nullptr, 0, nullptr);
+}
+
+bool Renderer::IsSphereVisible(const glm::vec3& center, float radius) const {
+    // Side planes of the view frustum from the rows of the view projection matrix. The projection is infinite
+    // and the near plane sits right at the camera, so neither of them culls anything worth the test.
+    glm::vec4 x_row = glm::vec4(m_ViewProjection[0][0], m_ViewProjection[1][0], m_ViewProjection[2][0], m_ViewProjection[3][0]);
+    glm::vec4 y_row = glm::vec4(m_ViewProjection[0][1], m_ViewProjection[1][1], m_ViewProjection[2][1], m_ViewProjection[3][1]);
+    glm::vec4 w_row = glm::vec4(m_ViewProjection[0][3], m_ViewProjection[1][3], m_ViewProjection[2][3], m_ViewProjection[3][3]);
+    
+    for (const auto& plane : { w_row + x_row, w_row - x_row, w_row + y_row, w_row - y_row }) {
+        float length = glm::length(glm::vec3(plane));
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius * length) {
             return false;
         }
     }
@@ -994,6 +2452,103 @@ bool Renderer::CreateCommandBuffers() {
     return true;
 }
 
+void Renderer::RecordDrawCalls(VkCommandBuffer command_buffer, uint32_t index, const std::vector<uint32_t>& order, PipelinePass pass) {
+    VkPipeline bound_pipeline = VK_NULL_HANDLE;
+    VkBuffer bound_vertex_buffer = VK_NULL_HANDLE;
+    VkBuffer bound_index_buffer = VK_NULL_HANDLE;
+    
+    for (auto i : order) {
+        DrawCall draw = m_DrawCalls[i];
+        
+        // Pulled faces are drawn the way RecordFaceExpansion prepared them for this frame
+        if (draw.Format == VertexFormat::Face) {
+            const auto& expanded = m_ExpandedDraws[i];
+            if (!expanded.Visible) {
+                continue;
+            }
+            
+            if (m_FaceExpansion == FaceExpansion::MeshShader) {
+                draw.Format = VertexFormat::MeshFace;
+            } else if (expanded.FirstQuad != UINT32_MAX) {
+                draw.Format = VertexFormat::Chunk;
+                draw.VertexBuffer = m_ExpandedVertexBuffers[index];
+                draw.VertexOffset = static_cast<int32_t>(expanded.FirstQuad * 4);
+            }
+        }
+        
+        PipelineKey key{};
+        key.Pass = pass;
+        key.Format = draw.Format;
+        key.Fog = m_FogEnabled;
+        key.AmbientOcclusion = m_AmbientOcclusionEnabled;
+        key.AlphaTest = draw.AlphaTest;
+        
+        VkPipeline pipeline = GetGraphicsPipeline(key);
+        if (pipeline == VK_NULL_HANDLE) {
+            continue;
+        }
+        
+        if (pipeline != bound_pipeline) {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            bound_pipeline = pipeline;
+        }
+        
+        if (draw.Format == VertexFormat::MeshFace) {
+            // Transparent faces are seen from both sides, like the culling mode of the transparent pipelines
+            MeshPushConstants constants{};
+            constants.model = draw.Model;
+            constants.firstFace = static_cast<uint32_t>(draw.VertexOffset / 4);
+            constants.faceCount = draw.IndexCount / 6;
+            constants.backFaceCulling = pass != PipelinePass::Transparent ? VK_TRUE : VK_FALSE;
+            vkCmdPushConstants(command_buffer, m_PipelineLayout, m_PushConstantStages, 0, sizeof(constants), &constants);
+            m_CmdDrawMeshTasks(command_buffer, (constants.faceCount + MESH_SHADER_GROUP_FACES - 1) / MESH_SHADER_GROUP_FACES, 1, 1);
+            continue;
+        }
+        
+        if (draw.VertexBuffer != bound_vertex_buffer && draw.VertexBuffer != VK_NULL_HANDLE) {
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(command_buffer, 0, 1, &draw.VertexBuffer, &offset);
+            bound_vertex_buffer = draw.VertexBuffer;
+        }
+        
+        if (draw.IndexBuffer != bound_index_buffer) {
+            vkCmdBindIndexBuffer(command_buffer, draw.IndexBuffer, 0, draw.IndexType);
+            bound_index_buffer = draw.IndexBuffer;
+        }
+        
+        PushConstants constants{};
+        constants.model = draw.Model;
+        vkCmdPushConstants(command_buffer, m_PipelineLayout, m_PushConstantStages, 0, sizeof(constants), &constants);
+        vkCmdDrawIndexed(command_buffer, draw.IndexCount, 1, 0, draw.VertexOffset, 0);
+    }
+}
+
+VkPipeline Renderer::GetGraphicsPipeline(const PipelineKey& key) {
+    PipelineKey canonical = key.Canonical();
+    auto pipeline = m_GraphicsPipelines.find(canonical);
+    if (pipeline != m_GraphicsPipelines.end()) {
+        return pipeline->second;
+    }
+    
+    // First use of a variant compiles it on the spot, the pipeline cache makes this cheap on later runs.
+    // Failures are remembered as VK_NULL_HANDLE so a broken variant is not rebuilt every frame.
+    PipelineSet pipelines{};
+    bool built = false;
+    try {
+        built = BuildGraphicsPipelines({ canonical }, pipelines);
+    } catch (const std::exception& exception) {
+        std::cerr << "Failed to read shader: " << exception.what() << "\n";
+    }
+    if (!built) {
+        DestroyPipelines(pipelines);
+        m_GraphicsPipelines[canonical] = VK_NULL_HANDLE;
+        return VK_NULL_HANDLE;
+    }
+    
+    m_GraphicsPipelines[canonical] = pipelines.Graphics[canonical];
+    return pipelines.Graphics[canonical];
+}
+
 bool Renderer::CreateSyncObjects() {
     m_ImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     m_RenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1060,14 +2615,14 @@ bool Renderer::IsDeviceSuitable(VkPhysicalDevice device) const {
         && features.samplerAnisotropy;
 }
 
-bool Renderer::CheckDeviceExtensionsSupport(VkPhysicalDevice device) const {
+bool Renderer::CheckDeviceExtensionsSupport(VkPhysicalDevice device, const std::vector<const char*>& extensions) const {
     uint32_t extensions_count = 0;
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensions_count, nullptr);
     std::vector<VkExtensionProperties> available_extensions(extensions_count);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensions_count, available_extensions.data());
     
-    // Check if all extensions in DeviceExtensions are presented in available_extensions
-    for (auto extension : DeviceExtensions) {
+    // Check if all requested extensions are presented in available_extensions
+    for (auto extension : extensions) {
         auto result = std::find_if(available_extensions.begin(),
                                    available_extensions.end(),
                                    [=](const VkExtensionProperties& rhs) { return strcmp(extension, rhs.extensionName) == 0; });
@@ -1080,6 +2635,43 @@ bool Renderer::CheckDeviceExtensionsSupport(VkPhysicalDevice device) const {
     return true;
 }
 
+bool Renderer::SupportsMeshShaders(VkPhysicalDevice device) const {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (m_InstanceVersion < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1 || !CheckDeviceExtensionsSupport(device, MeshShaderExtensions)) {
+        return false;
+    }
+    
+    VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features{};
+    mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &mesh_shader_features;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    
+    return mesh_shader_features.taskShader && mesh_shader_features.meshShader;
+}
+
+bool Renderer::SupportsPartiallyBoundDescriptors(VkPhysicalDevice device) const {
+    // Features are queried through vkGetPhysicalDeviceFeatures2, which needs Vulkan 1.1
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    if (m_InstanceVersion < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1 || !CheckDeviceExtensionsSupport(device, DescriptorIndexingExtensions)) {
+        return false;
+    }
+    
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptor_indexing_features{};
+    descriptor_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &descriptor_indexing_features;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    
+    return descriptor_indexing_features.descriptorBindingPartiallyBound;
+}
+
 Renderer::QueueFamilyIndices Renderer::FindQueueFamilies(VkPhysicalDevice device) const {
     uint32_t queue_families_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_families_count, nullptr);
@@ -1158,7 +2750,8 @@ std::vector<char> Renderer::ReadFile(const std::string &filename) const {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
     
     if (!file.is_open()) {
-        throw std::runtime_error("failed to open file!");
+        // Shader binaries are built from the GLSL sources by resources/compile_shaders
+        throw std::runtime_error("failed to open file " + filename + "!");
     }
     
     auto file_size = static_cast<size_t>(file.tellg());
@@ -1171,7 +2764,18 @@ std::vector<char> Renderer::ReadFile(const std::string &filename) const {
 }
 
 VkShaderModule Renderer::CreateShaderModule(const std::vector<char> &code) const {
-    VkShaderModuleCreateInfo create_info;
+    // A binary caught mid-write must not reach the driver
+    constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+    uint32_t magic = 0;
+    if (code.size() >= sizeof(magic)) {
+        std::memcpy(&magic, code.data(), sizeof(magic));
+    }
+    if (code.size() % sizeof(uint32_t) != 0 || magic != SPIRV_MAGIC) {
+        std::cerr << "Shader module is not valid SPIR-V\n";
+        return VK_NULL_HANDLE;
+    }
+    
+    VkShaderModuleCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     create_info.codeSize = code.size();
     create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
@@ -1185,14 +2789,72 @@ VkShaderModule Renderer::CreateShaderModule(const std::vector<char> &code) const
     return shader_module;
 }
 
-uint32_t Renderer::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
+std::optional<Renderer::PipelineSet> Renderer::BuildPipelines(const std::vector<PipelineKey>& keys) const {
+    // Runs on a worker thread; only reads state that stays fixed until the build is collected or cancelled
+    PipelineSet pipelines{};
+    try {
+        if (BuildGraphicsPipelines(keys, pipelines) && BuildComputePipeline(pipelines) && BuildShadowPipeline(pipelines)) {
+            return pipelines;
+        }
+    } catch (const std::exception& exception) {
+        std::cerr << "Failed to read shader: " << exception.what() << "\n";
+    }
+    
+    DestroyPipelines(pipelines);
+    return std::nullopt;
+}
+
+Renderer::PipelineSet Renderer::SwapPipelines(PipelineSet pipelines) {
+    PipelineSet previous{};
+    previous.Graphics = std::exchange(m_GraphicsPipelines, std::move(pipelines.Graphics));
+    previous.Cluster = std::exchange(m_ClusterPipeline, pipelines.Cluster);
+    previous.ExpandFaces = std::exchange(m_ExpandFacesPipeline, pipelines.ExpandFaces);
+    previous.Shadow = std::exchange(m_ShadowPipeline, pipelines.Shadow);
+    previous.ShadowFaces = std::exchange(m_ShadowFacesPipeline, pipelines.ShadowFaces);
+    
+    return previous;
+}
+
+void Renderer::DestroyPipelines(const PipelineSet& pipelines) const {
+    for (const auto& [key, pipeline] : pipelines.Graphics) {
+        vkDestroyPipeline(m_Device, pipeline, nullptr);
+    }
+    vkDestroyPipeline(m_Device, pipelines.Cluster, nullptr);
+    vkDestroyPipeline(m_Device, pipelines.ExpandFaces, nullptr);
+    vkDestroyPipeline(m_Device, pipelines.Shadow, nullptr);
+    vkDestroyPipeline(m_Device, pipelines.ShadowFaces, nullptr);
+}
+
+void Renderer::SavePipelineCache() const {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(m_Device, m_PipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(m_Device, m_PipelineCache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+    
+    std::ofstream file(PIPELINE_CACHE_PATH, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write pipeline cache\n";
+        return;
+    }
+    file.write(data.data(), size);
+}
+
+uint32_t Renderer::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred) const {
     VkPhysicalDeviceMemoryProperties memory_properties{};
     vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &memory_properties);
     
-    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
-        if ((type_filter & (1 << i))
-            && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
+    // Preferred properties are dropped when no type offers them
+    for (auto required : { properties | preferred, properties }) {
+        for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+            if ((type_filter & (1 << i))
+                && (memory_properties.memoryTypes[i].propertyFlags & required) == required) {
+                return i;
+            }
         }
     }
     
@@ -1200,6 +2862,125 @@ uint32_t Renderer::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags pr
     return -1;
 }
 
+bool Renderer::CreateDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer* buffer, VkDeviceMemory* buffer_memory) const {
+    if (!CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, buffer_memory)) {
+        return false;
+    }
+    
+    return UploadToBuffer(data, size, *buffer, 0);
+}
+
+bool Renderer::UploadToBuffer(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset) const {
+    VkBuffer staging_buffer;
+    VkDeviceMemory staging_buffer_memory;
+    if (!CreateBuffer(size,
+                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                      &staging_buffer,
+                      &staging_buffer_memory)) {
+        std::cerr << "Failed to create staging buffer\n";
+        return false;
+    }
+    
+    void* mapped;
+    vkMapMemory(m_Device, staging_buffer_memory, 0, size, 0, &mapped);
+    memcpy(mapped, data, size);
+    vkUnmapMemory(m_Device, staging_buffer_memory);
+    
+    CopyBuffer(staging_buffer, buffer, size, offset);
+    
+    vkDestroyBuffer(m_Device, staging_buffer, nullptr);
+    vkFreeMemory(m_Device, staging_buffer_memory, nullptr);
+    
+    return true;
+}
+
+bool Renderer::CreateGpuMesh(const QuadMesh& data, GpuMesh& mesh) {
+    if (data.QuadCount() == 0) {
+        return true;
+    }
+    
+    if (!data.Faces.empty()) {
+        auto first = AllocateFaces(data.QuadCount());
+        if (!first) {
+            std::cerr << "Failed to allocate space in the face buffer\n";
+            return false;
+        }
+        
+        mesh.FirstFace = *first;
+        mesh.QuadCount = data.QuadCount();
+        return UploadToBuffer(data.Faces.data(), sizeof(data.Faces[0]) * data.Faces.size(), m_FaceBuffer, sizeof(PackedFace) * mesh.FirstFace);
+    }
+    
+    if (!CreateDeviceLocalBuffer(data.Vertices.data(), sizeof(data.Vertices[0]) * data.Vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &mesh.VertexBuffer, &mesh.VertexBufferMemory)) {
+        return false;
+    }
+    
+    mesh.QuadCount = data.QuadCount();
+    return true;
+}
+
+void Renderer::DestroyGpuMesh(GpuMesh& mesh) {
+    if (mesh.VertexBuffer == VK_NULL_HANDLE && mesh.QuadCount > 0) {
+        FreeFaces(mesh.FirstFace, mesh.QuadCount);
+    }
+    
+    vkDestroyBuffer(m_Device, mesh.VertexBuffer, nullptr);
+    vkFreeMemory(m_Device, mesh.VertexBufferMemory, nullptr);
+    mesh = GpuMesh{};
+}
+
+void Renderer::DestroyRetiredMeshes(bool all) {
+    // Same rule as DestroyRetiredPipelines
+    auto retired = std::remove_if(m_RetiredMeshes.begin(), m_RetiredMeshes.end(), [&](RetiredMesh& entry) {
+        if (all || m_FrameNumber >= entry.RetiredFrame + MAX_FRAMES_IN_FLIGHT) {
+            DestroyGpuMesh(entry.Mesh);
+            return true;
+        }
+        return false;
+    });
+    m_RetiredMeshes.erase(retired, m_RetiredMeshes.end());
+}
+
+std::optional<uint32_t> Renderer::AllocateFaces(uint32_t count) {
+    // First fit, chunks are remeshed often enough that the buffer does not stay fragmented for long
+    for (auto range = m_FreeFaces.begin(); range != m_FreeFaces.end(); ++range) {
+        auto [first, available] = *range;
+        if (available < count) {
+            continue;
+        }
+        
+        m_FreeFaces.erase(range);
+        if (available > count) {
+            m_FreeFaces[first + count] = available - count;
+        }
+        return first;
+    }
+    
+    return std::nullopt;
+}
+
+void Renderer::FreeFaces(uint32_t first, uint32_t count) {
+    auto next = m_FreeFaces.lower_bound(first);
+    
+    // Merge with the free ranges directly before and after
+    if (next != m_FreeFaces.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == first) {
+            first = previous->first;
+            count += previous->second;
+            m_FreeFaces.erase(previous);
+        }
+    }
+    
+    if (next != m_FreeFaces.end() && first + count == next->first) {
+        count += next->second;
+        m_FreeFaces.erase(next);
+    }
+    
+    m_FreeFaces[first] = count;
+}
+
 bool Renderer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkBuffer* buffer, VkDeviceMemory* buffer_memory) const {
     VkBufferCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1229,17 +3010,18 @@ bool Renderer::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemor
     return true;
 }
 
-void Renderer::CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) const {
+void Renderer::CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize dst_offset) const {
     VkCommandBuffer command_buffer = BeginSingleTimeCommands();
     
     VkBufferCopy region{};
+    region.dstOffset = dst_offset;
     region.size = size;
     vkCmdCopyBuffer(command_buffer, src, dst, 1, &region);
     
     EndSingleTimeCommands(command_buffer);
 }
 
-void Renderer::CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkImage *image, VkDeviceMemory *image_memory) const {
+void Renderer::CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkImage *image, VkDeviceMemory *image_memory, uint32_t array_layers) const {
     VkImageCreateInfo image_create_info{};
     image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     image_create_info.imageType = VK_IMAGE_TYPE_2D;
@@ -1247,7 +3029,7 @@ void Renderer::CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels,
     image_create_info.extent.height = static_cast<uint32_t>(height);
     image_create_info.extent.depth = 1;
     image_create_info.mipLevels = 1;
-    image_create_info.arrayLayers = 1;
+    image_create_info.arrayLayers = array_layers;
     image_create_info.format = format;
     image_create_info.tiling = tiling;
     image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1267,7 +3049,9 @@ void Renderer::CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels,
     VkMemoryAllocateInfo memory{};
     memory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     memory.allocationSize = requirements.size;
-    memory.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, memory_properties);
+    // Transient attachments never leave tile memory on tilers, lazily allocated memory may then never be committed
+    VkMemoryPropertyFlags preferred = (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0;
+    memory.memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, memory_properties, preferred);
     
     if (vkAllocateMemory(m_Device, &memory, nullptr, image_memory) != VK_SUCCESS) {
         std::cerr << "Failed to allocate image memory\n";
@@ -1367,11 +3151,11 @@ void Renderer::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
     EndSingleTimeCommands(command_buffer);
 }
 
-VkImageView Renderer::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels) const {
+VkImageView Renderer::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels, VkImageViewType view_type, uint32_t base_layer, uint32_t layer_count) const {
     VkImageViewCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     create_info.image = image;
-    create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    create_info.viewType = view_type;
     create_info.format = format;
     create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
     create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -1380,8 +3164,8 @@ VkImageView Renderer::CreateImageView(VkImage image, VkFormat format, VkImageAsp
     create_info.subresourceRange.aspectMask = aspect_flags;
     create_info.subresourceRange.baseMipLevel = 0;
     create_info.subresourceRange.levelCount = mip_levels;
-    create_info.subresourceRange.baseArrayLayer = 0;
-    create_info.subresourceRange.layerCount = 1;
+    create_info.subresourceRange.baseArrayLayer = base_layer;
+    create_info.subresourceRange.layerCount = layer_count;
     
     VkImageView view;
     if (vkCreateImageView(m_Device, &create_info, nullptr, &view) != VK_SUCCESS) {
@@ -1409,6 +3193,7 @@ VkFormat Renderer::FindSupportedFormat(const std::vector<VkFormat>& candidates,
 }
 
 VkFormat Renderer::FindDepthFormat() const {
+    // Reverse Z only gains precision with a float depth buffer, the 24 bit format is a last resort
     return FindSupportedFormat(
         { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
         VK_IMAGE_TILING_OPTIMAL,
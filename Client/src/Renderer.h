@@ -8,11 +8,15 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <glm/gtx/hash.hpp>
 
 #include <stb/stb_image.h>
 
 #include "tiny_obj_loader.h"
+#include "ShaderWatcher.h"
+#include "CookedMesh.h"
+#include "DescriptorAllocator.h"
 
 #include <chrono>
 #include <iostream>
@@ -24,17 +28,40 @@
 #include <optional>
 #include <array>
 #include <unordered_map>
+#include <random>
+#include <map>
+#include <future>
+#include <utility>
 
 constexpr unsigned int WIDTH = 800;
 constexpr unsigned int HEIGHT = 600;
 constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+constexpr uint32_t CLUSTER_GRID_X = 16;
+constexpr uint32_t CLUSTER_GRID_Y = 9;
+constexpr uint32_t CLUSTER_GRID_Z = 24;
+constexpr uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+constexpr uint32_t MAX_LIGHTS = 16384;
+constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+constexpr uint32_t SHADOW_CASCADE_COUNT = 4;
+constexpr uint32_t SHADOW_CACHED_CASCADE_START = 2;
+constexpr uint32_t SHADOW_MAP_SIZE = 2048;
+constexpr uint32_t MAX_SHORT_INDEX_QUADS = UINT16_MAX / 4;
+constexpr uint32_t FACE_BUFFER_CAPACITY = 1 << 20; // PackedFace records shared by all chunks, 16 MiB
+constexpr uint32_t FACE_EXPANSION_QUAD_CAPACITY = 1 << 16; // Quads expand_faces.comp writes per swapchain image, 9 MiB
+constexpr uint32_t MAX_FACE_EXPANSION_JOBS = 4096;
+constexpr uint32_t MESH_SHADER_GROUP_FACES = 32; // Faces per task and mesh work group, see face.task
 const std::string MODEL_PATH = "resources/Grass_Block.obj";
 const std::string TEXTURE_PATH = "resources/Grass_Block.png";
+const std::string SHADER_DIRECTORY = "resources";
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+const glm::vec3 SKY_COLOR = glm::vec3(0.55f, 0.7f, 0.9f);
 
 #ifdef NDEBUG
     constexpr bool EnableValidationLayers = false;
+    constexpr bool EnableShaderHotReload = false;
 #else
     constexpr bool EnableValidationLayers = true;
+    constexpr bool EnableShaderHotReload = true;
 #endif
 
 const std::vector<const char*> ValidationLayers = {
@@ -45,6 +72,21 @@ const std::vector<const char*> DeviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+// Enabled on top of DeviceExtensions where supported so optional bindings can stay unwritten
+const std::vector<const char*> DescriptorIndexingExtensions = {
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+};
+
+// Enabled on top of DeviceExtensions when faces are expanded by mesh shaders
+const std::vector<const char*> MeshShaderExtensions = {
+    VK_EXT_MESH_SHADER_EXTENSION_NAME,
+    VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+    VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME
+};
+
+struct QuadMesh;
+struct ChunkMesh;
+
 class Renderer {
     // Contains hooks to all queue families required by renderer
     struct QueueFamilyIndices {
@@ -67,16 +109,221 @@ class Renderer {
         app->m_FramebufferResized = true;
     }
     
+    static void KeyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+        auto app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+        if (action != GLFW_PRESS) {
+            return;
+        }
+        
+        if (key == GLFW_KEY_F1) {
+            app->m_OverdrawVisualisation = !app->m_OverdrawVisualisation;
+        } else if (key == GLFW_KEY_F2) {
+            app->m_DepthPrepassEnabled = !app->m_DepthPrepassEnabled;
+        } else if (key == GLFW_KEY_F3) {
+            app->m_FogEnabled = !app->m_FogEnabled;
+        } else if (key == GLFW_KEY_F4) {
+            app->m_AmbientOcclusionEnabled = !app->m_AmbientOcclusionEnabled;
+        }
+    }
+    
     struct UniformBufferObject {
-        glm::mat4 model;
         glm::mat4 view;
         glm::mat4 projection;
+        glm::mat4 inverseProjection;
+        glm::uvec4 clusterGrid;  // xyz cluster counts, w light count
+        glm::vec4 screenParams;  // xy framebuffer size, z near plane, w view distance
+        glm::mat4 cascadeViewProjection[SHADOW_CASCADE_COUNT];
+        glm::vec4 cascadeSplits; // View depth at which each cascade ends
+        glm::vec4 sunDirection;  // xyz direction the light travels in world space, w intensity
+    };
+    
+    // Device local copy of a quad mesh drawn with the shared quad index buffers, empty meshes have no buffers
+    struct GpuMesh {
+        VkBuffer VertexBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory VertexBufferMemory = VK_NULL_HANDLE;
+        uint32_t FirstFace = 0; // Range in the face buffer when pulled, no vertex buffer then
+        uint32_t QuadCount = 0;
+    };
+    
+    struct ChunkRenderData {
+        GpuMesh Opaque;
+        GpuMesh Transparent;
+    };
+    
+    struct ShadowPushConstants {
+        glm::mat4 model;
+        glm::mat4 viewProjection;
+    };
+    
+    // Cascades from SHADOW_CACHED_CASCADE_START on are centred on the camera and kept between frames
+    // until the sun moves, the snapped centre moves or geometry inside them changes
+    struct ShadowCascade {
+        glm::mat4 ViewProjection;
+        glm::vec3 Center;
+        float Radius;
+        float SplitFar;
+        glm::vec3 SunDirection;
+        bool Dirty = true;
+        // Drawn by the frame being recorded, clean once that frame is submitted
+        bool Recorded = false;
+    };
+    
+    // Offset and count into the light index list, written by cluster_lights.comp
+    struct LightCluster {
+        uint32_t Offset;
+        uint32_t Count;
+    };
+    
+    struct PushConstants {
+        glm::mat4 model;
+    };
+    
+    // Push constants of face.task and face.mesh, starts with PushConstants
+    struct MeshPushConstants {
+        glm::mat4 model;
+        uint32_t firstFace;
+        uint32_t faceCount;
+        VkBool32 backFaceCulling;
+    };
+    
+    // std430 layout shared with expand_faces.comp, one work group expands the faces of one draw
+    struct FaceExpansionJob {
+        uint32_t FirstFace;
+        uint32_t FaceCount;
+        uint32_t FirstQuad;
+        uint32_t Padding;
+    };
+    
+    // Everything a frame binds in binding order, written into each frame's descriptor set by m_FrameDescriptorTemplate
+    struct FrameDescriptors {
+        VkDescriptorBufferInfo Uniforms;
+        VkDescriptorImageInfo Texture;
+        VkDescriptorBufferInfo Lights;
+        VkDescriptorBufferInfo Clusters;
+        VkDescriptorBufferInfo LightIndices;
+        VkDescriptorImageInfo Shadow;
+        VkDescriptorBufferInfo Faces;
+        VkDescriptorBufferInfo FaceJobs;
+        VkDescriptorBufferInfo ExpandedVertices;
+    };
+    
+    // How a pulled chunk draw is drawn in the frame being recorded, see RecordFaceExpansion
+    struct ExpandedDraw {
+        bool Visible = true;
+        uint32_t FirstQuad = UINT32_MAX; // Quad in this frame's expanded vertex buffer, UINT32_MAX leaves the faces to face.vert
+    };
+    
+    enum class PipelinePass : uint8_t {
+        Opaque,
+        DepthPrepass,
+        Transparent,
+        Overdraw
+    };
+    
+    // Vertex data a draw provides; models carry no baked lighting in Vertex::Shading
+    enum class VertexFormat : uint8_t {
+        Chunk,
+        Model,
+        Face,    // PackedFace records pulled from the face buffer by face.vert
+        MeshFace // PackedFace records expanded by face.task and face.mesh
+    };
+    
+    // Selects a graphics pipeline variant. Features are baked in with specialization constants,
+    // so a disabled feature is compiled out instead of branched over.
+    struct PipelineKey {
+        PipelinePass Pass = PipelinePass::Opaque;
+        VertexFormat Format = VertexFormat::Chunk;
+        bool Fog = false;
+        bool AmbientOcclusion = false;
+        bool AlphaTest = false;
+        
+        // Drops features the pass does not use so equivalent variants share a pipeline
+        PipelineKey Canonical() const {
+            PipelineKey key = *this;
+            if (Pass == PipelinePass::DepthPrepass || Pass == PipelinePass::Overdraw) {
+                key.Fog = false;
+                key.AmbientOcclusion = false;
+            }
+            return key;
+        }
+        
+        uint32_t Packed() const {
+            return static_cast<uint32_t>(Pass)
+                | static_cast<uint32_t>(Format) << 2
+                | static_cast<uint32_t>(Fog) << 4
+                | static_cast<uint32_t>(AmbientOcclusion) << 5
+                | static_cast<uint32_t>(AlphaTest) << 6;
+        }
+        
+        bool operator==(const PipelineKey& other) const {
+            return Packed() == other.Packed();
+        }
+        
+        struct Hash {
+            size_t operator()(const PipelineKey& key) const {
+                return std::hash<uint32_t>()(key.Packed());
+            }
+        };
+    };
+    
+    // Data behind the specialization constants of shader.vert and shader.frag
+    struct SpecializationConstants {
+        VkBool32 fog;
+        VkBool32 ambientOcclusion;
+        VkBool32 alphaTest;
+        VkBool32 bakedShading;
+        float fogColor[3];
+    };
+    
+    using GraphicsPipelineMap = std::unordered_map<PipelineKey, VkPipeline, PipelineKey::Hash>;
+    
+    // Every pipeline built from a shader in SHADER_DIRECTORY, rebuilt together on hot reload
+    struct PipelineSet {
+        GraphicsPipelineMap Graphics;
+        VkPipeline Cluster = VK_NULL_HANDLE;
+        VkPipeline ExpandFaces = VK_NULL_HANDLE;
+        VkPipeline Shadow = VK_NULL_HANDLE;
+        VkPipeline ShadowFaces = VK_NULL_HANDLE;
+    };
+    
+    // Pipelines swapped out on frame RetiredFrame, destroyed once no frame in flight can reference them
+    struct RetiredPipelines {
+        PipelineSet Pipelines;
+        uint64_t RetiredFrame;
+    };
+    
+    // Mesh of a removed chunk, freed the same way as retired pipelines
+    struct RetiredMesh {
+        GpuMesh Mesh;
+        uint64_t RetiredFrame;
+    };
+    
+    // Single indexed draw of a mesh; Center is in model space and is used for depth sorting
+    struct DrawCall {
+        VkBuffer VertexBuffer;
+        VkBuffer IndexBuffer;
+        uint32_t IndexCount;
+        VkIndexType IndexType;
+        int32_t VertexOffset;
+        glm::mat4 Model;
+        glm::vec3 Center;
+        float Radius;
+        bool Transparent;
+        bool AlphaTest;
+        VertexFormat Format;
     };
     
 public:
+    // std430 layout shared with cluster_lights.comp and shader.frag
+    struct PointLight {
+        glm::vec4 PositionRadius;
+        glm::vec4 ColorIntensity;
+    };
+    
     struct Vertex {
         glm::vec3 Position;
         glm::vec3 Color;
+        glm::u8vec4 Shading; // x ambient occlusion, y sky light, z block light, w opacity; all normalized
         glm::vec2 TextureCoordinate;
         
         static VkVertexInputBindingDescription BingindDescription() {
@@ -88,8 +335,8 @@ public:
             return description;
         }
         
-        static std::array<VkVertexInputAttributeDescription, 3> AttributeDescriptions() {
-            std::array<VkVertexInputAttributeDescription, 3> descriptions;
+        static std::array<VkVertexInputAttributeDescription, 4> AttributeDescriptions() {
+            std::array<VkVertexInputAttributeDescription, 4> descriptions;
             descriptions[0].binding = 0;
             descriptions[0].location = 0;
             descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
@@ -105,19 +352,58 @@ public:
             descriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
             descriptions[2].offset = offsetof(Vertex, TextureCoordinate);
             
+            descriptions[3].binding = 0;
+            descriptions[3].location = 3;
+            descriptions[3].format = VK_FORMAT_R8G8B8A8_UNORM;
+            descriptions[3].offset = offsetof(Vertex, Shading);
+            
             return descriptions;
         }
     };
     
+    // std430 layout shared with face.vert and shadow_face.vert, one chunk quad expanded to four vertices.
+    // Per corner values are in the order of the unrotated corners.
+    struct PackedFace {
+        uint32_t Position;   // Bits 0-14 block xyz, 15-16 axis, 17 positive side, 18-19 first corner, 20-21 atlas row, 22-29 ambient occlusion per corner
+        uint32_t Tint;       // RGBA8
+        uint32_t SkyLight;   // 8 bits per corner
+        uint32_t BlockLight; // 8 bits per corner
+    };
+    
+    // Where packed chunk faces become vertices, see SetFaceExpansion
+    enum class FaceExpansion : uint8_t {
+        VertexShader, // face.vert pulls every face of every chunk
+        Compute,      // expand_faces.comp writes the faces of visible chunks into a vertex buffer every frame
+        MeshShader    // face.task drops faces pointing away from the camera, face.mesh expands the rest on chip
+    };
+    
     [[nodiscard]] GLFWwindow* Initialize();
     void DrawFrame();
     void Destroy();
     
+    void AddLight(const PointLight& light);
+    void LoadLightBenchmark(uint32_t light_count);
+    void SetSunDirection(const glm::vec3& direction);
+    void UploadChunk(const glm::ivec3& position, const ChunkMesh& mesh);
+    void RemoveChunk(const glm::ivec3& position);
+    void SetFrameTimeReporting(bool enabled);
+    
+    // Chunks upload PackedFace records instead of vertices and face.vert expands them by gl_VertexIndex,
+    // must be chosen before Initialize. Chunk meshes then need ChunkMesher::Options::PackedFaces.
+    void SetVertexPulling(bool enabled);
+    bool VertexPullingEnabled() const { return m_VertexPullingEnabled; }
+    
+    // Keeps only packed faces resident and expands them for the chunks in view, implies vertex pulling.
+    // Must be chosen before Initialize; mesh shaders fall back to compute on devices without VK_EXT_mesh_shader.
+    void SetFaceExpansion(FaceExpansion expansion);
+    FaceExpansion GetFaceExpansion() const { return m_FaceExpansion; }
+    
 private:
     GLFWwindow* m_Window;
     
     // Setup
     VkInstance m_Instance;
+    uint32_t m_InstanceVersion = VK_API_VERSION_1_0;
     VkSurfaceKHR m_Surface;
     VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
     VkDevice m_Device;
@@ -132,7 +418,10 @@ private:
     VkRenderPass m_RenderPass;
     VkDescriptorSetLayout m_DescriptorSetLayout;
     VkPipelineLayout m_PipelineLayout;
-    VkPipeline m_GraphicsPipeline;
+    GraphicsPipelineMap m_GraphicsPipelines;
+    VkPipelineLayout m_ClusterPipelineLayout;
+    VkPipeline m_ClusterPipeline;
+    VkPipeline m_ExpandFacesPipeline = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> m_SwapchainFramebuffers;
     VkCommandPool m_CommandPool;
     std::vector<VkCommandBuffer> m_CommandBuffers;
@@ -142,14 +431,99 @@ private:
     std::vector<VkFence> m_InFlightFences;
     std::vector<VkFence> m_ImagesInFlight;
     size_t m_CurrentFrame = 0;
+    uint64_t m_FrameNumber = 0;
+    
+    // Shader hot reload
+    VkPipelineCache m_PipelineCache = VK_NULL_HANDLE;
+    ShaderWatcher m_ShaderWatcher;
+    std::future<std::optional<PipelineSet>> m_PipelineBuild;
+    std::vector<RetiredPipelines> m_RetiredPipelines;
+    std::vector<RetiredMesh> m_RetiredMeshes;
+    
+    // Scene
+    glm::vec3 m_CameraPosition = glm::vec3(5.0f);
+    glm::mat4 m_ViewProjection = glm::mat4(1.0f);
+    std::vector<DrawCall> m_DrawCalls;
+    std::unordered_map<glm::ivec3, ChunkRenderData> m_Chunks;
+    std::vector<uint32_t> m_OpaqueOrder;
+    std::vector<uint32_t> m_TransparentOrder;
+    bool m_DepthPrepassEnabled = true;
+    bool m_OverdrawVisualisation = false;
+    bool m_FogEnabled = true;
+    bool m_AmbientOcclusionEnabled = true;
+    float m_FieldOfView = glm::radians(45.0f);
+    float m_NearPlane = 0.1f;
+    float m_ViewDistance = 64.0f; // The projection is infinite, this bounds light clustering and fog
+    
+    // Clustered lighting
+    std::vector<PointLight> m_Lights;
+    std::vector<VkBuffer> m_LightBuffers;
+    std::vector<VkDeviceMemory> m_LightBuffersMemory;
+    std::vector<VkBuffer> m_ClusterBuffers;
+    std::vector<VkDeviceMemory> m_ClusterBuffersMemory;
+    std::vector<VkBuffer> m_LightIndexBuffers;
+    std::vector<VkDeviceMemory> m_LightIndexBuffersMemory;
     
-    // Model
-    std::vector<Vertex> m_Vertices;
-    std::vector<uint32_t> m_Indices;
+    // Shadows
+    glm::vec3 m_SunDirection = glm::normalize(glm::vec3(-0.4f, -0.3f, -1.0f));
+    float m_ShadowDistance = 10.0f;
+    std::array<ShadowCascade, SHADOW_CASCADE_COUNT> m_ShadowCascades;
+    VkFormat m_ShadowFormat;
+    VkImage m_ShadowImage;
+    VkDeviceMemory m_ShadowImageMemory;
+    VkImageView m_ShadowImageView;
+    std::array<VkImageView, SHADOW_CASCADE_COUNT> m_ShadowLayerViews;
+    std::array<VkFramebuffer, SHADOW_CASCADE_COUNT> m_ShadowFramebuffers;
+    VkRenderPass m_ShadowRenderPass;
+    VkPipelineLayout m_ShadowPipelineLayout;
+    VkPipeline m_ShadowPipeline;
+    VkPipeline m_ShadowFacesPipeline = VK_NULL_HANDLE;
+    VkSampler m_ShadowSampler;
+    
+    // Shadow pass GPU timings, two timestamps per cascade for every swapchain image
+    VkQueryPool m_ShadowQueryPool = VK_NULL_HANDLE;
+    uint32_t m_ShadowQuerySlots = 0;
+    float m_TimestampPeriod = 0.0f;
+    std::vector<std::array<bool, SHADOW_CASCADE_COUNT>> m_ShadowQueriesWritten;
+    std::array<double, SHADOW_CASCADE_COUNT> m_ShadowTimeAccumulator{};
+    std::array<uint32_t, SHADOW_CASCADE_COUNT> m_ShadowRenderCount{};
+    
+    // Frame time reporting
+    bool m_ReportFrameTimes = false;
+    std::chrono::steady_clock::time_point m_LastFrameTime;
+    double m_FrameTimeAccumulator = 0.0;
+    uint32_t m_FrameTimeSamples = 0;
+    
+    // Model, the cooked mesh stays mapped only until its buffers are uploaded
+    CookedMesh m_Model;
     VkBuffer m_VertexBuffer;
     VkDeviceMemory m_VertexBufferMemory;
     VkBuffer m_IndexBuffer;
     VkDeviceMemory m_IndexBufferMemory;
+    
+    // Index pattern of consecutive quads shared by every chunk draw. Meshes up to MAX_SHORT_INDEX_QUADS
+    // use the 16-bit buffer, larger ones the 32-bit buffer sized for MAX_CHUNK_QUADS.
+    VkBuffer m_ShortQuadIndexBuffer;
+    VkDeviceMemory m_ShortQuadIndexBufferMemory;
+    VkBuffer m_QuadIndexBuffer;
+    VkDeviceMemory m_QuadIndexBufferMemory;
+    
+    // Vertex pulling, chunks own ranges of the face buffer; free ranges are keyed by their first face
+    bool m_VertexPullingEnabled = false;
+    VkBuffer m_FaceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_FaceBufferMemory = VK_NULL_HANDLE;
+    std::map<uint32_t, uint32_t> m_FreeFaces;
+    
+    // Face expansion, the expanded vertex and job buffers exist per swapchain image with compute only
+    FaceExpansion m_FaceExpansion = FaceExpansion::VertexShader;
+    VkShaderStageFlags m_PushConstantStages = VK_SHADER_STAGE_VERTEX_BIT;
+    PFN_vkCmdDrawMeshTasksEXT m_CmdDrawMeshTasks = nullptr;
+    std::vector<VkBuffer> m_ExpandedVertexBuffers;
+    std::vector<VkDeviceMemory> m_ExpandedVertexBuffersMemory;
+    std::vector<VkBuffer> m_FaceJobBuffers;
+    std::vector<VkDeviceMemory> m_FaceJobBuffersMemory;
+    std::vector<ExpandedDraw> m_ExpandedDraws;
+    
     uint32_t m_MipLevels;
     VkImage m_TextureImage;
     VkDeviceMemory m_TextureImageMemory;
@@ -157,8 +531,14 @@ private:
     
     std::vector<VkBuffer> m_UniformBuffers;
     std::vector<VkDeviceMemory> m_UniformBuffersMemory;
-    VkDescriptorPool m_DescriptorPool;
-    std::vector<VkDescriptorSet> m_DescriptorSets;
+    
+    // Descriptor sets are allocated per frame from pools reset in bulk, one template write covers every binding
+    DescriptorAllocator m_DescriptorAllocator;
+    DescriptorTemplate m_FrameDescriptorTemplate;
+    VkDescriptorSet m_FrameDescriptorSet = VK_NULL_HANDLE;
+    bool m_UpdateTemplatesSupported = false;
+    bool m_PartiallyBoundSupported = false;
+    
     VkSampler m_Sampler;
     VkImage m_DepthImage;
     VkDeviceMemory m_DepthImageMemory;
@@ -175,6 +555,25 @@ private:
     void DestroySwapchain();
     void RecreateSwapchain();
     void UpdateUniformBuffer(uint32_t index);
+    void SortDrawCalls();
+    bool RecordCommandBuffer(uint32_t index);
+    // Only the transition of the swapchain image for presenting, for frames that failed to record
+    bool RecordPresentOnly(uint32_t index);
+    void RecordDrawCalls(VkCommandBuffer command_buffer, uint32_t index, const std::vector<uint32_t>& order, PipelinePass pass);
+    VkPipeline GetGraphicsPipeline(const PipelineKey& key);
+    void RecordLightCulling(VkCommandBuffer command_buffer, uint32_t index) const;
+    void RecordFaceExpansion(VkCommandBuffer command_buffer, uint32_t index);
+    bool IsSphereVisible(const glm::vec3& center, float radius) const;
+    void UpdateShadowCascades();
+    void InvalidateShadowCascades(const glm::vec3& center, float radius);
+    // Timestamp queries are kept per frame in flight
+    void RecordShadowPasses(VkCommandBuffer command_buffer, uint32_t frame);
+    void CollectShadowTimings(uint32_t frame);
+    void UpdateLightBuffer(uint32_t index);
+    void ReportFrameTime();
+    void UpdateShaderHotReload();
+    void DestroyRetiredPipelines(bool all);
+    void CancelPipelineBuild();
     
     void CreateWindow();
     bool CreateInstance();
@@ -185,8 +584,12 @@ private:
     bool CreateImageViews();
     bool CreateRenderPass();
     bool CreateDescriptorSetLayout();
+    bool CreatePipelineCache();
     bool CreateGraphicPipeline();
+    bool CreateComputePipeline();
     bool CreateCommandPool();
+    bool CreateShadowResources();
+    bool CreateShadowPipeline();
     bool CreateColorResources();
     bool CreateDepthResources();
     bool CreateFramebuffers();
@@ -196,15 +599,22 @@ private:
     bool LoadModel();
     bool CreateVertexBuffer();
     bool CreateIndexBuffer();
+    bool CreateQuadIndexBuffers();
+    bool CreateFaceBuffer();
+    bool CreateScene();
     bool CreateUniformBuffers();
-    bool CreateDescriptorPool();
-    bool CreateDescriptorSet();
+    bool CreateLightBuffers();
+    bool CreateFaceExpansionBuffers();
+    bool CreateDescriptorAllocator();
+    bool UpdateFrameDescriptors(uint32_t index);
     bool CreateCommandBuffers();
     bool CreateSyncObjects();
     
     bool CheckValidationLayers() const;
     bool IsDeviceSuitable(VkPhysicalDevice device) const;
-    bool CheckDeviceExtensionsSupport(VkPhysicalDevice device) const;
+    bool CheckDeviceExtensionsSupport(VkPhysicalDevice device, const std::vector<const char*>& extensions = DeviceExtensions) const;
+    bool SupportsMeshShaders(VkPhysicalDevice device) const;
+    bool SupportsPartiallyBoundDescriptors(VkPhysicalDevice device) const;
     QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device) const;
     SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device) const;
     VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats) const;
@@ -212,15 +622,29 @@ private:
     VkExtent2D ChooseSwapExtent(VkSurfaceCapabilitiesKHR capabilities) const;
     std::vector<char> ReadFile(const std::string& filename) const;
     VkShaderModule CreateShaderModule(const std::vector<char>& code) const;
-    uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    bool BuildGraphicsPipelines(const std::vector<PipelineKey>& keys, PipelineSet& pipelines) const;
+    bool BuildComputePipeline(PipelineSet& pipelines) const;
+    bool BuildShadowPipeline(PipelineSet& pipelines) const;
+    std::optional<PipelineSet> BuildPipelines(const std::vector<PipelineKey>& keys) const;
+    PipelineSet SwapPipelines(PipelineSet pipelines);
+    void DestroyPipelines(const PipelineSet& pipelines) const;
+    void SavePipelineCache() const;
+    uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred = 0) const;
+    bool CreateDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer* buffer, VkDeviceMemory* buffer_memory) const;
+    bool UploadToBuffer(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset) const;
+    bool CreateGpuMesh(const QuadMesh& data, GpuMesh& mesh);
+    void DestroyGpuMesh(GpuMesh& mesh);
+    void DestroyRetiredMeshes(bool all);
+    std::optional<uint32_t> AllocateFaces(uint32_t count);
+    void FreeFaces(uint32_t first, uint32_t count);
     bool CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkBuffer* buffer, VkDeviceMemory* buffer_memory) const;
-    void CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) const;
-    void CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkImage* image, VkDeviceMemory* image_memory) const;
+    void CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize dst_offset = 0) const;
+    void CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkImage* image, VkDeviceMemory* image_memory, uint32_t array_layers = 1) const;
     VkCommandBuffer BeginSingleTimeCommands() const;
     void EndSingleTimeCommands(VkCommandBuffer buffer) const;
     void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout, uint32_t mip_levels) const;
     void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) const;
-    VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels) const;
+    VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels, VkImageViewType view_type = VK_IMAGE_VIEW_TYPE_2D, uint32_t base_layer = 0, uint32_t layer_count = 1) const;
     VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const;
     VkFormat FindDepthFormat() const;
     bool HasStencilComponent(VkFormat format) const;
@@ -228,20 +652,4 @@ private:
     VkSampleCountFlagBits MaxUsableSampleCount() const;
 };
 
-bool operator==(const Renderer::Vertex left, const Renderer::Vertex& right);
-
-namespace std {
-
-template <>
-struct hash<Renderer::Vertex> {
-    size_t operator()(const Renderer::Vertex& vertex) const {
-        return
-            ((hash<glm::vec3>()(vertex.Position) ^
-            (hash<glm::vec3>()(vertex.Color) << 1)) >> 1) ^
-            (hash<glm::vec2>()(vertex.TextureCoordinate) << 1);
-    }
-};
-
-}
-
 #endif
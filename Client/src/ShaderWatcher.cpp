@@ -0,0 +1,114 @@
+#include "ShaderWatcher.h"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Writes closer together than this are treated as one change
+constexpr int SETTLE_MILLISECONDS = 100;
+constexpr int IDLE_POLL_MILLISECONDS = 250;
+
+bool IsSpirvFile(const char* name) {
+    std::string filename(name);
+    return filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".spv") == 0;
+}
+
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    Stop();
+}
+
+bool ShaderWatcher::Start(const std::string& directory) {
+#ifdef __linux__
+    m_Descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_Descriptor < 0) {
+        std::cerr << "Failed to initialize inotify\n";
+        return false;
+    }
+    
+    // Compilers either rewrite the file in place or rename a temporary over it
+    m_Watch = inotify_add_watch(m_Descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (m_Watch < 0) {
+        std::cerr << "Failed to watch shader directory " << directory << "\n";
+        close(m_Descriptor);
+        m_Descriptor = -1;
+        return false;
+    }
+    
+    m_Running = true;
+    m_Thread = std::thread(&ShaderWatcher::Watch, this);
+    return true;
+#else
+    std::cerr << "Shader hot reload is only supported on Linux\n";
+    return false;
+#endif
+}
+
+void ShaderWatcher::Stop() {
+    m_Running = false;
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+
+#ifdef __linux__
+    if (m_Descriptor >= 0) {
+        inotify_rm_watch(m_Descriptor, m_Watch);
+        close(m_Descriptor);
+    }
+#endif
+    m_Descriptor = -1;
+    m_Watch = -1;
+}
+
+bool ShaderWatcher::PollChanges() {
+    return m_Changed.exchange(false);
+}
+
+void ShaderWatcher::Watch() {
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    bool pending = false;
+    
+    while (m_Running) {
+        pollfd descriptor{};
+        descriptor.fd = m_Descriptor;
+        descriptor.events = POLLIN;
+        
+        int ready = poll(&descriptor, 1, pending ? SETTLE_MILLISECONDS : IDLE_POLL_MILLISECONDS);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            
+            std::cerr << "Failed to poll shader directory\n";
+            break;
+        }
+        
+        if (ready == 0) {
+            // Nothing written for a while, the batch is complete
+            if (pending) {
+                m_Changed = true;
+                pending = false;
+            }
+            continue;
+        }
+        
+        ssize_t length = read(m_Descriptor, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->len > 0 && IsSpirvFile(event->name)) {
+                pending = true;
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+}
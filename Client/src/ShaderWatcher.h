@@ -0,0 +1,33 @@
+#ifndef ShaderWatcher_h
+#define ShaderWatcher_h
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Watches a directory for rewritten SPIR-V binaries on a background thread. Bursts of writes
+// (glslc writing several stages, editors saving through a temporary file) are reported as one change.
+class ShaderWatcher {
+public:
+    ShaderWatcher() = default;
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+    ~ShaderWatcher();
+    
+    bool Start(const std::string& directory);
+    void Stop();
+    
+    // True once for every settled batch of changes since the last call
+    bool PollChanges();
+
+private:
+    int m_Descriptor = -1;
+    int m_Watch = -1;
+    std::thread m_Thread;
+    std::atomic<bool> m_Running = false;
+    std::atomic<bool> m_Changed = false;
+    
+    void Watch();
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "Renderer.h"
+#include "ChunkMesher.h"
 
 #include <SFML/System.hpp>
 #include <SFML/Network.hpp>
@@ -15,6 +16,31 @@
 #include "tiny_obj_loader.h"
 
 #include <iostream>
+#include <cmath>
+
+// Rolling hills with a pond, a glass pillar and a torch until chunks come from the server
+Chunk BuildDemoChunk() {
+    Chunk chunk;
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            int height = 8 + static_cast<int>(2.0f * std::sin(x * 0.5f) + 2.0f * std::cos(z * 0.4f));
+            for (int y = 0; y <= height; y++) {
+                chunk.SetBlock(x, y, z, y == height ? Block::Grass : (y > height - 3 ? Block::Dirt : Block::Stone));
+            }
+            for (int y = height + 1; y <= 7; y++) {
+                chunk.SetBlock(x, y, z, Block::Water);
+            }
+        }
+    }
+    
+    for (int y = 10; y < 14; y++) {
+        chunk.SetBlock(4, y, 4, Block::Glass);
+    }
+    chunk.SetBlock(10, 12, 10, Block::Torch);
+    
+    chunk.ComputeLighting();
+    return chunk;
+}
 
 int main(int argc, const char * argv[]) {
     /*sf::TcpSocket socket;
@@ -36,8 +62,55 @@ int main(int argc, const char * argv[]) {
     std::cout << " OK!\n";*/
     
     Renderer renderer;
+    
+    // --vertex-pulling uploads chunks as packed faces expanded in the vertex shader
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--vertex-pulling") {
+            renderer.SetVertexPulling(true);
+        }
+    }
+    
+    // --face-expansion compute|mesh expands the packed faces of visible chunks every frame instead
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--face-expansion") {
+            std::string expansion = argv[i + 1];
+            if (expansion == "compute") {
+                renderer.SetFaceExpansion(Renderer::FaceExpansion::Compute);
+            } else if (expansion == "mesh") {
+                renderer.SetFaceExpansion(Renderer::FaceExpansion::MeshShader);
+            } else {
+                std::cerr << "Unknown face expansion " << expansion << ", expected compute or mesh\n";
+            }
+        }
+    }
+    
     auto window = renderer.Initialize();
     
+    Chunk chunk = BuildDemoChunk();
+    ChunkMesher::Neighbourhood neighbourhood{};
+    neighbourhood[13] = &chunk;
+    
+    ChunkMesher::Options options;
+    options.PackedFaces = renderer.VertexPullingEnabled();
+    
+    ChunkMesh mesh;
+    ChunkMesher(options).Mesh(neighbourhood, mesh);
+    renderer.UploadChunk(glm::ivec3(-1, -1, -1), mesh);
+    
+    // --lights N fills the scene with N random point lights and reports average frame times
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--lights") {
+            renderer.LoadLightBenchmark(static_cast<uint32_t>(std::stoul(argv[i + 1])));
+        }
+    }
+    
+    // --profile reports frame times and shadow pass GPU times per cascade
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--profile") {
+            renderer.SetFrameTimeReporting(true);
+        }
+    }
+    
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
         
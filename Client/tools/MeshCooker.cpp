@@ -0,0 +1,41 @@
+// Cooks OBJ models into the mapped mesh format the client loads, so shipped builds never parse OBJ text.
+// Built from the client sources: MeshCooker.cpp ../src/ModelLoader.cpp ../src/CookedMesh.cpp ../src/MappedFile.cpp
+//
+// Usage: MeshCooker <model.obj>... writes <model>.cmesh next to each model
+
+#include "ModelLoader.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <model.obj>...\n";
+        return 1;
+    }
+    
+    ModelLoader loader;
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string path = argv[i];
+        std::string cooked_path = ModelLoader::CookedPath(path);
+        if (!loader.Cook(path, cooked_path)) {
+            std::cerr << "Failed to cook " << path << "\n";
+            failures++;
+            continue;
+        }
+        
+        CookedMesh mesh;
+        if (!mesh.Open(cooked_path)) {
+            std::cerr << "Failed to verify " << cooked_path << "\n";
+            failures++;
+            continue;
+        }
+        
+        std::cout << cooked_path << ": " << mesh.GetHeader().VertexCount << " vertices, " << mesh.GetHeader().IndexCount << " indices\n";
+    }
+    
+    return failures == 0 ? 0 : 1;
+}
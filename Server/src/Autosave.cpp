@@ -0,0 +1,98 @@
+#include "Autosave.h"
+
+#include <chrono>
+
+Autosave::Autosave(World& world, ChunkIoService& io, EditLog* log)
+    : m_World(world)
+    , m_Io(io)
+    , m_Log(log) {
+}
+
+size_t Autosave::Start() {
+    auto start = std::chrono::steady_clock::now();
+    if (!IsRunning()) {
+        m_Pending.clear();
+        m_Next = 0;
+        m_Stats = {};
+    }
+    
+    // Everything committed so far is part of the snapshots below
+    if (m_Log) {
+        m_Segment = m_Log->Rotate();
+    }
+    
+    std::vector<std::unique_ptr<Column>> snapshots;
+    size_t first = m_Pending.size();
+    size_t chunks = 0;
+    
+    // Queued before the dirty columns, so a newer snapshot of a column loaded again wins
+    for (std::unique_ptr<Column>& retry : m_Retries) {
+        snapshots.push_back(retry->Snapshot());
+        m_Pending.push_back({retry->GetPosition(), 0, std::move(retry), {}});
+    }
+    m_Retries.clear();
+    
+    for (ColumnPosition position : m_World.TakeDirtyColumns()) {
+        Column* column = m_World.GetColumn(position);
+        uint16_t dirty = column ? column->GetDirtySections() : 0;
+        if (dirty == 0) {
+            continue;
+        }
+        
+        std::unique_ptr<Column> snapshot = column->Snapshot();
+        snapshots.push_back(snapshot->Snapshot());
+        m_Pending.push_back({position, dirty, std::move(snapshot), {}});
+        column->ClearDirty();
+        for (; dirty != 0; dirty &= dirty - 1) {
+            chunks++;
+        }
+    }
+    
+    auto results = m_Io.Save(snapshots);
+    for (size_t i = 0; i < results.size(); i++) {
+        m_Pending[first + i].Result = std::move(results[i]);
+    }
+    
+    m_Stats.Columns += results.size();
+    m_Stats.Chunks += chunks;
+    m_Stats.PauseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return chunks;
+}
+
+bool Autosave::Poll() {
+    for (; m_Next < m_Pending.size(); m_Next++) {
+        PendingSave& save = m_Pending[m_Next];
+        if (save.Result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            break;
+        }
+        
+        if (!save.Result.get()) {
+            m_Stats.Failed++;
+            Column* column = m_World.GetColumn(save.Position);
+            if (column && save.Sections != 0) {
+                column->MarkDirty(save.Sections);
+            } else {
+                m_Retries.push_back(std::move(save.Snapshot));
+            }
+        }
+        save.Snapshot.reset();
+    }
+    
+    if (m_Flush.valid() && m_Flush.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        if (m_Flush.get()) {
+            m_Log->Checkpoint(m_FlushSegment);
+        } else {
+            m_Stats.Failed++;
+        }
+    }
+    
+    // Failed columns are saved again by a later autosave, which checkpoints the log in their place
+    if (m_Segment != 0 && m_Next == m_Pending.size() && !m_Flush.valid()) {
+        if (m_Stats.Failed == 0) {
+            m_Flush = m_Io.Flush();
+            m_FlushSegment = m_Segment;
+        }
+        m_Segment = 0;
+    }
+    return IsRunning();
+}
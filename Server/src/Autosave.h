@@ -0,0 +1,66 @@
+#ifndef Autosave_h
+#define Autosave_h
+
+#include "ChunkIoService.h"
+#include "EditLog.h"
+#include "World.h"
+
+#include <cstddef>
+#include <future>
+#include <vector>
+
+// Saves the columns of a world whose sections changed since they were last saved. Starting an
+// autosave only visits the columns the world reported dirty and takes a copy-on-write snapshot of
+// each, which shares its sections; encoding, compression and the writes all happen on the I/O
+// service while ticks go on. Columns whose save fails are marked dirty again, or when they were
+// unloaded meanwhile, their snapshot is kept and saved again by the next autosave. With an edit
+// log, every autosave rotates it, and once all saves so far went through and are synced the
+// segments before the rotation are checkpointed. Columns unloaded in between have to be saved first.
+class Autosave {
+public:
+    struct Stats {
+        size_t Columns = 0;
+        size_t Chunks = 0;
+        size_t Failed = 0;
+        double PauseSeconds = 0.0;
+    };
+    
+    Autosave(World& world, ChunkIoService& io, EditLog* log = nullptr);
+    
+    // Call between ticks, after the log commit of the tick. Returns the number of dirty chunks
+    // queued. Overlapping autosaves are fine, the service only writes the newest snapshot of a column.
+    size_t Start();
+    // Call once per tick, returns whether saves are still in flight
+    bool Poll();
+    
+    bool IsRunning() const { return m_Next < m_Pending.size() || m_Flush.valid(); }
+    // Counts of the autosaves since the last time none was running
+    const Stats& GetStats() const { return m_Stats; }
+
+private:
+    struct PendingSave {
+        ColumnPosition Position;
+        uint16_t Sections;
+        // Kept until the save resolves, in case the column is unloaded and the save fails
+        std::unique_ptr<Column> Snapshot;
+        std::future<bool> Result;
+    };
+    
+    World& m_World;
+    ChunkIoService& m_Io;
+    EditLog* m_Log;
+    
+    // The service resolves saves in the order they were queued, so only the front is polled
+    std::vector<PendingSave> m_Pending;
+    size_t m_Next = 0;
+    // Failed saves of columns that were no longer loaded
+    std::vector<std::unique_ptr<Column>> m_Retries;
+    Stats m_Stats;
+    
+    // Segment of the last rotation, 0 once it is being checkpointed
+    uint64_t m_Segment = 0;
+    std::future<bool> m_Flush;
+    uint64_t m_FlushSegment = 0;
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "ChunkIoService.h"
+#include "ColumnCodec.h"
+#include "World.h"
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ChunkIoService::ChunkIoService(std::string directory, IoBackend backend, Compression compression)
+    : m_Io(backend)
+    , m_Storage(std::move(directory), compression)
+    , m_Compression(compression)
+    , m_Thread([this]() { Work(); }) {
+}
+
+ChunkIoService::~ChunkIoService() {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_Wake.notify_one();
+    m_Thread.join();
+}
+
+bool ChunkIoService::Create() {
+    return m_Storage.Create();
+}
+
+std::future<LoadedColumn> ChunkIoService::Load(ColumnPosition position) {
+    LoadRequest request{position, {}};
+    auto result = request.Result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Loads.push_back(std::move(request));
+        m_Pending++;
+    }
+    m_Wake.notify_one();
+    return result;
+}
+
+std::future<bool> ChunkIoService::Save(const Column& column) {
+    return Save(column.Snapshot());
+}
+
+std::future<bool> ChunkIoService::Save(std::unique_ptr<Column> snapshot) {
+    SaveRequest request{std::move(snapshot), {}};
+    auto result = request.Result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Saves.push_back(std::move(request));
+        m_Pending++;
+    }
+    m_Wake.notify_one();
+    return result;
+}
+
+std::vector<std::future<bool>> ChunkIoService::Save(std::vector<std::unique_ptr<Column>>& snapshots) {
+    std::vector<std::future<bool>> results;
+    results.reserve(snapshots.size());
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (auto& snapshot : snapshots) {
+            m_Saves.push_back({std::move(snapshot), {}});
+            results.push_back(m_Saves.back().Result.get_future());
+        }
+        m_Pending += snapshots.size();
+    }
+    m_Wake.notify_one();
+    return results;
+}
+
+std::future<bool> ChunkIoService::Flush() {
+    std::promise<bool> promise;
+    auto result = promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Flushes.push_back(std::move(promise));
+        m_Pending++;
+    }
+    m_Wake.notify_one();
+    return result;
+}
+
+void ChunkIoService::Work() {
+#ifdef __linux__
+    // Waking up for a request must not preempt the thread that queued it, which is usually in
+    // the middle of a tick
+    sched_param parameters{};
+    pthread_setschedparam(pthread_self(), SCHED_BATCH, &parameters);
+#endif
+    
+    std::vector<LoadRequest> loads;
+    std::vector<SaveRequest> saves;
+    std::vector<std::promise<bool>> flushes;
+    
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait(lock, [this]() {
+                return m_Stopping || !m_Loads.empty() || !m_Saves.empty() || !m_Flushes.empty();
+            });
+            
+            if (m_Loads.empty() && m_Saves.empty() && m_Flushes.empty()) {
+                return;
+            }
+            loads.swap(m_Loads);
+            saves.swap(m_Saves);
+            flushes.swap(m_Flushes);
+        }
+        
+        if (!saves.empty()) {
+            SaveBatch(saves);
+        }
+        if (!loads.empty()) {
+            LoadBatch(loads);
+        }
+        if (!flushes.empty()) {
+            bool flushed = m_Storage.Flush();
+            for (auto& flush : flushes) {
+                flush.set_value(flushed);
+            }
+        }
+        
+        m_Pending -= loads.size() + saves.size() + flushes.size();
+        loads.clear();
+        saves.clear();
+        flushes.clear();
+    }
+}
+
+void ChunkIoService::SaveBatch(std::vector<SaveRequest>& saves) {
+    // Only the newest save of a column is written, the ones before it share its result
+    std::unordered_map<uint64_t, size_t> newest;
+    for (size_t i = 0; i < saves.size(); i++) {
+        newest[World::Key(saves[i].Snapshot->GetPosition())] = i;
+    }
+    
+    std::vector<Transfer> transfers;
+    m_Blobs.resize(std::max(m_Blobs.size(), newest.size()));
+    for (size_t i = 0; i < saves.size(); i++) {
+        const Column& column = *saves[i].Snapshot;
+        RegionFile* region = newest[World::Key(column.GetPosition())] == i ? m_Storage.GetRegion(column.GetPosition(), true) : nullptr;
+        if (!region) {
+            continue;
+        }
+        
+        std::vector<uint8_t>& blob = m_Blobs[transfers.size()];
+        m_Encoded.clear();
+        ColumnCodec::Encode(column, m_Encoded);
+        RegionFile::Pack(m_Encoded.data(), m_Encoded.size(), m_Compression, blob);
+        
+        uint32_t count = static_cast<uint32_t>(blob.size() / RegionFile::SECTOR_SIZE);
+        transfers.push_back({region, {region->Allocate(count), count}, i, blob.data()});
+    }
+    RunTransfers(transfers, true);
+    
+    // Written blobs go into the tables in memory. Each region syncs its blobs before it writes its
+    // table and frees the replaced blobs only after that, all on the next Flush.
+    std::vector<char> saved(saves.size(), false);
+    std::vector<RegionFile*> regions;
+    for (Transfer& transfer : transfers) {
+        if (!transfer.Succeeded) {
+            std::cerr << "Failed to write column " << saves[transfer.Request].Snapshot->GetPosition().X << ", "
+                << saves[transfer.Request].Snapshot->GetPosition().Z << "\n";
+            transfer.Region->Release(transfer.Entry);
+            continue;
+        }
+        
+        transfer.Region->Replace(RegionFile::ColumnIndex(saves[transfer.Request].Snapshot->GetPosition()), transfer.Entry);
+        saved[transfer.Request] = true;
+        if (std::find(regions.begin(), regions.end(), transfer.Region) == regions.end()) {
+            regions.push_back(transfer.Region);
+        }
+    }
+    
+    for (RegionFile* region : regions) {
+        if (region->NeedsCompaction()) {
+            region->Compact();
+        }
+    }
+    
+    for (SaveRequest& save : saves) {
+        save.Result.set_value(saved[newest[World::Key(save.Snapshot->GetPosition())]]);
+    }
+}
+
+void ChunkIoService::LoadBatch(std::vector<LoadRequest>& loads) {
+    std::vector<Transfer> transfers;
+    std::vector<LoadedColumn> columns(loads.size());
+    for (size_t i = 0; i < loads.size(); i++) {
+        RegionFile* region = nullptr;
+        columns[i].Result = m_Storage.FindColumn(loads[i].Position, region);
+        if (columns[i].Result == LoadResult::Loaded) {
+            transfers.push_back({region, region->GetEntry(RegionFile::ColumnIndex(loads[i].Position)), i});
+        }
+    }
+    RunTransfers(transfers, false);
+    
+    for (const Transfer& transfer : transfers) {
+        ColumnPosition position = loads[transfer.Request].Position;
+        auto column = std::make_unique<Column>(position);
+        if (!transfer.Succeeded
+            || !RegionFile::Unpack(transfer.Data, transfer.Entry.Count * RegionFile::SECTOR_SIZE, m_Encoded)
+            || !ColumnCodec::Decode(m_Encoded.data(), m_Encoded.size(), *column)) {
+            std::cerr << "Failed to load column " << position.X << ", " << position.Z << "\n";
+            columns[transfer.Request].Result = LoadResult::Damaged;
+            continue;
+        }
+        column->ClearDirty();
+        columns[transfer.Request].Value = std::move(column);
+    }
+    
+    for (size_t i = 0; i < loads.size(); i++) {
+        loads[i].Result.set_value(std::move(columns[i]));
+    }
+}
+
+void ChunkIoService::RunTransfers(std::vector<Transfer>& transfers, bool write) {
+    std::sort(transfers.begin(), transfers.end(), [](const Transfer& a, const Transfer& b) {
+        return a.Region != b.Region ? a.Region < b.Region : a.Entry.Sector < b.Entry.Sector;
+    });
+    
+    m_Requests.clear();
+    m_Runs.clear();
+    std::vector<size_t> run_of(transfers.size());
+    for (size_t begin = 0; begin < transfers.size();) {
+        size_t end = begin + 1;
+        while (end < transfers.size() && transfers[end].Region == transfers[begin].Region
+            && transfers[end].Entry.Sector == transfers[end - 1].Entry.Sector + transfers[end - 1].Entry.Count) {
+            end++;
+        }
+        
+        uint32_t first = transfers[begin].Entry.Sector;
+        uint32_t sectors = transfers[end - 1].Entry.Sector + transfers[end - 1].Entry.Count - first;
+        
+        // A single blob being written goes out straight from its own buffer
+        uint8_t* data = transfers[begin].Data;
+        if (!write || end - begin > 1) {
+            m_Runs.emplace_back(sectors * RegionFile::SECTOR_SIZE);
+            data = m_Runs.back().data();
+            for (size_t i = begin; i < end; i++) {
+                uint8_t* blob = data + (transfers[i].Entry.Sector - first) * RegionFile::SECTOR_SIZE;
+                if (write) {
+                    std::copy(transfers[i].Data, transfers[i].Data + transfers[i].Entry.Count * RegionFile::SECTOR_SIZE, blob);
+                } else {
+                    transfers[i].Data = blob;
+                }
+            }
+        }
+        
+        FileIo::Request request;
+        request.Descriptor = transfers[begin].Region->GetDescriptor();
+        request.Offset = first * RegionFile::SECTOR_SIZE;
+        request.Data = data;
+        request.Size = sectors * RegionFile::SECTOR_SIZE;
+        request.Write = write;
+        for (size_t i = begin; i < end; i++) {
+            run_of[i] = m_Requests.size();
+        }
+        m_Requests.push_back(request);
+        begin = end;
+    }
+    
+    m_Io.Run(m_Requests.data(), m_Requests.size());
+    for (size_t i = 0; i < transfers.size(); i++) {
+        transfers[i].Succeeded = m_Requests[run_of[i]].Succeeded;
+    }
+}
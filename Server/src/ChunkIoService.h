@@ -0,0 +1,103 @@
+#ifndef ChunkIoService_h
+#define ChunkIoService_h
+
+#include "FileIo.h"
+#include "RegionStorage.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoadedColumn {
+    LoadResult Result = LoadResult::Missing;
+    std::unique_ptr<Column> Value;
+};
+
+// Loads and saves columns of one world directory on a thread of its own, so the tick thread only
+// queues requests and polls their futures. Requests queued while the thread is busy are handled
+// together: saves of the same column collapse into the newest one and blobs that end up next to
+// each other on disk are read or written with a single request. Saves are applied before loads of
+// the same batch, so a load always sees the last save queued before it. Region tables are only
+// written on Flush, after the blobs they point at are synced, so saves survive a crash once a
+// Flush queued after them resolved.
+class ChunkIoService {
+public:
+    explicit ChunkIoService(std::string directory, IoBackend backend = FileIo::DefaultBackend(), Compression compression = Compression::Lz4);
+    ChunkIoService(const ChunkIoService&) = delete;
+    ChunkIoService& operator=(const ChunkIoService&) = delete;
+    // Finishes every queued request first
+    ~ChunkIoService();
+    
+    // Creates the directory when it is missing
+    bool Create();
+    
+    // The column is only set when it loaded, loaded columns start out clean
+    std::future<LoadedColumn> Load(ColumnPosition position);
+    // Snapshots the column, the snapshot is encoded and written on the I/O thread. Resolves once the
+    // blob is written, it is durable after the next Flush.
+    std::future<bool> Save(const Column& column);
+    std::future<bool> Save(std::unique_ptr<Column> snapshot);
+    // Queues every snapshot under one lock, the futures come back in the same order
+    std::vector<std::future<bool>> Save(std::vector<std::unique_ptr<Column>>& snapshots);
+    // Resolves once everything queued before it has been written and synced to disk
+    std::future<bool> Flush();
+    
+    IoBackend GetBackend() const { return m_Io.GetBackend(); }
+    const std::string& GetDirectory() const { return m_Storage.GetDirectory(); }
+    // Requests that have not resolved yet
+    size_t GetPendingCount() const { return m_Pending; }
+
+private:
+    struct LoadRequest {
+        ColumnPosition Position;
+        std::promise<LoadedColumn> Result;
+    };
+    
+    struct SaveRequest {
+        std::unique_ptr<Column> Snapshot;
+        std::promise<bool> Result;
+    };
+    
+    // Blob of one request on its way to or from the disk
+    struct Transfer {
+        RegionFile* Region;
+        RegionFile::Entry Entry;
+        size_t Request;
+        uint8_t* Data = nullptr;
+        bool Succeeded = false;
+    };
+    
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::vector<LoadRequest> m_Loads;
+    std::vector<SaveRequest> m_Saves;
+    std::vector<std::promise<bool>> m_Flushes;
+    bool m_Stopping = false;
+    std::atomic<size_t> m_Pending = 0;
+    
+    // Only touched by the I/O thread
+    FileIo m_Io;
+    RegionStorage m_Storage;
+    Compression m_Compression;
+    std::vector<FileIo::Request> m_Requests;
+    std::vector<std::vector<uint8_t>> m_Blobs;
+    std::vector<std::vector<uint8_t>> m_Runs;
+    std::vector<uint8_t> m_Encoded;
+    
+    std::thread m_Thread;
+    
+    void Work();
+    void SaveBatch(std::vector<SaveRequest>& saves);
+    void LoadBatch(std::vector<LoadRequest>& loads);
+    
+    // Merges transfers of neighbouring sectors into one request each and runs them, writes copy
+    // their blobs from Data into the merged buffers first and reads point Data into them after
+    void RunTransfers(std::vector<Transfer>& transfers, bool write);
+};
+
+#endif
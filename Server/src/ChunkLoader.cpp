@@ -0,0 +1,290 @@
+#include "ChunkLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace {
+
+// Ring first, then ticket type, then the step along the spiral of the ticket
+uint64_t Priority(int ring, TicketType type, uint32_t step) {
+    return static_cast<uint64_t>(ring) << 40 | static_cast<uint64_t>(type) << 32 | step;
+}
+
+template<typename T>
+bool IsReady(const std::future<T>& future) {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+}
+
+ChunkLoader::ChunkLoader(World& world, ChunkIoService& io, GenerationPipeline* generator, ChunkLoaderSettings settings)
+    : m_World(world)
+    , m_Io(io)
+    , m_Generator(generator)
+    , m_Settings(settings) {
+}
+
+ChunkLoader::TicketId ChunkLoader::AddTicket(TicketType type, ColumnPosition centre, int radius) {
+    TicketId id = m_NextTicket++;
+    m_Tickets[id] = {type, centre, std::max(radius, 0)};
+    m_TicketsChanged = true;
+    return id;
+}
+
+void ChunkLoader::MoveTicket(TicketId id, ColumnPosition centre) {
+    auto found = m_Tickets.find(id);
+    if (found != m_Tickets.end() && (found->second.Centre.X != centre.X || found->second.Centre.Z != centre.Z)) {
+        found->second.Centre = centre;
+        m_TicketsChanged = true;
+    }
+}
+
+void ChunkLoader::RemoveTicket(TicketId id) {
+    m_TicketsChanged |= m_Tickets.erase(id) != 0;
+}
+
+void ChunkLoader::Update() {
+    m_Tick++;
+    if (m_TicketsChanged) {
+        Rebuild();
+        m_TicketsChanged = false;
+    }
+    
+    Generate();
+    std::vector<Entry*> unneeded = Poll();
+    
+    // Past their grace period, or sooner while over the cap. Columns being saved still take up
+    // memory, but will not for long.
+    size_t projected = m_Counts.MemoryBytes;
+    for (Entry* entry : unneeded) {
+        bool expired = m_Tick - entry->UnneededSince >= m_Settings.GraceTicks;
+        if (!expired && projected <= m_Settings.MemoryCap) {
+            break;
+        }
+        
+        projected -= std::min(projected, ColumnMemory(*entry->Value));
+        Evict(*entry);
+    }
+    
+    StartLoads();
+}
+
+size_t ChunkLoader::ColumnMemory(const Column& column) {
+    size_t memory = sizeof(Column);
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        memory += column.GetSection(i) ? sizeof(Section) : 0;
+    }
+    return memory;
+}
+
+void ChunkLoader::Rebuild() {
+    // Every ticket walks its square ring by ring, each column keeps its best priority
+    std::unordered_map<uint64_t, std::pair<uint64_t, ColumnPosition>> best;
+    for (const auto& [id, ticket] : m_Tickets) {
+        uint32_t step = 0;
+        auto visit = [&](int dx, int dz, int ring) {
+            ColumnPosition position{ticket.Centre.X + dx, ticket.Centre.Z + dz};
+            uint64_t priority = Priority(ring, ticket.Type, step++);
+            auto [found, inserted] = best.try_emplace(World::Key(position), priority, position);
+            if (!inserted) {
+                found->second.first = std::min(found->second.first, priority);
+            }
+        };
+        
+        visit(0, 0, 0);
+        for (int ring = 1; ring <= ticket.Radius; ring++) {
+            for (int i = -ring; i < ring; i++) {
+                visit(i, -ring, ring);
+            }
+            for (int i = -ring; i < ring; i++) {
+                visit(ring, i, ring);
+            }
+            for (int i = ring; i > -ring; i--) {
+                visit(i, ring, ring);
+            }
+            for (int i = ring; i > -ring; i--) {
+                visit(-ring, i, ring);
+            }
+        }
+    }
+    
+    std::vector<std::pair<uint64_t, ColumnPosition>> ordered;
+    ordered.reserve(best.size());
+    m_WantedKeys.clear();
+    for (const auto& [key, wanted] : best) {
+        ordered.push_back(wanted);
+        m_WantedKeys.insert(key);
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first < b.first : World::Key(a.second) < World::Key(b.second);
+    });
+    
+    m_Wanted.clear();
+    for (const auto& wanted : ordered) {
+        m_Wanted.push_back(wanted.second);
+    }
+    m_WantedNext = 0;
+    
+    for (auto& [key, entry] : m_Entries) {
+        bool needed = m_WantedKeys.count(key) != 0;
+        if (entry.Needed && !needed) {
+            entry.UnneededSince = m_Tick;
+        }
+        entry.Needed = needed;
+    }
+}
+
+void ChunkLoader::Generate() {
+    if (m_Generation.valid()) {
+        if (!IsReady(m_Generation)) {
+            return;
+        }
+        
+        // Columns nobody needs any more are dropped, they come out the same the next time
+        for (std::unique_ptr<Column>& column : m_Generation.get()) {
+            auto found = m_Entries.find(World::Key(column->GetPosition()));
+            if (!found->second.Needed) {
+                m_Entries.erase(found);
+                continue;
+            }
+            found->second.Value = m_World.InsertColumn(std::move(column));
+            found->second.State = EntryState::Loaded;
+            m_Totals.Generated++;
+        }
+    }
+    
+    std::vector<ColumnPosition> batch;
+    size_t taken = 0;
+    for (; taken < m_ToGenerate.size() && batch.size() < m_Settings.GenerateBatch; taken++) {
+        ColumnPosition position = m_ToGenerate[taken];
+        auto found = m_Entries.find(World::Key(position));
+        if (found == m_Entries.end()) {
+            continue;
+        }
+        if (!found->second.Needed) {
+            m_Entries.erase(found);
+            continue;
+        }
+        batch.push_back(position);
+    }
+    m_ToGenerate.erase(m_ToGenerate.begin(), m_ToGenerate.begin() + taken);
+    
+    if (batch.empty()) {
+        return;
+    }
+    
+    if (!m_Generator) {
+        for (ColumnPosition position : batch) {
+            Entry& entry = m_Entries[World::Key(position)];
+            entry.Value = m_World.LoadColumn(position);
+            entry.State = EntryState::Loaded;
+            m_Totals.Generated++;
+        }
+        return;
+    }
+    
+    // Only the scratch world and the pipeline are touched off the tick thread
+    m_Generation = std::async(std::launch::async, [generator = m_Generator, batch] {
+        World world;
+        generator->Generate(world, batch);
+        std::vector<std::unique_ptr<Column>> columns;
+        for (ColumnPosition position : batch) {
+            columns.push_back(world.TakeColumn(position));
+        }
+        return columns;
+    });
+}
+
+std::vector<ChunkLoader::Entry*> ChunkLoader::Poll() {
+    m_Counts = {};
+    std::vector<Entry*> unneeded;
+    for (auto it = m_Entries.begin(); it != m_Entries.end();) {
+        Entry& entry = it->second;
+        if (entry.State == EntryState::Loading && IsReady(entry.Load)) {
+            // Columns that were never saved wait for the generator
+            LoadedColumn loaded = entry.Load.get();
+            if (loaded.Result == LoadResult::Loaded) {
+                entry.Value = m_World.InsertColumn(std::move(loaded.Value));
+                entry.State = EntryState::Loaded;
+                m_Totals.Loads++;
+            } else if (loaded.Result == LoadResult::Missing) {
+                entry.State = EntryState::Generating;
+                m_ToGenerate.push_back(entry.Position);
+            } else {
+                std::cerr << "Column " << entry.Position.X << ", " << entry.Position.Z << " is damaged, leaving it unloaded\n";
+                entry.State = EntryState::Damaged;
+                m_Totals.Damaged++;
+            }
+        } else if (entry.State == EntryState::Damaged && !entry.Needed) {
+            // Tried again the next time it is needed
+            it = m_Entries.erase(it);
+            continue;
+        } else if (entry.State == EntryState::Evicting && IsReady(entry.Save)) {
+            entry.State = EntryState::Loaded;
+            if (!entry.Save.get()) {
+                entry.Value->MarkDirty(entry.SavedSections);
+                m_Totals.FailedSaves++;
+            } else if (!entry.Needed && entry.Value->GetDirtySections() == 0) {
+                m_World.UnloadColumn(entry.Position);
+                m_Totals.Unloads++;
+                it = m_Entries.erase(it);
+                continue;
+            }
+            // Columns needed again stay, columns written to while they were saved go around again
+        }
+        
+        if (entry.State == EntryState::Loading || entry.State == EntryState::Generating) {
+            m_Counts.Pending++;
+        } else if (entry.State != EntryState::Damaged) {
+            m_Counts.Loaded++;
+            m_Counts.Evicting += entry.State == EntryState::Evicting;
+            m_Counts.MemoryBytes += ColumnMemory(*entry.Value);
+            if (entry.State == EntryState::Loaded && !entry.Needed) {
+                unneeded.push_back(&entry);
+            }
+        }
+        ++it;
+    }
+    
+    std::sort(unneeded.begin(), unneeded.end(), [](const Entry* a, const Entry* b) {
+        return a->UnneededSince < b->UnneededSince;
+    });
+    return unneeded;
+}
+
+void ChunkLoader::Evict(Entry& entry) {
+    uint16_t dirty = entry.Value->GetDirtySections();
+    if (dirty != 0) {
+        entry.SavedSections = dirty;
+        entry.Save = m_Io.Save(*entry.Value);
+        entry.Value->ClearDirty();
+        entry.State = EntryState::Evicting;
+        m_Counts.Evicting++;
+        return;
+    }
+    
+    m_Counts.Loaded--;
+    m_Counts.MemoryBytes -= ColumnMemory(*entry.Value);
+    m_World.UnloadColumn(entry.Position);
+    m_Totals.Unloads++;
+    m_Entries.erase(World::Key(entry.Position));
+}
+
+void ChunkLoader::StartLoads() {
+    // Loads in flight count as columns of the average size
+    size_t average = m_Counts.Loaded > 0 ? m_Counts.MemoryBytes / m_Counts.Loaded : sizeof(Column) + COLUMN_SECTIONS * sizeof(Section);
+    for (; m_WantedNext < m_Wanted.size(); m_WantedNext++) {
+        if (m_Counts.Pending >= m_Settings.MaxPending || m_Counts.MemoryBytes + (m_Counts.Pending + 1) * average > m_Settings.MemoryCap) {
+            break;
+        }
+        
+        ColumnPosition position = m_Wanted[m_WantedNext];
+        auto [found, inserted] = m_Entries.try_emplace(World::Key(position));
+        if (inserted) {
+            found->second.Position = position;
+            found->second.Load = m_Io.Load(position);
+            m_Counts.Pending++;
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef ChunkLoader_h
+#define ChunkLoader_h
+
+#include "ChunkIoService.h"
+#include "GenerationPipeline.h"
+#include "World.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// At the same distance, columns of earlier types load first
+enum class TicketType : uint8_t {
+    Player,
+    Spawn,
+    Forced
+};
+
+struct ChunkLoaderSettings {
+    // Ticks a column stays loaded after the last ticket covering it went away
+    uint64_t GraceTicks = 100;
+    // Estimated bytes of loaded columns, see ChunkLoader::ColumnMemory
+    size_t MemoryCap = size_t(1) << 30;
+    // Loads in flight on the I/O service
+    size_t MaxPending = 64;
+    // Columns that were never saved are generated off the tick thread, up to this many at once
+    size_t GenerateBatch = 16;
+};
+
+// Decides which columns of a world are loaded. Players, spawn areas and forced loads hold tickets
+// that need every column within their radius. Needed columns load from disk through the I/O service
+// ring by ring around the tickets, so the nearest ones come first, and columns that were never
+// saved are generated in the background, one batch at a time. Columns whose saved copy cannot be
+// read are reported and never generated, so nothing gets saved over them. A column nobody needs any
+// more stays loaded for a grace period, so a player walking back and forth over a column border
+// does not reload the same columns, and is then saved and unloaded. When the loaded columns outgrow
+// the memory cap, unneeded ones are evicted right away, least recently needed first, and no more
+// loads start until there is room again.
+class ChunkLoader {
+public:
+    using TicketId = uint32_t;
+    
+    struct Counts {
+        size_t Loaded = 0;
+        // Loading from disk or waiting to be generated
+        size_t Pending = 0;
+        // Loaded, but being saved before they are unloaded
+        size_t Evicting = 0;
+        size_t MemoryBytes = 0;
+    };
+    
+    struct Totals {
+        uint64_t Loads = 0;
+        uint64_t Generated = 0;
+        uint64_t Unloads = 0;
+        uint64_t FailedSaves = 0;
+        // Saved columns that could not be read, they are left alone rather than generated again
+        uint64_t Damaged = 0;
+    };
+    
+    // Columns are generated empty without a pipeline. The pipeline and its job pool run the loader's
+    // batches and must not be used elsewhere while it exists.
+    ChunkLoader(World& world, ChunkIoService& io, GenerationPipeline* generator, ChunkLoaderSettings settings);
+    ChunkLoader(const ChunkLoader&) = delete;
+    ChunkLoader& operator=(const ChunkLoader&) = delete;
+    
+    // Radius in columns, the ticket covers a square of side 2 * radius + 1
+    TicketId AddTicket(TicketType type, ColumnPosition centre, int radius);
+    void MoveTicket(TicketId id, ColumnPosition centre);
+    void RemoveTicket(TicketId id);
+    
+    // Call once per tick
+    void Update();
+    
+    const Counts& GetCounts() const { return m_Counts; }
+    const Totals& GetTotals() const { return m_Totals; }
+    
+    // The column and its allocated sections
+    static size_t ColumnMemory(const Column& column);
+
+private:
+    enum class EntryState : uint8_t {
+        Loading,
+        Generating,
+        Loaded,
+        Evicting,
+        // Saved but unreadable, kept out of the world until nobody needs it
+        Damaged
+    };
+    
+    struct Ticket {
+        TicketType Type;
+        ColumnPosition Centre;
+        int Radius;
+    };
+    
+    // A column the loader is responsible for, from the moment its load starts until it is unloaded
+    struct Entry {
+        ColumnPosition Position;
+        EntryState State = EntryState::Loading;
+        bool Needed = true;
+        uint64_t UnneededSince = 0;
+        Column* Value = nullptr;
+        uint16_t SavedSections = 0;
+        std::future<LoadedColumn> Load;
+        std::future<bool> Save;
+    };
+    
+    World& m_World;
+    ChunkIoService& m_Io;
+    GenerationPipeline* m_Generator;
+    ChunkLoaderSettings m_Settings;
+    
+    std::unordered_map<TicketId, Ticket> m_Tickets;
+    TicketId m_NextTicket = 1;
+    bool m_TicketsChanged = false;
+    
+    std::unordered_map<uint64_t, Entry> m_Entries;
+    // Needed columns nearest first, rebuilt whenever a ticket changes
+    std::vector<ColumnPosition> m_Wanted;
+    std::unordered_set<uint64_t> m_WantedKeys;
+    // Everything in front of it has an entry
+    size_t m_WantedNext = 0;
+    std::vector<ColumnPosition> m_ToGenerate;
+    // The batch being generated, in a world of its own
+    std::future<std::vector<std::unique_ptr<Column>>> m_Generation;
+    
+    uint64_t m_Tick = 0;
+    Counts m_Counts;
+    Totals m_Totals;
+    
+    void Rebuild();
+    // Moves a finished batch into the world and starts the next one
+    void Generate();
+    // Polls loads and saves in flight, counts what is loaded and returns the loaded columns nobody
+    // needs, least recently needed first
+    std::vector<Entry*> Poll();
+    // Dirty columns are saved first, clean ones are unloaded and their entry dropped right away
+    void Evict(Entry& entry);
+    void StartLoads();
+};
+
+#endif
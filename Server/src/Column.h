@@ -0,0 +1,284 @@
+#ifndef Column_h
+#define Column_h
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+constexpr int CHUNK_SHIFT = 4;
+constexpr int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+constexpr int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+constexpr int COLUMN_SECTIONS = 16;
+constexpr int COLUMN_HEIGHT = CHUNK_SIZE * COLUMN_SECTIONS;
+constexpr uint8_t MAX_LIGHT_LEVEL = 15;
+
+// Same ids as the client's blocks, they go over the wire as is
+enum class Block : uint8_t {
+    Air,
+    Grass,
+    Dirt,
+    Stone,
+    Water,
+    Glass,
+    Torch,
+    Log,
+    Leaves
+};
+
+inline bool IsOpaque(Block block) {
+    return block != Block::Air && block != Block::Water && block != Block::Glass && block != Block::Torch;
+}
+
+// Blocks that stop an entity, fluids included
+inline bool BlocksMotion(Block block) {
+    return block != Block::Air && block != Block::Torch;
+}
+
+// Blocks that can be stood on
+inline bool IsSolid(Block block) {
+    return block != Block::Air && block != Block::Water && block != Block::Torch;
+}
+
+inline uint8_t LightEmission(Block block) {
+    return block == Block::Torch ? 14 : 0;
+}
+
+// Highest block of each kind per (x, z) of a column, for rain, spawning and sky light
+enum class Heightmap : uint8_t {
+    MotionBlocking,
+    Opaque,
+    Solid
+};
+
+constexpr int HEIGHTMAP_COUNT = 3;
+
+inline bool MatchesHeightmap(Heightmap heightmap, Block block) {
+    switch (heightmap) {
+        case Heightmap::MotionBlocking: return BlocksMotion(block);
+        case Heightmap::Opaque: return IsOpaque(block);
+        case Heightmap::Solid: return IsSolid(block);
+    }
+    return false;
+}
+
+struct ColumnPosition {
+    int32_t X = 0;
+    int32_t Z = 0;
+    
+    bool operator==(const ColumnPosition& other) const { return X == other.X && Z == other.Z; }
+    bool operator!=(const ColumnPosition& other) const { return !(*this == other); }
+};
+
+enum class Side : uint8_t {
+    PositiveX,
+    NegativeX,
+    PositiveZ,
+    NegativeZ
+};
+
+// Cubic slice of a column, laid out like the client's chunks with y pointing up. Light is stored
+// per block like on the client, sky light in the high nibble and block light in the low nibble.
+struct Section {
+    std::array<Block, CHUNK_VOLUME> Blocks{};
+    std::array<uint8_t, CHUNK_VOLUME> Light;
+    
+    // Open sky until lighting runs, the same as the unallocated sections above
+    Section() { Light.fill(MAX_LIGHT_LEVEL << 4); }
+    
+    static int Index(int x, int y, int z) {
+        return x + CHUNK_SIZE * (z + CHUNK_SIZE * y);
+    }
+};
+
+// Where the columns of a world report turning dirty. Positions may repeat or belong to columns
+// that were unloaded since, the list is only a hint of where to look.
+struct DirtyList {
+    std::mutex Mutex;
+    std::vector<ColumnPosition> Positions;
+};
+
+// Full height stack of sections at one (x, z) chunk position. Sections that were never written
+// are not allocated and read as air. Neighbour pointers are kept up to date by the owning World.
+// Every write marks its section dirty until the next autosave picks the column up.
+class Column {
+public:
+    explicit Column(ColumnPosition position) : m_Position(position) {}
+    Column(const Column&) = delete;
+    Column& operator=(const Column&) = delete;
+    
+    ColumnPosition GetPosition() const { return m_Position; }
+    Column* GetNeighbour(Side side) const { return m_Neighbours[static_cast<int>(side)]; }
+    
+    // Coordinates are local to the column, y outside of [0, COLUMN_HEIGHT) reads as air
+    Block GetBlock(int x, int y, int z) const {
+        if (static_cast<unsigned>(y) >= COLUMN_HEIGHT) {
+            return Block::Air;
+        }
+        
+        const Section* section = m_Sections[y / CHUNK_SIZE].get();
+        return section ? section->Blocks[Section::Index(x, y % CHUNK_SIZE, z)] : Block::Air;
+    }
+    
+    // Unallocated sections read as open sky, below the column is dark
+    uint8_t GetLight(int x, int y, int z) const {
+        if (static_cast<unsigned>(y) >= COLUMN_HEIGHT) {
+            return y < 0 ? 0 : MAX_LIGHT_LEVEL << 4;
+        }
+        
+        const Section* section = m_Sections[y / CHUNK_SIZE].get();
+        return section ? section->Light[Section::Index(x, y % CHUNK_SIZE, z)] : MAX_LIGHT_LEVEL << 4;
+    }
+    
+    // Returns false when y is outside of the column
+    bool SetBlock(int x, int y, int z, Block block) {
+        if (static_cast<unsigned>(y) >= COLUMN_HEIGHT) {
+            return false;
+        }
+        
+        int index = y / CHUNK_SIZE;
+        if (!m_Sections[index] && block == Block::Air) {
+            return true;
+        }
+        
+        WritableSection(index, true)->Blocks[Section::Index(x, y % CHUNK_SIZE, z)] = block;
+        if (!m_HeightmapsStale) {
+            UpdateHeightmaps(x, y, z, block);
+        }
+        return true;
+    }
+    
+    // One above the highest matching block at local x, z, 0 when there is none. Rebuilds stale
+    // heightmaps, so it is not safe to call on a column other threads read.
+    int GetHeight(Heightmap heightmap, int x, int z) const {
+        if (m_HeightmapsStale) {
+            RebuildHeightmaps();
+        }
+        return m_Heights[HeightIndex(heightmap, x, z)];
+    }
+    
+    const Section* GetSection(int index) const { return m_Sections[index].get(); }
+    
+    // Section to write to, marked dirty and copied first when a snapshot still shares it. Returns
+    // nullptr for unallocated sections unless allocate is set. Blocks written through it are not
+    // seen by the heightmaps, they are rebuilt on the next GetHeight.
+    Section* EditSection(int index, bool allocate = false) {
+        Section* section = WritableSection(index, allocate);
+        if (section) {
+            m_HeightmapsStale = true;
+        }
+        return section;
+    }
+    
+    // Replaces a whole section, nullptr turns it into air
+    void SetSection(int index, std::unique_ptr<Section> section) {
+        m_Sections[index] = std::move(section);
+        m_HeightmapsStale = true;
+        MarkDirty(static_cast<uint16_t>(1 << index));
+    }
+    
+    // Sections changed since the last ClearDirty, one bit per section
+    uint16_t GetDirtySections() const { return m_DirtySections; }
+    void MarkDirty(uint16_t sections) {
+        // Only the first change since the last save reports the column
+        if (m_DirtySections == 0 && sections != 0 && m_DirtyList) {
+            std::lock_guard<std::mutex> lock(m_DirtyList->Mutex);
+            m_DirtyList->Positions.push_back(m_Position);
+        }
+        m_DirtySections |= sections;
+    }
+    void ClearDirty() { m_DirtySections = 0; }
+    
+    // Copy of the column that shares every section with it. Writes to either side copy the
+    // section they touch first, so the snapshot can be read on another thread while the column
+    // keeps changing. Neighbours are not part of the snapshot.
+    std::unique_ptr<Column> Snapshot() const {
+        auto snapshot = std::make_unique<Column>(m_Position);
+        snapshot->m_Sections = m_Sections;
+        snapshot->m_HeightmapsStale = true;
+        return snapshot;
+    }
+
+private:
+    friend class World;
+    
+    ColumnPosition m_Position;
+    std::array<std::shared_ptr<Section>, COLUMN_SECTIONS> m_Sections;
+    std::array<Column*, 4> m_Neighbours{};
+    uint16_t m_DirtySections = 0;
+    DirtyList* m_DirtyList = nullptr;
+    
+    // Empty columns start with every height at 0. Rebuilt lazily, also through const columns.
+    mutable std::array<uint16_t, HEIGHTMAP_COUNT * CHUNK_SIZE * CHUNK_SIZE> m_Heights{};
+    mutable bool m_HeightmapsStale = false;
+    
+    static int HeightIndex(Heightmap heightmap, int x, int z) {
+        return x + CHUNK_SIZE * (z + CHUNK_SIZE * static_cast<int>(heightmap));
+    }
+    
+    Section* WritableSection(int index, bool allocate) {
+        auto& section = m_Sections[index];
+        if (!section) {
+            if (!allocate) {
+                return nullptr;
+            }
+            section = std::make_shared<Section>();
+        } else if (section.use_count() > 1) {
+            section = std::make_shared<Section>(*section);
+        }
+        
+        // A count of one may come from a snapshot that was just released on another thread, its
+        // last reads have to happen before the writes to follow
+        std::atomic_thread_fence(std::memory_order_acquire);
+        MarkDirty(static_cast<uint16_t>(1 << index));
+        return section.get();
+    }
+    
+    // Placing a block can only raise a height. Only removing the top block scans, down to the
+    // next match below it.
+    void UpdateHeightmaps(int x, int y, int z, Block block) {
+        for (int i = 0; i < HEIGHTMAP_COUNT; i++) {
+            Heightmap heightmap = static_cast<Heightmap>(i);
+            uint16_t& height = m_Heights[HeightIndex(heightmap, x, z)];
+            if (MatchesHeightmap(heightmap, block)) {
+                height = std::max<uint16_t>(height, static_cast<uint16_t>(y + 1));
+            } else if (height == y + 1) {
+                height = static_cast<uint16_t>(ScanDown(heightmap, x, y, z));
+            }
+        }
+    }
+    
+    // One above the highest match below y, skipping unallocated sections
+    int ScanDown(Heightmap heightmap, int x, int y, int z) const {
+        while (y > 0) {
+            const Section* section = m_Sections[(y - 1) / CHUNK_SIZE].get();
+            if (!section) {
+                y = (y - 1) / CHUNK_SIZE * CHUNK_SIZE;
+                continue;
+            }
+            
+            y--;
+            if (MatchesHeightmap(heightmap, section->Blocks[Section::Index(x, y % CHUNK_SIZE, z)])) {
+                return y + 1;
+            }
+        }
+        return 0;
+    }
+    
+    void RebuildHeightmaps() const {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                for (int i = 0; i < HEIGHTMAP_COUNT; i++) {
+                    m_Heights[HeightIndex(static_cast<Heightmap>(i), x, z)] = static_cast<uint16_t>(ScanDown(static_cast<Heightmap>(i), x, COLUMN_HEIGHT, z));
+                }
+            }
+        }
+        m_HeightmapsStale = false;
+    }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "ColumnCodec.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+// Narrowest width that can index a palette of count values, widths divide a byte evenly
+int IndexBits(int count) {
+    return count <= 1 ? 0 : count <= 2 ? 1 : count <= 4 ? 2 : count <= 16 ? 4 : 8;
+}
+
+// Palette size minus one, the palette, then the packed indices
+void EncodePaletted(const uint8_t* values, std::vector<uint8_t>& out) {
+    // Values in use first, with independent stores rather than a branch per value, then the palette
+    // in ascending order
+    std::array<bool, 256> present{};
+    for (int i = 0; i < CHUNK_VOLUME; i++) {
+        present[values[i]] = true;
+    }
+    
+    std::array<uint8_t, 256> lookup{};
+    std::array<uint8_t, 256> palette;
+    int count = 0;
+    for (int value = 0; value < 256; value++) {
+        if (present[value]) {
+            lookup[value] = static_cast<uint8_t>(count);
+            palette[count++] = static_cast<uint8_t>(value);
+        }
+    }
+    
+    out.push_back(static_cast<uint8_t>(count - 1));
+    out.insert(out.end(), palette.begin(), palette.begin() + count);
+    
+    int bits = IndexBits(count);
+    if (bits == 0) {
+        return;
+    }
+    
+    int per_byte = 8 / bits;
+    size_t start = out.size();
+    out.resize(start + CHUNK_VOLUME / per_byte);
+    uint8_t* packed = out.data() + start;
+    for (int i = 0; i < CHUNK_VOLUME; i += per_byte) {
+        int byte = 0;
+        for (int j = 0; j < per_byte; j++) {
+            byte |= lookup[values[i + j]] << j * bits;
+        }
+        *packed++ = static_cast<uint8_t>(byte);
+    }
+}
+
+bool DecodePaletted(const uint8_t*& in, const uint8_t* end, uint8_t* values) {
+    if (in == end) {
+        return false;
+    }
+    
+    int count = *in++ + 1;
+    if (end - in < count) {
+        return false;
+    }
+    const uint8_t* palette = in;
+    in += count;
+    
+    int bits = IndexBits(count);
+    if (bits == 0) {
+        std::fill(values, values + CHUNK_VOLUME, palette[0]);
+        return true;
+    }
+    
+    int per_byte = 8 / bits;
+    if (end - in < CHUNK_VOLUME / per_byte) {
+        return false;
+    }
+    
+    // Every possible index byte expanded to its values up front, so unpacking is a copy per byte.
+    // Indices past the palette only show up in damaged data.
+    std::array<uint64_t, 256> expanded;
+    std::array<bool, 256> valid;
+    int mask = (1 << bits) - 1;
+    for (int byte = 0; byte < 256; byte++) {
+        uint64_t unpacked = 0;
+        valid[byte] = true;
+        for (int j = 0; j < per_byte; j++) {
+            int index = byte >> j * bits & mask;
+            valid[byte] &= index < count;
+            unpacked |= uint64_t(palette[std::min(index, count - 1)]) << j * 8;
+        }
+        expanded[byte] = unpacked;
+    }
+    
+    bool intact = true;
+    for (int i = 0; i < CHUNK_VOLUME; i += per_byte) {
+        int byte = *in++;
+        intact &= valid[byte];
+        memcpy(values + i, &expanded[byte], per_byte);
+    }
+    return intact;
+}
+
+}
+
+void ColumnCodec::Encode(const Column& column, std::vector<uint8_t>& out) {
+    uint16_t mask = 0;
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        mask |= static_cast<uint16_t>(column.GetSection(i) != nullptr) << i;
+    }
+    out.push_back(static_cast<uint8_t>(mask));
+    out.push_back(static_cast<uint8_t>(mask >> 8));
+    
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        if (const Section* section = column.GetSection(i)) {
+            EncodePaletted(reinterpret_cast<const uint8_t*>(section->Blocks.data()), out);
+            EncodePaletted(section->Light.data(), out);
+        }
+    }
+}
+
+bool ColumnCodec::Decode(const uint8_t* data, size_t size, Column& column) {
+    const uint8_t* in = data;
+    const uint8_t* end = data + size;
+    if (size < 2) {
+        return false;
+    }
+    uint16_t mask = static_cast<uint16_t>(in[0] | in[1] << 8);
+    in += 2;
+    
+    // Decoded aside so a malformed blob leaves the column untouched
+    std::array<std::unique_ptr<Section>, COLUMN_SECTIONS> sections;
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        if (!(mask >> i & 1)) {
+            continue;
+        }
+        
+        sections[i] = std::make_unique<Section>();
+        if (!DecodePaletted(in, end, reinterpret_cast<uint8_t*>(sections[i]->Blocks.data()))
+            || !DecodePaletted(in, end, sections[i]->Light.data())) {
+            return false;
+        }
+    }
+    
+    if (in != end) {
+        return false;
+    }
+    
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        column.SetSection(i, std::move(sections[i]));
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef ColumnCodec_h
+#define ColumnCodec_h
+
+#include "Column.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Serialized form of a column: a mask of its allocated sections, then the blocks and the light of
+// each of them. Both arrays are stored as a palette of the values they use and indices packed to
+// 0, 1, 2, 4 or 8 bits, so a section of stone and water with uniform light costs a few hundred bytes
+// before compression.
+class ColumnCodec {
+public:
+    static void Encode(const Column& column, std::vector<uint8_t>& out);
+    
+    // Replaces every section of the column, fails on truncated or malformed data
+    static bool Decode(const uint8_t* data, size_t size, Column& column);
+};
+
+#endif
@@ -0,0 +1,405 @@
+#include "EditLog.h"
+#include "World.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define EDIT_LOG_SSE42
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t MAGIC = 0x4c57434d; // "MCWL"
+
+// Castagnoli polynomial, reflected
+std::array<uint32_t, 256> CrcTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? crc >> 1 ^ 0x82f63b78 : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+#ifdef EDIT_LOG_SSE42
+
+// Same checksum from the crc32 instruction, eight bytes at a time
+__attribute__((target("sse4.2"))) uint32_t Crc32cSse42(const uint8_t* data, size_t size) {
+    uint64_t crc = ~0u;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u64(crc, word);
+    }
+    
+    uint32_t tail = static_cast<uint32_t>(crc);
+    for (; size > 0; data++, size--) {
+        tail = _mm_crc32_u8(tail, *data);
+    }
+    return ~tail;
+}
+
+#endif
+
+uint32_t Crc32c(const uint8_t* data, size_t size) {
+#ifdef EDIT_LOG_SSE42
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) {
+        return Crc32cSse42(data, size);
+    }
+#endif
+    
+    static const std::array<uint32_t, 256> table = CrcTable();
+    uint32_t crc = ~0u;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ crc >> 8;
+    }
+    return ~crc;
+}
+
+bool WriteAll(int descriptor, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(descriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// New and deleted segments only survive a crash once their directory is synced
+bool SyncDirectory(const std::string& directory) {
+    int descriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return false;
+    }
+    bool synced = fsync(descriptor) == 0;
+    close(descriptor);
+    return synced;
+}
+
+}
+
+EditLog::EditLog(std::string directory)
+    : m_Directory(std::move(directory))
+    , m_Frame(sizeof(FrameHeader)) {
+}
+
+EditLog::~EditLog() {
+    if (!m_Thread.joinable()) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_Wake.notify_one();
+    m_Thread.join();
+    
+    if (m_Descriptor >= 0) {
+        close(m_Descriptor);
+    }
+}
+
+bool EditLog::Open() {
+    std::error_code error;
+    std::filesystem::create_directories(m_Directory, error);
+    if (error) {
+        std::cerr << "Failed to create log directory " << m_Directory << "\n";
+        return false;
+    }
+    
+    std::vector<uint64_t> segments = ListSegments(m_Directory);
+    m_Segment = segments.empty() ? 0 : segments.back() + 1;
+    m_Thread = std::thread([this]() { Work(); });
+    return true;
+}
+
+uint64_t EditLog::Commit() {
+    if (m_Frame.size() == sizeof(FrameHeader)) {
+        return m_Sequence;
+    }
+    
+    FrameHeader header{};
+    header.Magic = MAGIC;
+    header.Sequence = ++m_Sequence;
+    header.Count = static_cast<uint32_t>((m_Frame.size() - sizeof(FrameHeader)) / RECORD_SIZE);
+    memcpy(m_Frame.data(), &header, sizeof(header));
+    
+    // The thread only sleeps while nothing is queued
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        idle = m_Batches.empty();
+        if (idle || m_Batches.back().Segment != m_Segment) {
+            m_Batches.push_back({m_Segment, 0, {}});
+        }
+        Batch& batch = m_Batches.back();
+        batch.Sequence = m_Sequence;
+        batch.Frames.insert(batch.Frames.end(), m_Frame.begin(), m_Frame.end());
+    }
+    if (idle) {
+        m_Wake.notify_one();
+    }
+    
+    m_Frame.resize(sizeof(FrameHeader));
+    return m_Sequence;
+}
+
+uint64_t EditLog::GetDurableSequence() const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Durable;
+}
+
+bool EditLog::WaitDurable(uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Synced.wait(lock, [&]() {
+        return m_Durable >= sequence || m_Failed;
+    });
+    return m_Durable >= sequence;
+}
+
+bool EditLog::HasFailed() const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Failed;
+}
+
+uint64_t EditLog::Rotate() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return ++m_Segment;
+}
+
+void EditLog::Checkpoint(uint64_t segment) {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Checkpoint = std::max(m_Checkpoint, segment);
+    }
+    m_Wake.notify_one();
+}
+
+void EditLog::Work() {
+#ifdef __linux__
+    // Like the chunk I/O thread, a commit must not hand the core over in the middle of a tick
+    sched_param parameters{};
+    pthread_setschedparam(pthread_self(), SCHED_BATCH, &parameters);
+#endif
+    
+    std::vector<Batch> batches;
+    
+    while (true) {
+        uint64_t checkpoint = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait(lock, [this]() {
+                return m_Stopping || !m_Batches.empty() || m_Checkpoint > m_Deleted;
+            });
+            
+            if (m_Batches.empty() && m_Checkpoint <= m_Deleted) {
+                return;
+            }
+            batches.swap(m_Batches);
+            checkpoint = m_Checkpoint;
+        }
+        
+        bool written = true;
+        uint64_t sequence = 0;
+        for (Batch& batch : batches) {
+            // Checksums cover everything after themselves
+            for (size_t offset = 0; offset < batch.Frames.size();) {
+                FrameHeader header;
+                memcpy(&header, batch.Frames.data() + offset, sizeof(header));
+                size_t size = sizeof(FrameHeader) + header.Count * RECORD_SIZE;
+                header.Checksum = Crc32c(batch.Frames.data() + offset + 8, size - 8);
+                memcpy(batch.Frames.data() + offset, &header, sizeof(header));
+                offset += size;
+            }
+            
+            // Frames of the previous segment are synced before any go to the next one
+            if (written && (m_Descriptor < 0 || batch.Segment != m_OpenSegment)) {
+                written = (m_Descriptor < 0 || fdatasync(m_Descriptor) == 0) && OpenSegment(batch.Segment);
+            }
+            written = written && WriteAll(m_Descriptor, batch.Frames.data(), batch.Frames.size());
+            sequence = batch.Sequence;
+        }
+        if (written && !batches.empty() && fdatasync(m_Descriptor) != 0) {
+            written = false;
+        }
+        
+        if (checkpoint > m_Deleted) {
+            DeleteSegments(m_Directory, checkpoint);
+            m_Deleted = checkpoint;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!written && !m_Failed) {
+                std::cerr << "Failed to write edit log " << SegmentPath(m_Directory, m_OpenSegment) << "\n";
+                m_Failed = true;
+            }
+            if (written && !m_Failed && !batches.empty()) {
+                m_Durable = sequence;
+            }
+        }
+        m_Synced.notify_all();
+        batches.clear();
+    }
+}
+
+bool EditLog::OpenSegment(uint64_t segment) {
+    if (m_Descriptor >= 0) {
+        close(m_Descriptor);
+    }
+    
+    m_OpenSegment = segment;
+    m_Descriptor = open(SegmentPath(m_Directory, segment).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    return m_Descriptor >= 0 && SyncDirectory(m_Directory);
+}
+
+void EditLog::DeleteSegments(const std::string& directory, uint64_t before) {
+    bool deleted = false;
+    for (uint64_t segment : ListSegments(directory)) {
+        if (segment < before) {
+            deleted |= unlink(SegmentPath(directory, segment).c_str()) == 0;
+        }
+    }
+    if (deleted) {
+        SyncDirectory(directory);
+    }
+}
+
+std::string EditLog::SegmentPath(const std::string& directory, uint64_t segment) {
+    return directory + "/edits." + std::to_string(segment) + ".log";
+}
+
+std::vector<uint64_t> EditLog::ListSegments(const std::string& directory) {
+    std::vector<uint64_t> segments;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 10 && name.compare(0, 6, "edits.") == 0 && name.compare(name.size() - 4, 4, ".log") == 0) {
+            std::string number = name.substr(6, name.size() - 10);
+            if (number.find_first_not_of("0123456789") == std::string::npos) {
+                segments.push_back(std::stoull(number));
+            }
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+bool EditLog::Read(const std::string& directory, std::vector<BlockEdit>& edits) {
+    std::vector<uint8_t> data;
+    for (uint64_t segment : ListSegments(directory)) {
+        std::string path = SegmentPath(directory, segment);
+        int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+            std::cerr << "Failed to open edit log " << path << "\n";
+            return false;
+        }
+        
+        data.clear();
+        uint8_t buffer[65536];
+        ssize_t count;
+        while ((count = read(descriptor, buffer, sizeof(buffer))) != 0) {
+            if (count < 0 && errno != EINTR) {
+                std::cerr << "Failed to read edit log " << path << "\n";
+                close(descriptor);
+                return false;
+            }
+            data.insert(data.end(), buffer, buffer + std::max<ssize_t>(count, 0));
+        }
+        close(descriptor);
+        
+        for (size_t offset = 0; offset < data.size();) {
+            FrameHeader header{};
+            bool intact = data.size() - offset >= sizeof(header);
+            size_t size = 0;
+            if (intact) {
+                memcpy(&header, data.data() + offset, sizeof(header));
+                size = sizeof(FrameHeader) + static_cast<size_t>(header.Count) * RECORD_SIZE;
+                intact = header.Magic == MAGIC && size <= data.size() - offset && Crc32c(data.data() + offset + 8, size - 8) == header.Checksum;
+            }
+            if (!intact) {
+                std::cerr << "Dropped damaged edit log frames from " << path << " on, " << data.size() - offset << " bytes\n";
+                return true;
+            }
+            
+            for (const uint8_t* record = data.data() + offset + sizeof(header); record < data.data() + offset + size; record += RECORD_SIZE) {
+                BlockEdit edit;
+                memcpy(&edit.X, record, 4);
+                memcpy(&edit.Z, record + 4, 4);
+                edit.Y = record[8];
+                edit.Value = static_cast<Block>(record[9]);
+                edits.push_back(edit);
+            }
+            offset += size;
+        }
+    }
+    return true;
+}
+
+bool EditLog::Replay(const std::string& directory, RegionStorage& storage, const std::function<void(Column&)>& generate) {
+    std::vector<BlockEdit> edits;
+    if (!Read(directory, edits)) {
+        return false;
+    }
+    
+    std::unordered_map<uint64_t, std::unique_ptr<Column>> columns;
+    for (const BlockEdit& edit : edits) {
+        ColumnPosition position = World::ColumnAt(edit.X, edit.Z);
+        auto& column = columns[World::Key(position)];
+        if (!column) {
+            column = std::make_unique<Column>(position);
+            LoadResult loaded = storage.LoadColumn(position, *column);
+            if (loaded == LoadResult::Damaged) {
+                // Saving over it would lose whatever is left of it, and the log with it
+                std::cerr << "Failed to replay edit log " << directory << ", column " << position.X << ", " << position.Z
+                    << " is damaged\n";
+                return false;
+            }
+            if (loaded == LoadResult::Missing && generate) {
+                generate(*column);
+            }
+        }
+        column->SetBlock(edit.X & (CHUNK_SIZE - 1), edit.Y, edit.Z & (CHUNK_SIZE - 1), edit.Value);
+    }
+    
+    bool saved = true;
+    for (auto& [key, column] : columns) {
+        saved &= storage.SaveColumn(*column);
+    }
+    if (!saved || !storage.Flush()) {
+        std::cerr << "Failed to replay edit log " << directory << "\n";
+        return false;
+    }
+    
+    std::vector<uint64_t> segments = ListSegments(directory);
+    if (!segments.empty()) {
+        DeleteSegments(directory, segments.back() + 1);
+    }
+    return true;
+}
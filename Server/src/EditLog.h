@@ -0,0 +1,129 @@
+#ifndef EditLog_h
+#define EditLog_h
+
+#include "RegionStorage.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Write-ahead log of the block edits made since the last autosave, so a crash loses nothing that
+// was committed. Edits of a tick are appended to one frame, and Commit hands the frame to a thread
+// of its own that writes every frame queued since its last pass with one write and one sync. The
+// log is split into segments named edits.<n>.log: an autosave rotates to a new segment when it
+// takes its snapshots, and once they are saved and synced the segments before it are deleted.
+// Frames carry a CRC32C of their records, filled in on the log thread, so a commit cut short by a
+// crash is recognised and dropped when the log is replayed.
+class EditLog {
+public:
+    struct BlockEdit {
+        int X;
+        int Y;
+        int Z;
+        Block Value;
+    };
+    
+    explicit EditLog(std::string directory);
+    EditLog(const EditLog&) = delete;
+    EditLog& operator=(const EditLog&) = delete;
+    // Writes and syncs everything committed first
+    ~EditLog();
+    
+    // Creates the directory when it is missing and starts the thread. Commits go to a segment after
+    // the ones already there, which have to be replayed before the world changes again.
+    bool Open();
+    
+    // World block coordinates of a change that went through, y within the column
+    void Append(int x, int y, int z, Block block) {
+        size_t offset = m_Frame.size();
+        m_Frame.resize(offset + RECORD_SIZE);
+        uint8_t* record = m_Frame.data() + offset;
+        memcpy(record, &x, 4);
+        memcpy(record + 4, &z, 4);
+        record[8] = static_cast<uint8_t>(y);
+        record[9] = static_cast<uint8_t>(block);
+    }
+    // Call once per tick, queues the edits appended since the last commit as one frame. Returns
+    // the sequence number of the frame, or of the last one when nothing was appended.
+    uint64_t Commit();
+    
+    // Highest sequence number written and synced
+    uint64_t GetDurableSequence() const;
+    // Returns false when the log failed to write before reaching the sequence
+    bool WaitDurable(uint64_t sequence);
+    bool HasFailed() const;
+    
+    // Later commits go to a new segment, returns its number. Call when an autosave takes its
+    // snapshots, right after the commit of the tick.
+    uint64_t Rotate();
+    // Deletes the segments before the given one, call once everything they hold is saved and synced
+    void Checkpoint(uint64_t segment);
+    
+    const std::string& GetDirectory() const { return m_Directory; }
+    
+    // Appends the edits of every intact frame in the directory, oldest first. Reading stops at the
+    // first damaged frame, which is where a crash cut the last commit short.
+    static bool Read(const std::string& directory, std::vector<BlockEdit>& edits);
+    // Applies the log to the region files, then deletes the segments once the columns are saved and
+    // synced. Columns that were never saved are filled by generate first when it is given, so edits
+    // to terrain generated after the last autosave keep the terrain around them. A saved column that
+    // cannot be read stops the replay before anything is written. On failure the segments are left
+    // for the next attempt.
+    static bool Replay(const std::string& directory, RegionStorage& storage, const std::function<void(Column&)>& generate = nullptr);
+
+private:
+    static constexpr size_t RECORD_SIZE = 10;
+    
+    struct FrameHeader {
+        uint32_t Magic;
+        // CRC32C of the rest of the header and the records
+        uint32_t Checksum;
+        uint64_t Sequence;
+        uint32_t Count;
+        uint32_t Reserved;
+    };
+    
+    // Frames committed to one segment that the thread has not written yet
+    struct Batch {
+        uint64_t Segment;
+        uint64_t Sequence;
+        std::vector<uint8_t> Frames;
+    };
+    
+    std::string m_Directory;
+    
+    // Only touched by the tick thread
+    std::vector<uint8_t> m_Frame;
+    uint64_t m_Sequence = 0;
+    
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Synced;
+    std::vector<Batch> m_Batches;
+    uint64_t m_Segment = 0;
+    uint64_t m_Checkpoint = 0;
+    uint64_t m_Durable = 0;
+    bool m_Failed = false;
+    bool m_Stopping = false;
+    
+    // Only touched by the log thread
+    int m_Descriptor = -1;
+    uint64_t m_OpenSegment = 0;
+    uint64_t m_Deleted = 0;
+    
+    std::thread m_Thread;
+    
+    void Work();
+    bool OpenSegment(uint64_t segment);
+    
+    static std::string SegmentPath(const std::string& directory, uint64_t segment);
+    static std::vector<uint64_t> ListSegments(const std::string& directory);
+    static void DeleteSegments(const std::string& directory, uint64_t before);
+};
+
+#endif
@@ -0,0 +1,285 @@
+#include "FileIo.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <cerrno>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define FILE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+constexpr unsigned RING_ENTRIES = 256;
+
+// Blocking transfer of a whole request
+bool Transfer(FileIo::Request& request) {
+    uint8_t* data = request.Data;
+    uint64_t offset = request.Offset;
+    size_t size = request.Size;
+    while (size > 0) {
+        ssize_t count = request.Write
+            ? pwrite(request.Descriptor, data, size, static_cast<off_t>(offset))
+            : pread(request.Descriptor, data, size, static_cast<off_t>(offset));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        offset += static_cast<uint64_t>(count);
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+}
+
+#ifdef FILE_IO_URING
+
+// Submission and completion queues shared with the kernel. Only the thread running a batch touches
+// them, so the only ordering needed is against the kernel: acquire its tails, release our heads.
+struct FileIo::Ring {
+    int Descriptor = -1;
+    unsigned Capacity = 0;
+    
+    void* SubmissionMemory = MAP_FAILED;
+    size_t SubmissionSize = 0;
+    void* CompletionMemory = MAP_FAILED;
+    size_t CompletionSize = 0;
+    io_uring_sqe* Submissions = nullptr;
+    size_t SubmissionsSize = 0;
+    
+    unsigned* SubmissionTail = nullptr;
+    unsigned* SubmissionMask = nullptr;
+    unsigned* SubmissionArray = nullptr;
+    unsigned* CompletionHead = nullptr;
+    unsigned* CompletionTail = nullptr;
+    unsigned* CompletionMask = nullptr;
+    io_uring_cqe* Completions = nullptr;
+    
+    ~Ring() {
+        if (Submissions) {
+            munmap(Submissions, SubmissionsSize);
+        }
+        if (CompletionMemory != MAP_FAILED && CompletionMemory != SubmissionMemory) {
+            munmap(CompletionMemory, CompletionSize);
+        }
+        if (SubmissionMemory != MAP_FAILED) {
+            munmap(SubmissionMemory, SubmissionSize);
+        }
+        if (Descriptor >= 0) {
+            close(Descriptor);
+        }
+    }
+};
+
+namespace {
+
+template<typename T>
+T* At(void* memory, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(memory) + offset);
+}
+
+}
+
+// Read and write on plain buffers arrived after the ring itself, so they are probed for
+std::unique_ptr<FileIo::Ring> FileIo::CreateRing(unsigned entries) {
+    io_uring_params params{};
+    auto ring = std::make_unique<Ring>();
+    ring->Descriptor = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring->Descriptor < 0) {
+        return nullptr;
+    }
+    ring->Capacity = params.sq_entries;
+    
+    std::vector<uint8_t> probe_memory(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(probe_memory.data());
+    if (syscall(__NR_io_uring_register, ring->Descriptor, IORING_REGISTER_PROBE, probe, 256) < 0
+        || probe->last_op < IORING_OP_WRITE
+        || !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+        || !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) {
+        return nullptr;
+    }
+    
+    ring->SubmissionSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->CompletionSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_map) {
+        ring->SubmissionSize = std::max(ring->SubmissionSize, ring->CompletionSize);
+    }
+    
+    ring->SubmissionMemory = mmap(nullptr, ring->SubmissionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->Descriptor, IORING_OFF_SQ_RING);
+    if (ring->SubmissionMemory == MAP_FAILED) {
+        return nullptr;
+    }
+    
+    ring->CompletionMemory = single_map ? ring->SubmissionMemory : mmap(nullptr, ring->CompletionSize,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->Descriptor, IORING_OFF_CQ_RING);
+    if (ring->CompletionMemory == MAP_FAILED) {
+        return nullptr;
+    }
+    
+    ring->SubmissionsSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* entries_memory = mmap(nullptr, ring->SubmissionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->Descriptor, IORING_OFF_SQES);
+    if (entries_memory == MAP_FAILED) {
+        return nullptr;
+    }
+    ring->Submissions = static_cast<io_uring_sqe*>(entries_memory);
+    
+    ring->SubmissionTail = At<unsigned>(ring->SubmissionMemory, params.sq_off.tail);
+    ring->SubmissionMask = At<unsigned>(ring->SubmissionMemory, params.sq_off.ring_mask);
+    ring->SubmissionArray = At<unsigned>(ring->SubmissionMemory, params.sq_off.array);
+    ring->CompletionHead = At<unsigned>(ring->CompletionMemory, params.cq_off.head);
+    ring->CompletionTail = At<unsigned>(ring->CompletionMemory, params.cq_off.tail);
+    ring->CompletionMask = At<unsigned>(ring->CompletionMemory, params.cq_off.ring_mask);
+    ring->Completions = At<io_uring_cqe>(ring->CompletionMemory, params.cq_off.cqes);
+    return ring;
+}
+
+#else
+
+struct FileIo::Ring {
+};
+
+std::unique_ptr<FileIo::Ring> FileIo::CreateRing(unsigned) {
+    return nullptr;
+}
+
+#endif
+
+FileIo::FileIo(IoBackend backend, unsigned thread_count)
+    : m_Backend(backend) {
+    if (m_Backend == IoBackend::Uring) {
+        m_Ring = CreateRing(RING_ENTRIES);
+    }
+    if (m_Backend == IoBackend::Uring && !m_Ring) {
+        std::cerr << "Failed to set up io_uring, falling back to threads\n";
+        m_Backend = IoBackend::Threads;
+    }
+    
+    if (m_Backend == IoBackend::Threads) {
+        m_Jobs = std::make_unique<JobPool>(thread_count);
+    }
+}
+
+FileIo::~FileIo() = default;
+
+void FileIo::Run(Request* requests, size_t count) {
+    if (m_Backend == IoBackend::Uring) {
+        RunUring(requests, count);
+    } else {
+        RunThreads(requests, count);
+    }
+}
+
+bool FileIo::SupportsUring() {
+    static bool supported = CreateRing(1) != nullptr;
+    return supported;
+}
+
+IoBackend FileIo::DefaultBackend() {
+    return SupportsUring() ? IoBackend::Uring : IoBackend::Threads;
+}
+
+void FileIo::RunThreads(Request* requests, size_t count) {
+    m_Jobs->ParallelFor(count, [requests](size_t i) {
+        requests[i].Succeeded = Transfer(requests[i]);
+    });
+}
+
+void FileIo::RunUring(Request* requests, size_t count) {
+#ifdef FILE_IO_URING
+    Ring& ring = *m_Ring;
+    
+    // Bytes done per request, short transfers go back into the queue for the rest
+    std::vector<size_t> done(count, 0);
+    std::vector<size_t> resume;
+    size_t next = 0;
+    unsigned in_flight = 0;
+    unsigned unsubmitted = 0;
+    for (size_t i = 0; i < count; i++) {
+        requests[i].Succeeded = requests[i].Size == 0;
+    }
+    
+    auto queue = [&](size_t i) {
+        Request& request = requests[i];
+        unsigned tail = *ring.SubmissionTail;
+        unsigned slot = tail & *ring.SubmissionMask;
+        io_uring_sqe& entry = ring.Submissions[slot];
+        entry = {};
+        entry.opcode = request.Write ? IORING_OP_WRITE : IORING_OP_READ;
+        entry.fd = request.Descriptor;
+        entry.off = request.Offset + done[i];
+        entry.addr = reinterpret_cast<uint64_t>(request.Data + done[i]);
+        entry.len = static_cast<uint32_t>(request.Size - done[i]);
+        entry.user_data = i;
+        ring.SubmissionArray[slot] = slot;
+        __atomic_store_n(ring.SubmissionTail, tail + 1, __ATOMIC_RELEASE);
+        in_flight++;
+        unsubmitted++;
+    };
+    
+    while (next < count || !resume.empty() || in_flight > 0) {
+        while (!resume.empty() && in_flight < ring.Capacity) {
+            queue(resume.back());
+            resume.pop_back();
+        }
+        while (next < count && in_flight < ring.Capacity) {
+            if (requests[next].Size > 0) {
+                queue(next);
+            }
+            next++;
+        }
+        if (in_flight == 0) {
+            continue;
+        }
+        
+        int submitted = static_cast<int>(syscall(__NR_io_uring_enter, ring.Descriptor, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            
+            // Not expected past setup, the ring is given up on and the rest of the batch fails
+            std::cerr << "Failed to submit to io_uring, falling back to threads\n";
+            m_Ring.reset();
+            m_Backend = IoBackend::Threads;
+            m_Jobs = std::make_unique<JobPool>();
+            return;
+        }
+        unsubmitted -= static_cast<unsigned>(submitted);
+        
+        unsigned head = *ring.CompletionHead;
+        while (head != __atomic_load_n(ring.CompletionTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& completion = ring.Completions[head & *ring.CompletionMask];
+            size_t i = completion.user_data;
+            in_flight--;
+            head++;
+            
+            if (completion.res > 0) {
+                done[i] += static_cast<size_t>(completion.res);
+                if (done[i] < requests[i].Size) {
+                    resume.push_back(i);
+                } else {
+                    requests[i].Succeeded = true;
+                }
+            } else if (completion.res == -EINTR || completion.res == -EAGAIN) {
+                resume.push_back(i);
+            }
+        }
+        __atomic_store_n(ring.CompletionHead, head, __ATOMIC_RELEASE);
+    }
+#else
+    RunThreads(requests, count);
+#endif
+}
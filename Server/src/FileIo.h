@@ -0,0 +1,57 @@
+#ifndef FileIo_h
+#define FileIo_h
+
+#include "JobPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+enum class IoBackend : uint8_t {
+    Threads,
+    Uring
+};
+
+// Runs batches of positional reads and writes. The uring backend submits a whole batch with one
+// system call and waits for its completions on the calling thread; the fallback spreads blocking
+// pread and pwrite calls over a pool of threads. Short transfers are resumed until they finish.
+class FileIo {
+public:
+    struct Request {
+        int Descriptor = -1;
+        uint64_t Offset = 0;
+        uint8_t* Data = nullptr;
+        size_t Size = 0;
+        bool Write = false;
+        bool Succeeded = false;
+    };
+    
+    // Falls back to threads when io_uring cannot be set up
+    explicit FileIo(IoBackend backend = DefaultBackend(), unsigned thread_count = 4);
+    FileIo(const FileIo&) = delete;
+    FileIo& operator=(const FileIo&) = delete;
+    ~FileIo();
+    
+    IoBackend GetBackend() const { return m_Backend; }
+    
+    // Returns once every request has completed, requests of one batch run in no particular order
+    void Run(Request* requests, size_t count);
+    
+    static bool SupportsUring();
+    static IoBackend DefaultBackend();
+
+private:
+    struct Ring;
+    
+    IoBackend m_Backend;
+    std::unique_ptr<Ring> m_Ring;
+    std::unique_ptr<JobPool> m_Jobs;
+    
+    // Nullptr when io_uring or the operations used are not available
+    static std::unique_ptr<Ring> CreateRing(unsigned entries);
+    
+    void RunUring(Request* requests, size_t count);
+    void RunThreads(Request* requests, size_t count);
+};
+
+#endif
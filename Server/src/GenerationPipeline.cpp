@@ -0,0 +1,226 @@
+#include "GenerationPipeline.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+// Columns further than this from a requested one are never needed
+constexpr int RING_RADIUS = 2;
+
+GenerationStage Next(GenerationStage stage) {
+    return static_cast<GenerationStage>(static_cast<int>(stage) + 1);
+}
+
+// Stage a column must reach when it lies on the given ring around a requested one
+GenerationStage RingTarget(int ring) {
+    return ring == 0 ? GenerationStage::Lighting : ring == 1 ? GenerationStage::Decoration : GenerationStage::Caves;
+}
+
+uint64_t Nanoseconds(std::chrono::steady_clock::duration duration) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+}
+
+GenerationPipeline::GenerationPipeline(uint32_t seed, JobPool& jobs, NoiseBackend backend)
+    : m_Generator(seed, backend)
+    , m_Jobs(jobs) {
+}
+
+void GenerationPipeline::Generate(World& world, const std::vector<ColumnPosition>& positions) {
+    // Every column involved with the furthest stage any requested column needs it to reach
+    std::vector<ColumnPosition> order;
+    std::vector<GenerationStage> targets;
+    std::unordered_map<uint64_t, size_t> lookup;
+    for (ColumnPosition position : positions) {
+        for (int dz = -RING_RADIUS; dz <= RING_RADIUS; dz++) {
+            for (int dx = -RING_RADIUS; dx <= RING_RADIUS; dx++) {
+                ColumnPosition around{position.X + dx, position.Z + dz};
+                GenerationStage target = RingTarget(std::max(std::abs(dx), std::abs(dz)));
+                auto [found, inserted] = lookup.try_emplace(World::Key(around), order.size());
+                if (inserted) {
+                    order.push_back(around);
+                    targets.push_back(target);
+                } else {
+                    targets[found->second] = std::max(targets[found->second], target);
+                }
+            }
+        }
+    }
+    
+    size_t count = order.size();
+    auto entries = std::make_unique<Entry[]>(count);
+    size_t remaining = 0;
+    for (size_t i = 0; i < count; i++) {
+        Entry& entry = entries[i];
+        entry.Position = order[i];
+        entry.Target = targets[i];
+        if (entry.Target == GenerationStage::Lighting) {
+            entry.Blocks = world.LoadColumn(entry.Position);
+        } else {
+            entry.Scratch = std::make_unique<Column>(entry.Position);
+            entry.Blocks = entry.Scratch.get();
+        }
+        
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                auto found = lookup.find(World::Key({entry.Position.X + dx, entry.Position.Z + dz}));
+                entry.Neighbours[(dx + 1) + (dz + 1) * 3] = found != lookup.end() ? &entries[found->second] : nullptr;
+            }
+        }
+        remaining += static_cast<size_t>(entry.Target);
+    }
+    
+    m_Queue = std::make_unique<WorkQueue<Entry*>>(count);
+    m_Remaining = remaining;
+    
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; i++) {
+        entries[i].ReadyTime = start;
+        TrySchedule(entries[i]);
+    }
+    
+    m_Jobs.ParallelFor(m_Jobs.GetThreadCount(), [this](size_t) {
+        Work();
+    });
+    m_Queue.reset();
+    
+    for (int i = 0; i < GENERATION_STAGE_COUNT; i++) {
+        m_Stats[i].Runs = m_Counters[i].Runs;
+        m_Stats[i].BusySeconds = m_Counters[i].BusyNanoseconds * 1e-9;
+        m_Stats[i].StallSeconds = m_Counters[i].StallNanoseconds * 1e-9;
+    }
+    m_IdleSeconds = m_IdleNanoseconds * 1e-9;
+}
+
+void GenerationPipeline::ResetStats() {
+    for (StageCounters& counters : m_Counters) {
+        counters.Runs = 0;
+        counters.BusyNanoseconds = 0;
+        counters.StallNanoseconds = 0;
+    }
+    m_IdleNanoseconds = 0;
+    m_Stats = {};
+    m_IdleSeconds = 0.0;
+}
+
+bool GenerationPipeline::IsReady(const Entry& entry) const {
+    GenerationStage stage = entry.Stage;
+    if (stage >= entry.Target) {
+        return false;
+    }
+    
+    // Noise, surface and caves only touch their own column
+    GenerationStage next = Next(stage);
+    if (next < GenerationStage::Decoration) {
+        return true;
+    }
+    
+    for (const Entry* neighbour : entry.Neighbours) {
+        if (!neighbour || neighbour->Stage < stage) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void GenerationPipeline::TrySchedule(Entry& entry) {
+    // Readiness is checked again after claiming the entry: between the first check and the claim
+    // another thread may have queued it, run the stage and released it
+    while (IsReady(entry)) {
+        if (entry.Queued.exchange(true)) {
+            return;
+        }
+        
+        if (IsReady(entry)) {
+            m_Queue->Push(&entry);
+            return;
+        }
+        entry.Queued = false;
+    }
+}
+
+void GenerationPipeline::RunStage(Entry& entry) {
+    GenerationStage stage = Next(entry.Stage);
+    auto start = Clock::now();
+    
+    switch (stage) {
+        case GenerationStage::Noise:
+            m_Generator.NoiseStage(entry.Position, entry.Surface, *entry.Blocks);
+            break;
+        case GenerationStage::Surface:
+            m_Generator.SurfaceStage(entry.Surface, *entry.Blocks);
+            break;
+        case GenerationStage::Caves:
+            m_Generator.CaveStage(entry.Position, entry.Surface, *entry.Blocks);
+            break;
+        case GenerationStage::Decoration: {
+            Neighbourhood<const ColumnSurface> surfaces;
+            for (size_t i = 0; i < surfaces.size(); i++) {
+                surfaces[i] = &entry.Neighbours[i]->Surface;
+            }
+            m_Generator.DecorationStage(entry.Position, surfaces, *entry.Blocks);
+            break;
+        }
+        case GenerationStage::Lighting: {
+            Neighbourhood<const Column> columns;
+            for (size_t i = 0; i < columns.size(); i++) {
+                columns[i] = entry.Neighbours[i]->Blocks;
+            }
+            m_Generator.LightingStage(columns, *entry.Blocks);
+            break;
+        }
+        default:
+            break;
+    }
+    
+    auto end = Clock::now();
+    StageCounters& counters = m_Counters[static_cast<int>(stage) - 1];
+    counters.Runs++;
+    counters.BusyNanoseconds += Nanoseconds(end - start);
+    counters.StallNanoseconds += Nanoseconds(start - entry.ReadyTime);
+    entry.ReadyTime = end;
+    
+    // Publish the stage before releasing the entry, then wake whatever was waiting on it
+    entry.Stage = stage;
+    entry.Queued = false;
+    m_Remaining--;
+    
+    for (Entry* neighbour : entry.Neighbours) {
+        if (neighbour) {
+            TrySchedule(*neighbour);
+        }
+    }
+}
+
+void GenerationPipeline::Work() {
+    uint64_t idle = 0;
+    Clock::time_point idle_start;
+    bool waiting = false;
+    
+    while (m_Remaining > 0) {
+        Entry* entry = nullptr;
+        if (!m_Queue->Pop(entry)) {
+            if (!waiting) {
+                idle_start = Clock::now();
+                waiting = true;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        
+        if (waiting) {
+            idle += Nanoseconds(Clock::now() - idle_start);
+            waiting = false;
+        }
+        RunStage(*entry);
+    }
+    
+    if (waiting) {
+        idle += Nanoseconds(Clock::now() - idle_start);
+    }
+    m_IdleNanoseconds += idle;
+}
@@ -0,0 +1,97 @@
+#ifndef GenerationPipeline_h
+#define GenerationPipeline_h
+
+#include "JobPool.h"
+#include "TerrainGenerator.h"
+#include "WorkQueue.h"
+#include "World.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Last stage a column has completed, stages run in this order
+enum class GenerationStage : uint8_t {
+    Empty,
+    Noise,
+    Surface,
+    Caves,
+    Decoration,
+    Lighting
+};
+
+constexpr int GENERATION_STAGE_COUNT = static_cast<int>(GenerationStage::Lighting);
+
+// Runs the terrain generator stage by stage over many columns at once. Decoration only starts once
+// the eight columns around it have their caves, and lighting once they are decorated. Workers pull
+// ready stages from a lock-free queue, and a column that finishes a stage queues itself and any
+// neighbour that was only waiting on it, so there is no global lock and no pass-wide barrier.
+class GenerationPipeline {
+public:
+    struct StageStats {
+        uint64_t Runs = 0;
+        double BusySeconds = 0.0;
+        // Time between a column finishing the previous stage and starting this one, spent waiting
+        // on its neighbours or for a free worker
+        double StallSeconds = 0.0;
+    };
+    
+    GenerationPipeline(uint32_t seed, JobPool& jobs, NoiseBackend backend = Noise::DefaultBackend());
+    
+    // Generates every position through lighting and loads it into the world, replacing what was
+    // there. The two rings of columns around them are generated as far as the requested ones need
+    // and dropped afterwards; generation is deterministic, so they come out the same when requested.
+    void Generate(World& world, const std::vector<ColumnPosition>& positions);
+    
+    NoiseBackend GetBackend() const { return m_Generator.GetBackend(); }
+    
+    // Totals since construction or the last reset, indexed by stage - 1
+    const std::array<StageStats, GENERATION_STAGE_COUNT>& GetStageStats() const { return m_Stats; }
+    double GetIdleSeconds() const { return m_IdleSeconds; }
+    void ResetStats();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    struct Entry {
+        ColumnPosition Position;
+        GenerationStage Target = GenerationStage::Empty;
+        std::atomic<GenerationStage> Stage = GenerationStage::Empty;
+        std::atomic<bool> Queued = false;
+        
+        // Either a column of the world or scratch space for the rings
+        Column* Blocks = nullptr;
+        std::unique_ptr<Column> Scratch;
+        ColumnSurface Surface;
+        
+        Neighbourhood<Entry> Neighbours{};
+        Clock::time_point ReadyTime;
+    };
+    
+    struct StageCounters {
+        std::atomic<uint64_t> Runs = 0;
+        std::atomic<uint64_t> BusyNanoseconds = 0;
+        std::atomic<uint64_t> StallNanoseconds = 0;
+    };
+    
+    TerrainGenerator m_Generator;
+    JobPool& m_Jobs;
+    
+    std::unique_ptr<WorkQueue<Entry*>> m_Queue;
+    std::atomic<size_t> m_Remaining = 0;
+    std::array<StageCounters, GENERATION_STAGE_COUNT> m_Counters;
+    std::atomic<uint64_t> m_IdleNanoseconds = 0;
+    
+    std::array<StageStats, GENERATION_STAGE_COUNT> m_Stats;
+    double m_IdleSeconds = 0.0;
+    
+    bool IsReady(const Entry& entry) const;
+    void TrySchedule(Entry& entry);
+    void RunStage(Entry& entry);
+    void Work();
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "JobPool.h"
+
+JobPool::JobPool(unsigned thread_count) {
+    for (unsigned i = 1; i < thread_count; i++) {
+        m_Workers.emplace_back(&JobPool::Work, this);
+    }
+}
+
+JobPool::~JobPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+    }
+    m_Wake.notify_all();
+    
+    for (std::thread& worker : m_Workers) {
+        worker.join();
+    }
+}
+
+void JobPool::ParallelFor(size_t count, const std::function<void(size_t)>& job) {
+    if (count == 0) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Job = &job;
+        m_Count = count;
+        m_Next = 0;
+        m_Busy = m_Workers.size();
+        m_Batch++;
+    }
+    m_Wake.notify_all();
+    
+    Drain();
+    
+    // Every worker checks in before the batch ends, so none can still be reading m_Job afterwards
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Done.wait(lock, [this] { return m_Busy == 0; });
+    m_Job = nullptr;
+}
+
+void JobPool::Work() {
+    uint64_t batch = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait(lock, [&] { return m_Stopping || m_Batch != batch; });
+            if (m_Stopping) {
+                return;
+            }
+            batch = m_Batch;
+        }
+        
+        Drain();
+        
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (--m_Busy == 0) {
+            m_Done.notify_one();
+        }
+    }
+}
+
+void JobPool::Drain() {
+    for (size_t i = m_Next++; i < m_Count; i = m_Next++) {
+        (*m_Job)(i);
+    }
+}
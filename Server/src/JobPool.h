@@ -0,0 +1,45 @@
+#ifndef JobPool_h
+#define JobPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running batches of independent jobs. The calling thread works on
+// the batch too, so a pool of one thread runs everything inline.
+class JobPool {
+public:
+    explicit JobPool(unsigned thread_count = std::thread::hardware_concurrency());
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+    ~JobPool();
+    
+    unsigned GetThreadCount() const { return static_cast<unsigned>(m_Workers.size()) + 1; }
+    
+    // Calls job(i) for every i in [0, count) and returns once all of them have finished.
+    // Jobs are handed out one index at a time, so uneven jobs still balance across threads.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Done;
+    
+    const std::function<void(size_t)>* m_Job = nullptr;
+    size_t m_Count = 0;
+    std::atomic<size_t> m_Next = 0;
+    uint64_t m_Batch = 0;
+    size_t m_Busy = 0;
+    bool m_Stopping = false;
+    
+    void Work();
+    void Drain();
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "Lz4.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+constexpr int HASH_BITS = 12;
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+
+// The format wants the last five bytes to be literals and the last match to start twelve bytes
+// before the end, so decoders can copy in wide chunks without checking every byte
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT = 12;
+
+uint32_t Read32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t HashOf(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Lengths that do not fit their nibble continue in bytes of 255 and a final remainder
+uint8_t* WriteLength(uint8_t* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+bool ReadLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (in == end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}
+
+size_t Lz4Bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t Lz4Compress(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity) {
+    std::array<uint32_t, 1 << HASH_BITS> table{};
+    uint8_t* out = destination;
+    uint8_t* out_end = destination + capacity;
+    size_t anchor = 0;
+    
+    // Token, literals and offset of one sequence, or false when they would overflow the output
+    auto emit = [&](size_t literals_end, size_t offset, size_t match_length) {
+        size_t literals = literals_end - anchor;
+        size_t worst = 1 + literals / 255 + 1 + literals + 2 + match_length / 255 + 1;
+        if (worst > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+        
+        uint8_t* token = out++;
+        *token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+        if (literals >= 15) {
+            out = WriteLength(out, literals - 15);
+        }
+        memcpy(out, source + anchor, literals);
+        out += literals;
+        
+        // The final sequence is literals only
+        if (match_length == 0) {
+            return true;
+        }
+        
+        *out++ = static_cast<uint8_t>(offset);
+        *out++ = static_cast<uint8_t>(offset >> 8);
+        size_t length = match_length - MIN_MATCH;
+        *token |= static_cast<uint8_t>(std::min<size_t>(length, 15));
+        if (length >= 15) {
+            out = WriteLength(out, length - 15);
+        }
+        return true;
+    };
+    
+    if (size > MATCH_LIMIT) {
+        size_t limit = size - MATCH_LIMIT;
+        size_t position = 0;
+        while (position < limit) {
+            uint32_t sequence = Read32(source + position);
+            uint32_t& slot = table[HashOf(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint32_t>(position);
+            
+            if (candidate >= position || position - candidate > MAX_OFFSET || Read32(source + candidate) != sequence) {
+                // Skip faster through data that does not compress
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+            
+            while (position > anchor && candidate > 0 && source[position - 1] == source[candidate - 1]) {
+                position--;
+                candidate--;
+            }
+            
+            size_t length = MIN_MATCH;
+            size_t max_length = size - LAST_LITERALS - position;
+            while (length < max_length && source[candidate + length] == source[position + length]) {
+                length++;
+            }
+            
+            if (!emit(position, position - candidate, length)) {
+                return 0;
+            }
+            
+            position += length;
+            anchor = position;
+            if (position - 2 < limit) {
+                table[HashOf(Read32(source + position - 2))] = static_cast<uint32_t>(position - 2);
+            }
+        }
+    }
+    
+    if (!emit(size, 0, 0)) {
+        return 0;
+    }
+    return static_cast<size_t>(out - destination);
+}
+
+bool Lz4Decompress(const uint8_t* source, size_t source_size, uint8_t* destination, size_t size) {
+    const uint8_t* in = source;
+    const uint8_t* end = source + source_size;
+    uint8_t* out = destination;
+    uint8_t* out_end = destination + size;
+    
+    while (in < end) {
+        uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(in, end, literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(end - in) || literals > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+        
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+        if (in == end) {
+            break;
+        }
+        
+        if (end - in < 2) {
+            return false;
+        }
+        size_t offset = in[0] | in[1] << 8;
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - destination)) {
+            return false;
+        }
+        
+        size_t length = token & 15;
+        if (length == 15 && !ReadLength(in, end, length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (length > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+        
+        // Matches may overlap their own output, which repeats the last offset bytes
+        const uint8_t* match = out - offset;
+        if (offset >= length) {
+            memcpy(out, match, length);
+            out += length;
+        } else {
+            for (size_t i = 0; i < length; i++) {
+                *out++ = match[i];
+            }
+        }
+    }
+    
+    return out == out_end;
+}
@@ -0,0 +1,20 @@
+#ifndef Lz4_h
+#define Lz4_h
+
+#include <cstddef>
+#include <cstdint>
+
+// Compressor and decompressor for the LZ4 block format, so blobs can be read by any LZ4 library.
+// Compression is a single greedy pass over a small hash table of recent positions: a fraction of
+// the ratio of the high compression modes, in exchange for speeds close to a memcpy.
+
+// Largest output Lz4Compress can produce for size bytes of input
+size_t Lz4Bound(size_t size);
+
+// Returns the compressed size, or 0 when the output does not fit into capacity
+size_t Lz4Compress(const uint8_t* source, size_t size, uint8_t* destination, size_t capacity);
+
+// Fails unless the block is well formed and decompresses to exactly size bytes
+bool Lz4Decompress(const uint8_t* source, size_t source_size, uint8_t* destination, size_t size);
+
+#endif
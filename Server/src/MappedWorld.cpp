@@ -0,0 +1,168 @@
+#include "MappedWorld.h"
+#include "ColumnCodec.h"
+#include "RegionStorage.h"
+#include "World.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Linux default, the kernel's fault_around_bytes
+constexpr uintptr_t FAULT_AROUND_BYTES = 64 * 1024;
+
+}
+
+MappedWorld::MappedWorld(std::string directory, size_t cache_columns)
+    : m_Directory(std::move(directory))
+    , m_Capacity(std::max<size_t>(cache_columns, 1)) {
+    // Held until the regions are unmapped
+    std::string path = RegionStorage::LockPath(m_Directory);
+    m_Lock = open(path.c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (m_Lock < 0) {
+        std::cerr << "Failed to open lock file " << path << "\n";
+    } else if (flock(m_Lock, LOCK_SH | LOCK_NB) != 0) {
+        std::cerr << "Failed to lock world directory " << m_Directory << ", a server is writing to it\n";
+        close(m_Lock);
+        m_Lock = -1;
+    }
+}
+
+MappedWorld::~MappedWorld() {
+    for (auto& [key, region] : m_Regions) {
+        if (region) {
+            munmap(const_cast<uint8_t*>(region->Data), region->Size);
+        }
+    }
+    if (m_Lock >= 0) {
+        close(m_Lock);
+    }
+}
+
+const Column* MappedWorld::GetColumn(ColumnPosition position) {
+    uint64_t key = World::Key(position);
+    auto found = m_Lookup.find(key);
+    if (found != m_Lookup.end()) {
+        m_Cache.splice(m_Cache.begin(), m_Cache, found->second);
+        m_Stats.Hits++;
+        return found->second->Value.get();
+    }
+    
+    Region* region = GetRegion(position);
+    if (!region) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<Column> column = Decode(*region, position);
+    if (!column) {
+        return nullptr;
+    }
+    m_Stats.Misses++;
+    
+    // The least recently used entry is reused for the new column
+    if (m_Cache.size() >= m_Capacity) {
+        m_Lookup.erase(m_Cache.back().Key);
+        m_Cache.splice(m_Cache.begin(), m_Cache, std::prev(m_Cache.end()));
+        m_Cache.front() = {key, std::move(column)};
+        m_Stats.Evictions++;
+    } else {
+        m_Cache.push_front({key, std::move(column)});
+    }
+    m_Lookup.emplace(key, m_Cache.begin());
+    return m_Cache.front().Value.get();
+}
+
+Block MappedWorld::GetBlock(int x, int y, int z) {
+    const Column* column = GetColumn(World::ColumnAt(x, z));
+    return column ? column->GetBlock(x & (CHUNK_SIZE - 1), y, z & (CHUNK_SIZE - 1)) : Block::Air;
+}
+
+int MappedWorld::GetHeight(Heightmap heightmap, int x, int z) {
+    const Column* column = GetColumn(World::ColumnAt(x, z));
+    return column ? column->GetHeight(heightmap, x & (CHUNK_SIZE - 1), z & (CHUNK_SIZE - 1)) : 0;
+}
+
+MappedWorld::Region* MappedWorld::GetRegion(ColumnPosition position) {
+    if (!IsOpen()) {
+        return nullptr;
+    }
+    
+    auto [found, inserted] = m_Regions.try_emplace(World::Key(RegionFile::RegionOf(position)));
+    if (!inserted) {
+        return found->second.get();
+    }
+    
+    std::string path = RegionStorage::RegionPath(m_Directory, position);
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return nullptr;
+    }
+    
+    struct stat status{};
+    void* data = MAP_FAILED;
+    if (fstat(descriptor, &status) == 0 && static_cast<uint64_t>(status.st_size) >= RegionFile::HEADER_SECTORS * RegionFile::SECTOR_SIZE) {
+        data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+    }
+    // The mapping keeps the file open
+    close(descriptor);
+    
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map region file " << path << "\n";
+        return nullptr;
+    }
+    
+    auto region = std::make_unique<Region>();
+    region->Data = static_cast<const uint8_t*>(data);
+    region->Size = static_cast<size_t>(status.st_size);
+    if (!RegionFile::IsValidHeader(region->Data)) {
+        std::cerr << "Failed to read region file " << path << "\n";
+        munmap(data, region->Size);
+        return nullptr;
+    }
+    
+    // Blobs are read in no particular order, read ahead would only fill the mapping
+    madvise(data, region->Size, MADV_RANDOM);
+    found->second = std::move(region);
+    return found->second.get();
+}
+
+std::unique_ptr<Column> MappedWorld::Decode(const Region& region, ColumnPosition position) {
+    int index = RegionFile::ColumnIndex(position);
+    RegionFile::Entry entry;
+    memcpy(&entry, region.Data + RegionFile::TableOffset(index), sizeof(entry));
+    if (entry.Count == 0) {
+        return nullptr;
+    }
+    
+    uint64_t sectors = region.Size / RegionFile::SECTOR_SIZE;
+    if (entry.Sector < RegionFile::HEADER_SECTORS || entry.Sector > sectors || entry.Count > sectors - entry.Sector) {
+        std::cerr << "Damaged column " << position.X << ", " << position.Z << " in " << m_Directory << "\n";
+        return nullptr;
+    }
+    
+    const uint8_t* blob = region.Data + entry.Sector * RegionFile::SECTOR_SIZE;
+    size_t size = entry.Count * RegionFile::SECTOR_SIZE;
+    auto column = std::make_unique<Column>(position);
+    bool decoded = RegionFile::Unpack(blob, size, m_Buffer) && ColumnCodec::Decode(m_Buffer.data(), m_Buffer.size(), *column);
+    
+    // A fault maps every cached page of the aligned window around it, not just the blob, so the
+    // whole window is dropped. Pages of other blobs in it just fault in again from the page cache.
+    uintptr_t begin = reinterpret_cast<uintptr_t>(region.Data);
+    uintptr_t first = std::max(reinterpret_cast<uintptr_t>(blob) & ~(FAULT_AROUND_BYTES - 1), begin);
+    uintptr_t last = std::min((reinterpret_cast<uintptr_t>(blob) + size + FAULT_AROUND_BYTES - 1) & ~(FAULT_AROUND_BYTES - 1), begin + region.Size);
+    madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+    
+    if (!decoded) {
+        std::cerr << "Damaged column " << position.X << ", " << position.Z << " in " << m_Directory << "\n";
+        return nullptr;
+    }
+    column->ClearDirty();
+    return column;
+}
@@ -0,0 +1,82 @@
+#ifndef MappedWorld_h
+#define MappedWorld_h
+
+#include "Column.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Read-only view of a world directory for servers that never change the world, such as spectator,
+// replay and map render servers. Region files are mapped rather than read, a column is decoded on
+// first access and kept in a least recently used cache of a fixed number of columns, and there is
+// no way to write anything back. Once a blob is decoded its pages are dropped from the mapping
+// again, they stay in the page cache, so resident memory is the cache plus the region tables no
+// matter how large the world is. Not thread safe.
+//
+// Nothing may write the directory while it is mapped: a region file truncated under the mapping
+// raises SIGBUS and a table rewritten under it reads torn. A mapped world holds a shared lock on
+// the directory's session.lock and a RegionStorage an exclusive one, whichever comes second gets
+// nothing from the directory.
+class MappedWorld {
+public:
+    struct Stats {
+        uint64_t Hits = 0;
+        uint64_t Misses = 0;
+        uint64_t Evictions = 0;
+    };
+    
+    // Reports and serves no columns when a server is writing the directory
+    MappedWorld(std::string directory, size_t cache_columns);
+    MappedWorld(const MappedWorld&) = delete;
+    MappedWorld& operator=(const MappedWorld&) = delete;
+    ~MappedWorld();
+    
+    // nullptr when the column was never saved or is damaged. A column stays valid while it is one
+    // of the cache_columns most recently returned.
+    const Column* GetColumn(ColumnPosition position);
+    // World block coordinates, blocks of missing columns read as air
+    Block GetBlock(int x, int y, int z);
+    // One above the highest matching block at world x, z, 0 when the column is missing
+    int GetHeight(Heightmap heightmap, int x, int z);
+    
+    size_t GetCachedCount() const { return m_Cache.size(); }
+    size_t GetCapacity() const { return m_Capacity; }
+    const Stats& GetStats() const { return m_Stats; }
+    const std::string& GetDirectory() const { return m_Directory; }
+    bool IsOpen() const { return m_Lock >= 0; }
+
+private:
+    struct Region {
+        const uint8_t* Data = nullptr;
+        size_t Size = 0;
+    };
+    
+    struct CachedColumn {
+        uint64_t Key;
+        std::unique_ptr<Column> Value;
+    };
+    
+    std::string m_Directory;
+    size_t m_Capacity;
+    int m_Lock = -1;
+    
+    // Regions that failed to open are kept as nullptr so they are only tried once
+    std::unordered_map<uint64_t, std::unique_ptr<Region>> m_Regions;
+    
+    // Most recently returned first
+    std::list<CachedColumn> m_Cache;
+    std::unordered_map<uint64_t, std::list<CachedColumn>::iterator> m_Lookup;
+    
+    std::vector<uint8_t> m_Buffer;
+    Stats m_Stats;
+    
+    Region* GetRegion(ColumnPosition position);
+    std::unique_ptr<Column> Decode(const Region& region, ColumnPosition position);
+};
+
+#endif
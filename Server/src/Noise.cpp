@@ -0,0 +1,263 @@
+#include "Noise.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NOISE_AVX2
+#define NOISE_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr int32_t FADE_6 = 6;
+constexpr int32_t FADE_15 = 15;
+constexpr int32_t FADE_10 = 10 * NOISE_ONE;
+
+constexpr uint32_t PRIME_X = 0x27d4eb2du;
+constexpr uint32_t PRIME_Y = 0x165667b1u;
+constexpr uint32_t PRIME_Z = 0x9e3779b1u;
+constexpr uint32_t MIX_A = 0x2c1b3c6du;
+constexpr uint32_t MIX_B = 0x297a2d39u;
+
+// Lowbias32 style finalizer over the combined lattice coordinates
+uint32_t HashCell(uint32_t seed, int32_t x, int32_t y, int32_t z) {
+    uint32_t hash = seed ^ static_cast<uint32_t>(x) * PRIME_X ^ static_cast<uint32_t>(y) * PRIME_Y ^ static_cast<uint32_t>(z) * PRIME_Z;
+    hash ^= hash >> 15;
+    hash *= MIX_A;
+    hash ^= hash >> 12;
+    hash *= MIX_B;
+    hash ^= hash >> 15;
+    return hash;
+}
+
+// Negates value when bit is set, the same mask trick the vector path uses
+int32_t Flip(int32_t value, uint32_t bit) {
+    int32_t mask = -static_cast<int32_t>(bit);
+    return (value ^ mask) - mask;
+}
+
+// Diagonal gradients, one hash bit per axis decides the sign
+int32_t Gradient2D(uint32_t hash, int32_t x, int32_t z) {
+    return Flip(x, hash & 1) + Flip(z, (hash >> 1) & 1);
+}
+
+int32_t Gradient3D(uint32_t hash, int32_t x, int32_t y, int32_t z) {
+    return Flip(x, hash & 1) + Flip(y, (hash >> 1) & 1) + Flip(z, (hash >> 2) & 1);
+}
+
+// 6t^5 - 15t^4 + 10t^3, ordered so no product leaves 32 bits
+int32_t Fade(int32_t t) {
+    int32_t t2 = (t * t) >> NOISE_FRACTION_BITS;
+    int32_t t3 = (t2 * t) >> NOISE_FRACTION_BITS;
+    return (t3 * (FADE_6 * t2 - FADE_15 * t + FADE_10)) >> NOISE_FRACTION_BITS;
+}
+
+int32_t Lerp(int32_t a, int32_t b, int32_t t) {
+    return a + (((b - a) * t) >> NOISE_FRACTION_BITS);
+}
+
+struct Lattice {
+    int32_t Cell;
+    int32_t Fraction;
+};
+
+Lattice Split(int32_t coordinate, int period_shift) {
+    return {coordinate >> period_shift, (coordinate & ((1 << period_shift) - 1)) << (NOISE_FRACTION_BITS - period_shift)};
+}
+
+int32_t Sample2D(uint32_t seed, int32_t x, Lattice z, int period_shift) {
+    Lattice lx = Split(x, period_shift);
+    
+    int32_t n00 = Gradient2D(HashCell(seed, lx.Cell, 0, z.Cell), lx.Fraction, z.Fraction);
+    int32_t n10 = Gradient2D(HashCell(seed, lx.Cell + 1, 0, z.Cell), lx.Fraction - NOISE_ONE, z.Fraction);
+    int32_t n01 = Gradient2D(HashCell(seed, lx.Cell, 0, z.Cell + 1), lx.Fraction, z.Fraction - NOISE_ONE);
+    int32_t n11 = Gradient2D(HashCell(seed, lx.Cell + 1, 0, z.Cell + 1), lx.Fraction - NOISE_ONE, z.Fraction - NOISE_ONE);
+    
+    int32_t u = Fade(lx.Fraction);
+    return Lerp(Lerp(n00, n10, u), Lerp(n01, n11, u), Fade(z.Fraction));
+}
+
+int32_t Sample3D(uint32_t seed, int32_t x, Lattice y, Lattice z, int period_shift) {
+    Lattice lx = Split(x, period_shift);
+    int32_t u = Fade(lx.Fraction);
+    
+    int32_t planes[2];
+    for (int dy = 0; dy < 2; dy++) {
+        int32_t fy = y.Fraction - dy * NOISE_ONE;
+        int32_t rows[2];
+        for (int dz = 0; dz < 2; dz++) {
+            int32_t fz = z.Fraction - dz * NOISE_ONE;
+            int32_t n0 = Gradient3D(HashCell(seed, lx.Cell, y.Cell + dy, z.Cell + dz), lx.Fraction, fy, fz);
+            int32_t n1 = Gradient3D(HashCell(seed, lx.Cell + 1, y.Cell + dy, z.Cell + dz), lx.Fraction - NOISE_ONE, fy, fz);
+            rows[dz] = Lerp(n0, n1, u);
+        }
+        planes[dy] = Lerp(rows[0], rows[1], Fade(z.Fraction));
+    }
+    
+    return Lerp(planes[0], planes[1], Fade(y.Fraction));
+}
+
+#ifdef NOISE_AVX2
+
+// Vector twins of the scalar helpers above, eight consecutive x coordinates per call
+
+NOISE_AVX2_TARGET __m256i HashCell8(__m256i seed, __m256i x, __m256i y, __m256i z) {
+    __m256i hash = _mm256_xor_si256(seed, _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int32_t>(PRIME_X))));
+    hash = _mm256_xor_si256(hash, _mm256_mullo_epi32(y, _mm256_set1_epi32(static_cast<int32_t>(PRIME_Y))));
+    hash = _mm256_xor_si256(hash, _mm256_mullo_epi32(z, _mm256_set1_epi32(static_cast<int32_t>(PRIME_Z))));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 15));
+    hash = _mm256_mullo_epi32(hash, _mm256_set1_epi32(static_cast<int32_t>(MIX_A)));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 12));
+    hash = _mm256_mullo_epi32(hash, _mm256_set1_epi32(static_cast<int32_t>(MIX_B)));
+    hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 15));
+    return hash;
+}
+
+NOISE_AVX2_TARGET __m256i Flip8(__m256i value, __m256i hash, int bit) {
+    __m256i mask = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(_mm256_srli_epi32(hash, bit), _mm256_set1_epi32(1)));
+    return _mm256_sub_epi32(_mm256_xor_si256(value, mask), mask);
+}
+
+NOISE_AVX2_TARGET __m256i Gradient2D8(__m256i hash, __m256i x, __m256i z) {
+    return _mm256_add_epi32(Flip8(x, hash, 0), Flip8(z, hash, 1));
+}
+
+NOISE_AVX2_TARGET __m256i Gradient3D8(__m256i hash, __m256i x, __m256i y, __m256i z) {
+    return _mm256_add_epi32(_mm256_add_epi32(Flip8(x, hash, 0), Flip8(y, hash, 1)), Flip8(z, hash, 2));
+}
+
+NOISE_AVX2_TARGET __m256i Fade8(__m256i t) {
+    __m256i t2 = _mm256_srai_epi32(_mm256_mullo_epi32(t, t), NOISE_FRACTION_BITS);
+    __m256i t3 = _mm256_srai_epi32(_mm256_mullo_epi32(t2, t), NOISE_FRACTION_BITS);
+    __m256i inner = _mm256_sub_epi32(_mm256_mullo_epi32(t2, _mm256_set1_epi32(FADE_6)), _mm256_mullo_epi32(t, _mm256_set1_epi32(FADE_15)));
+    inner = _mm256_add_epi32(inner, _mm256_set1_epi32(FADE_10));
+    return _mm256_srai_epi32(_mm256_mullo_epi32(t3, inner), NOISE_FRACTION_BITS);
+}
+
+NOISE_AVX2_TARGET __m256i Lerp8(__m256i a, __m256i b, __m256i t) {
+    return _mm256_add_epi32(a, _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b, a), t), NOISE_FRACTION_BITS));
+}
+
+NOISE_AVX2_TARGET void Split8(int32_t x, int period_shift, __m256i& cell, __m256i& fraction) {
+    __m256i coordinate = _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    cell = _mm256_sra_epi32(coordinate, _mm_cvtsi32_si128(period_shift));
+    fraction = _mm256_and_si256(coordinate, _mm256_set1_epi32((1 << period_shift) - 1));
+    fraction = _mm256_sll_epi32(fraction, _mm_cvtsi32_si128(NOISE_FRACTION_BITS - period_shift));
+}
+
+NOISE_AVX2_TARGET void Row2DAvx2(uint32_t seed, int32_t x, Lattice z, int period_shift, int32_t* out, int count) {
+    const __m256i seeds = _mm256_set1_epi32(static_cast<int32_t>(seed));
+    const __m256i one = _mm256_set1_epi32(NOISE_ONE);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i z0 = _mm256_set1_epi32(z.Cell);
+    const __m256i z1 = _mm256_set1_epi32(z.Cell + 1);
+    const __m256i fz0 = _mm256_set1_epi32(z.Fraction);
+    const __m256i fz1 = _mm256_set1_epi32(z.Fraction - NOISE_ONE);
+    const __m256i v = _mm256_set1_epi32(Fade(z.Fraction));
+    
+    for (int i = 0; i < count; i += 8) {
+        __m256i x0, fx0;
+        Split8(x + i, period_shift, x0, fx0);
+        __m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(1));
+        __m256i fx1 = _mm256_sub_epi32(fx0, one);
+        
+        __m256i n00 = Gradient2D8(HashCell8(seeds, x0, zero, z0), fx0, fz0);
+        __m256i n10 = Gradient2D8(HashCell8(seeds, x1, zero, z0), fx1, fz0);
+        __m256i n01 = Gradient2D8(HashCell8(seeds, x0, zero, z1), fx0, fz1);
+        __m256i n11 = Gradient2D8(HashCell8(seeds, x1, zero, z1), fx1, fz1);
+        
+        __m256i u = Fade8(fx0);
+        __m256i result = Lerp8(Lerp8(n00, n10, u), Lerp8(n01, n11, u), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+}
+
+NOISE_AVX2_TARGET void Row3DAvx2(uint32_t seed, int32_t x, Lattice y, Lattice z, int period_shift, int32_t* out, int count) {
+    const __m256i seeds = _mm256_set1_epi32(static_cast<int32_t>(seed));
+    const __m256i one = _mm256_set1_epi32(NOISE_ONE);
+    const __m256i w = _mm256_set1_epi32(Fade(y.Fraction));
+    const __m256i v = _mm256_set1_epi32(Fade(z.Fraction));
+    
+    for (int i = 0; i < count; i += 8) {
+        __m256i x0, fx0;
+        Split8(x + i, period_shift, x0, fx0);
+        __m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(1));
+        __m256i fx1 = _mm256_sub_epi32(fx0, one);
+        __m256i u = Fade8(fx0);
+        
+        __m256i planes[2];
+        for (int dy = 0; dy < 2; dy++) {
+            __m256i cy = _mm256_set1_epi32(y.Cell + dy);
+            __m256i fy = _mm256_set1_epi32(y.Fraction - dy * NOISE_ONE);
+            __m256i rows[2];
+            for (int dz = 0; dz < 2; dz++) {
+                __m256i cz = _mm256_set1_epi32(z.Cell + dz);
+                __m256i fz = _mm256_set1_epi32(z.Fraction - dz * NOISE_ONE);
+                __m256i n0 = Gradient3D8(HashCell8(seeds, x0, cy, cz), fx0, fy, fz);
+                __m256i n1 = Gradient3D8(HashCell8(seeds, x1, cy, cz), fx1, fy, fz);
+                rows[dz] = Lerp8(n0, n1, u);
+            }
+            planes[dy] = Lerp8(rows[0], rows[1], v);
+        }
+        
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), Lerp8(planes[0], planes[1], w));
+    }
+}
+
+#endif
+
+}
+
+Noise::Noise(uint32_t seed, NoiseBackend backend)
+    : m_Seed(seed)
+    , m_Backend(backend == NoiseBackend::Avx2 && !SupportsAvx2() ? NoiseBackend::Scalar : backend) {
+}
+
+bool Noise::SupportsAvx2() {
+#ifdef NOISE_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+NoiseBackend Noise::DefaultBackend() {
+    return SupportsAvx2() ? NoiseBackend::Avx2 : NoiseBackend::Scalar;
+}
+
+void Noise::Row2D(int32_t x, int32_t z, int period_shift, uint32_t salt, int32_t* out, int count) const {
+    uint32_t seed = HashCell(m_Seed, 0, static_cast<int32_t>(salt), 0);
+    Lattice lz = Split(z, period_shift);
+    
+    int i = 0;
+#ifdef NOISE_AVX2
+    if (m_Backend == NoiseBackend::Avx2) {
+        i = count & ~7;
+        Row2DAvx2(seed, x, lz, period_shift, out, i);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = Sample2D(seed, x + i, lz, period_shift);
+    }
+}
+
+void Noise::Row3D(int32_t x, int32_t y, int32_t z, int period_shift, uint32_t salt, int32_t* out, int count) const {
+    uint32_t seed = HashCell(m_Seed, 0, static_cast<int32_t>(salt), 0);
+    Lattice ly = Split(y, period_shift);
+    Lattice lz = Split(z, period_shift);
+    
+    int i = 0;
+#ifdef NOISE_AVX2
+    if (m_Backend == NoiseBackend::Avx2) {
+        i = count & ~7;
+        Row3DAvx2(seed, x, ly, lz, period_shift, out, i);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = Sample3D(seed, x + i, ly, lz, period_shift);
+    }
+}
+
+uint32_t Noise::Hash(int32_t x, int32_t y, int32_t z, uint32_t salt) const {
+    return HashCell(HashCell(m_Seed, 0, static_cast<int32_t>(salt), 0), x, y, z);
+}
@@ -0,0 +1,40 @@
+#ifndef Noise_h
+#define Noise_h
+
+#include <cstdint>
+
+// Noise values are fixed point with this many fraction bits, roughly within [-NOISE_ONE, NOISE_ONE]
+constexpr int NOISE_FRACTION_BITS = 12;
+constexpr int32_t NOISE_ONE = 1 << NOISE_FRACTION_BITS;
+
+enum class NoiseBackend {
+    Scalar,
+    Avx2
+};
+
+// Gradient noise over integer block coordinates. Everything is computed in 32-bit integer
+// arithmetic, so the scalar and AVX2 paths, and every compiler and platform, produce the same bits.
+// Lattice cells are 1 << period_shift blocks wide, period_shift must be in [0, NOISE_FRACTION_BITS].
+// Rows sample count consecutive x coordinates starting at x.
+class Noise {
+public:
+    explicit Noise(uint32_t seed, NoiseBackend backend = DefaultBackend());
+    
+    static bool SupportsAvx2();
+    static NoiseBackend DefaultBackend();
+    
+    NoiseBackend GetBackend() const { return m_Backend; }
+    
+    // salt picks an independent noise field for the same seed
+    void Row2D(int32_t x, int32_t z, int period_shift, uint32_t salt, int32_t* out, int count) const;
+    void Row3D(int32_t x, int32_t y, int32_t z, int period_shift, uint32_t salt, int32_t* out, int count) const;
+    
+    // Well mixed hash of a single point, for scattering features as deterministically as the noise
+    uint32_t Hash(int32_t x, int32_t y, int32_t z, uint32_t salt) const;
+
+private:
+    uint32_t m_Seed;
+    NoiseBackend m_Backend;
+};
+
+#endif
@@ -0,0 +1,388 @@
+#include "RegionFile.h"
+#include "Lz4.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char MAGIC[4] = {'M', 'C', 'R', 'G'};
+
+// Holes count once they make up more than half of the blobs and at least this many sectors
+constexpr uint32_t COMPACT_MIN_FREE_SECTORS = 64;
+
+// A new file only survives a crash once its directory is synced
+bool SyncDirectory(const std::string& path) {
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    int descriptor = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (descriptor < 0) {
+        return false;
+    }
+    bool synced = fsync(descriptor) == 0;
+    close(descriptor);
+    return synced;
+}
+
+struct FileHeader {
+    char Magic[4];
+    uint32_t Version;
+    uint32_t SectorSize;
+    uint32_t Reserved;
+};
+
+uint32_t SectorsFor(uint64_t size) {
+    return static_cast<uint32_t>((size + RegionFile::SECTOR_SIZE - 1) / RegionFile::SECTOR_SIZE);
+}
+
+}
+
+RegionFile::~RegionFile() {
+    Close();
+}
+
+bool RegionFile::Open(const std::string& path, bool create) {
+    Close();
+    
+    m_Descriptor = open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (m_Descriptor < 0) {
+        if (create) {
+            std::cerr << "Failed to open region file " << path << "\n";
+        }
+        return false;
+    }
+    m_Path = path;
+    
+    struct stat status{};
+    if (fstat(m_Descriptor, &status) != 0) {
+        std::cerr << "Failed to open region file " << path << "\n";
+        Close();
+        return false;
+    }
+    
+    if (status.st_size == 0) {
+        std::vector<uint8_t> header(HEADER_SECTORS * SECTOR_SIZE);
+        FileHeader file_header{};
+        memcpy(file_header.Magic, MAGIC, sizeof(MAGIC));
+        file_header.Version = VERSION;
+        file_header.SectorSize = SECTOR_SIZE;
+        memcpy(header.data(), &file_header, sizeof(file_header));
+        // Synced with its directory entry before anything is saved to it, so a crash cannot lose the file
+        if (!WriteAt(0, header.data(), header.size()) || fsync(m_Descriptor) != 0 || !SyncDirectory(path)) {
+            std::cerr << "Failed to create region file " << path << "\n";
+            Close();
+            return false;
+        }
+        status.st_size = static_cast<off_t>(header.size());
+    }
+    
+    FileHeader file_header{};
+    if (static_cast<uint64_t>(status.st_size) < HEADER_SECTORS * SECTOR_SIZE
+        || !ReadAt(0, &file_header, sizeof(file_header))
+        || !IsValidHeader(reinterpret_cast<const uint8_t*>(&file_header))
+        || !ReadAt(SECTOR_SIZE, m_Table.data(), sizeof(m_Table))) {
+        std::cerr << "Failed to read region file " << path << "\n";
+        Close();
+        return false;
+    }
+    
+    m_Used.assign(SectorsFor(static_cast<uint64_t>(status.st_size)), false);
+    std::fill(m_Used.begin(), m_Used.begin() + HEADER_SECTORS, true);
+    m_FreeSectors = static_cast<uint32_t>(m_Used.size()) - HEADER_SECTORS;
+    
+    for (int i = 0; i < REGION_COLUMNS; i++) {
+        Entry& entry = m_Table[i];
+        if (entry.Count == 0) {
+            continue;
+        }
+        
+        bool valid = entry.Sector >= HEADER_SECTORS && entry.Sector <= m_Used.size() && entry.Count <= m_Used.size() - entry.Sector;
+        for (uint32_t sector = entry.Sector; valid && sector < entry.Sector + entry.Count; sector++) {
+            valid = !m_Used[sector];
+        }
+        
+        if (!valid) {
+            std::cerr << "Dropping damaged column " << i << " of region file " << path << "\n";
+            entry = {};
+            m_Dropped[i] = true;
+            continue;
+        }
+        
+        std::fill(m_Used.begin() + entry.Sector, m_Used.begin() + entry.Sector + entry.Count, true);
+        m_FreeSectors -= entry.Count;
+    }
+    
+    return true;
+}
+
+bool RegionFile::IsValidHeader(const uint8_t* header) {
+    FileHeader file_header{};
+    memcpy(&file_header, header, sizeof(file_header));
+    return memcmp(file_header.Magic, MAGIC, sizeof(MAGIC)) == 0 && file_header.Version == VERSION && file_header.SectorSize == SECTOR_SIZE;
+}
+
+void RegionFile::Close() {
+    if (m_Descriptor >= 0) {
+        if (HasPendingChanges()) {
+            Flush();
+        }
+        close(m_Descriptor);
+    }
+    m_Descriptor = -1;
+    m_Path.clear();
+    m_Table = {};
+    m_Dropped = {};
+    m_Used.clear();
+    m_FreeSectors = 0;
+    m_ChangedFirst = REGION_COLUMNS;
+    m_ChangedLast = -1;
+    m_Replaced.clear();
+}
+
+bool RegionFile::Read(int index, std::vector<uint8_t>& data) {
+    Entry entry = m_Table[index];
+    if (entry.Count == 0) {
+        return false;
+    }
+    
+    m_Buffer.resize(entry.Count * SECTOR_SIZE);
+    if (!ReadAt(entry.Sector * SECTOR_SIZE, m_Buffer.data(), m_Buffer.size())) {
+        std::cerr << "Failed to read column " << index << " of region file " << m_Path << "\n";
+        return false;
+    }
+    
+    if (!Unpack(m_Buffer.data(), m_Buffer.size(), data)) {
+        std::cerr << "Damaged column " << index << " in region file " << m_Path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool RegionFile::Write(int index, const uint8_t* data, size_t size, Compression compression) {
+    Pack(data, size, compression, m_Buffer);
+    uint32_t count = static_cast<uint32_t>(m_Buffer.size() / SECTOR_SIZE);
+    
+    Entry entry{Allocate(count), count};
+    if (!WriteAt(entry.Sector * SECTOR_SIZE, m_Buffer.data(), m_Buffer.size())) {
+        std::cerr << "Failed to write column " << index << " of region file " << m_Path << "\n";
+        Release(entry);
+        return false;
+    }
+    
+    Replace(index, entry);
+    if (NeedsCompaction()) {
+        Compact();
+    }
+    return true;
+}
+
+void RegionFile::Pack(const uint8_t* data, size_t size, Compression compression, std::vector<uint8_t>& blob) {
+    BlobHeader header{};
+    header.RawSize = static_cast<uint32_t>(size);
+    blob.resize(sizeof(header) + size);
+    
+    size_t compressed = compression == Compression::Lz4 ? Lz4Compress(data, size, blob.data() + sizeof(header), size) : 0;
+    if (compressed > 0) {
+        header.Compression = static_cast<uint8_t>(Compression::Lz4);
+        header.Size = static_cast<uint32_t>(compressed);
+    } else {
+        header.Compression = static_cast<uint8_t>(Compression::None);
+        header.Size = static_cast<uint32_t>(size);
+        memcpy(blob.data() + sizeof(header), data, size);
+    }
+    memcpy(blob.data(), &header, sizeof(header));
+    
+    blob.resize(SectorsFor(sizeof(header) + header.Size) * SECTOR_SIZE, 0);
+}
+
+bool RegionFile::Unpack(const uint8_t* blob, size_t size, std::vector<uint8_t>& data) {
+    BlobHeader header{};
+    if (size < sizeof(header)) {
+        return false;
+    }
+    
+    memcpy(&header, blob, sizeof(header));
+    const uint8_t* payload = blob + sizeof(header);
+    if (header.Size > size - sizeof(header)) {
+        return false;
+    }
+    
+    if (header.Compression == static_cast<uint8_t>(Compression::Lz4)) {
+        data.resize(header.RawSize);
+        return Lz4Decompress(payload, header.Size, data.data(), data.size());
+    }
+    
+    if (header.Compression == static_cast<uint8_t>(Compression::None) && header.RawSize == header.Size) {
+        data.assign(payload, payload + header.Size);
+        return true;
+    }
+    return false;
+}
+
+bool RegionFile::Erase(int index) {
+    if (m_Table[index].Count != 0) {
+        Replace(index, {});
+    }
+    return true;
+}
+
+bool RegionFile::Compact() {
+    // Holes left by replaced blobs only open up once the table on disk no longer points at them
+    if (!Flush()) {
+        return false;
+    }
+    
+    while (true) {
+        // Blob ending last in the file
+        int last = -1;
+        for (int i = 0; i < REGION_COLUMNS; i++) {
+            if (m_Table[i].Count != 0 && (last < 0 || m_Table[i].Sector > m_Table[last].Sector)) {
+                last = i;
+            }
+        }
+        
+        // First hole in front of it that fits it
+        Entry entry = last < 0 ? Entry{HEADER_SECTORS, 0} : m_Table[last];
+        uint32_t run = 0;
+        uint32_t target = 0;
+        for (uint32_t sector = HEADER_SECTORS; sector < entry.Sector && run < entry.Count; sector++) {
+            run = m_Used[sector] ? 0 : run + 1;
+            target = sector + 1 - run;
+        }
+        if (last < 0 || run < entry.Count) {
+            break;
+        }
+        
+        m_Buffer.resize(entry.Count * SECTOR_SIZE);
+        Entry moved{target, entry.Count};
+        if (!ReadAt(entry.Sector * SECTOR_SIZE, m_Buffer.data(), m_Buffer.size())
+            || !WriteAt(moved.Sector * SECTOR_SIZE, m_Buffer.data(), m_Buffer.size())) {
+            std::cerr << "Failed to compact region file " << m_Path << "\n";
+            return false;
+        }
+        
+        std::fill(m_Used.begin() + moved.Sector, m_Used.begin() + moved.Sector + moved.Count, true);
+        m_FreeSectors -= moved.Count;
+        Replace(last, moved);
+    }
+    
+    // The moved blobs' old copies are freed once the table points at the new ones, only then is
+    // everything past the last blob safe to drop
+    if (!Flush()) {
+        return false;
+    }
+    
+    uint32_t end = HEADER_SECTORS;
+    for (const Entry& entry : m_Table) {
+        end = std::max(end, entry.Count != 0 ? entry.Sector + entry.Count : 0);
+    }
+    if (ftruncate(m_Descriptor, static_cast<off_t>(end * SECTOR_SIZE)) != 0) {
+        std::cerr << "Failed to truncate region file " << m_Path << "\n";
+        return false;
+    }
+    m_FreeSectors -= GetSectorCount() - end;
+    m_Used.resize(end);
+    return true;
+}
+
+bool RegionFile::NeedsCompaction() const {
+    uint32_t used = GetSectorCount() - HEADER_SECTORS - m_FreeSectors;
+    return m_FreeSectors >= COMPACT_MIN_FREE_SECTORS && m_FreeSectors * 2 > used;
+}
+
+bool RegionFile::Flush() {
+    // Blobs before the table that points at them
+    if (fdatasync(m_Descriptor) != 0) {
+        std::cerr << "Failed to flush region file " << m_Path << "\n";
+        return false;
+    }
+    
+    if (m_ChangedFirst <= m_ChangedLast) {
+        const Entry* changed = m_Table.data() + m_ChangedFirst;
+        size_t size = (m_ChangedLast - m_ChangedFirst + 1) * sizeof(Entry);
+        if (!WriteAt(TableOffset(m_ChangedFirst), changed, size) || fdatasync(m_Descriptor) != 0) {
+            std::cerr << "Failed to flush region file " << m_Path << "\n";
+            return false;
+        }
+        m_ChangedFirst = REGION_COLUMNS;
+        m_ChangedLast = -1;
+    }
+    
+    for (const Entry& entry : m_Replaced) {
+        Release(entry);
+    }
+    m_Replaced.clear();
+    return true;
+}
+
+uint32_t RegionFile::Allocate(uint32_t count) {
+    uint32_t run = 0;
+    for (uint32_t sector = HEADER_SECTORS; sector < m_Used.size(); sector++) {
+        run = m_Used[sector] ? 0 : run + 1;
+        if (run == count) {
+            uint32_t first = sector + 1 - count;
+            std::fill(m_Used.begin() + first, m_Used.begin() + sector + 1, true);
+            m_FreeSectors -= count;
+            return first;
+        }
+    }
+    
+    // Free sectors at the end of the file are extended rather than skipped
+    uint32_t first = GetSectorCount() - run;
+    m_FreeSectors -= run;
+    m_Used.resize(first, true);
+    m_Used.resize(first + count, true);
+    return first;
+}
+
+void RegionFile::Replace(int index, Entry entry) {
+    if (m_Table[index].Count != 0) {
+        m_Replaced.push_back(m_Table[index]);
+    }
+    m_Table[index] = entry;
+    m_Dropped[index] = false;
+    m_ChangedFirst = std::min(m_ChangedFirst, index);
+    m_ChangedLast = std::max(m_ChangedLast, index);
+}
+
+void RegionFile::Release(Entry entry) {
+    if (entry.Count == 0) {
+        return;
+    }
+    
+    std::fill(m_Used.begin() + entry.Sector, m_Used.begin() + entry.Sector + entry.Count, false);
+    m_FreeSectors += entry.Count;
+}
+
+bool RegionFile::ReadAt(uint64_t offset, void* data, size_t size) const {
+    auto* bytes = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t count = pread(m_Descriptor, bytes, size, static_cast<off_t>(offset));
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        offset += static_cast<uint64_t>(count);
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool RegionFile::WriteAt(uint64_t offset, const void* data, size_t size) const {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t count = pwrite(m_Descriptor, bytes, size, static_cast<off_t>(offset));
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        offset += static_cast<uint64_t>(count);
+        size -= static_cast<size_t>(count);
+    }
+    return true;
+}
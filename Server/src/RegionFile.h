@@ -0,0 +1,137 @@
+#ifndef RegionFile_h
+#define RegionFile_h
+
+#include "Column.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr int REGION_SHIFT = 5;
+constexpr int REGION_SIZE = 1 << REGION_SHIFT;
+constexpr int REGION_COLUMNS = REGION_SIZE * REGION_SIZE;
+
+enum class Compression : uint8_t {
+    None,
+    Lz4
+};
+
+// One file holding the blobs of REGION_SIZE x REGION_SIZE columns. The first sector holds the magic
+// and version, the sectors after it a table with the first sector and sector count of every blob.
+// Blobs start on sector boundaries and are never overwritten in place: a save writes into free
+// sectors or at the end of the file and points the table in memory at the new copy. Flush syncs
+// the blobs, then writes and syncs the table, and only then frees the sectors of the copies it
+// replaced, so the table on disk only ever points at synced blobs that are still there and a
+// crash leaves every column as it was at one of the flushes. Compact moves the last blobs down
+// into holes and flushes before it truncates the file. Sectors are the size of a disk sector
+// rather than a page, most compressed columns fit into three of them.
+class RegionFile {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t SECTOR_SIZE = 512;
+    
+    struct Entry {
+        uint32_t Sector;
+        uint32_t Count;
+    };
+    
+    // File header sector, then the table
+    static constexpr uint32_t HEADER_SECTORS = 1 + sizeof(Entry) * REGION_COLUMNS / SECTOR_SIZE;
+    
+    RegionFile() = default;
+    RegionFile(const RegionFile&) = delete;
+    RegionFile& operator=(const RegionFile&) = delete;
+    ~RegionFile();
+    
+    // Creates an empty region when the file is missing and create is set. Table entries that point
+    // outside of the file or into another blob are dropped with a warning.
+    bool Open(const std::string& path, bool create);
+    // Flushes first when anything changed
+    void Close();
+    bool IsOpen() const { return m_Descriptor >= 0; }
+    
+    // Checks the magic, version and sector size at the start of a file
+    static bool IsValidHeader(const uint8_t* header);
+    
+    // Position of the region holding a column
+    static ColumnPosition RegionOf(ColumnPosition position) {
+        return {position.X >> REGION_SHIFT, position.Z >> REGION_SHIFT};
+    }
+    
+    // Columns are indexed x + z * REGION_SIZE with coordinates local to the region
+    static int ColumnIndex(ColumnPosition position) {
+        int mask = REGION_SIZE - 1;
+        return (position.X & mask) + (position.Z & mask) * REGION_SIZE;
+    }
+    
+    bool Contains(int index) const { return m_Table[index].Count != 0; }
+    // Whether Open dropped the column's entry as damaged, until the column is written again
+    bool IsDropped(int index) const { return m_Dropped[index]; }
+    
+    // Returns false when the column was never written or its blob is damaged
+    bool Read(int index, std::vector<uint8_t>& data);
+    // Compressed data is stored as is whenever compression does not make it smaller. Both are
+    // durable after the next Flush.
+    bool Write(int index, const uint8_t* data, size_t size, Compression compression);
+    bool Erase(int index);
+    
+    // Write split up for callers doing their own I/O: Pack the blob, write it to the sectors from
+    // Allocate and Replace the entry once the write succeeded, or Release the sectors when it failed.
+    // Blobs are padded to whole sectors so the tail of a reused hole never reads as part of them.
+    static void Pack(const uint8_t* data, size_t size, Compression compression, std::vector<uint8_t>& blob);
+    static bool Unpack(const uint8_t* blob, size_t size, std::vector<uint8_t>& data);
+    static uint64_t TableOffset(int index) { return SECTOR_SIZE + index * sizeof(Entry); }
+    
+    // First sector of a run of count free sectors, growing the file when no hole is large enough
+    uint32_t Allocate(uint32_t count);
+    // Points the table at a written blob. The replaced blob stays allocated until the next Flush.
+    void Replace(int index, Entry entry);
+    // Frees sectors from Allocate that never made it into the table
+    void Release(Entry entry);
+    
+    int GetDescriptor() const { return m_Descriptor; }
+    Entry GetEntry(int index) const { return m_Table[index]; }
+    const std::array<Entry, REGION_COLUMNS>& GetTable() const { return m_Table; }
+    
+    // Moves blobs from the end of the file into holes in front of them and truncates what is left
+    bool Compact();
+    // Once holes outgrow half of the blobs
+    bool NeedsCompaction() const;
+    // Syncs the blobs, writes and syncs the table, then frees the sectors of replaced blobs
+    bool Flush();
+    // Table changes or replaced blobs waiting for the next Flush
+    bool HasPendingChanges() const { return m_ChangedFirst <= m_ChangedLast || !m_Replaced.empty(); }
+    
+    uint32_t GetSectorCount() const { return static_cast<uint32_t>(m_Used.size()); }
+    uint32_t GetFreeSectorCount() const { return m_FreeSectors; }
+
+private:
+    // Written at the start of every blob's first sector
+    struct BlobHeader {
+        uint32_t Size;
+        uint32_t RawSize;
+        uint8_t Compression;
+        uint8_t Reserved[3];
+    };
+    
+    int m_Descriptor = -1;
+    std::string m_Path;
+    std::array<Entry, REGION_COLUMNS> m_Table{};
+    std::array<bool, REGION_COLUMNS> m_Dropped{};
+    std::vector<bool> m_Used;
+    uint32_t m_FreeSectors = 0;
+    std::vector<uint8_t> m_Buffer;
+    
+    // Table entries changed since the last Flush, empty when first > last
+    int m_ChangedFirst = REGION_COLUMNS;
+    int m_ChangedLast = -1;
+    // Blobs the table on disk may still point at
+    std::vector<Entry> m_Replaced;
+    
+    bool ReadAt(uint64_t offset, void* data, size_t size) const;
+    bool WriteAt(uint64_t offset, const void* data, size_t size) const;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "RegionStorage.h"
+#include "ColumnCodec.h"
+#include "World.h"
+
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+RegionStorage::RegionStorage(std::string directory, Compression compression)
+    : m_Directory(std::move(directory))
+    , m_Compression(compression) {
+}
+
+RegionStorage::~RegionStorage() {
+    m_Regions.clear();
+    if (m_Lock >= 0) {
+        close(m_Lock);
+    }
+}
+
+bool RegionStorage::Create() {
+    std::error_code error;
+    std::filesystem::create_directories(m_Directory, error);
+    if (error) {
+        std::cerr << "Failed to create world directory " << m_Directory << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool RegionStorage::SaveColumn(const Column& column) {
+    RegionFile* region = GetRegion(column.GetPosition(), true);
+    if (!region) {
+        return false;
+    }
+    
+    m_Buffer.clear();
+    ColumnCodec::Encode(column, m_Buffer);
+    return region->Write(RegionFile::ColumnIndex(column.GetPosition()), m_Buffer.data(), m_Buffer.size(), m_Compression);
+}
+
+LoadResult RegionStorage::LoadColumn(ColumnPosition position, Column& column) {
+    RegionFile* region = nullptr;
+    LoadResult found = FindColumn(position, region);
+    if (found != LoadResult::Loaded) {
+        return found;
+    }
+    if (!region->Read(RegionFile::ColumnIndex(position), m_Buffer)) {
+        return LoadResult::Damaged;
+    }
+    
+    if (!ColumnCodec::Decode(m_Buffer.data(), m_Buffer.size(), column)) {
+        std::cerr << "Failed to decode column " << position.X << ", " << position.Z << "\n";
+        return LoadResult::Damaged;
+    }
+    column.ClearDirty();
+    return LoadResult::Loaded;
+}
+
+LoadResult RegionStorage::FindColumn(ColumnPosition position, RegionFile*& region) {
+    region = GetRegion(position, false);
+    if (!region) {
+        std::error_code error;
+        return std::filesystem::exists(RegionPath(m_Directory, position), error) || error ? LoadResult::Damaged : LoadResult::Missing;
+    }
+    
+    int index = RegionFile::ColumnIndex(position);
+    if (!region->Contains(index)) {
+        return region->IsDropped(index) ? LoadResult::Damaged : LoadResult::Missing;
+    }
+    return LoadResult::Loaded;
+}
+
+bool RegionStorage::EraseColumn(ColumnPosition position) {
+    RegionFile* region = GetRegion(position, false);
+    return !region || region->Erase(RegionFile::ColumnIndex(position));
+}
+
+bool RegionStorage::Flush() {
+    bool flushed = true;
+    for (auto& [key, region] : m_Regions) {
+        flushed &= region->Flush();
+    }
+    return flushed;
+}
+
+bool RegionStorage::Compact() {
+    bool compacted = true;
+    for (auto& [key, region] : m_Regions) {
+        compacted &= region->Compact();
+    }
+    return compacted;
+}
+
+RegionFile* RegionStorage::GetRegion(ColumnPosition position, bool create) {
+    ColumnPosition region = RegionFile::RegionOf(position);
+    auto found = m_Regions.find(World::Key(region));
+    if (found != m_Regions.end()) {
+        return found->second.get();
+    }
+    
+    if (!Lock()) {
+        return nullptr;
+    }
+    
+    auto file = std::make_unique<RegionFile>();
+    if (!file->Open(RegionPath(m_Directory, position), create)) {
+        return nullptr;
+    }
+    return m_Regions.emplace(World::Key(region), std::move(file)).first->second.get();
+}
+
+bool RegionStorage::Lock() {
+    if (m_Lock >= 0) {
+        return true;
+    }
+    if (m_LockFailed) {
+        return false;
+    }
+    
+    // A missing directory has no regions to open either
+    std::string path = LockPath(m_Directory);
+    int descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (descriptor < 0) {
+        if (errno != ENOENT) {
+            std::cerr << "Failed to open lock file " << path << "\n";
+        }
+        return false;
+    }
+    if (flock(descriptor, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "Failed to lock world directory " << m_Directory << ", it is in use\n";
+        close(descriptor);
+        m_LockFailed = true;
+        return false;
+    }
+    m_Lock = descriptor;
+    return true;
+}
+
+std::string RegionStorage::RegionPath(const std::string& directory, ColumnPosition position) {
+    ColumnPosition region = RegionFile::RegionOf(position);
+    return directory + "/r." + std::to_string(region.X) + "." + std::to_string(region.Z) + ".region";
+}
@@ -0,0 +1,67 @@
+#ifndef RegionStorage_h
+#define RegionStorage_h
+
+#include "RegionFile.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class LoadResult : uint8_t {
+    Loaded,
+    // Never saved, or erased since
+    Missing,
+    // Saved but the region file or the blob could not be read or decoded
+    Damaged
+};
+
+// Region files of one world directory, named r.<x>.<z>.region after their region coordinates.
+// Files are opened on first use and stay open until the storage is destroyed. Not thread safe.
+// Opening the first file takes an exclusive lock on the directory's session.lock, so a second
+// storage or a MappedWorld on the same directory finds no regions instead of tearing them.
+class RegionStorage {
+public:
+    explicit RegionStorage(std::string directory, Compression compression = Compression::Lz4);
+    RegionStorage(const RegionStorage&) = delete;
+    RegionStorage& operator=(const RegionStorage&) = delete;
+    // Closes the files before the lock is released
+    ~RegionStorage();
+    
+    // Creates the directory when it is missing
+    bool Create();
+    
+    bool SaveColumn(const Column& column);
+    // Leaves the column untouched unless it loaded, loaded columns start out clean
+    LoadResult LoadColumn(ColumnPosition position, Column& column);
+    // Region holding a saved column for callers doing their own reads, Loaded once it is found.
+    // A column is Missing when its region file does not exist or has no entry for it.
+    LoadResult FindColumn(ColumnPosition position, RegionFile*& region);
+    bool EraseColumn(ColumnPosition position);
+    
+    bool Flush();
+    bool Compact();
+    
+    const std::string& GetDirectory() const { return m_Directory; }
+    
+    // Region file holding the column, nullptr when it does not exist and create is not set
+    RegionFile* GetRegion(ColumnPosition position, bool create);
+    
+    static std::string RegionPath(const std::string& directory, ColumnPosition position);
+    static std::string LockPath(const std::string& directory) { return directory + "/session.lock"; }
+
+private:
+    std::string m_Directory;
+    Compression m_Compression;
+    std::unordered_map<uint64_t, std::unique_ptr<RegionFile>> m_Regions;
+    std::vector<uint8_t> m_Buffer;
+    
+    int m_Lock = -1;
+    // Someone else holds the lock, reported once and not tried again
+    bool m_LockFailed = false;
+    
+    bool Lock();
+};
+
+#endif
@@ -0,0 +1,359 @@
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// Noise fields of one seed, each salt is an unrelated field
+enum Salt : uint32_t {
+    CONTINENT_SALT = 1,
+    HILLS_SALT,
+    DETAIL_SALT,
+    HUMIDITY_SALT,
+    CAVE_A_SALT,
+    CAVE_B_SALT,
+    TREE_SALT
+};
+
+constexpr int CONTINENT_SHIFT = 10;
+constexpr int CONTINENT_AMPLITUDE = 24;
+constexpr int HILLS_SHIFT = 9;
+constexpr int MIN_AMPLITUDE = 12;
+constexpr int MAX_AMPLITUDE = 52;
+constexpr int DETAIL_SHIFT = 7;
+constexpr int DETAIL_OCTAVES = 5;
+constexpr int HUMIDITY_SHIFT = 8;
+constexpr int32_t FOREST_HUMIDITY = NOISE_ONE / 4;
+
+constexpr int HILLS_HEIGHT = SEA_LEVEL + 20;
+constexpr int MOUNTAINS_HEIGHT = SEA_LEVEL + 40;
+constexpr int SOIL_DEPTH = 4;
+
+// Caves are carved where two independent fields are both close to zero, leaving long tunnels
+constexpr int CAVE_SHIFT = 5;
+constexpr int32_t CAVE_WIDTH = NOISE_ONE / 12;
+
+// Every column rolls this many tree spots, the biome decides how many of them grow
+constexpr int TREE_ATTEMPTS = 8;
+constexpr int MIN_TRUNK_HEIGHT = 4;
+
+// Light fades out after this many blocks, so nothing further from the column can reach it
+constexpr int LIGHT_MARGIN = MAX_LIGHT_LEVEL - 1;
+constexpr int LIGHT_EXTENT = CHUNK_SIZE + 2 * LIGHT_MARGIN;
+
+constexpr int AREA = CHUNK_SIZE * CHUNK_SIZE;
+
+int TreeDensity(Biome biome) {
+    switch (biome) {
+        case Biome::Forest: return 6;
+        case Biome::Hills: return 2;
+        case Biome::Plains: return 1;
+        default: return 0;
+    }
+}
+
+// Trees only grow into air and trunks win over leaves, so overlapping trees come out the same
+// whichever is placed first
+void PlaceTreeBlock(Column& column, int x, int y, int z, Block block) {
+    if (x < 0 || z < 0 || x >= CHUNK_SIZE || z >= CHUNK_SIZE) {
+        return;
+    }
+    
+    Block current = column.GetBlock(x, y, z);
+    if (current == Block::Air || (block == Block::Log && current == Block::Leaves)) {
+        column.SetBlock(x, y, z, block);
+    }
+}
+
+}
+
+TerrainGenerator::TerrainGenerator(uint32_t seed, NoiseBackend backend)
+    : m_Noise(seed, backend) {
+}
+
+void TerrainGenerator::NoiseStage(ColumnPosition position, ColumnSurface& surface, Column& column) const {
+    int32_t base_x = position.X * CHUNK_SIZE;
+    int32_t base_z = position.Z * CHUNK_SIZE;
+    
+    int32_t continent[CHUNK_SIZE];
+    int32_t hills[CHUNK_SIZE];
+    int32_t humidity[CHUNK_SIZE];
+    int32_t octave[CHUNK_SIZE];
+    surface.MaxHeight = 0;
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        m_Noise.Row2D(base_x, base_z + z, CONTINENT_SHIFT, CONTINENT_SALT, continent, CHUNK_SIZE);
+        m_Noise.Row2D(base_x, base_z + z, HILLS_SHIFT, HILLS_SALT, hills, CHUNK_SIZE);
+        m_Noise.Row2D(base_x, base_z + z, HUMIDITY_SHIFT, HUMIDITY_SALT, humidity, CHUNK_SIZE);
+        
+        // Fractal sum, every octave at twice the frequency and half the weight of the last
+        int32_t detail[CHUNK_SIZE] = {};
+        for (int i = 0; i < DETAIL_OCTAVES; i++) {
+            m_Noise.Row2D(base_x, base_z + z, DETAIL_SHIFT - i, DETAIL_SALT + i * 16, octave, CHUNK_SIZE);
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                detail[x] += octave[x] >> i;
+            }
+        }
+        
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            int32_t amplitude = MIN_AMPLITUDE + (((hills[x] + NOISE_ONE) * (MAX_AMPLITUDE - MIN_AMPLITUDE)) >> (NOISE_FRACTION_BITS + 1));
+            int32_t height = SEA_LEVEL + 4 + ((continent[x] * CONTINENT_AMPLITUDE) >> NOISE_FRACTION_BITS) + ((detail[x] * amplitude) >> (NOISE_FRACTION_BITS + 1));
+            height = std::clamp(height, 1, COLUMN_HEIGHT - 1);
+            
+            Biome biome = Biome::Plains;
+            if (height <= SEA_LEVEL) {
+                biome = Biome::Ocean;
+            } else if (height >= MOUNTAINS_HEIGHT) {
+                biome = Biome::Mountains;
+            } else if (height >= HILLS_HEIGHT) {
+                biome = Biome::Hills;
+            } else if (humidity[x] > FOREST_HUMIDITY) {
+                biome = Biome::Forest;
+            }
+            
+            surface.Heights[x + z * CHUNK_SIZE] = static_cast<int16_t>(height);
+            surface.Biomes[x + z * CHUNK_SIZE] = biome;
+            surface.MaxHeight = std::max(surface.MaxHeight, height);
+        }
+    }
+    
+    int filled_sections = (std::max(surface.MaxHeight, SEA_LEVEL) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        if (i >= filled_sections) {
+            column.SetSection(i, nullptr);
+            continue;
+        }
+        
+        auto section = std::make_unique<Section>();
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                int height = surface.Heights[x + z * CHUNK_SIZE];
+                for (int y = 0; y < CHUNK_SIZE; y++) {
+                    int world_y = i * CHUNK_SIZE + y;
+                    Block block = world_y < height ? Block::Stone : world_y < SEA_LEVEL ? Block::Water : Block::Air;
+                    section->Blocks[Section::Index(x, y, z)] = block;
+                }
+            }
+        }
+        column.SetSection(i, std::move(section));
+    }
+}
+
+void TerrainGenerator::SurfaceStage(const ColumnSurface& surface, Column& column) const {
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            int height = surface.Heights[x + z * CHUNK_SIZE];
+            Biome biome = surface.Biomes[x + z * CHUNK_SIZE];
+            Block top = biome == Biome::Mountains ? Block::Stone : biome == Biome::Ocean ? Block::Dirt : Block::Grass;
+            Block soil = biome == Biome::Mountains ? Block::Stone : Block::Dirt;
+            
+            for (int y = std::max(height - SOIL_DEPTH, 0); y < height - 1; y++) {
+                column.SetBlock(x, y, z, soil);
+            }
+            column.SetBlock(x, height - 1, z, top);
+        }
+    }
+}
+
+void TerrainGenerator::CaveStage(ColumnPosition position, const ColumnSurface& surface, Column& column) const {
+    int32_t first[CHUNK_SIZE];
+    int32_t second[CHUNK_SIZE];
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        // Caves stay below the soil so they never open into the sea or leave floating grass
+        int row_max = 0;
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            row_max = std::max<int>(row_max, surface.Heights[x + z * CHUNK_SIZE] - SOIL_DEPTH);
+        }
+        
+        for (int y = 1; y < row_max; y++) {
+            m_Noise.Row3D(position.X * CHUNK_SIZE, y, position.Z * CHUNK_SIZE + z, CAVE_SHIFT, CAVE_A_SALT, first, CHUNK_SIZE);
+            m_Noise.Row3D(position.X * CHUNK_SIZE, y, position.Z * CHUNK_SIZE + z, CAVE_SHIFT, CAVE_B_SALT, second, CHUNK_SIZE);
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                bool tunnel = std::abs(first[x]) < CAVE_WIDTH && std::abs(second[x]) < CAVE_WIDTH;
+                if (tunnel && y < surface.Heights[x + z * CHUNK_SIZE] - SOIL_DEPTH) {
+                    column.SetBlock(x, y, z, Block::Air);
+                }
+            }
+        }
+    }
+}
+
+void TerrainGenerator::DecorationStage(ColumnPosition position, const Neighbourhood<const ColumnSurface>& surfaces, Column& column) const {
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const ColumnSurface& source = *surfaces[(dx + 1) + (dz + 1) * 3];
+            for (int attempt = 0; attempt < TREE_ATTEMPTS; attempt++) {
+                uint32_t hash = m_Noise.Hash(position.X + dx, attempt, position.Z + dz, TREE_SALT);
+                int x = hash & (CHUNK_SIZE - 1);
+                int z = (hash >> 4) & (CHUNK_SIZE - 1);
+                int ground = source.Heights[x + z * CHUNK_SIZE];
+                if (static_cast<int>((hash >> 8) & 7) >= TreeDensity(source.Biomes[x + z * CHUNK_SIZE]) || ground <= SEA_LEVEL) {
+                    continue;
+                }
+                
+                // Tree base relative to the column being decorated
+                int base_x = x + dx * CHUNK_SIZE;
+                int base_z = z + dz * CHUNK_SIZE;
+                int crown = ground + MIN_TRUNK_HEIGHT + static_cast<int>((hash >> 11) & 3);
+                
+                for (int y = crown - 2; y <= crown + 1; y++) {
+                    int radius = y < crown ? 2 : 1;
+                    bool trim_corners = radius == 1 ? y == crown + 1 : ((hash >> (15 + y - crown)) & 1) != 0;
+                    for (int oz = -radius; oz <= radius; oz++) {
+                        for (int ox = -radius; ox <= radius; ox++) {
+                            if (trim_corners && std::abs(ox) == radius && std::abs(oz) == radius) {
+                                continue;
+                            }
+                            PlaceTreeBlock(column, base_x + ox, y, base_z + oz, Block::Leaves);
+                        }
+                    }
+                }
+                
+                for (int y = ground; y < crown; y++) {
+                    PlaceTreeBlock(column, base_x, y, base_z, Block::Log);
+                }
+            }
+        }
+    }
+}
+
+void TerrainGenerator::LightingStage(const Neighbourhood<const Column>& columns, Column& column) const {
+    // Above the highest allocated section of the neighbourhood everything is open sky. One layer of
+    // it is kept on top so light still reaches down into water and glass at the boundary.
+    int top_section = 0;
+    for (const Column* neighbour : columns) {
+        for (int i = COLUMN_SECTIONS - 1; i >= top_section; i--) {
+            if (neighbour->GetSection(i)) {
+                top_section = i + 1;
+                break;
+            }
+        }
+    }
+    if (top_section == 0) {
+        return;
+    }
+    
+    int height = std::min(top_section * CHUNK_SIZE + 1, COLUMN_HEIGHT);
+    auto index = [](int x, int y, int z) {
+        return x + LIGHT_EXTENT * (z + LIGHT_EXTENT * y);
+    };
+    
+    // The centre column plus LIGHT_MARGIN blocks of its neighbours on every side
+    std::vector<Block> blocks(static_cast<size_t>(LIGHT_EXTENT) * LIGHT_EXTENT * height);
+    std::vector<uint8_t> light(blocks.size(), 0);
+    for (int z = 0; z < LIGHT_EXTENT; z++) {
+        for (int x = 0; x < LIGHT_EXTENT; x++) {
+            int local_x = x - LIGHT_MARGIN;
+            int local_z = z - LIGHT_MARGIN;
+            const Column* source = columns[((local_x >> CHUNK_SHIFT) + 1) + ((local_z >> CHUNK_SHIFT) + 1) * 3];
+            int column_index = Section::Index(local_x & (CHUNK_SIZE - 1), 0, local_z & (CHUNK_SIZE - 1));
+            for (int y = 0; y < height; y++) {
+                const Section* section = source->GetSection(y / CHUNK_SIZE);
+                blocks[index(x, y, z)] = section ? section->Blocks[column_index + (y % CHUNK_SIZE) * AREA] : Block::Air;
+            }
+        }
+    }
+    
+    // Same rules as the client's Chunk::ComputeLighting: sky light falls straight down through air
+    // and both channels spread losing one level per block
+    std::vector<int> sky_bottom(LIGHT_EXTENT * LIGHT_EXTENT);
+    for (int z = 0; z < LIGHT_EXTENT; z++) {
+        for (int x = 0; x < LIGHT_EXTENT; x++) {
+            int y = height;
+            while (y > 0 && blocks[index(x, y - 1, z)] == Block::Air) {
+                y--;
+                light[index(x, y, z)] = MAX_LIGHT_LEVEL << 4;
+            }
+            sky_bottom[x + z * LIGHT_EXTENT] = y;
+        }
+    }
+    
+    // Open sky next to open sky has nothing to spread, only cells beside something darker are queued
+    std::vector<int> queue;
+    queue.reserve(blocks.size() / 4);
+    for (int z = 0; z < LIGHT_EXTENT; z++) {
+        for (int x = 0; x < LIGHT_EXTENT; x++) {
+            int bottom = sky_bottom[x + z * LIGHT_EXTENT];
+            int darkest = bottom + 1;
+            const int sides[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+            for (const auto& side : sides) {
+                int nx = x + side[0];
+                int nz = z + side[1];
+                if (nx >= 0 && nz >= 0 && nx < LIGHT_EXTENT && nz < LIGHT_EXTENT) {
+                    darkest = std::max(darkest, sky_bottom[nx + nz * LIGHT_EXTENT]);
+                }
+            }
+            
+            for (int y = bottom; y < std::min(darkest, height); y++) {
+                queue.push_back(index(x, y, z));
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (uint8_t emission = LightEmission(blocks[i])) {
+            light[i] = (light[i] & 0xF0) | emission;
+            queue.push_back(static_cast<int>(i));
+        }
+    }
+    
+    for (size_t head = 0; head < queue.size(); head++) {
+        int current = queue[head];
+        int x = current % LIGHT_EXTENT;
+        int z = (current / LIGHT_EXTENT) % LIGHT_EXTENT;
+        int y = current / (LIGHT_EXTENT * LIGHT_EXTENT);
+        
+        uint8_t sky = light[current] >> 4;
+        uint8_t block = light[current] & 0x0F;
+        
+        const int offsets[6][3] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+        for (const auto& offset : offsets) {
+            int nx = x + offset[0];
+            int ny = y + offset[1];
+            int nz = z + offset[2];
+            if (nx < 0 || ny < 0 || nz < 0 || nx >= LIGHT_EXTENT || ny >= height || nz >= LIGHT_EXTENT) {
+                continue;
+            }
+            
+            int neighbour = index(nx, ny, nz);
+            if (IsOpaque(blocks[neighbour])) {
+                continue;
+            }
+            
+            uint8_t neighbour_sky = light[neighbour] >> 4;
+            uint8_t neighbour_block = light[neighbour] & 0x0F;
+            bool changed = false;
+            
+            if (sky > 1 && neighbour_sky < sky - 1) {
+                neighbour_sky = sky - 1;
+                changed = true;
+            }
+            
+            if (block > 1 && neighbour_block < block - 1) {
+                neighbour_block = block - 1;
+                changed = true;
+            }
+            
+            if (changed) {
+                light[neighbour] = static_cast<uint8_t>((neighbour_sky << 4) | neighbour_block);
+                queue.push_back(neighbour);
+            }
+        }
+    }
+    
+    for (int i = 0; i < top_section; i++) {
+        Section* section = column.EditSection(i);
+        if (!section) {
+            continue;
+        }
+        
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                for (int x = 0; x < CHUNK_SIZE; x++) {
+                    section->Light[Section::Index(x, y, z)] = light[index(x + LIGHT_MARGIN, i * CHUNK_SIZE + y, z + LIGHT_MARGIN)];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef TerrainGenerator_h
+#define TerrainGenerator_h
+
+#include "Column.h"
+#include "Noise.h"
+
+#include <array>
+#include <cstdint>
+
+constexpr int SEA_LEVEL = 64;
+
+enum class Biome : uint8_t {
+    Ocean,
+    Plains,
+    Forest,
+    Hills,
+    Mountains
+};
+
+// Per column results of the noise stage, indexed x + z * CHUNK_SIZE. Written once, then only read
+// by the later stages of the column and by the decoration of its neighbours.
+struct ColumnSurface {
+    std::array<int16_t, CHUNK_SIZE * CHUNK_SIZE> Heights{};
+    std::array<Biome, CHUNK_SIZE * CHUNK_SIZE> Biomes{};
+    int MaxHeight = 0;
+};
+
+// The 3x3 columns around the one being generated, indexed (dx + 1) + (dz + 1) * 3
+template<typename T>
+using Neighbourhood = std::array<T*, 9>;
+
+// Generation stages of a single column, see GenerationPipeline for the order they run in. The output
+// depends only on the seed and the column position, never on the noise backend, so a world can be
+// hashed. Every stage writes to its own column only.
+class TerrainGenerator {
+public:
+    explicit TerrainGenerator(uint32_t seed, NoiseBackend backend = Noise::DefaultBackend());
+    
+    NoiseBackend GetBackend() const { return m_Noise.GetBackend(); }
+    
+    // Heightmap and biomes, then stone below the surface and water up to the sea
+    void NoiseStage(ColumnPosition position, ColumnSurface& surface, Column& column) const;
+    // Soil and top blocks picked by biome
+    void SurfaceStage(const ColumnSurface& surface, Column& column) const;
+    void CaveStage(ColumnPosition position, const ColumnSurface& surface, Column& column) const;
+    // Trees rooted in this column and its neighbours, keeping only the blocks that land in this column.
+    // Reads nothing but the neighbours' surfaces, which stay fixed while they are decorated themselves.
+    void DecorationStage(ColumnPosition position, const Neighbourhood<const ColumnSurface>& surfaces, Column& column) const;
+    // Sky and block light of the centre column, including light spreading in from its neighbours
+    void LightingStage(const Neighbourhood<const Column>& columns, Column& column) const;
+
+private:
+    Noise m_Noise;
+};
+
+#endif
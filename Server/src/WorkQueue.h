@@ -0,0 +1,88 @@
+#ifndef WorkQueue_h
+#define WorkQueue_h
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Bounded multi-producer multi-consumer queue after Dmitry Vyukov's design. Every cell carries a
+// sequence number telling producers and consumers whose turn it is, so threads only race on one
+// index each with a compare exchange and never take a lock.
+template<typename T>
+class WorkQueue {
+public:
+    // Capacity is rounded up to a power of two
+    explicit WorkQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        
+        m_Cells = std::make_unique<Cell[]>(size);
+        m_Mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            m_Cells[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    WorkQueue(const WorkQueue&) = delete;
+    WorkQueue& operator=(const WorkQueue&) = delete;
+    
+    // Returns false when the queue is full
+    bool Push(T value) {
+        size_t position = m_Tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = m_Cells[position & m_Mask];
+            size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (m_Tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.Value = std::move(value);
+                    cell.Sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = m_Tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    // Returns false when the queue is empty
+    bool Pop(T& value) {
+        size_t position = m_Head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = m_Cells[position & m_Mask];
+            size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0) {
+                if (m_Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.Value);
+                    cell.Sequence.store(position + m_Mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = m_Head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> Sequence;
+        T Value;
+    };
+    
+    std::unique_ptr<Cell[]> m_Cells;
+    size_t m_Mask = 0;
+    
+    // Separate cache lines so producers and consumers do not invalidate each other
+    alignas(64) std::atomic<size_t> m_Tail = 0;
+    alignas(64) std::atomic<size_t> m_Head = 0;
+};
+
+#endif
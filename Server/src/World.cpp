@@ -0,0 +1,222 @@
+#include "World.h"
+
+namespace {
+
+constexpr int LOCAL_MASK = CHUNK_SIZE - 1;
+
+// Chunk offsets in Side order, opposite sides differ in the lowest bit
+constexpr int SIDE_OFFSETS[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+
+Side Opposite(int side) {
+    return static_cast<Side>(side ^ 1);
+}
+
+}
+
+Column* World::LoadColumn(ColumnPosition position) {
+    if ((m_Count + 1) * 2 > m_Slots.size()) {
+        Grow();
+    }
+    
+    uint64_t key = Key(position);
+    Slot& slot = m_Slots[FindSlot(key)];
+    if (slot.Value) {
+        return slot.Value.get();
+    }
+    
+    slot.Key = key;
+    slot.Value = std::make_unique<Column>(position);
+    slot.Value->m_DirtyList = &m_DirtyList;
+    m_Count++;
+    
+    Link(*slot.Value);
+    return slot.Value.get();
+}
+
+Column* World::InsertColumn(std::unique_ptr<Column> column) {
+    if ((m_Count + 1) * 2 > m_Slots.size()) {
+        Grow();
+    }
+    
+    uint64_t key = Key(column->GetPosition());
+    Slot& slot = m_Slots[FindSlot(key)];
+    if (slot.Value) {
+        Unlink(*slot.Value);
+    } else {
+        m_Count++;
+    }
+    
+    slot.Key = key;
+    slot.Value = std::move(column);
+    slot.Value->m_DirtyList = &m_DirtyList;
+    uint16_t dirty = slot.Value->GetDirtySections();
+    slot.Value->ClearDirty();
+    slot.Value->MarkDirty(dirty);
+    
+    Link(*slot.Value);
+    return slot.Value.get();
+}
+
+bool World::UnloadColumn(ColumnPosition position) {
+    return TakeColumn(position) != nullptr;
+}
+
+std::unique_ptr<Column> World::TakeColumn(ColumnPosition position) {
+    if (m_Slots.empty()) {
+        return nullptr;
+    }
+    
+    size_t hole = FindSlot(Key(position));
+    if (!m_Slots[hole].Value) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<Column> column = std::move(m_Slots[hole].Value);
+    Unlink(*column);
+    column->m_DirtyList = nullptr;
+    m_Count--;
+    
+    // Backward shift deletion: pull later entries of the probe run into the hole unless that would
+    // move them in front of their home slot, so lookups never need tombstones
+    size_t mask = m_Slots.size() - 1;
+    for (size_t i = (hole + 1) & mask; m_Slots[i].Value; i = (i + 1) & mask) {
+        size_t home = Hash(m_Slots[i].Key) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            m_Slots[hole] = std::move(m_Slots[i]);
+            hole = i;
+        }
+    }
+    
+    return column;
+}
+
+Column* World::GetColumn(ColumnPosition position) const {
+    if (m_Slots.empty()) {
+        return nullptr;
+    }
+    
+    return m_Slots[FindSlot(Key(position))].Value.get();
+}
+
+Block World::GetBlock(int x, int y, int z) const {
+    const Column* column = GetColumn(ColumnAt(x, z));
+    return column ? column->GetBlock(x & LOCAL_MASK, y, z & LOCAL_MASK) : Block::Air;
+}
+
+bool World::SetBlock(int x, int y, int z, Block block) {
+    Column* column = GetColumn(ColumnAt(x, z));
+    return column && column->SetBlock(x & LOCAL_MASK, y, z & LOCAL_MASK, block);
+}
+
+int World::GetHeight(Heightmap heightmap, int x, int z) const {
+    const Column* column = GetColumn(ColumnAt(x, z));
+    return column ? column->GetHeight(heightmap, x & LOCAL_MASK, z & LOCAL_MASK) : 0;
+}
+
+std::vector<ColumnPosition> World::TakeDirtyColumns() {
+    std::vector<ColumnPosition> positions;
+    std::lock_guard<std::mutex> lock(m_DirtyList.Mutex);
+    positions.swap(m_DirtyList.Positions);
+    return positions;
+}
+
+// MurmurHash3 finalizer, neighbouring columns differ in a few low bits of either half of the key
+uint64_t World::Hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+size_t World::FindSlot(uint64_t key) const {
+    size_t mask = m_Slots.size() - 1;
+    size_t i = Hash(key) & mask;
+    while (m_Slots[i].Value && m_Slots[i].Key != key) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void World::Grow() {
+    std::vector<Slot> slots(m_Slots.empty() ? 16 : m_Slots.size() * 2);
+    std::swap(slots, m_Slots);
+    
+    // Columns move between slots by pointer, so neighbour links stay valid
+    size_t mask = m_Slots.size() - 1;
+    for (Slot& slot : slots) {
+        if (!slot.Value) {
+            continue;
+        }
+        
+        size_t i = Hash(slot.Key) & mask;
+        while (m_Slots[i].Value) {
+            i = (i + 1) & mask;
+        }
+        m_Slots[i] = std::move(slot);
+    }
+}
+
+void World::Link(Column& column) {
+    ColumnPosition position = column.GetPosition();
+    for (int side = 0; side < 4; side++) {
+        Column* neighbour = GetColumn({position.X + SIDE_OFFSETS[side][0], position.Z + SIDE_OFFSETS[side][1]});
+        column.m_Neighbours[side] = neighbour;
+        if (neighbour) {
+            neighbour->m_Neighbours[static_cast<int>(Opposite(side))] = &column;
+        }
+    }
+}
+
+void World::Unlink(Column& column) {
+    for (int side = 0; side < 4; side++) {
+        if (Column* neighbour = column.m_Neighbours[side]) {
+            neighbour->m_Neighbours[static_cast<int>(Opposite(side))] = nullptr;
+        }
+        column.m_Neighbours[side] = nullptr;
+    }
+}
+
+Block BlockCursor::GetBlock(int x, int y, int z) {
+    const Column* column = Resolve(World::ColumnAt(x, z));
+    return column ? column->GetBlock(x & LOCAL_MASK, y, z & LOCAL_MASK) : Block::Air;
+}
+
+bool BlockCursor::SetBlock(int x, int y, int z, Block block) {
+    Column* column = Resolve(World::ColumnAt(x, z));
+    return column && column->SetBlock(x & LOCAL_MASK, y, z & LOCAL_MASK, block);
+}
+
+Column* BlockCursor::Resolve(ColumnPosition position) {
+    if (m_Column) {
+        ColumnPosition current = m_Column->GetPosition();
+        int dx = position.X - current.X;
+        int dz = position.Z - current.Z;
+        if (dx == 0 && dz == 0) {
+            return m_Column;
+        }
+        
+        // Up to one step along each axis, diagonals take two hops
+        if (dx >= -1 && dx <= 1 && dz >= -1 && dz <= 1) {
+            Column* column = m_Column;
+            if (dx != 0) {
+                column = column->GetNeighbour(dx > 0 ? Side::PositiveX : Side::NegativeX);
+            }
+            if (column && dz != 0) {
+                column = column->GetNeighbour(dz > 0 ? Side::PositiveZ : Side::NegativeZ);
+            }
+            if (column) {
+                m_Column = column;
+                return column;
+            }
+        }
+    }
+    
+    // Far jumps and holes in the neighbour links fall back to the table
+    Column* column = m_World.GetColumn(position);
+    if (column) {
+        m_Column = column;
+    }
+    return column;
+}
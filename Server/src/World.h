@@ -0,0 +1,102 @@
+#ifndef World_h
+#define World_h
+
+#include "Column.h"
+
+#include <cstddef>
+#include <vector>
+
+// Loaded chunk columns keyed by their (x, z) chunk position. Columns live in a linear probing,
+// power of two table so a lookup is one hash and usually one cache line. Column addresses stay
+// stable while they are loaded, which is what lets neighbours point at each other.
+class World {
+public:
+    World() = default;
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+    
+    // Returns the column at position, creating an empty one and linking its neighbours when it is new
+    Column* LoadColumn(ColumnPosition position);
+    // Puts a column that was loaded or built elsewhere into the world, replacing the one at its
+    // position. A dirty column is reported like any other write. Replacing frees the old column,
+    // which invalidates pointers to it and every BlockCursor like unloading does.
+    Column* InsertColumn(std::unique_ptr<Column> column);
+    // Frees the column, invalidating pointers to it and every BlockCursor
+    bool UnloadColumn(ColumnPosition position);
+    // Removes the column and hands it over unlinked, null when it is not loaded. Invalidates every
+    // BlockCursor like unloading does.
+    std::unique_ptr<Column> TakeColumn(ColumnPosition position);
+    Column* GetColumn(ColumnPosition position) const;
+    size_t GetColumnCount() const { return m_Count; }
+    
+    // World block coordinates, blocks in columns that are not loaded read as air and ignore writes
+    Block GetBlock(int x, int y, int z) const;
+    bool SetBlock(int x, int y, int z, Block block);
+    // One above the highest matching block at world x, z, 0 when the column is not loaded
+    int GetHeight(Heightmap heightmap, int x, int z) const;
+    
+    template<typename Function>
+    void ForEachColumn(Function&& function) const {
+        for (const Slot& slot : m_Slots) {
+            if (slot.Value) {
+                function(static_cast<const Column&>(*slot.Value));
+            }
+        }
+    }
+    
+    template<typename Function>
+    void ForEachColumn(Function&& function) {
+        for (Slot& slot : m_Slots) {
+            if (slot.Value) {
+                function(*slot.Value);
+            }
+        }
+    }
+    
+    // Positions of the columns that turned dirty since the last call, see DirtyList
+    std::vector<ColumnPosition> TakeDirtyColumns();
+    
+    // Arithmetic shifts floor negative coordinates into the right column
+    static ColumnPosition ColumnAt(int x, int z) { return {x >> CHUNK_SHIFT, z >> CHUNK_SHIFT}; }
+    // Both coordinates packed into one integer, for tables keyed by column position
+    static uint64_t Key(ColumnPosition position) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(position.X)) << 32 | static_cast<uint32_t>(position.Z);
+    }
+
+private:
+    struct Slot {
+        uint64_t Key = 0;
+        std::unique_ptr<Column> Value;
+    };
+    
+    std::vector<Slot> m_Slots;
+    size_t m_Count = 0;
+    DirtyList m_DirtyList;
+    
+    static uint64_t Hash(uint64_t key);
+    
+    // Index of the slot holding key, or of the empty slot that ends its probe sequence
+    size_t FindSlot(uint64_t key) const;
+    void Grow();
+    void Link(Column& column);
+    void Unlink(Column& column);
+};
+
+// Block access that remembers the last column it touched. Moving into the same or an adjacent
+// column follows neighbour pointers instead of hashing again, so walks over nearby blocks never
+// touch the table. Unloading, taking or replacing a column invalidates every cursor in the world.
+class BlockCursor {
+public:
+    explicit BlockCursor(World& world) : m_World(world) {}
+    
+    Block GetBlock(int x, int y, int z);
+    bool SetBlock(int x, int y, int z, Block block);
+
+private:
+    World& m_World;
+    Column* m_Column = nullptr;
+    
+    Column* Resolve(ColumnPosition position);
+};
+
+#endif
@@ -0,0 +1,179 @@
+// Measures the tick pause of starting an autosave for different numbers of dirty chunks, and how
+// ticks that keep editing blocks fare while the snapshots are written.
+// Built from the server sources: AutosaveBench.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Noise.cpp
+// ../src/TerrainGenerator.cpp ../src/GenerationPipeline.cpp ../src/Lz4.cpp ../src/ColumnCodec.cpp
+// ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/FileIo.cpp ../src/ChunkIoService.cpp ../src/EditLog.cpp
+// ../src/Autosave.cpp
+//
+// Usage: AutosaveBench [directory] defaults to /dev/shm/minicraft-autosave
+
+#include "Autosave.h"
+#include "GenerationPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t SEED = 1337;
+constexpr int TEMPLATE_SIDE = 8;
+constexpr int SECTIONS_PER_COLUMN = 6;
+constexpr size_t MAX_DIRTY_CHUNKS = 100000;
+constexpr auto TICK_LENGTH = std::chrono::milliseconds(50);
+constexpr int EDITS_PER_TICK = 2000;
+constexpr int QUIET_TICKS = 10;
+
+double Microseconds(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// A large world built from copies of a small generated one, so the biggest case does not spend
+// minutes in the generator
+std::vector<ColumnPosition> BuildWorld(World& world) {
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    World source;
+    std::vector<ColumnPosition> template_positions;
+    for (int x = 0; x < TEMPLATE_SIDE; x++) {
+        for (int z = 0; z < TEMPLATE_SIDE; z++) {
+            template_positions.push_back({x, z});
+        }
+    }
+    pipeline.Generate(source, template_positions);
+    
+    int side = 1;
+    while (static_cast<size_t>(side * side * SECTIONS_PER_COLUMN) < MAX_DIRTY_CHUNKS) {
+        side++;
+    }
+    
+    std::vector<ColumnPosition> positions;
+    for (int x = 0; x < side; x++) {
+        for (int z = 0; z < side; z++) {
+            const Column* original = source.GetColumn(template_positions[(x + z * side) % template_positions.size()]);
+            Column* column = world.LoadColumn({x, z});
+            for (int i = 0; i < SECTIONS_PER_COLUMN; i++) {
+                const Section* section = original->GetSection(i);
+                column->SetSection(i, section ? std::make_unique<Section>(*section) : std::make_unique<Section>());
+            }
+            column->ClearDirty();
+            positions.push_back({x, z});
+        }
+    }
+    world.TakeDirtyColumns();
+    return positions;
+}
+
+// Edits random blocks like a busy tick would, returns how long that took
+double EditingTick(World& world, const std::vector<ColumnPosition>& positions, std::mt19937& random) {
+    std::uniform_int_distribution<size_t> pick(0, positions.size() - 1);
+    std::uniform_int_distribution<int> local(0, CHUNK_SIZE - 1);
+    std::uniform_int_distribution<int> height(0, SECTIONS_PER_COLUMN * CHUNK_SIZE - 1);
+    auto start = Clock::now();
+    for (int i = 0; i < EDITS_PER_TICK; i++) {
+        world.GetColumn(positions[pick(random)])->SetBlock(local(random), height(random), local(random), Block::Glass);
+    }
+    return Microseconds(start);
+}
+
+void Run(World& world, const std::vector<ColumnPosition>& positions, size_t dirty_chunks, ChunkIoService& io) {
+    std::mt19937 random(11);
+    std::vector<double> quiet_ticks;
+    for (int i = 0; i < QUIET_TICKS; i++) {
+        quiet_ticks.push_back(EditingTick(world, positions, random));
+    }
+    std::sort(quiet_ticks.begin(), quiet_ticks.end());
+    world.ForEachColumn([](Column& column) {
+        column.ClearDirty();
+    });
+    world.TakeDirtyColumns();
+    
+    // One edited block dirties its chunk, whole columns are dirtied before moving on
+    for (size_t i = 0; i < dirty_chunks; i++) {
+        Column* column = world.GetColumn(positions[i / SECTIONS_PER_COLUMN]);
+        int y = static_cast<int>(i % SECTIONS_PER_COLUMN) * CHUNK_SIZE;
+        column->SetBlock(0, y, 0, column->GetBlock(0, y, 0) == Block::Stone ? Block::Dirt : Block::Stone);
+    }
+    
+    // What the pause would be if every dirty column was copied instead of shared
+    auto start = Clock::now();
+    std::vector<std::unique_ptr<Column>> copies;
+    world.ForEachColumn([&](const Column& column) {
+        if (column.GetDirtySections() == 0) {
+            return;
+        }
+        auto copy = std::make_unique<Column>(column.GetPosition());
+        for (int i = 0; i < COLUMN_SECTIONS; i++) {
+            if (const Section* section = column.GetSection(i)) {
+                copy->SetSection(i, std::make_unique<Section>(*section));
+            }
+        }
+        copies.push_back(std::move(copy));
+    });
+    double copy_pause = Microseconds(start);
+    copies.clear();
+    
+    Autosave autosave(world, io);
+    size_t queued = autosave.Start();
+    double pause = autosave.GetStats().PauseSeconds * 1e6;
+    
+    // Ticks carry on editing, which copies the sections the snapshots still share first
+    std::vector<double> ticks;
+    auto save_start = Clock::now();
+    auto deadline = save_start;
+    while (autosave.IsRunning()) {
+        auto tick_start = Clock::now();
+        EditingTick(world, positions, random);
+        autosave.Poll();
+        ticks.push_back(Microseconds(tick_start));
+        
+        deadline += TICK_LENGTH;
+        std::this_thread::sleep_until(deadline);
+    }
+    double save_seconds = Microseconds(save_start) * 1e-6;
+    std::sort(ticks.begin(), ticks.end());
+    
+    std::cout << std::fixed << std::setprecision(0) << std::setw(6) << queued << " dirty chunks in "
+        << std::setw(5) << autosave.GetStats().Columns << " columns: pause " << std::setw(6) << pause << " us (copying them "
+        << std::setw(7) << copy_pause << " us), saved in " << std::setprecision(2) << save_seconds << " s, editing ticks p50 "
+        << std::setprecision(0) << ticks[ticks.size() / 2] << " us, max " << ticks.back() << " us (without a save p50 "
+        << quiet_ticks[quiet_ticks.size() / 2] << " us)"
+        << (autosave.GetStats().Failed ? ", saves failed" : "") << "\n" << std::defaultfloat;
+    
+    // Leave the world clean for the next case
+    world.ForEachColumn([](Column& column) {
+        column.ClearDirty();
+    });
+    world.TakeDirtyColumns();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "/dev/shm/minicraft-autosave";
+    std::filesystem::remove_all(directory);
+    
+    World world;
+    std::vector<ColumnPosition> positions = BuildWorld(world);
+    std::cout << positions.size() << " columns of " << SECTIONS_PER_COLUMN << " chunks loaded\n";
+    
+    {
+        ChunkIoService io(directory);
+        if (!io.Create()) {
+            return 1;
+        }
+        
+        for (size_t dirty_chunks : {1000, 10000, 100000}) {
+            Run(world, positions, dirty_chunks, io);
+        }
+    }
+    
+    std::filesystem::remove_all(directory);
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Checks that autosaves lose no edits. Blocks are edited every tick while 30 autosaves overlap each
+// other and their writes, then a last one is waited for and flushed. Every column has to be clean
+// and read back from disk exactly as it is in the world. Then a column is unloaded while its save
+// fails, and the next autosave has to save it anyway. Exits with 1 on the first difference.
+// Built from the server sources: AutosaveCheck.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Lz4.cpp
+// ../src/ColumnCodec.cpp ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/FileIo.cpp ../src/ChunkIoService.cpp
+// ../src/EditLog.cpp ../src/Autosave.cpp
+//
+// Usage: AutosaveCheck [directory] defaults to /dev/shm/minicraft-autosave-check
+
+#include "Autosave.h"
+
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+namespace {
+
+constexpr int SIDE = 12;
+constexpr int AUTOSAVES = 30;
+constexpr int TICKS_PER_AUTOSAVE = 4;
+constexpr int EDITS_PER_TICK = 500;
+
+bool Same(const Column& loaded, const Column& expected) {
+    for (int y = 0; y < COLUMN_HEIGHT; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                if (loaded.GetBlock(x, y, z) != expected.GetBlock(x, y, z)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Edits bunch up in part of the world, so some columns turn dirty again while their last save is
+// still in flight and others are never touched
+void Edit(World& world, std::mt19937& random) {
+    std::uniform_int_distribution<int> horizontal(0, SIDE * CHUNK_SIZE * 3 / 4 - 1);
+    std::uniform_int_distribution<int> vertical(0, COLUMN_HEIGHT - 1);
+    std::uniform_int_distribution<int> block(0, static_cast<int>(Block::Leaves));
+    for (int i = 0; i < EDITS_PER_TICK; i++) {
+        world.SetBlock(horizontal(random), vertical(random), horizontal(random), static_cast<Block>(block(random)));
+    }
+}
+
+void Finish(Autosave& autosave) {
+    autosave.Start();
+    while (autosave.Poll()) {
+    }
+}
+
+// A directory where the region file should be makes its saves fail until it is removed
+bool CheckUnloaded(const std::string& directory) {
+    std::filesystem::remove_all(directory);
+    ColumnPosition position{40, -7};
+    std::string region = RegionStorage::RegionPath(directory, position);
+    
+    std::unique_ptr<Column> expected;
+    {
+        World world;
+        ChunkIoService io(directory);
+        if (!io.Create() || !std::filesystem::create_directory(region)) {
+            return false;
+        }
+        
+        Autosave autosave(world, io);
+        world.LoadColumn(position)->SetBlock(3, 70, 9, Block::Stone);
+        expected = world.GetColumn(position)->Snapshot();
+        autosave.Start();
+        // Clean once its save is queued, so nothing stops it from being unloaded
+        world.UnloadColumn(position);
+        while (autosave.Poll()) {
+        }
+        if (autosave.GetStats().Failed != 1) {
+            std::cerr << "Failed: the save of the unloaded column did not fail\n";
+            return false;
+        }
+        
+        std::filesystem::remove(region);
+        Finish(autosave);
+        if (autosave.GetStats().Failed != 0 || !io.Flush().get()) {
+            std::cerr << "Failed: the unloaded column was not saved again\n";
+            return false;
+        }
+    }
+    
+    RegionStorage storage(directory);
+    Column loaded(position);
+    if (storage.LoadColumn(position, loaded) != LoadResult::Loaded || !Same(loaded, *expected)) {
+        std::cerr << "Failed: the unloaded column lost its edits\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "/dev/shm/minicraft-autosave-check";
+    std::filesystem::remove_all(directory);
+    
+    World world;
+    for (int z = 0; z < SIDE; z++) {
+        for (int x = 0; x < SIDE; x++) {
+            world.LoadColumn({x, z});
+        }
+    }
+    
+    {
+        ChunkIoService io(directory);
+        if (!io.Create()) {
+            return 1;
+        }
+        
+        // Started every few ticks whether or not the one before finished
+        Autosave autosave(world, io);
+        std::mt19937 random(5);
+        for (int i = 0; i < AUTOSAVES; i++) {
+            autosave.Start();
+            for (int tick = 0; tick < TICKS_PER_AUTOSAVE; tick++) {
+                Edit(world, random);
+                autosave.Poll();
+            }
+        }
+        
+        Finish(autosave);
+        if (autosave.GetStats().Failed != 0 || !io.Flush().get()) {
+            std::cerr << "Failed: saves failed\n";
+            return 1;
+        }
+    }
+    
+    RegionStorage storage(directory);
+    bool matches = true;
+    world.ForEachColumn([&](const Column& column) {
+        ColumnPosition position = column.GetPosition();
+        Column loaded(position);
+        // Columns that were never edited were never saved either
+        LoadResult saved = storage.LoadColumn(position, loaded);
+        if (column.GetDirtySections() != 0 || saved == LoadResult::Damaged || !Same(loaded, column)) {
+            std::cerr << "Failed: column " << position.X << ", " << position.Z << " was not saved as it is\n";
+            matches = false;
+        }
+    });
+    if (!matches || !CheckUnloaded(directory)) {
+        return 1;
+    }
+    
+    std::cout << AUTOSAVES + 1 << " autosaves of " << AUTOSAVES * TICKS_PER_AUTOSAVE * EDITS_PER_TICK
+        << " edits match the world, a failed save of an unloaded column was saved again\n";
+    std::filesystem::remove_all(directory);
+    return 0;
+}
@@ -0,0 +1,169 @@
+// Measures how long server ticks take while every loaded column is autosaved, once with the saves
+// on the tick thread and once through the I/O service with each of its backends.
+// Built from the server sources: ChunkIoBench.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Noise.cpp
+// ../src/TerrainGenerator.cpp ../src/GenerationPipeline.cpp ../src/Lz4.cpp ../src/ColumnCodec.cpp
+// ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/FileIo.cpp ../src/ChunkIoService.cpp
+//
+// Usage: ChunkIoBench [columns per side] [columns saved per tick] [directory] defaults to 64, every
+// column in one tick and /dev/shm/minicraft-io
+
+#include "ChunkIoService.h"
+#include "GenerationPipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t SEED = 1337;
+constexpr auto TICK_LENGTH = std::chrono::milliseconds(50);
+constexpr int WARMUP_TICKS = 20;
+constexpr int COOLDOWN_TICKS = 20;
+constexpr int BLOCK_READS_PER_TICK = 100000;
+
+// Stands in for the rest of a tick with block reads all over the world
+unsigned SimulateTick(World& world, int side, std::mt19937& random) {
+    BlockCursor cursor(world);
+    std::uniform_int_distribution<int> horizontal(-side / 2 * CHUNK_SIZE, (side - side / 2) * CHUNK_SIZE - 1);
+    std::uniform_int_distribution<int> vertical(0, COLUMN_HEIGHT - 1);
+    unsigned checksum = 0;
+    int x = horizontal(random);
+    int z = horizontal(random);
+    for (int i = 0; i < BLOCK_READS_PER_TICK; i++) {
+        // Mostly nearby blocks, like entities looking around themselves
+        if (i % 64 == 0) {
+            x = horizontal(random);
+            z = horizontal(random);
+        }
+        checksum += static_cast<unsigned>(cursor.GetBlock(x + i % 7, vertical(random), z + i % 5));
+    }
+    return checksum;
+}
+
+double Percentile(std::vector<double> values, double fraction) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+}
+
+// Ticks at 20 per second and starts saving every column after the warmup. The inline mode saves
+// on the tick thread, the others hand the columns to the service and poll their futures.
+void Run(const char* name, World& world, int side, size_t per_tick, const std::string& directory, bool inline_saves, IoBackend backend) {
+    std::filesystem::remove_all(directory);
+    RegionStorage storage(directory);
+    std::unique_ptr<ChunkIoService> service;
+    if (inline_saves) {
+        storage.Create();
+    } else {
+        service = std::make_unique<ChunkIoService>(directory, backend);
+        service->Create();
+    }
+    
+    std::vector<const Column*> columns;
+    world.ForEachColumn([&](const Column& column) {
+        columns.push_back(&column);
+    });
+    
+    std::mt19937 random(7);
+    std::vector<double> quiet_ticks;
+    std::vector<double> saving_ticks;
+    std::vector<std::future<bool>> pending;
+    size_t next = 0;
+    size_t failed = 0;
+    int cooldown = COOLDOWN_TICKS;
+    Clock::time_point save_start;
+    double save_seconds = 0.0;
+    unsigned checksum = 0;
+    
+    auto deadline = Clock::now();
+    for (int tick = 0; cooldown > 0; tick++) {
+        auto start = Clock::now();
+        checksum += SimulateTick(world, side, random);
+        
+        bool saving = tick >= WARMUP_TICKS && save_seconds == 0.0;
+        if (tick == WARMUP_TICKS) {
+            save_start = start;
+        }
+        
+        if (saving) {
+            size_t end = per_tick == 0 ? columns.size() : std::min(columns.size(), next + per_tick);
+            for (; next < end; next++) {
+                if (inline_saves) {
+                    failed += !storage.SaveColumn(*columns[next]);
+                } else {
+                    pending.push_back(service->Save(*columns[next]));
+                }
+            }
+            
+            auto finished = std::remove_if(pending.begin(), pending.end(), [&](std::future<bool>& save) {
+                if (save.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    return false;
+                }
+                failed += !save.get();
+                return true;
+            });
+            pending.erase(finished, pending.end());
+            
+            if (next == columns.size() && pending.empty()) {
+                save_seconds = std::chrono::duration<double>(Clock::now() - save_start).count();
+            }
+        } else if (save_seconds > 0.0) {
+            cooldown--;
+        }
+        
+        double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        (saving ? saving_ticks : quiet_ticks).push_back(elapsed);
+        
+        deadline += TICK_LENGTH;
+        std::this_thread::sleep_until(deadline);
+        deadline = std::max(deadline, Clock::now() - TICK_LENGTH);
+    }
+    
+    std::cout << std::fixed << std::setprecision(2) << name << ": quiet ticks p50 " << Percentile(quiet_ticks, 0.5)
+        << " ms, max " << Percentile(quiet_ticks, 1.0) << " ms; during the autosave p50 " << Percentile(saving_ticks, 0.5)
+        << " ms, p99 " << Percentile(saving_ticks, 0.99) << " ms, max " << Percentile(saving_ticks, 1.0) << " ms over "
+        << saving_ticks.size() << " ticks; autosave took " << save_seconds * 1e3 << " ms"
+        << (failed ? ", saves failed" : "") << " (checksum " << checksum << ")\n" << std::defaultfloat;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int side = argc > 1 ? std::atoi(argv[1]) : 64;
+    int per_tick = argc > 2 ? std::atoi(argv[2]) : 0;
+    std::string directory = argc > 3 ? argv[3] : "/dev/shm/minicraft-io";
+    if (side <= 0 || per_tick < 0) {
+        std::cerr << "Usage: " << argv[0] << " [columns per side] [columns saved per tick] [directory]\n";
+        return 1;
+    }
+    
+    std::vector<ColumnPosition> positions;
+    for (int x = -side / 2; x < side - side / 2; x++) {
+        for (int z = -side / 2; z < side - side / 2; z++) {
+            positions.push_back({x, z});
+        }
+    }
+    
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    World world;
+    pipeline.Generate(world, positions);
+    
+    Run("inline ", world, side, static_cast<size_t>(per_tick), directory, true, IoBackend::Threads);
+    Run("threads", world, side, static_cast<size_t>(per_tick), directory, false, IoBackend::Threads);
+    if (FileIo::SupportsUring()) {
+        Run("uring  ", world, side, static_cast<size_t>(per_tick), directory, false, IoBackend::Uring);
+    } else {
+        std::cout << "io_uring not supported, skipped\n";
+    }
+    
+    std::filesystem::remove_all(directory);
+    return 0;
+}
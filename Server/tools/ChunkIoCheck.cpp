@@ -0,0 +1,180 @@
+// Checks that the I/O service loads back what was saved with each of its backends. Every column is
+// saved several times in a row without waiting, so the saves collapse and only the newest may come
+// back, columns that were never saved have to load as missing, and after a flush a fresh storage
+// and a fresh service have to read the same from disk. A column whose blob is overwritten with
+// garbage has to load as damaged rather than missing. Exits with 1 on the first difference.
+// Built from the server sources: ChunkIoCheck.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Lz4.cpp
+// ../src/ColumnCodec.cpp ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/FileIo.cpp ../src/ChunkIoService.cpp
+//
+// Usage: ChunkIoCheck [directory] defaults to /dev/shm/minicraft-io-check
+
+#include "ChunkIoService.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+namespace {
+
+constexpr int VERSIONS = 4;
+constexpr int WRITES_PER_COLUMN = 2000;
+
+// Spread over both sides of region borders, negative coordinates included
+std::vector<ColumnPosition> Positions() {
+    std::vector<ColumnPosition> positions;
+    for (int x = -40; x < 40; x += 9) {
+        for (int z = -36; z < 36; z += 7) {
+            positions.push_back({x, z});
+        }
+    }
+    return positions;
+}
+
+// Same blocks for the same position and version
+std::unique_ptr<Column> Version(ColumnPosition position, int version) {
+    std::mt19937 random(static_cast<uint32_t>(position.X * 7919 + position.Z * 104729 + version));
+    auto column = std::make_unique<Column>(position);
+    for (int i = 0; i < WRITES_PER_COLUMN; i++) {
+        int x = static_cast<int>(random() % CHUNK_SIZE);
+        int y = static_cast<int>(random() % COLUMN_HEIGHT);
+        int z = static_cast<int>(random() % CHUNK_SIZE);
+        column->SetBlock(x, y, z, static_cast<Block>(random() % (static_cast<int>(Block::Leaves) + 1)));
+    }
+    return column;
+}
+
+bool Same(const Column& loaded, const Column& expected) {
+    if (loaded.GetPosition() != expected.GetPosition()) {
+        return false;
+    }
+    for (int y = 0; y < COLUMN_HEIGHT; y++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            for (int x = 0; x < CHUNK_SIZE; x++) {
+                if (loaded.GetBlock(x, y, z) != expected.GetBlock(x, y, z)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Columns next to saved ones and in regions nothing was saved to
+bool CheckMissing(ChunkIoService& io, const char* label) {
+    for (ColumnPosition position : {ColumnPosition{-39, -36}, ColumnPosition{5, 7}, ColumnPosition{1000, -1000}}) {
+        if (io.Load(position).get().Result != LoadResult::Missing) {
+            std::cerr << "Failed: " << label << ": column " << position.X << ", " << position.Z << " was never saved\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CheckLoads(ChunkIoService& io, const char* label) {
+    std::vector<ColumnPosition> positions = Positions();
+    std::vector<std::future<LoadedColumn>> loads;
+    for (ColumnPosition position : positions) {
+        loads.push_back(io.Load(position));
+    }
+    
+    for (size_t i = 0; i < positions.size(); i++) {
+        std::unique_ptr<Column> loaded = loads[i].get().Value;
+        if (!loaded || !Same(*loaded, *Version(positions[i], VERSIONS - 1))) {
+            std::cerr << "Failed: " << label << ": column " << positions[i].X << ", " << positions[i].Z
+                << (loaded ? " is not the newest save\n" : " did not load\n");
+            return false;
+        }
+    }
+    return CheckMissing(io, label);
+}
+
+bool Check(const std::string& directory, IoBackend backend) {
+    std::filesystem::remove_all(directory);
+    std::vector<ColumnPosition> positions = Positions();
+    {
+        ChunkIoService io(directory, backend);
+        if (!io.Create()) {
+            return false;
+        }
+        
+        // Every version queued at once, the I/O thread picks them up in whatever batches it gets to
+        std::vector<std::future<bool>> saves;
+        for (int version = 0; version < VERSIONS; version++) {
+            for (ColumnPosition position : positions) {
+                saves.push_back(io.Save(Version(position, version)));
+            }
+        }
+        for (std::future<bool>& save : saves) {
+            if (!save.get()) {
+                std::cerr << "Failed: a save failed\n";
+                return false;
+            }
+        }
+        
+        if (!CheckLoads(io, "before the flush") || !io.Flush().get()) {
+            return false;
+        }
+    }
+    
+    // What the tables on disk point at, and where the first blob starts
+    ColumnPosition damaged = positions.front();
+    uint64_t offset = 0;
+    {
+        RegionStorage storage(directory);
+        for (ColumnPosition position : positions) {
+            Column column(position);
+            if (storage.LoadColumn(position, column) != LoadResult::Loaded || !Same(column, *Version(position, VERSIONS - 1))) {
+                std::cerr << "Failed: column " << position.X << ", " << position.Z << " reads back different from disk\n";
+                return false;
+            }
+        }
+        RegionFile* region = nullptr;
+        storage.FindColumn(damaged, region);
+        offset = region->GetEntry(RegionFile::ColumnIndex(damaged)).Sector * RegionFile::SECTOR_SIZE;
+    }
+    
+    {
+        ChunkIoService io(directory, backend);
+        if (!CheckLoads(io, "reopened")) {
+            return false;
+        }
+    }
+    
+    // Garbage over the header of that blob
+    {
+        std::fstream file(RegionStorage::RegionPath(directory, damaged), std::ios::in | std::ios::out | std::ios::binary);
+        std::vector<char> garbage(16, '\xff');
+        file.seekp(static_cast<std::streamoff>(offset));
+        file.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+    }
+    
+    ChunkIoService io(directory, backend);
+    if (io.Load(damaged).get().Result != LoadResult::Damaged) {
+        std::cerr << "Failed: column " << damaged.X << ", " << damaged.Z << " was overwritten but did not load as damaged\n";
+        return false;
+    }
+    return CheckMissing(io, "damaged");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "/dev/shm/minicraft-io-check";
+    
+    if (!Check(directory, IoBackend::Threads)) {
+        return 1;
+    }
+    std::cout << "threads: " << Positions().size() << " columns saved " << VERSIONS << " times each load back as the newest save\n";
+    
+    if (!FileIo::SupportsUring()) {
+        std::cout << "io_uring not supported, skipped\n";
+    } else if (!Check(directory, IoBackend::Uring)) {
+        return 1;
+    } else {
+        std::cout << "uring: " << Positions().size() << " columns saved " << VERSIONS << " times each load back as the newest save\n";
+    }
+    
+    std::filesystem::remove_all(directory);
+    return 0;
+}
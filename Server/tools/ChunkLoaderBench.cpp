@@ -0,0 +1,182 @@
+// Measures the chunk loader with players walking over a saved world and into ungenerated land, a
+// player pacing over a column border with and without a grace period, and a memory cap smaller
+// than what the tickets ask for.
+// Built from the server sources: ChunkLoaderBench.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Noise.cpp
+// ../src/TerrainGenerator.cpp ../src/GenerationPipeline.cpp ../src/Lz4.cpp ../src/ColumnCodec.cpp
+// ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/FileIo.cpp ../src/ChunkIoService.cpp ../src/ChunkLoader.cpp
+//
+// Usage: ChunkLoaderBench [directory] defaults to /dev/shm/minicraft-loader
+
+#include "ChunkLoader.h"
+#include "RegionStorage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t SEED = 1337;
+constexpr int TEMPLATE_SIDE = 8;
+constexpr int SECTIONS_PER_COLUMN = 6;
+// Saved columns from 0 to WORLD_SIDE - 1 on both axes, everything else is generated
+constexpr int WORLD_SIDE = 64;
+constexpr int VIEW_RADIUS = 8;
+constexpr int SPAWN_RADIUS = 4;
+constexpr auto TICK_LENGTH = std::chrono::milliseconds(2);
+
+// Copies of a small generated world, saved and synced
+bool BuildWorld(const std::string& directory) {
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    World source;
+    std::vector<ColumnPosition> template_positions;
+    for (int z = 0; z < TEMPLATE_SIDE; z++) {
+        for (int x = 0; x < TEMPLATE_SIDE; x++) {
+            template_positions.push_back({x, z});
+        }
+    }
+    pipeline.Generate(source, template_positions);
+    
+    RegionStorage storage(directory);
+    if (!storage.Create()) {
+        return false;
+    }
+    
+    bool saved = true;
+    for (int z = 0; z < WORLD_SIDE; z++) {
+        for (int x = 0; x < WORLD_SIDE; x++) {
+            const Column* original = source.GetColumn(template_positions[(x + z * 3) % template_positions.size()]);
+            Column column({x, z});
+            for (int i = 0; i < SECTIONS_PER_COLUMN; i++) {
+                const Section* section = original->GetSection(i);
+                column.SetSection(i, section ? std::make_unique<Section>(*section) : std::make_unique<Section>());
+            }
+            saved &= storage.SaveColumn(column);
+        }
+    }
+    return saved && storage.Flush();
+}
+
+// Runs a tick of the loader, returns its duration in microseconds
+double Tick(ChunkLoader& loader) {
+    auto start = Clock::now();
+    loader.Update();
+    double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    std::this_thread::sleep_for(TICK_LENGTH);
+    return elapsed;
+}
+
+void Settle(ChunkLoader& loader) {
+    do {
+        Tick(loader);
+    } while (loader.GetCounts().Pending > 0 || loader.GetCounts().Evicting > 0);
+}
+
+void PrintCounts(const char* label, const ChunkLoader& loader) {
+    const ChunkLoader::Counts& counts = loader.GetCounts();
+    const ChunkLoader::Totals& totals = loader.GetTotals();
+    std::cout << "    " << label << ": " << counts.Loaded << " loaded, " << counts.Pending << " pending, " << counts.Evicting
+        << " evicting, " << counts.MemoryBytes / (1024 * 1024) << " MiB; " << totals.Loads << " loads, " << totals.Generated
+        << " generated, " << totals.Unloads << " unloads, " << totals.FailedSaves << " failed saves\n";
+}
+
+// Two players walk east from the middle of the saved world, past its edge, while spawn stays loaded
+void Walk(const std::string& directory, size_t memory_cap) {
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    World world;
+    ChunkIoService io(directory);
+    ChunkLoaderSettings settings;
+    settings.MemoryCap = memory_cap;
+    ChunkLoader loader(world, io, &pipeline, settings);
+    
+    std::cout << "  walk, memory cap " << memory_cap / (1024 * 1024) << " MiB\n";
+    loader.AddTicket(TicketType::Spawn, {0, 0}, SPAWN_RADIUS);
+    ChunkLoader::TicketId first = loader.AddTicket(TicketType::Player, {WORLD_SIDE / 2, WORLD_SIDE / 4}, VIEW_RADIUS);
+    ChunkLoader::TicketId second = loader.AddTicket(TicketType::Player, {WORLD_SIDE / 2, WORLD_SIDE * 3 / 4}, VIEW_RADIUS);
+    
+    auto start = Clock::now();
+    Settle(loader);
+    std::cout << std::fixed << std::setprecision(0) << "    joined in "
+        << std::chrono::duration<double, std::milli>(Clock::now() - start).count() << " ms\n" << std::defaultfloat;
+    PrintCounts("joined", loader);
+    
+    // A column every 4 ticks, about running speed
+    std::vector<double> ticks;
+    size_t most_memory = 0;
+    size_t most_pending = 0;
+    for (int step = 1; step <= WORLD_SIDE; step++) {
+        loader.MoveTicket(first, {WORLD_SIDE / 2 + step, WORLD_SIDE / 4});
+        loader.MoveTicket(second, {WORLD_SIDE / 2 + step, WORLD_SIDE * 3 / 4});
+        for (int i = 0; i < 4; i++) {
+            ticks.push_back(Tick(loader));
+            most_memory = std::max(most_memory, loader.GetCounts().MemoryBytes);
+            most_pending = std::max(most_pending, loader.GetCounts().Pending);
+        }
+        if (step == WORLD_SIDE / 2) {
+            PrintCounts("at the edge of the saved world", loader);
+        }
+    }
+    PrintCounts("walked", loader);
+    Settle(loader);
+    PrintCounts("settled", loader);
+    
+    std::sort(ticks.begin(), ticks.end());
+    std::cout << std::fixed << std::setprecision(0) << "    update p50 " << ticks[ticks.size() / 2] << " us, p99 "
+        << ticks[ticks.size() * 99 / 100] << " us, max " << ticks.back() << " us; most " << most_memory / (1024 * 1024)
+        << " MiB loaded, " << most_pending << " pending\n" << std::defaultfloat;
+}
+
+// A player steps back and forth over a column border every few ticks
+void Pace(const std::string& directory, uint64_t grace_ticks) {
+    World world;
+    ChunkIoService io(directory);
+    ChunkLoaderSettings settings;
+    settings.GraceTicks = grace_ticks;
+    ChunkLoader loader(world, io, nullptr, settings);
+    
+    ColumnPosition centre{WORLD_SIDE / 2, WORLD_SIDE / 2};
+    ChunkLoader::TicketId player = loader.AddTicket(TicketType::Player, centre, VIEW_RADIUS);
+    Settle(loader);
+    uint64_t loads = loader.GetTotals().Loads;
+    
+    for (int i = 0; i < 100; i++) {
+        loader.MoveTicket(player, {centre.X + i % 2, centre.Z});
+        for (int j = 0; j < 5; j++) {
+            Tick(loader);
+        }
+    }
+    
+    std::cout << "  pacing, grace " << grace_ticks << " ticks: " << loader.GetTotals().Loads - loads << " loads, "
+        << loader.GetTotals().Unloads << " unloads over 100 crossings\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "/dev/shm/minicraft-loader";
+    std::cout << WORLD_SIDE * WORLD_SIDE << " saved columns of " << SECTIONS_PER_COLUMN << " sections, view radius "
+        << VIEW_RADIUS << "\n";
+    
+    // Two views and spawn ask for about 38 MiB. Walks save what they generate, so each starts over.
+    for (size_t cap : {size_t(1) << 30, size_t(24) << 20}) {
+        std::filesystem::remove_all(directory);
+        if (!BuildWorld(directory)) {
+            std::cerr << "Failed to build the world\n";
+            return 1;
+        }
+        Walk(directory, cap);
+    }
+    for (uint64_t grace : {uint64_t(0), uint64_t(100)}) {
+        Pace(directory, grace);
+    }
+    
+    std::filesystem::remove_all(directory);
+    return 0;
+}
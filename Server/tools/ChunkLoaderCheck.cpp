@@ -0,0 +1,131 @@
+// Checks the chunk loader against a saved world with one damaged column. Saved columns have to load
+// as they were saved, missing ones have to be generated, and the damaged one has to stay out of the
+// world and be left untouched on disk after the loader saved and unloaded everything.
+// Built from the server sources: ChunkLoaderCheck.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Noise.cpp
+// ../src/TerrainGenerator.cpp ../src/GenerationPipeline.cpp ../src/Lz4.cpp ../src/ColumnCodec.cpp
+// ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/FileIo.cpp ../src/ChunkIoService.cpp ../src/ChunkLoader.cpp
+//
+// Usage: ChunkLoaderCheck [directory] defaults to /dev/shm/minicraft-loader-check
+
+#include "ChunkLoader.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t SEED = 1337;
+// Saved columns from 0 to SAVED_SIDE - 1 on both axes, the ticket reaches past them
+constexpr int SAVED_SIDE = 4;
+constexpr int RADIUS = 3;
+constexpr ColumnPosition CENTRE{SAVED_SIDE / 2, SAVED_SIDE / 2};
+constexpr ColumnPosition DAMAGED{1, 1};
+
+// A stone marker at a height only saved columns have
+bool HasMarker(const Column& column) {
+    return column.GetBlock(3, COLUMN_HEIGHT - 1, 5) == Block::Stone;
+}
+
+bool BuildWorld(const std::string& directory) {
+    RegionStorage storage(directory);
+    if (!storage.Create()) {
+        return false;
+    }
+    
+    for (int z = 0; z < SAVED_SIDE; z++) {
+        for (int x = 0; x < SAVED_SIDE; x++) {
+            Column column({x, z});
+            column.SetBlock(3, COLUMN_HEIGHT - 1, 5, Block::Stone);
+            if (!storage.SaveColumn(column)) {
+                return false;
+            }
+        }
+    }
+    if (!storage.Flush()) {
+        return false;
+    }
+    
+    // Garbage over the header of one blob
+    RegionFile* region = nullptr;
+    storage.FindColumn(DAMAGED, region);
+    uint64_t offset = region->GetEntry(RegionFile::ColumnIndex(DAMAGED)).Sector * RegionFile::SECTOR_SIZE;
+    std::fstream file(RegionStorage::RegionPath(directory, DAMAGED), std::ios::in | std::ios::out | std::ios::binary);
+    std::vector<char> garbage(16, '\xff');
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+    return static_cast<bool>(file);
+}
+
+void Settle(ChunkLoader& loader) {
+    do {
+        loader.Update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } while (loader.GetCounts().Pending > 0 || loader.GetCounts().Evicting > 0);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "/dev/shm/minicraft-loader-check";
+    std::filesystem::remove_all(directory);
+    if (!BuildWorld(directory)) {
+        std::cerr << "Failed: could not build the world\n";
+        return 1;
+    }
+    
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    World world;
+    {
+        ChunkIoService io(directory);
+        ChunkLoaderSettings settings;
+        settings.GraceTicks = 0;
+        ChunkLoader loader(world, io, &pipeline, settings);
+        
+        ChunkLoader::TicketId ticket = loader.AddTicket(TicketType::Player, CENTRE, RADIUS);
+        Settle(loader);
+        
+        int side = 2 * RADIUS + 1;
+        if (loader.GetTotals().Damaged != 1 || world.GetColumn(DAMAGED) || world.GetColumnCount() != static_cast<size_t>(side * side - 1)) {
+            std::cerr << "Failed: " << world.GetColumnCount() << " columns loaded, " << loader.GetTotals().Damaged
+                << " damaged, the damaged column " << (world.GetColumn(DAMAGED) ? "is" : "is not") << " in the world\n";
+            return 1;
+        }
+        
+        bool matches = true;
+        world.ForEachColumn([&](const Column& column) {
+            ColumnPosition position = column.GetPosition();
+            bool saved = position.X >= 0 && position.X < SAVED_SIDE && position.Z >= 0 && position.Z < SAVED_SIDE;
+            if (HasMarker(column) != saved || (!saved && column.GetDirtySections() == 0)) {
+                std::cerr << "Failed: column " << position.X << ", " << position.Z << (saved ? " did not load\n" : " was not generated\n");
+                matches = false;
+            }
+        });
+        if (!matches) {
+            return 1;
+        }
+        
+        // Generated columns are saved on their way out, the damaged one must not be
+        loader.RemoveTicket(ticket);
+        Settle(loader);
+        if (world.GetColumnCount() != 0 || loader.GetTotals().FailedSaves != 0 || !io.Flush().get()) {
+            std::cerr << "Failed: " << world.GetColumnCount() << " columns left loaded, " << loader.GetTotals().FailedSaves
+                << " saves failed\n";
+            return 1;
+        }
+    }
+    
+    RegionStorage storage(directory);
+    Column column(DAMAGED);
+    Column generated({-RADIUS + CENTRE.X, CENTRE.Z});
+    if (storage.LoadColumn(DAMAGED, column) != LoadResult::Damaged || storage.LoadColumn(generated.GetPosition(), generated) != LoadResult::Loaded) {
+        std::cerr << "Failed: the damaged column was saved over or a generated one was not saved\n";
+        return 1;
+    }
+    
+    std::cout << "Saved columns loaded, missing ones generated and saved, the damaged one left alone\n";
+    std::filesystem::remove_all(directory);
+    return 0;
+}
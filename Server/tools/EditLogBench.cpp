@@ -0,0 +1,259 @@
+// Measures sustained block edits per second with the edit log synced every tick, then kills a
+// server that autosaves into its region files halfway through a commit and checks that replaying
+// the log brings back exactly the world before that commit.
+// Built from the server sources: EditLogBench.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Lz4.cpp
+// ../src/ColumnCodec.cpp ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/FileIo.cpp
+// ../src/ChunkIoService.cpp ../src/Autosave.cpp ../src/EditLog.cpp
+//
+// Usage: EditLogBench [directory] defaults to minicraft-editlog, keep it off tmpfs so syncs reach a disk
+
+#include "Autosave.h"
+#include "EditLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int WORLD_SIDE = 16;
+constexpr double RUN_SECONDS = 1.0;
+constexpr int RECOVERY_TICKS = 200;
+constexpr int RECOVERY_EDITS_PER_TICK = 1000;
+constexpr int AUTOSAVE_INTERVAL = 60;
+// Shorter than a real tick to keep the run short, still long enough for an autosave to finish
+constexpr auto RECOVERY_TICK_LENGTH = std::chrono::milliseconds(5);
+
+enum class Mode {
+    None,
+    GroupCommit,
+    // Waits for the sync at the end of every tick, the way a log without a thread of its own would
+    SyncEachTick
+};
+
+const char* MODE_NAMES[] = { "no log", "group commit", "sync each tick" };
+
+void LoadWorld(World& world) {
+    for (int x = 0; x < WORLD_SIDE; x++) {
+        for (int z = 0; z < WORLD_SIDE; z++) {
+            world.LoadColumn({x, z});
+        }
+    }
+}
+
+// Places or digs out blocks below y 64 all over the world, logging the ones that went through
+void EditBlocks(World& world, EditLog* log, std::mt19937& random, int count) {
+    std::uniform_int_distribution<int> horizontal(0, WORLD_SIDE * CHUNK_SIZE - 1);
+    std::uniform_int_distribution<int> vertical(0, 63);
+    for (int i = 0; i < count; i++) {
+        int x = horizontal(random);
+        int y = vertical(random);
+        int z = horizontal(random);
+        Block block = random() & 1 ? Block::Stone : Block::Air;
+        if (world.SetBlock(x, y, z, block) && log) {
+            log->Append(x, y, z, block);
+        }
+    }
+}
+
+double Percentile(std::vector<double>& values, double fraction) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(values.size() * fraction))];
+}
+
+void RunThroughput(const std::string& directory, Mode mode, int edits_per_tick) {
+    std::filesystem::remove_all(directory);
+    World world;
+    LoadWorld(world);
+    std::mt19937 random(7);
+    
+    EditLog log(directory);
+    if (mode != Mode::None && !log.Open()) {
+        return;
+    }
+    
+    // Commit time of every frame, to see how long it takes to become durable
+    std::vector<Clock::time_point> committed(1);
+    std::vector<double> lags;
+    uint64_t seen = 0;
+    auto collect = [&](uint64_t durable) {
+        for (; seen < durable; seen++) {
+            lags.push_back(std::chrono::duration<double, std::micro>(Clock::now() - committed[seen + 1]).count());
+        }
+    };
+    
+    auto start = Clock::now();
+    size_t ticks = 0;
+    while (std::chrono::duration<double>(Clock::now() - start).count() < RUN_SECONDS) {
+        EditBlocks(world, mode == Mode::None ? nullptr : &log, random, edits_per_tick);
+        if (mode != Mode::None) {
+            uint64_t sequence = log.Commit();
+            committed.push_back(Clock::now());
+            if (mode == Mode::SyncEachTick) {
+                log.WaitDurable(sequence);
+            }
+            collect(log.GetDurableSequence());
+        }
+        ticks++;
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    
+    if (mode != Mode::None) {
+        log.WaitDurable(committed.size() - 1);
+        collect(log.GetDurableSequence());
+    }
+    
+    std::cout << std::setw(14) << MODE_NAMES[static_cast<int>(mode)] << " " << std::setw(6) << edits_per_tick << " edits/tick: "
+        << std::setw(10) << static_cast<uint64_t>(ticks * edits_per_tick / elapsed) << " edits/s, " << std::setw(8)
+        << elapsed * 1e6 / ticks << " us/tick";
+    if (mode != Mode::None) {
+        std::cout << ", durable after p50 " << Percentile(lags, 0.5) << " us, p99 " << Percentile(lags, 0.99) << " us";
+    }
+    std::cout << "\n";
+}
+
+bool SameBlocks(const Column& a, const Column& b) {
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        const Section* first = a.GetSection(i);
+        const Section* second = b.GetSection(i);
+        for (int block = 0; block < CHUNK_VOLUME; block++) {
+            Block left = first ? first->Blocks[block] : Block::Air;
+            Block right = second ? second->Blocks[block] : Block::Air;
+            if (left != right) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The server side of the recovery run, in a child process that dies without running any
+// destructor: pending saves are never flushed and the log is never closed
+[[noreturn]] void RunServer(const std::string& directory, const std::string& log_directory) {
+    World world;
+    LoadWorld(world);
+    std::mt19937 random(11);
+    
+    auto* io = new ChunkIoService(directory);
+    auto* log = new EditLog(log_directory);
+    if (!io->Create() || !log->Open()) {
+        _exit(1);
+    }
+    
+    Autosave autosave(world, *io, log);
+    for (int tick = 1; tick <= RECOVERY_TICKS; tick++) {
+        EditBlocks(world, log, random, RECOVERY_EDITS_PER_TICK);
+        log->Commit();
+        if (tick % AUTOSAVE_INTERVAL == 0) {
+            autosave.Start();
+        }
+        autosave.Poll();
+        std::this_thread::sleep_for(RECOVERY_TICK_LENGTH);
+    }
+    
+    // A commit that only makes it halfway to the disk when the server dies
+    EditBlocks(world, log, random, RECOVERY_EDITS_PER_TICK);
+    log->WaitDurable(log->Commit());
+    _exit(0);
+}
+
+bool RunRecovery(const std::string& directory) {
+    std::filesystem::remove_all(directory);
+    std::string log_directory = directory + "/log";
+    
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        RunServer(directory, log_directory);
+    }
+    int status = 0;
+    if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Failed: the server did not run\n";
+        return false;
+    }
+    
+    // The same edits again: the world as it was before the torn commit and as it was when the
+    // server died
+    World expected;
+    World crashed;
+    LoadWorld(expected);
+    LoadWorld(crashed);
+    std::mt19937 expected_random(11);
+    std::mt19937 crashed_random(11);
+    for (int tick = 0; tick <= RECOVERY_TICKS; tick++) {
+        if (tick < RECOVERY_TICKS) {
+            EditBlocks(expected, nullptr, expected_random, RECOVERY_EDITS_PER_TICK);
+        }
+        EditBlocks(crashed, nullptr, crashed_random, RECOVERY_EDITS_PER_TICK);
+    }
+    
+    size_t segments = 0;
+    std::filesystem::path last;
+    uint64_t last_number = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(log_directory)) {
+        // edits.<n>.log
+        uint64_t number = std::stoull(entry.path().stem().extension().string().substr(1));
+        if (segments++ == 0 || number > last_number) {
+            last = entry.path();
+            last_number = number;
+        }
+    }
+    std::filesystem::resize_file(last, std::filesystem::file_size(last) - RECOVERY_EDITS_PER_TICK * 5);
+    
+    std::vector<EditLog::BlockEdit> edits;
+    EditLog::Read(log_directory, edits);
+    
+    auto start = Clock::now();
+    RegionStorage storage(directory);
+    if (!EditLog::Replay(log_directory, storage)) {
+        return false;
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    
+    // Exactly the world before the torn commit is back, columns that were never saved read as air
+    size_t mismatches = 0;
+    size_t torn = 0;
+    expected.ForEachColumn([&](const Column& column) {
+        Column loaded(column.GetPosition());
+        mismatches += storage.LoadColumn(column.GetPosition(), loaded) == LoadResult::Damaged || !SameBlocks(column, loaded);
+        torn += !SameBlocks(column, *crashed.GetColumn(column.GetPosition()));
+    });
+    
+    std::cout << "Recovery: " << segments << " log segments left after the last checkpoint, " << edits.size()
+        << " edits replayed in " << elapsed << " ms, " << mismatches << " columns differ from the world before the torn commit, "
+        << "which changed " << torn << ", log " << (std::filesystem::is_empty(log_directory) ? "truncated" : "left behind") << "\n";
+    if (mismatches != 0 || torn == 0 || !std::filesystem::is_empty(log_directory)) {
+        std::cerr << "Failed: the recovered world is not the world before the torn commit\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "minicraft-editlog";
+    
+    std::cout << std::fixed << std::setprecision(1);
+    for (int edits_per_tick : {10, 100, 1000, 10000, 100000}) {
+        for (Mode mode : {Mode::None, Mode::GroupCommit, Mode::SyncEachTick}) {
+            RunThroughput(directory, mode, edits_per_tick);
+        }
+    }
+    
+    bool recovered = RunRecovery(directory);
+    std::filesystem::remove_all(directory);
+    return recovered ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+// Measures surface height queries from the column heightmaps against scanning the column down
+// from the top, and what keeping the heightmaps up to date adds to block writes.
+// Built from the server sources: HeightmapBench.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Noise.cpp
+// ../src/TerrainGenerator.cpp ../src/GenerationPipeline.cpp
+//
+// Usage: HeightmapBench [columns per side] defaults to 16
+
+#include "GenerationPipeline.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t SEED = 1337;
+constexpr int QUERY_COUNT = 1 << 22;
+constexpr int EDIT_COUNT = 1 << 20;
+
+constexpr Heightmap HEIGHTMAPS[HEIGHTMAP_COUNT] = {Heightmap::MotionBlocking, Heightmap::Opaque, Heightmap::Solid};
+
+struct Edit {
+    int X;
+    int Y;
+    int Z;
+    Block Value;
+};
+
+// What every caller did before the heightmaps
+int ScanHeight(const World& world, Heightmap heightmap, int x, int z) {
+    for (int y = COLUMN_HEIGHT - 1; y >= 0; y--) {
+        if (MatchesHeightmap(heightmap, world.GetBlock(x, y, z))) {
+            return y + 1;
+        }
+    }
+    return 0;
+}
+
+double Nanoseconds(Clock::time_point start, int count) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+}
+
+// Builders and miners at the surface, half of the edits remove the top block of their column
+std::vector<Edit> SurfaceEdits(World& world, int extent) {
+    static const Block placed[] = {Block::Stone, Block::Glass, Block::Torch, Block::Water, Block::Log};
+    std::mt19937 random(2);
+    std::vector<Edit> edits;
+    edits.reserve(EDIT_COUNT);
+    for (int i = 0; i < EDIT_COUNT; i++) {
+        int x = static_cast<int>(random() % extent);
+        int z = static_cast<int>(random() % extent);
+        int top = world.GetHeight(Heightmap::MotionBlocking, x, z);
+        if (random() % 2 == 0 && top > 1) {
+            edits.push_back({x, top - 1, z, Block::Air});
+            world.SetBlock(x, top - 1, z, Block::Air);
+        } else if (top < COLUMN_HEIGHT) {
+            Block block = placed[random() % 5];
+            edits.push_back({x, top, z, block});
+            world.SetBlock(x, top, z, block);
+        }
+    }
+    return edits;
+}
+
+void Generate(World& world, int side) {
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    std::vector<ColumnPosition> positions;
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            positions.push_back({x, z});
+        }
+    }
+    pipeline.Generate(world, positions);
+}
+
+// Heightmaps are rebuilt on the next query after this
+void Invalidate(World& world) {
+    world.ForEachColumn([](Column& column) {
+        column.EditSection(0);
+    });
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int side = argc > 1 ? std::atoi(argv[1]) : 16;
+    if (side <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [columns per side]\n";
+        return 1;
+    }
+    int extent = side * CHUNK_SIZE;
+    
+    World world;
+    Generate(world, side);
+    
+    auto start = Clock::now();
+    for (int z = 0; z < extent; z += CHUNK_SIZE) {
+        for (int x = 0; x < extent; x += CHUNK_SIZE) {
+            world.GetHeight(Heightmap::Opaque, x, z);
+        }
+    }
+    std::cout << side * side << " generated columns, rebuilding every heightmap: " << Nanoseconds(start, side * side) / 1e3
+        << " us per column\n";
+    
+    std::mt19937 random(1);
+    std::vector<std::pair<int, int>> queries(QUERY_COUNT);
+    for (auto& query : queries) {
+        query = {static_cast<int>(random() % extent), static_cast<int>(random() % extent)};
+    }
+    
+    unsigned checksum = 0;
+    start = Clock::now();
+    for (const auto& [x, z] : queries) {
+        checksum += static_cast<unsigned>(world.GetHeight(HEIGHTMAPS[x % HEIGHTMAP_COUNT], x, z));
+    }
+    double lookup = Nanoseconds(start, QUERY_COUNT);
+    
+    unsigned scan_checksum = 0;
+    start = Clock::now();
+    for (const auto& [x, z] : queries) {
+        scan_checksum += static_cast<unsigned>(ScanHeight(world, HEIGHTMAPS[x % HEIGHTMAP_COUNT], x, z));
+    }
+    double scan = Nanoseconds(start, QUERY_COUNT);
+    std::cout << "height queries: heightmap " << lookup << " ns, scanning the column " << scan << " ns ("
+        << (checksum == scan_checksum ? "same" : "DIFFERENT") << " results)\n";
+    
+    // The same edits with the heightmaps kept up to date and with them left stale
+    std::vector<Edit> edits = SurfaceEdits(world, extent);
+    for (bool maintained : {false, true}) {
+        if (!maintained) {
+            Invalidate(world);
+        } else {
+            world.ForEachColumn([](Column& column) {
+                column.GetHeight(Heightmap::Opaque, 0, 0);
+            });
+        }
+        
+        start = Clock::now();
+        for (const Edit& edit : edits) {
+            world.SetBlock(edit.X, edit.Y, edit.Z, edit.Value);
+        }
+        std::cout << "surface edits, " << (maintained ? "heightmaps maintained" : "no heightmaps") << ": "
+            << Nanoseconds(start, static_cast<int>(edits.size())) << " ns each\n";
+    }
+    
+    // Every edit followed by the query a mob spawner or rain would make at the same spot
+    start = Clock::now();
+    for (const Edit& edit : edits) {
+        world.SetBlock(edit.X, edit.Y, edit.Z, edit.Value);
+        checksum += static_cast<unsigned>(world.GetHeight(Heightmap::MotionBlocking, edit.X, edit.Z));
+    }
+    double edit_lookup = Nanoseconds(start, static_cast<int>(edits.size()));
+    start = Clock::now();
+    for (const Edit& edit : edits) {
+        world.SetBlock(edit.X, edit.Y, edit.Z, edit.Value);
+        checksum += static_cast<unsigned>(ScanHeight(world, Heightmap::MotionBlocking, edit.X, edit.Z));
+    }
+    double edit_scan = Nanoseconds(start, static_cast<int>(edits.size()));
+    std::cout << "edit then query: heightmap " << edit_lookup << " ns, scanning the column " << edit_scan << " ns\n";
+    
+    size_t mismatches = 0;
+    for (int z = 0; z < extent; z++) {
+        for (int x = 0; x < extent; x++) {
+            for (Heightmap heightmap : HEIGHTMAPS) {
+                mismatches += world.GetHeight(heightmap, x, z) != ScanHeight(world, heightmap, x, z);
+            }
+        }
+    }
+    std::cout << "heights that differ from a scan after every edit: " << mismatches << " (checksum " << checksum << ")\n";
+    return mismatches == 0 ? 0 : 1;
+}
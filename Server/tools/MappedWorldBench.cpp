@@ -0,0 +1,274 @@
+// Measures resident memory and first access latency of the read-only mapped world against loading
+// the whole world, with the region files out of and in the page cache. Every case runs in a process
+// of its own so their resident sets do not mix. Surface heights of the mapped columns have to match
+// a scan of their blocks, and a storage and a mapped world must not have the directory at once.
+// Built from the server sources: MappedWorldBench.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Noise.cpp
+// ../src/TerrainGenerator.cpp ../src/GenerationPipeline.cpp ../src/Lz4.cpp ../src/ColumnCodec.cpp
+// ../src/RegionFile.cpp ../src/RegionStorage.cpp ../src/MappedWorld.cpp
+//
+// Usage: MappedWorldBench [columns per side] [cached columns] [directory] defaults to 96, 1024 and
+// minicraft-mapped, keep the directory off tmpfs so the cold case reads from a disk
+
+#include "GenerationPipeline.h"
+#include "MappedWorld.h"
+#include "RegionStorage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t SEED = 1337;
+constexpr int TEMPLATE_SIDE = 8;
+constexpr int SECTIONS_PER_COLUMN = 6;
+// Around a spectator, revisited once everything was touched
+constexpr int VIEW_SIDE = 16;
+constexpr int VIEW_LOOKUPS = 100000;
+
+std::vector<ColumnPosition> Positions(int side) {
+    std::vector<ColumnPosition> positions;
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            positions.push_back({x, z});
+        }
+    }
+    return positions;
+}
+
+// Copies of a small generated world, saved and synced
+bool BuildWorld(const std::string& directory, int side) {
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    World source;
+    std::vector<ColumnPosition> template_positions = Positions(TEMPLATE_SIDE);
+    pipeline.Generate(source, template_positions);
+    
+    RegionStorage storage(directory);
+    if (!storage.Create()) {
+        return false;
+    }
+    
+    bool saved = true;
+    for (ColumnPosition position : Positions(side)) {
+        const Column* original = source.GetColumn(template_positions[(position.X + position.Z * 3) % template_positions.size()]);
+        Column column(position);
+        for (int i = 0; i < SECTIONS_PER_COLUMN; i++) {
+            const Section* section = original->GetSection(i);
+            column.SetSection(i, section ? std::make_unique<Section>(*section) : std::make_unique<Section>());
+        }
+        saved &= storage.SaveColumn(column);
+    }
+    return saved && storage.Flush();
+}
+
+// Pushes the region files out of the page cache, they are clean after the sync
+void EvictPageCache(const std::string& directory) {
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        int descriptor = open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor >= 0) {
+            posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+            close(descriptor);
+        }
+    }
+}
+
+// Resident, anonymous and file backed memory in MiB
+std::string Resident() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    std::string result;
+    while (std::getline(status, line)) {
+        for (const char* field : {"VmRSS:", "RssAnon:", "RssFile:"}) {
+            if (line.compare(0, std::strlen(field), field) == 0) {
+                double kilobytes = std::atof(line.c_str() + std::strlen(field));
+                std::ostringstream value;
+                value << std::fixed << std::setprecision(1) << kilobytes / 1024.0;
+                result += (result.empty() ? "" : ", ") + std::string(field, std::strlen(field) - 1) + " " + value.str() + " MiB";
+            }
+        }
+    }
+    return result;
+}
+
+std::string Latencies(std::vector<double>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "p50 " << latencies[latencies.size() / 2] << " us, p99 "
+        << latencies[latencies.size() * 99 / 100] << " us, max " << latencies.back() << " us";
+    return out.str();
+}
+
+double Microseconds(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// A spectator looking around a view that fits the cache, returns nanoseconds per block
+template<typename WorldType>
+double ViewLookups(WorldType& world) {
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> pick(0, VIEW_SIDE * CHUNK_SIZE - 1);
+    std::uniform_int_distribution<int> height(0, SECTIONS_PER_COLUMN * CHUNK_SIZE - 1);
+    size_t solid = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < VIEW_LOOKUPS; i++) {
+        solid += world.GetBlock(pick(random), height(random), pick(random)) != Block::Air;
+    }
+    double elapsed = Microseconds(start) * 1e3 / VIEW_LOOKUPS;
+    return solid > 0 ? elapsed : 0.0;
+}
+
+// Runs the case in a child process, returns whether it succeeded
+bool Isolated(const std::function<bool()>& run) {
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        bool succeeded = run();
+        std::cout.flush();
+        _exit(succeeded ? 0 : 1);
+    }
+    
+    int status = 0;
+    waitpid(child, &status, 0);
+    return child > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+bool LoadEverything(const std::string& directory, int side, bool cold) {
+    if (cold) {
+        EvictPageCache(directory);
+    }
+    
+    RegionStorage storage(directory);
+    World world;
+    std::vector<double> latencies;
+    for (ColumnPosition position : Positions(side)) {
+        auto start = Clock::now();
+        if (storage.LoadColumn(position, *world.LoadColumn(position)) != LoadResult::Loaded) {
+            return false;
+        }
+        latencies.push_back(Microseconds(start));
+    }
+    
+    std::cout << "  whole world, " << (cold ? "cold" : "warm") << ": " << Latencies(latencies) << "\n    " << Resident()
+        << "\n    block lookups in view: " << std::fixed << std::setprecision(0) << ViewLookups(world) << " ns each\n" << std::defaultfloat;
+    return true;
+}
+
+bool Mapped(const std::string& directory, int side, size_t cached, bool cold) {
+    if (cold) {
+        EvictPageCache(directory);
+    }
+    
+    MappedWorld world(directory, cached);
+    std::vector<double> latencies;
+    for (ColumnPosition position : Positions(side)) {
+        auto start = Clock::now();
+        if (!world.GetColumn(position)) {
+            return false;
+        }
+        latencies.push_back(Microseconds(start));
+    }
+    std::cout << "  mapped, " << cached << " cached, " << (cold ? "cold" : "warm") << ": first access " << Latencies(latencies)
+        << "\n    " << Resident() << "\n";
+    
+    // Brings the view back into the cache first, so the lookups only measure hits
+    for (ColumnPosition position : Positions(VIEW_SIDE)) {
+        world.GetColumn(position);
+    }
+    double lookup = ViewLookups(world);
+    const MappedWorld::Stats& stats = world.GetStats();
+    std::cout << "    block lookups in view: " << std::fixed << std::setprecision(0) << lookup << " ns each, "
+        << stats.Hits << " hits, " << stats.Misses << " misses, " << stats.Evictions << " evictions\n" << std::defaultfloat;
+    
+    // Surface heights of the decoded columns against scanning them down
+    for (int z = 0; z < VIEW_SIDE * CHUNK_SIZE; z++) {
+        for (int x = 0; x < VIEW_SIDE * CHUNK_SIZE; x++) {
+            int top = COLUMN_HEIGHT;
+            while (top > 0 && !IsOpaque(world.GetBlock(x, top - 1, z))) {
+                top--;
+            }
+            if (world.GetHeight(Heightmap::Opaque, x, z) != top) {
+                std::cerr << "Failed: surface height at " << x << ", " << z << " differs from a scan\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Whichever opens the directory first keeps the other out
+bool Exclusive(const std::string& directory) {
+    ColumnPosition position{0, 0};
+    {
+        RegionStorage storage(directory);
+        Column column(position);
+        storage.LoadColumn(position, column);
+        MappedWorld world(directory, 1);
+        if (world.IsOpen() || world.GetColumn(position)) {
+            std::cerr << "Failed: the directory was mapped while a storage had it open\n";
+            return false;
+        }
+    }
+    
+    MappedWorld world(directory, 1);
+    RegionStorage storage(directory);
+    Column column(position);
+    if (!world.GetColumn(position) || storage.LoadColumn(position, column) != LoadResult::Damaged) {
+        std::cerr << "Failed: a storage opened the directory while it was mapped\n";
+        return false;
+    }
+    std::cout << "  a storage and a mapped world keep each other out of the directory\n";
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int side = argc > 1 ? std::atoi(argv[1]) : 96;
+    int cached = argc > 2 ? std::atoi(argv[2]) : 1024;
+    std::string directory = argc > 3 ? argv[3] : "minicraft-mapped";
+    if (side < VIEW_SIDE || cached < VIEW_SIDE * VIEW_SIDE) {
+        std::cerr << "Usage: " << argv[0] << " [columns per side, at least " << VIEW_SIDE << "] [cached columns, at least "
+            << VIEW_SIDE * VIEW_SIDE << "] [directory]\n";
+        return 1;
+    }
+    
+    std::filesystem::remove_all(directory);
+    if (!Isolated([&]() { return BuildWorld(directory, side); })) {
+        std::cerr << "Failed to build the world\n";
+        return 1;
+    }
+    
+    uintmax_t bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        bytes += entry.file_size();
+    }
+    std::cout << side * side << " columns of " << SECTIONS_PER_COLUMN << " sections, " << bytes / (1024 * 1024)
+        << " MiB of region files\n";
+    
+    bool succeeded = true;
+    for (bool cold : {true, false}) {
+        succeeded &= Isolated([&]() { return LoadEverything(directory, side, cold); });
+        for (size_t capacity : {static_cast<size_t>(VIEW_SIDE * VIEW_SIDE), static_cast<size_t>(cached)}) {
+            succeeded &= Isolated([&]() { return Mapped(directory, side, capacity, cold); });
+        }
+    }
+    succeeded &= Isolated([&]() { return Exclusive(directory); });
+    
+    std::filesystem::remove_all(directory);
+    return succeeded ? 0 : 1;
+}
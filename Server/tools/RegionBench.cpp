@@ -0,0 +1,141 @@
+// Measures saving and loading generated columns through region files.
+// Built from the server sources: RegionBench.cpp ../src/World.cpp ../src/JobPool.cpp ../src/Noise.cpp
+// ../src/TerrainGenerator.cpp ../src/GenerationPipeline.cpp ../src/Lz4.cpp ../src/ColumnCodec.cpp
+// ../src/RegionFile.cpp ../src/RegionStorage.cpp
+//
+// Usage: RegionBench [columns per side] [directory] defaults to 64 and /dev/shm/minicraft-regions, keep
+// the directory on tmpfs to measure the format rather than the disk
+
+#include "GenerationPipeline.h"
+#include "RegionStorage.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+
+constexpr uint32_t SEED = 1337;
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t DirectorySize(const std::string& directory) {
+    uint64_t size = 0;
+    for (const auto& file : std::filesystem::directory_iterator(directory)) {
+        size += file.file_size();
+    }
+    return size;
+}
+
+bool SameColumn(const Column& a, const Column& b) {
+    for (int i = 0; i < COLUMN_SECTIONS; i++) {
+        const Section* left = a.GetSection(i);
+        const Section* right = b.GetSection(i);
+        if (!left || !right) {
+            if (left != right) {
+                return false;
+            }
+            continue;
+        }
+        
+        if (left->Blocks != right->Blocks || left->Light != right->Light) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Run(const World& world, const std::string& directory, Compression compression, size_t sections) {
+    std::filesystem::remove_all(directory);
+    const char* name = compression == Compression::Lz4 ? "lz4 " : "none";
+    size_t columns = world.GetColumnCount();
+    double save = 0.0;
+    double flush = 0.0;
+    double resave = 0.0;
+    uint64_t size = 0;
+    uint64_t compacted = 0;
+    {
+        RegionStorage storage(directory, compression);
+        if (!storage.Create()) {
+            return;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        world.ForEachColumn([&](const Column& column) {
+            storage.SaveColumn(column);
+        });
+        save = Seconds(start);
+        
+        start = std::chrono::steady_clock::now();
+        storage.Flush();
+        flush = Seconds(start);
+        size = DirectorySize(directory);
+        
+        // Saving everything again reallocates every blob into the holes the first copies leave behind
+        start = std::chrono::steady_clock::now();
+        world.ForEachColumn([&](const Column& column) {
+            storage.SaveColumn(column);
+        });
+        resave = Seconds(start);
+        storage.Compact();
+        compacted = DirectorySize(directory);
+    }
+    
+    // A fresh storage so loads open the files like a restarted server would
+    RegionStorage loader(directory, compression);
+    size_t mismatches = 0;
+    auto start = std::chrono::steady_clock::now();
+    world.ForEachColumn([&](const Column& column) {
+        Column loaded(column.GetPosition());
+        mismatches += loader.LoadColumn(column.GetPosition(), loaded) != LoadResult::Loaded || !SameColumn(column, loaded);
+    });
+    double load = Seconds(start);
+    
+    std::cout << name << ": save " << columns / save << " columns/s, " << sections / save << " chunks/s (flush "
+        << flush * 1e3 << " ms), resave " << sections / resave << " chunks/s, load " << columns / load << " columns/s, "
+        << sections / load << " chunks/s\n"
+        << "      " << size / 1024 << " KiB on disk, " << compacted / 1024 << " KiB after resave and compaction, "
+        << static_cast<double>(size) / columns / 1024 << " KiB per column, "
+        << (mismatches == 0 ? "every column loads back identical" : "columns differ after loading") << "\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int side = argc > 1 ? std::atoi(argv[1]) : 64;
+    std::string directory = argc > 2 ? argv[2] : "/dev/shm/minicraft-regions";
+    if (side <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [columns per side] [directory]\n";
+        return 1;
+    }
+    
+    std::vector<ColumnPosition> positions;
+    for (int x = -side / 2; x < side - side / 2; x++) {
+        for (int z = -side / 2; z < side - side / 2; z++) {
+            positions.push_back({x, z});
+        }
+    }
+    
+    JobPool jobs;
+    GenerationPipeline pipeline(SEED, jobs);
+    World world;
+    pipeline.Generate(world, positions);
+    
+    size_t sections = 0;
+    world.ForEachColumn([&](const Column& column) {
+        for (int i = 0; i < COLUMN_SECTIONS; i++) {
+            sections += column.GetSection(i) != nullptr;
+        }
+    });
+    std::cout << world.GetColumnCount() << " columns, " << sections << " chunks\n";
+    
+    for (Compression compression : {Compression::None, Compression::Lz4}) {
+        Run(world, directory, compression, sections);
+    }
+    std::filesystem::remove_all(directory);
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Checks a region file against a reference under random writes, erases, compactions and flushes.
+// Every column has to read back as last written, a copy of the file taken at any point has to hold
+// exactly what was there at the last flush, as after a crash, and the file reopened after closing
+// has to hold everything. Exits with 1 on the first difference.
+// Built from the server sources: RegionFileCheck.cpp ../src/Lz4.cpp ../src/RegionFile.cpp
+//
+// Usage: RegionFileCheck [operations] [directory] defaults to 100000 and /dev/shm/minicraft-region-check
+
+#include "RegionFile.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Reference = std::map<int, std::vector<uint8_t>>;
+
+constexpr int VERIFY_INTERVAL = 500;
+constexpr int CRASH_INTERVAL = 2000;
+
+// Runs of one byte compress, noise does not, so both blob paths and a range of sizes get used
+std::vector<uint8_t> RandomData(std::mt19937& random) {
+    std::vector<uint8_t> data(random() % 4000 + 1);
+    bool compressible = random() % 2 == 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(compressible ? i / 64 : random());
+    }
+    return data;
+}
+
+bool Verify(RegionFile& region, const Reference& reference, const char* label) {
+    std::vector<uint8_t> data;
+    for (int index = 0; index < REGION_COLUMNS; index++) {
+        auto found = reference.find(index);
+        bool expected = found != reference.end();
+        if (region.Contains(index) != expected) {
+            std::cerr << "Failed: " << label << ": column " << index << (expected ? " is missing\n" : " should be gone\n");
+            return false;
+        }
+        if (expected && (!region.Read(index, data) || data != found->second)) {
+            std::cerr << "Failed: " << label << ": column " << index << " reads back different\n";
+            return false;
+        }
+    }
+    
+    // Every sector past the header is either free or part of exactly one blob
+    uint32_t used = RegionFile::HEADER_SECTORS;
+    for (const RegionFile::Entry& entry : region.GetTable()) {
+        used += entry.Count;
+    }
+    if (used + region.GetFreeSectorCount() > region.GetSectorCount()) {
+        std::cerr << "Failed: " << label << ": " << used << " used and " << region.GetFreeSectorCount()
+            << " free sectors in a file of " << region.GetSectorCount() << "\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    long operations = argc > 1 ? std::atol(argv[1]) : 100000;
+    std::string directory = argc > 2 ? argv[2] : "/dev/shm/minicraft-region-check";
+    if (operations <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [operations] [directory]\n";
+        return 1;
+    }
+    
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::string path = directory + "/r.0.0.mcr";
+    std::string copy = directory + "/crash.mcr";
+    
+    RegionFile region;
+    if (!region.Open(path, true)) {
+        return 1;
+    }
+    
+    Reference reference;
+    Reference flushed;
+    std::mt19937 random(11);
+    // Few enough columns that most writes replace a blob
+    std::uniform_int_distribution<int> column(0, 63);
+    long compactions = 0;
+    for (long i = 0; i < operations; i++) {
+        int index = column(random);
+        switch (random() % 10) {
+            case 0:
+                if (!region.Erase(index)) {
+                    return 1;
+                }
+                reference.erase(index);
+                break;
+            case 1:
+                if (!region.Compact()) {
+                    return 1;
+                }
+                flushed = reference;
+                compactions++;
+                break;
+            case 2:
+                if (!region.Flush()) {
+                    return 1;
+                }
+                flushed = reference;
+                break;
+            default: {
+                std::vector<uint8_t> data = RandomData(random);
+                Compression compression = random() % 2 == 0 ? Compression::Lz4 : Compression::None;
+                if (!region.Write(index, data.data(), data.size(), compression)) {
+                    return 1;
+                }
+                reference[index] = std::move(data);
+                // Compactions started by the write flush as well
+                if (!region.HasPendingChanges()) {
+                    flushed = reference;
+                    compactions++;
+                }
+                break;
+            }
+        }
+        
+        if (i % VERIFY_INTERVAL == 0 && !Verify(region, reference, "live")) {
+            return 1;
+        }
+        
+        if (i % CRASH_INTERVAL == 0) {
+            std::filesystem::copy_file(path, copy, std::filesystem::copy_options::overwrite_existing);
+            RegionFile crashed;
+            if (!crashed.Open(copy, false) || !Verify(crashed, flushed, "after a crash")) {
+                return 1;
+            }
+        }
+    }
+    
+    region.Close();
+    if (!region.Open(path, false) || !Verify(region, reference, "reopened")) {
+        return 1;
+    }
+    
+    std::cout << operations << " operations match the reference, " << compactions << " compactions, "
+        << reference.size() << " columns in " << region.GetSectorCount() << " sectors\n";
+    region.Close();
+    std::filesystem::remove_all(directory);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Measures block access throughput over a world of loaded columns.
+// Built from the server sources: WorldBench.cpp ../src/World.cpp
+//
+// Usage: WorldBench [columns per side] defaults to 100, or 10k loaded columns
+
+#include "World.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr int ACCESS_COUNT = 1 << 24;
+constexpr int SURFACE_HEIGHT = 64;
+
+struct Position {
+    int X;
+    int Y;
+    int Z;
+};
+
+template<typename Function>
+void Measure(const char* name, const std::vector<Position>& positions, Function&& access) {
+    unsigned checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Position& position : positions) {
+        checksum += static_cast<unsigned>(access(position));
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    
+    std::cout << name << ": " << positions.size() / elapsed.count() / 1e6 << " M blocks/s (checksum " << checksum << ")\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int side = argc > 1 ? std::atoi(argv[1]) : 100;
+    if (side <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [columns per side]\n";
+        return 1;
+    }
+    
+    World world;
+    for (int x = -side / 2; x < side - side / 2; x++) {
+        for (int z = -side / 2; z < side - side / 2; z++) {
+            world.LoadColumn({x, z});
+        }
+    }
+    
+    int min = -side / 2 * CHUNK_SIZE;
+    int extent = side * CHUNK_SIZE;
+    
+    std::mt19937 random(1);
+    BlockCursor filler(world);
+    for (int x = min; x < min + extent; x++) {
+        for (int z = min; z < min + extent; z++) {
+            int height = SURFACE_HEIGHT - 8 + static_cast<int>(random() % 16);
+            for (int y = 0; y < height; y++) {
+                filler.SetBlock(x, y, z, y + 1 == height ? Block::Grass : Block::Stone);
+            }
+        }
+    }
+    std::cout << world.GetColumnCount() << " columns loaded\n";
+    
+    std::vector<Position> scattered(ACCESS_COUNT);
+    for (Position& position : scattered) {
+        position = {min + static_cast<int>(random() % extent), static_cast<int>(random() % COLUMN_HEIGHT), min + static_cast<int>(random() % extent)};
+    }
+    
+    // Random walk of unit steps, the access pattern of lighting, physics and pathing
+    std::vector<Position> coherent(ACCESS_COUNT);
+    Position walker{0, SURFACE_HEIGHT, 0};
+    for (Position& position : coherent) {
+        int step = random() % 6;
+        int delta = step % 2 == 0 ? 1 : -1;
+        int* axis = step < 2 ? &walker.X : step < 4 ? &walker.Y : &walker.Z;
+        *axis += delta;
+        if (walker.X < min || walker.X >= min + extent || walker.Z < min || walker.Z >= min + extent) {
+            *axis -= 2 * delta;
+        }
+        position = walker;
+    }
+    
+    Measure("random, world", scattered, [&](const Position& p) { return world.GetBlock(p.X, p.Y, p.Z); });
+    
+    BlockCursor random_cursor(world);
+    Measure("random, cursor", scattered, [&](const Position& p) { return random_cursor.GetBlock(p.X, p.Y, p.Z); });
+    
+    Measure("coherent, world", coherent, [&](const Position& p) { return world.GetBlock(p.X, p.Y, p.Z); });
+    
+    BlockCursor coherent_cursor(world);
+    Measure("coherent, cursor", coherent, [&](const Position& p) { return coherent_cursor.GetBlock(p.X, p.Y, p.Z); });
+    
+    return 0;
+}
@@ -0,0 +1,147 @@
+// Checks the world table against a std::map reference under random loads, unloads and block writes,
+// through World and BlockCursor, including neighbour links after every change. Exits with 1 on the
+// first difference. Meant to be built with -fsanitize=address,undefined as well.
+// Built from the server sources: WorldCheck.cpp ../src/World.cpp
+//
+// Usage: WorldCheck [operations] defaults to 1M
+
+#include "World.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <utility>
+
+namespace {
+
+// Small enough that probe sequences collide and unloads shift entries back
+constexpr int COLUMN_RANGE = 24;
+constexpr int VERIFY_INTERVAL = 1000;
+constexpr Side SIDES[4] = {Side::PositiveX, Side::NegativeX, Side::PositiveZ, Side::NegativeZ};
+constexpr int SIDE_OFFSETS[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+
+using Key = std::pair<int, int>;
+// Non-air blocks of every loaded column by local index
+using Reference = std::map<Key, std::map<int, Block>>;
+
+int LocalIndex(int x, int y, int z) {
+    return (x & (CHUNK_SIZE - 1)) + CHUNK_SIZE * ((z & (CHUNK_SIZE - 1)) + CHUNK_SIZE * y);
+}
+
+bool Verify(const World& world, const Reference& reference) {
+    if (world.GetColumnCount() != reference.size()) {
+        std::cerr << "Failed: " << world.GetColumnCount() << " columns loaded, expected " << reference.size() << "\n";
+        return false;
+    }
+    
+    size_t visited = 0;
+    bool matches = true;
+    world.ForEachColumn([&](const Column& column) {
+        visited++;
+        ColumnPosition position = column.GetPosition();
+        if (world.GetColumn(position) != &column || !reference.count({position.X, position.Z})) {
+            std::cerr << "Failed: column " << position.X << ", " << position.Z << " is not where it belongs\n";
+            matches = false;
+        }
+        
+        for (int side = 0; side < 4; side++) {
+            const Column* expected = world.GetColumn({position.X + SIDE_OFFSETS[side][0], position.Z + SIDE_OFFSETS[side][1]});
+            if (column.GetNeighbour(SIDES[side]) != expected) {
+                std::cerr << "Failed: neighbour " << side << " of column " << position.X << ", " << position.Z << "\n";
+                matches = false;
+            }
+        }
+    });
+    if (visited != reference.size()) {
+        std::cerr << "Failed: visited " << visited << " columns, expected " << reference.size() << "\n";
+        return false;
+    }
+    return matches;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    long operations = argc > 1 ? std::atol(argv[1]) : 1000000;
+    if (operations <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [operations]\n";
+        return 1;
+    }
+    
+    World world;
+    std::optional<BlockCursor> cursor(world);
+    Reference reference;
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> column(-COLUMN_RANGE / 2, COLUMN_RANGE / 2);
+    std::uniform_int_distribution<int> local(0, CHUNK_SIZE - 1);
+    std::uniform_int_distribution<int> height(-2, COLUMN_HEIGHT + 1);
+    std::uniform_int_distribution<int> block(0, static_cast<int>(Block::Leaves));
+    
+    for (long i = 0; i < operations; i++) {
+        int cx = column(random);
+        int cz = column(random);
+        int x = cx * CHUNK_SIZE + local(random);
+        int y = height(random);
+        int z = cz * CHUNK_SIZE + local(random);
+        bool loaded = reference.count({cx, cz}) != 0;
+        bool inside = y >= 0 && y < COLUMN_HEIGHT;
+        
+        switch (random() % 6) {
+            case 0:
+                world.LoadColumn({cx, cz});
+                reference[{cx, cz}];
+                break;
+            case 1:
+                if (world.UnloadColumn({cx, cz}) != loaded) {
+                    std::cerr << "Failed: unloading column " << cx << ", " << cz << " returned " << !loaded << "\n";
+                    return 1;
+                }
+                reference.erase({cx, cz});
+                // Unloading invalidates cursors
+                cursor.emplace(world);
+                break;
+            case 2:
+            case 3: {
+                Block value = static_cast<Block>(block(random));
+                bool written = i % 2 == 0 ? world.SetBlock(x, y, z, value) : cursor->SetBlock(x, y, z, value);
+                if (written != (loaded && inside)) {
+                    std::cerr << "Failed: write at " << x << ", " << y << ", " << z << " returned " << written << "\n";
+                    return 1;
+                }
+                if (written && value == Block::Air) {
+                    reference[{cx, cz}].erase(LocalIndex(x, y, z));
+                } else if (written) {
+                    reference[{cx, cz}][LocalIndex(x, y, z)] = value;
+                }
+                break;
+            }
+            default: {
+                Block expected = Block::Air;
+                if (loaded && inside) {
+                    const auto& blocks = reference[{cx, cz}];
+                    auto found = blocks.find(LocalIndex(x, y, z));
+                    expected = found != blocks.end() ? found->second : Block::Air;
+                }
+                Block actual = i % 2 == 0 ? world.GetBlock(x, y, z) : cursor->GetBlock(x, y, z);
+                if (actual != expected) {
+                    std::cerr << "Failed: block at " << x << ", " << y << ", " << z << " is " << static_cast<int>(actual)
+                        << ", expected " << static_cast<int>(expected) << "\n";
+                    return 1;
+                }
+                break;
+            }
+        }
+        
+        if (i % VERIFY_INTERVAL == 0 && !Verify(world, reference)) {
+            return 1;
+        }
+    }
+    
+    if (!Verify(world, reference)) {
+        return 1;
+    }
+    std::cout << operations << " operations match the reference, " << reference.size() << " columns loaded\n";
+    return 0;
+}